@@ -20,10 +20,8 @@ module AP_MODULE_DECLARE_DATA mapserver_module;
 
 typedef struct {
   apr_pool_t *config_pool;
-  apr_time_t mtime;
   char   *mapfile_name;
   char   *uri;
-  mapObj *map;
 } mapserver_dir_config;
 
 /* These are the IO redirection hooks. They are mostly copied over from
@@ -171,13 +169,13 @@ static mapObj*
 msModuleLoadMap(mapservObj *mapserv, mapserver_dir_config *conf)
 {
   int i;
-  /* OK, here's the magic: we take the mapObj from our stored config.
-   * We will use a copy of it created by msCopyMap since MapServer
-   * modifies the object at several places during request processing
+  /* OK, here's the magic: the mapfile is only parsed once per process
+   * (and again whenever it or one of its INCLUDEs changes), every request
+   * gets its own copy of it since MapServer modifies the object at several
+   * places during request processing
    */
-  mapObj *map = msNewMapObj ();
+  mapObj *map = msLoadMapFromCache (conf->mapfile_name, NULL);
   if(!map) return NULL;
-  msCopyMap (map, conf->map);
 
 
   /* check for any %variable% substitutions here, also do any map_ changes, we do this here so WMS/WFS  */
@@ -245,27 +243,9 @@ mapserver_handler (request_rec *r)
          &mapserver_module);
 
   /* decline the request if there's no map configured */
-  if (!conf || !conf->map)
+  if (!conf || !conf->mapfile_name)
     return DECLINED;
 
-  apr_finfo_t mapstat;
-  if (apr_stat (&mapstat, conf->mapfile_name, APR_FINFO_MTIME, r->pool) == APR_SUCCESS) {
-    if (apr_time_sec (mapstat.mtime) > apr_time_sec (conf->mtime)) {
-      mapObj *newmap = msLoadMap (conf->mapfile_name, NULL);
-      if (newmap) {
-        msFreeMap (conf->map);
-        conf->map   = newmap;
-        conf->mtime = mapstat.mtime;
-      } else {
-        ap_log_error (APLOG_MARK, APLOG_WARNING, 0, NULL,
-                      "unable to reload map file %s", conf->mapfile_name);
-      }
-    }
-  } else {
-    ap_log_error (APLOG_MARK, APLOG_WARNING, 0, NULL,
-                  "%s: unable to stat file %s", __func__, conf->mapfile_name);
-  }
-
   /* make a copy of the URI so we can modify it safely */
   char *uri          = apr_pstrdup (r->pool, r->uri);
   int   len          = strlen (uri);
@@ -318,8 +298,7 @@ mapserver_handler (request_rec *r)
   mapserv->request->postrequest = post_data;
   mapserv->request->contenttype = szContentType;
 
-  //mapserv->map = msModuleLoadMap(mapserv,conf);
-  mapserv->map = conf->map;
+  mapserv->map = msModuleLoadMap(mapserv,conf);
   if(!mapserv->map) {
     msCGIWriteError(mapserv);
     goto end_request;
@@ -338,7 +317,6 @@ end_request:
     mapserv->request->ParamValues = NULL;
     mapserv->request->postrequest = NULL;
     mapserv->request->contenttype = NULL;
-    mapserv->map = NULL;
     msFreeMapServObj(mapserv);
   }
   msResetErrorList();
@@ -373,36 +351,36 @@ static const char*
 mapserver_set_map (cmd_parms *cmd, void *config, const char *arg)
 {
   mapserver_dir_config *conf = (mapserver_dir_config*) config;
-  /* if the mapObj already exists the WMS_Map was given more than once -
+  mapObj *map;
+  /* if a map file is already set the WMS_Map was given more than once -
    * may be the user forgot to comment something out...
    */
-  if (conf->map) {
+  if (conf->mapfile_name) {
     msWriteError (stderr);
     return (char*) apr_psprintf (cmd->temp_pool,
                                  "An MAP-file has already been registered for "
                                  "this URI - not accepting '%s'.", arg );
   }
-  /* Simply try loading the argument as map file. */
-  conf->mapfile_name = apr_pstrdup(cmd->pool, arg);
-  conf->map = msLoadMap ((char*) arg, NULL);
+  /* Make room for this map file in the parsed map file cache and simply
+   * try loading the argument through it, which also leaves it parsed for
+   * the children to copy.
+   */
+  msMapFileCacheSetSize (msMapFileCacheGetSize () + 1);
+  map = msLoadMapFromCache ((char*) arg, NULL);
 
   /* Ooops - we failed. We report it and fail. So beware: Always do a
    * configcheck before really restarting your web server!
    */
 
-  if (!conf->map) {
+  if (!map) {
     msWriteError (stderr);
     return (char*) apr_psprintf (cmd->temp_pool,
                                  "The given MAP-file '%s' could not be loaded",
                                  arg);
   }
+  msFreeMap (map);
 
-  apr_finfo_t status;
-  if (apr_stat (&status, conf->mapfile_name, APR_FINFO_MTIME, cmd->pool) != APR_SUCCESS) {
-    ap_log_error (APLOG_MARK, APLOG_WARNING, 0, NULL,
-                  "%s: unable to stat file %s", __func__, conf->mapfile_name);
-  }
-  conf->mtime = status.mtime;
+  conf->mapfile_name = apr_pstrdup(cmd->pool, arg);
   return NULL;
 }
 
@@ -416,9 +394,7 @@ mapserver_create_dir_config (apr_pool_t *p, char *dir)
   newconf = (mapserver_dir_config*) apr_pcalloc (p, sizeof (mapserver_dir_config));
   newconf->config_pool = p;
   newconf->uri = apr_pstrdup (p, dir);
-  newconf->map = NULL;
   newconf->mapfile_name = NULL;
-  newconf->mtime = apr_time_from_sec (0);
 
   if (dir) {
     int len = strlen (dir);
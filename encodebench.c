@@ -0,0 +1,148 @@
+/******************************************************************************
+ * $Id$
+ *
+ * Project:  MapServer
+ * Purpose:  Utility program to benchmark image encoding
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2016 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+
+#include "mapserver.h"
+#include "maptime.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+** Draws a mapfile once and encodes the resulting image repeatedly with the
+** default encoder of its output format and with the banded one selected by
+** FORMATOPTION "ENCODE_THREADS=n", reporting the size of the encoded image
+** and the time spent per image for both.
+*/
+
+static double elapsed(struct mstimeval *start)
+{
+  struct mstimeval now;
+  msGettimeofday(&now, NULL);
+  return (now.tv_sec + now.tv_usec/1.0e6) - (start->tv_sec + start->tv_usec/1.0e6);
+}
+
+static void usage(void)
+{
+  fprintf(stdout,"Usage: encodebench [-t threads] [-i iterations] [-s width height] [-f format] mapfile\n");
+  fprintf(stdout,"Defaults: -t 4 -i 10, size and format of the mapfile\n");
+}
+
+static int bench(mapObj *map, imageObj *img, const char *threads, int iterations, int *size, double *ms)
+{
+  struct mstimeval start;
+  int k;
+
+  msSetOutputFormatOption(map->outputformat, "ENCODE_THREADS", threads);
+  msGettimeofday(&start, NULL);
+  for(k=0; k<iterations; k++) {
+    unsigned char *buffer = msSaveImageBuffer(img, size, map->outputformat);
+    if(!buffer)
+      return MS_FAILURE;
+    free(buffer);
+  }
+  *ms = elapsed(&start) * 1000.0 / iterations;
+  return MS_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+  const char *mapfile = NULL, *format = NULL;
+  char threads[32];
+  int numthreads = 4, iterations = 10, width = 0, height = 0;
+  int i, size_default, size_banded;
+  double ms_default, ms_banded;
+  mapObj *map;
+  imageObj *img;
+
+  for(i=1; i<argc; i++) {
+    if(i < argc-1 && strcmp(argv[i],"-t") == 0) numthreads = atoi(argv[++i]);
+    else if(i < argc-1 && strcmp(argv[i],"-i") == 0) iterations = atoi(argv[++i]);
+    else if(i < argc-1 && strcmp(argv[i],"-f") == 0) format = argv[++i];
+    else if(i < argc-2 && strcmp(argv[i],"-s") == 0) {
+      width = atoi(argv[++i]);
+      height = atoi(argv[++i]);
+    } else if(argv[i][0] != '-' && !mapfile) mapfile = argv[i];
+    else {
+      usage();
+      exit(1);
+    }
+  }
+  if(!mapfile || numthreads < 1 || iterations < 1) {
+    usage();
+    exit(1);
+  }
+
+  if(msSetup() != MS_SUCCESS) {
+    msWriteError(stderr);
+    exit(1);
+  }
+
+  map = msLoadMap((char*)mapfile, NULL);
+  if(!map) {
+    msWriteError(stderr);
+    exit(1);
+  }
+  if(format) {
+    outputFormatObj *outputformat = msSelectOutputFormat(map, format);
+    if(outputformat == NULL) {
+      fprintf(stderr, "No such OUTPUTFORMAT as %s.\n", format);
+      exit(1);
+    }
+    msFree(map->imagetype);
+    map->imagetype = msStrdup(format);
+    msApplyOutputFormat(&(map->outputformat), outputformat,
+                        map->transparent, map->interlace, map->imagequality);
+  }
+  if(width > 0 && height > 0) {
+    map->width = width;
+    map->height = height;
+  }
+
+  img = msDrawMap(map, MS_FALSE);
+  if(!img) {
+    msWriteError(stderr);
+    exit(1);
+  }
+
+  snprintf(threads, sizeof(threads), "%d", numthreads);
+  if(bench(map, img, "", iterations, &size_default, &ms_default) != MS_SUCCESS ||
+      bench(map, img, threads, iterations, &size_banded, &ms_banded) != MS_SUCCESS) {
+    msWriteError(stderr);
+    exit(1);
+  }
+
+  fprintf(stdout, "%s: %dx%d %s, %d iterations\n", mapfile, img->width, img->height,
+          map->outputformat->name, iterations);
+  fprintf(stdout, "default encoder:          %10d bytes %10.2f ms\n", size_default, ms_default);
+  fprintf(stdout, "ENCODE_THREADS=%-3d       %10d bytes %10.2f ms\n", numthreads, size_banded, ms_banded);
+
+  msFreeImage(img);
+  msFreeMap(map);
+  msCleanup();
+  return 0;
+}
@@ -36,12 +36,15 @@ typedef struct {
   FT_Library library;
   face_element *face_cache;
   glyph_element *bitmap_glyph_cache;
+  layout_element *layout_cache; /* in least recently used order */
+  size_t layout_cache_used;
 } ft_cache;
 
 #ifdef USE_THREAD
 typedef struct ft_thread_cache ft_thread_cache;
 struct ft_thread_cache{
-  void* thread_id;
+  void* thread_id; /* NULL while parked */
+  void* owner; /* thread that may reuse it once parked */
   ft_thread_cache *next;
   ft_cache cache;
 };
@@ -50,6 +53,260 @@ ft_thread_cache *ft_caches;
   ft_cache global_ft_cache;
 #endif
 
+#define MS_GLYPHCACHE_BUCKETS 4096
+
+/************************************************************************/
+/*                           glyphCacheObj                              */
+/*                                                                      */
+/*      Process-wide cache of glyph metrics and outlines, shared by     */
+/*      the per-thread caches above so that each thread does not have  */
+/*      to load and keep its own copy of every glyph. Entries are built */
+/*      outside of the lock and never modified once published: a glyph */
+/*      first cached with its metrics only is replaced by a new entry   */
+/*      when its outline is needed. Outlines handed out to threads are  */
+/*      refcounted, an evicted entry is freed by its last user.         */
+/************************************************************************/
+typedef struct glyphCacheObj {
+  char *fontfile;
+  unsigned int size;
+  unsigned int codepoint;
+  unsigned int hash;
+  glyph_metrics metrics;
+  int has_outline;
+  FT_Outline outline;
+  size_t memsize;
+  int refcount;
+  int evicted;
+  struct glyphCacheObj *hashnext;
+  struct glyphCacheObj *prev, *next;
+} glyphCacheObj;
+
+static glyphCacheObj *glyphCacheBuckets[MS_GLYPHCACHE_BUCKETS];
+static glyphCacheObj *glyphCacheHead = NULL, *glyphCacheTail = NULL;
+static size_t glyphCacheMaxSize = 0;
+static size_t layoutCacheMaxSize = 0;
+static size_t glyphCacheUsed = 0;
+static long glyphCacheHits = 0, glyphCacheMisses = 0;
+
+static unsigned int glyphCacheHash(const char *fontfile, unsigned int size, unsigned int codepoint)
+{
+  unsigned int hash = 2166136261U;
+  while(*fontfile) {
+    hash ^= (unsigned char) *fontfile++;
+    hash *= 16777619U;
+  }
+  hash ^= size;
+  hash *= 16777619U;
+  hash ^= codepoint;
+  hash *= 16777619U;
+  return hash;
+}
+
+static void freeGlyphCacheObj(glyphCacheObj *entry)
+{
+  msFree(entry->fontfile);
+  if(entry->has_outline) {
+    free(entry->outline.points);
+    free(entry->outline.tags);
+    free(entry->outline.contours);
+  }
+  free(entry);
+}
+
+static void glyphCacheUnlinkLRU(glyphCacheObj *entry)
+{
+  if(entry->prev) entry->prev->next = entry->next;
+  else glyphCacheHead = entry->next;
+  if(entry->next) entry->next->prev = entry->prev;
+  else glyphCacheTail = entry->prev;
+  entry->prev = entry->next = NULL;
+}
+
+static void glyphCachePushLRU(glyphCacheObj *entry)
+{
+  entry->prev = NULL;
+  entry->next = glyphCacheHead;
+  if(glyphCacheHead) glyphCacheHead->prev = entry;
+  glyphCacheHead = entry;
+  if(!glyphCacheTail) glyphCacheTail = entry;
+}
+
+/* Removes an entry from the cache, must be called with the lock held. */
+static void glyphCacheEvict(glyphCacheObj *entry)
+{
+  glyphCacheObj **ppsEntry = &glyphCacheBuckets[entry->hash % MS_GLYPHCACHE_BUCKETS];
+
+  while(*ppsEntry != entry)
+    ppsEntry = &((*ppsEntry)->hashnext);
+  *ppsEntry = entry->hashnext;
+  glyphCacheUnlinkLRU(entry);
+  glyphCacheUsed -= entry->memsize;
+
+  if(entry->refcount == 0)
+    freeGlyphCacheObj(entry);
+  else
+    entry->evicted = MS_TRUE;
+}
+
+static void trimGlyphCache(void)
+{
+  while(glyphCacheTail && glyphCacheUsed > glyphCacheMaxSize)
+    glyphCacheEvict(glyphCacheTail);
+}
+
+static glyphCacheObj *glyphCacheLookup(const char *fontfile, unsigned int size,
+                                       unsigned int codepoint, unsigned int hash)
+{
+  glyphCacheObj *entry = glyphCacheBuckets[hash % MS_GLYPHCACHE_BUCKETS];
+
+  while(entry) {
+    if(entry->hash == hash && entry->size == size && entry->codepoint == codepoint &&
+        strcmp(entry->fontfile, fontfile) == 0)
+      return entry;
+    entry = entry->hashnext;
+  }
+  return NULL;
+}
+
+/*
+** Finds a glyph in the shared cache. When metrics is given they are copied
+** out, otherwise only an entry carrying an outline is returned, with a
+** reference taken on it that must be dropped with glyphCacheRelease().
+*/
+static glyphCacheObj *glyphCacheAcquire(const char *fontfile, unsigned int size,
+                                        unsigned int codepoint, glyph_metrics *metrics)
+{
+  glyphCacheObj *entry;
+  unsigned int hash = glyphCacheHash(fontfile, size, codepoint);
+
+  msAcquireLock(TLOCK_GLYPHCACHE);
+  entry = glyphCacheLookup(fontfile, size, codepoint, hash);
+  if(entry && !metrics && !entry->has_outline)
+    entry = NULL;
+  if(entry) {
+    glyphCacheHits++;
+    if(metrics)
+      *metrics = entry->metrics;
+    else
+      entry->refcount++;
+    glyphCacheUnlinkLRU(entry);
+    glyphCachePushLRU(entry);
+  } else {
+    glyphCacheMisses++;
+  }
+  msReleaseLock(TLOCK_GLYPHCACHE);
+  return entry;
+}
+
+static void glyphCacheRelease(glyphCacheObj *entry)
+{
+  msAcquireLock(TLOCK_GLYPHCACHE);
+  entry->refcount--;
+  if(entry->evicted && entry->refcount == 0)
+    freeGlyphCacheObj(entry);
+  msReleaseLock(TLOCK_GLYPHCACHE);
+}
+
+/*
+** Publishes the glyph currently loaded in the given face. If another thread
+** published the same glyph meanwhile its entry is kept, unless it lacks the
+** outline we are bringing. Returns the entry now in the cache, with a
+** reference taken on it when with_outline is set, or NULL if the glyph does
+** not fit in the cache.
+*/
+static glyphCacheObj *glyphCachePublish(face_element *face, unsigned int size,
+                                        unsigned int codepoint, glyph_metrics *metrics,
+                                        int with_outline)
+{
+  glyphCacheObj *entry, *other;
+  FT_Outline *src = &face->face->glyph->outline;
+
+  entry = (glyphCacheObj *) msSmallCalloc(1, sizeof(glyphCacheObj));
+  entry->fontfile = msStrdup(face->fontfile);
+  entry->size = size;
+  entry->codepoint = codepoint;
+  entry->hash = glyphCacheHash(entry->fontfile, size, codepoint);
+  entry->metrics = *metrics;
+  entry->memsize = sizeof(glyphCacheObj) + strlen(entry->fontfile) + 1;
+  if(with_outline) {
+    entry->has_outline = MS_TRUE;
+    entry->outline.n_points = src->n_points;
+    entry->outline.n_contours = src->n_contours;
+    entry->outline.flags = src->flags & ~FT_OUTLINE_OWNER;
+    entry->outline.points = (FT_Vector *) msSmallMalloc(MS_MAX(src->n_points, 1) * sizeof(FT_Vector));
+    entry->outline.tags = (char *) msSmallMalloc(MS_MAX(src->n_points, 1));
+    entry->outline.contours = (short *) msSmallMalloc(MS_MAX(src->n_contours, 1) * sizeof(short));
+    memcpy(entry->outline.points, src->points, src->n_points * sizeof(FT_Vector));
+    memcpy(entry->outline.tags, src->tags, src->n_points);
+    memcpy(entry->outline.contours, src->contours, src->n_contours * sizeof(short));
+    entry->memsize += src->n_points * (sizeof(FT_Vector) + 1) + src->n_contours * sizeof(short);
+    entry->refcount = 1;
+  }
+
+  msAcquireLock(TLOCK_GLYPHCACHE);
+  if(entry->memsize > glyphCacheMaxSize) {
+    msReleaseLock(TLOCK_GLYPHCACHE);
+    freeGlyphCacheObj(entry);
+    return NULL;
+  }
+  other = glyphCacheLookup(entry->fontfile, size, codepoint, entry->hash);
+  if(other && (other->has_outline || !with_outline)) {
+    if(with_outline)
+      other->refcount++;
+    msReleaseLock(TLOCK_GLYPHCACHE);
+    freeGlyphCacheObj(entry);
+    return other;
+  }
+  if(other)
+    glyphCacheEvict(other);
+  entry->hashnext = glyphCacheBuckets[entry->hash % MS_GLYPHCACHE_BUCKETS];
+  glyphCacheBuckets[entry->hash % MS_GLYPHCACHE_BUCKETS] = entry;
+  glyphCachePushLRU(entry);
+  glyphCacheUsed += entry->memsize;
+  trimGlyphCache();
+  msReleaseLock(TLOCK_GLYPHCACHE);
+  return entry;
+}
+
+/*
+** Sets the memory budget of the shared glyph cache, in bytes. A size of 0
+** (the default) disables it, each thread then keeps its own glyphs only.
+*/
+void msGlyphCacheSetSize(size_t size)
+{
+  msAcquireLock(TLOCK_GLYPHCACHE);
+  glyphCacheMaxSize = size;
+  trimGlyphCache();
+  msReleaseLock(TLOCK_GLYPHCACHE);
+}
+
+size_t msGlyphCacheGetSize(void)
+{
+  return glyphCacheMaxSize;
+}
+
+void msGlyphCacheGetStats(long *hits, long *misses, size_t *used)
+{
+  msAcquireLock(TLOCK_GLYPHCACHE);
+  if(hits) *hits = glyphCacheHits;
+  if(misses) *misses = glyphCacheMisses;
+  if(used) *used = glyphCacheUsed;
+  msReleaseLock(TLOCK_GLYPHCACHE);
+}
+
+static void msGlyphCacheCleanup(void)
+{
+  msAcquireLock(TLOCK_GLYPHCACHE);
+  if(msGetGlobalDebugLevel() >= MS_DEBUGLEVEL_V && (glyphCacheHits || glyphCacheMisses))
+    msDebug("msGlyphCacheCleanup(): %ld hits, %ld misses, %ld bytes in use.\n",
+            glyphCacheHits, glyphCacheMisses, (long) glyphCacheUsed);
+  while(glyphCacheTail)
+    glyphCacheEvict(glyphCacheTail);
+  glyphCacheHits = glyphCacheMisses = 0;
+  msReleaseLock(TLOCK_GLYPHCACHE);
+}
+
+
 
 void msInitFontCache(ft_cache *c) {
   memset(c,0,sizeof(ft_cache));
@@ -60,6 +317,13 @@ void msFreeFontCache(ft_cache *c) {
   /* ... TODO ... */
   face_element *cur_face,*tmp_face;
   glyph_element *cur_bitmap, *tmp_bitmap;
+  layout_element *cur_layout, *tmp_layout;
+  UT_HASH_ITER(hh, c->layout_cache, cur_layout, tmp_layout) {
+    UT_HASH_DEL(c->layout_cache, cur_layout);
+    free(cur_layout->key);
+    free(cur_layout->glyphs);
+    free(cur_layout);
+  }
   UT_HASH_ITER(hh, c->face_cache, cur_face, tmp_face) {
       index_element *cur_index,*tmp_index;
       outline_element *cur_outline,*tmp_outline;
@@ -70,7 +334,10 @@ void msFreeFontCache(ft_cache *c) {
       }
       UT_HASH_ITER(hh, cur_face->outline_cache, cur_outline, tmp_outline) {
         UT_HASH_DEL(cur_face->outline_cache,cur_outline);
-        FT_Outline_Done(c->library,&cur_outline->outline);
+        if(cur_outline->shared)
+          glyphCacheRelease((glyphCacheObj *) cur_outline->shared);
+        else
+          FT_Outline_Done(c->library,&cur_outline->outline);
         free(cur_outline);
       }
       UT_HASH_ITER(hh, cur_face->glyph_cache, cur_glyph, tmp_glyph) {
@@ -87,6 +354,7 @@ void msFreeFontCache(ft_cache *c) {
 #endif
       FT_Done_Face(cur_face->face);
       free(cur_face->font);
+      free(cur_face->fontfile);
       UT_HASH_DEL(c->face_cache,cur_face);
       free(cur_face);
   }
@@ -140,6 +408,7 @@ ft_cache* msGetFontCache() {
   cur = msSmallMalloc(sizeof(ft_thread_cache));
   cur->next = NULL;
   cur->thread_id = nThreadId;
+  cur->owner = NULL;
   msInitFontCache(&cur->cache);
   cur->next = ft_caches;
   ft_caches = cur;
@@ -157,6 +426,12 @@ void msFontCacheSetup() {
 #else
   ft_caches = NULL;
 #endif
+  /* Share glyphs between the threads of the process (size in kilobytes) */
+  if(getenv("MS_GLYPH_CACHE_SIZE"))
+    msGlyphCacheSetSize((size_t) atoi(getenv("MS_GLYPH_CACHE_SIZE")) * 1024);
+  /* Reuse the layout of repeated label strings (size in kilobytes, per thread) */
+  if(getenv("MS_TEXT_LAYOUT_CACHE_SIZE"))
+    msTextLayoutCacheSetSize((size_t) atoi(getenv("MS_TEXT_LAYOUT_CACHE_SIZE")) * 1024);
 }
 
 void msFontCacheCleanup() {
@@ -175,6 +450,51 @@ void msFontCacheCleanup() {
   }
   ft_caches = NULL;
   msReleaseLock( TLOCK_TTF );
+#endif
+  msGlyphCacheCleanup();
+}
+
+/*
+** Job worker threads (see msThreadRunJobs()) come and go, and the labels
+** they lay out keep pointing to the faces of their cache, which are drawn
+** by the thread that started them once the jobs are done. So the cache of
+** an exiting worker is not freed but parked for the next worker started by
+** the same thread, which bounds the number of caches to the number of
+** threads running at once.
+*/
+void msFontCacheThreadStart(void *owner) {
+#ifdef USE_THREAD
+  void* nThreadId = msGetThreadId();
+  ft_thread_cache *cur;
+
+  msAcquireLock( TLOCK_TTF );
+  for( cur = ft_caches; cur != NULL; cur = cur->next ) {
+    if( cur->thread_id == nThreadId )
+      break; /* already has one */
+    if( cur->thread_id == NULL && cur->owner == owner ) {
+      cur->thread_id = nThreadId;
+      cur->owner = NULL;
+      break;
+    }
+  }
+  msReleaseLock( TLOCK_TTF );
+#endif
+}
+
+void msFontCacheThreadEnd(void *owner) {
+#ifdef USE_THREAD
+  void* nThreadId = msGetThreadId();
+  ft_thread_cache *cur;
+
+  msAcquireLock( TLOCK_TTF );
+  for( cur = ft_caches; cur != NULL; cur = cur->next ) {
+    if( cur->thread_id == nThreadId ) {
+      cur->thread_id = NULL;
+      cur->owner = owner;
+      break;
+    }
+  }
+  msReleaseLock( TLOCK_TTF );
 #endif
 }
 
@@ -229,6 +549,7 @@ face_element* msGetFontFace(char *key, fontSetObj *fontset) {
       /* the previous calls may have failed, we ignore as there's nothing much left to do */
     }
     fc->font = msStrdup(key);
+    fc->fontfile = msStrdup(fontfile ? fontfile : MS_DEFAULT_FONT_KEY);
     UT_HASH_ADD_KEYPTR(hh,cache->face_cache,fc->font, strlen(key), fc);
   }
 
@@ -245,6 +566,11 @@ glyph_element* msGetGlyphByIndex(face_element *face, unsigned int size, unsigned
   if(!gc) {
     FT_Error error;
     gc = msSmallMalloc(sizeof(glyph_element));
+    gc->key = key;
+    if(glyphCacheMaxSize > 0 && glyphCacheAcquire(face->fontfile, size, codepoint, &gc->metrics) != NULL) {
+      UT_HASH_ADD(hh,face->glyph_cache,key,sizeof(glyph_element_key), gc);
+      return gc;
+    }
     if(MS_NINT(size * 96.0/72.0) != face->face->size->metrics.x_ppem) {
       FT_Set_Pixel_Sizes(face->face,0,MS_NINT(size * 96/72.0));
     }
@@ -259,7 +585,8 @@ glyph_element* msGetGlyphByIndex(face_element *face, unsigned int size, unsigned
     gc->metrics.maxy = face->face->glyph->metrics.horiBearingY / 64.0;
     gc->metrics.miny = gc->metrics.maxy - face->face->glyph->metrics.height / 64.0;
     gc->metrics.advance = face->face->glyph->metrics.horiAdvance / 64.0;
-    gc->key = key;
+    if(glyphCacheMaxSize > 0)
+      glyphCachePublish(face, size, codepoint, &gc->metrics, MS_FALSE);
     UT_HASH_ADD(hh,face->glyph_cache,key,sizeof(glyph_element_key), gc);
   }
   return gc;
@@ -276,7 +603,16 @@ outline_element* msGetGlyphOutline(face_element *face, glyph_element *glyph) {
     FT_Matrix matrix;
     FT_Vector pen;
     FT_Error error;
+    glyphCacheObj *shared = NULL;
     oc = msSmallMalloc(sizeof(outline_element));
+    oc->key = key;
+    if(glyphCacheMaxSize > 0 && (shared = glyphCacheAcquire(face->fontfile, glyph->key.size, glyph->key.codepoint, NULL)) != NULL) {
+      /* borrow the shared outline, the reference is dropped in msFreeFontCache() */
+      oc->outline = shared->outline;
+      oc->shared = shared;
+      UT_HASH_ADD(hh,face->outline_cache,key,sizeof(outline_element_key), oc);
+      return oc;
+    }
     if(MS_NINT(glyph->key.size * 96.0/72.0) != face->face->size->metrics.x_ppem) {
       FT_Set_Pixel_Sizes(face->face,0,MS_NINT(glyph->key.size * 96/72.0));
     }
@@ -287,13 +623,92 @@ outline_element* msGetGlyphOutline(face_element *face, glyph_element *glyph) {
     error = FT_Load_Glyph(face->face,glyph->key.codepoint,FT_LOAD_DEFAULT/*|FT_LOAD_IGNORE_TRANSFORM*/|FT_LOAD_NO_HINTING|FT_LOAD_IGNORE_GLOBAL_ADVANCE_WIDTH);
     if(error) {
       msSetError(MS_MISCERR, "unable to load glyph %ud for font \"%s\"", "msGetGlyphByIndex()",glyph->key.codepoint, face->font);
+      free(oc);
       return NULL;
     }
-    error = FT_Outline_New(cache->library, face->face->glyph->outline.n_points,
-        face->face->glyph->outline.n_contours, &oc->outline);
-    FT_Outline_Copy(&face->face->glyph->outline, &oc->outline);
-    oc->key = key;
+    if(glyphCacheMaxSize > 0)
+      shared = glyphCachePublish(face, glyph->key.size, glyph->key.codepoint, &glyph->metrics, MS_TRUE);
+    if(shared) {
+      oc->outline = shared->outline;
+      oc->shared = shared;
+    } else {
+      error = FT_Outline_New(cache->library, face->face->glyph->outline.n_points,
+          face->face->glyph->outline.n_contours, &oc->outline);
+      FT_Outline_Copy(&face->face->glyph->outline, &oc->outline);
+      oc->shared = NULL;
+    }
     UT_HASH_ADD(hh,face->outline_cache,key,sizeof(outline_element_key), oc);
   }
   return oc;
 }
+
+/*
+** Sets the memory budget of each thread's cache of laid out label strings,
+** in bytes. A size of 0 (the default) disables it.
+*/
+void msTextLayoutCacheSetSize(size_t size)
+{
+  layoutCacheMaxSize = size;
+}
+
+size_t msTextLayoutCacheGetSize(void)
+{
+  return layoutCacheMaxSize;
+}
+
+/*
+** Fills tp with a copy of the glyphs, line count and bounds cached for key,
+** returns MS_TRUE on a hit. The glyph and face pointers refer to the calling
+** thread's caches, which live as long as the layouts themselves.
+*/
+int msGetCachedTextLayout(const char *key, textPathObj *tp) {
+  layout_element *lc;
+  ft_cache *cache;
+  if(layoutCacheMaxSize == 0)
+    return MS_FALSE;
+  cache = msGetFontCache();
+  UT_HASH_FIND_STR(cache->layout_cache,key,lc);
+  if(!lc)
+    return MS_FALSE;
+  /* move to the end of the table, which is kept in least recently used order */
+  UT_HASH_DEL(cache->layout_cache,lc);
+  UT_HASH_ADD_KEYPTR(hh,cache->layout_cache,lc->key,strlen(lc->key),lc);
+  tp->numglyphs = lc->numglyphs;
+  tp->numlines = lc->numlines;
+  tp->bounds.bbox = lc->bbox;
+  tp->glyphs = msSmallMalloc(MS_MAX(lc->numglyphs,1) * sizeof(glyphObj));
+  memcpy(tp->glyphs, lc->glyphs, lc->numglyphs * sizeof(glyphObj));
+  return MS_TRUE;
+}
+
+void msCacheTextLayout(const char *key, textPathObj *tp) {
+  layout_element *lc, *tmp;
+  ft_cache *cache;
+  size_t size = sizeof(layout_element) + strlen(key) + 1 + tp->numglyphs * sizeof(glyphObj);
+  if(size > layoutCacheMaxSize)
+    return;
+  cache = msGetFontCache();
+  UT_HASH_FIND_STR(cache->layout_cache,key,lc);
+  if(lc)
+    return;
+  lc = msSmallMalloc(sizeof(layout_element));
+  lc->key = msStrdup(key);
+  lc->numglyphs = tp->numglyphs;
+  lc->numlines = tp->numlines;
+  lc->bbox = tp->bounds.bbox;
+  lc->glyphs = msSmallMalloc(MS_MAX(tp->numglyphs,1) * sizeof(glyphObj));
+  memcpy(lc->glyphs, tp->glyphs, tp->numglyphs * sizeof(glyphObj));
+  lc->size = size;
+  UT_HASH_ADD_KEYPTR(hh,cache->layout_cache,lc->key,strlen(lc->key),lc);
+  cache->layout_cache_used += size;
+  /* drop the least recently used layouts beyond the budget */
+  UT_HASH_ITER(hh, cache->layout_cache, lc, tmp) {
+    if(cache->layout_cache_used <= layoutCacheMaxSize)
+      break;
+    UT_HASH_DEL(cache->layout_cache,lc);
+    cache->layout_cache_used -= lc->size;
+    free(lc->key);
+    free(lc->glyphs);
+    free(lc);
+  }
+}
@@ -51,6 +51,7 @@ typedef struct {
 typedef struct {
   outline_element_key key;
   FT_Outline outline;
+  void *shared; /* entry of the process-wide glyph cache owning the outline, if any */
   UT_hash_handle hh;
 } outline_element;
 
@@ -66,6 +67,7 @@ typedef struct {
 
 struct face_element{
   char *font;
+  char *fontfile; /* identifies the face across threads and fontsets */
   FT_Face face;
   index_element *index_cache;
   glyph_element *glyph_cache;
@@ -74,12 +76,24 @@ struct face_element{
   UT_hash_handle hh;
 };
 
+typedef struct {
+  char *key; /* text and layout settings, see msLayoutTextSymbol() */
+  int numglyphs;
+  int numlines;
+  glyphObj *glyphs;
+  rectObj bbox;
+  size_t size;
+  UT_hash_handle hh;
+} layout_element;
+
 
 face_element* msGetFontFace(char *key, fontSetObj *fontset);
 outline_element* msGetGlyphOutline(face_element *face, glyph_element *glyph);
 glyph_element* msGetBitmapGlyph(rendererVTableObj *renderer, unsigned int size, unsigned int unicode);
 unsigned int msGetGlyphIndex(face_element *face, unsigned int unicode);
 glyph_element* msGetGlyphByIndex(face_element *face, unsigned int size, unsigned int codepoint);
+int msGetCachedTextLayout(const char *key, textPathObj *tp);
+void msCacheTextLayout(const char *key, textPathObj *tp);
 
 #ifdef __cplusplus
 }
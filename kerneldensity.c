@@ -27,55 +27,138 @@
  *****************************************************************************/
 
 #include "mapserver.h"
+#include "mapthread.h"
 #include <float.h>
 #ifdef USE_GDAL
 
 #include "gdal.h"
 #include "cpl_string.h"
 
-void gaussian_blur(float *values, int width, int height, int radius) {
-  float *tmp = (float*)msSmallMalloc(width*height*sizeof(float));
-  int length = radius*2+1;
-  float *kernel = (float*)msSmallMalloc(length*sizeof(float));
+/*
+** Separable gaussian blur. The vertical pass accumulates whole rows of the
+** horizontally blurred buffer into each output row, in cache sized strips,
+** rather than walking down the columns. Both passes run over bands of rows
+** with msThreadRunJobs() and use SSE where available; taps are summed in
+** the same order as a naive convolution so results do not change.
+*/
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MS_KERNELDENSITY_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define BLUR_STRIP_WIDTH 512
+#define KERNELDENSITY_MAX_THREADS 16 /* KERNELDENSITY_THREADS is capped at this */
+
+typedef struct {
+  float *values, *tmp, *kernel;
+  int width, height, radius, bandrows;
+} blurJobObj;
+
+static void blurRowsJob(void *data, int band) {
+  blurJobObj *job = (blurJobObj*)data;
+  int length = job->radius*2+1, width = job->width;
+  int y, ylast = MS_MIN((band+1)*job->bandrows, job->height);
+
+  for(y=band*job->bandrows; y<ylast; y++) {
+    const float *src = job->values + (size_t)width*y - job->radius;
+    float *dst = job->tmp + (size_t)width*y;
+    int i, x = job->radius;
+#ifdef MS_KERNELDENSITY_USE_SSE2
+    /* 16 outputs per iteration, four independent accumulators */
+    for(; x+16 <= width-job->radius; x+=16) {
+      __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps(), a2 = _mm_setzero_ps(), a3 = _mm_setzero_ps();
+      for(i=0; i<length; i++) {
+        __m128 k = _mm_set1_ps(job->kernel[i]);
+        const float *s = src + x + i;
+        a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(s), k));
+        a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(s+4), k));
+        a2 = _mm_add_ps(a2, _mm_mul_ps(_mm_loadu_ps(s+8), k));
+        a3 = _mm_add_ps(a3, _mm_mul_ps(_mm_loadu_ps(s+12), k));
+      }
+      _mm_storeu_ps(dst+x, a0);
+      _mm_storeu_ps(dst+x+4, a1);
+      _mm_storeu_ps(dst+x+8, a2);
+      _mm_storeu_ps(dst+x+12, a3);
+    }
+    for(; x+4 <= width-job->radius; x+=4) {
+      __m128 a0 = _mm_setzero_ps();
+      for(i=0; i<length; i++)
+        a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(src + x + i), _mm_set1_ps(job->kernel[i])));
+      _mm_storeu_ps(dst+x, a0);
+    }
+#endif
+    for(; x<width-job->radius; x++) {
+      float accum=0;
+      for(i=0; i<length; i++) {
+        accum+=src[x+i] * job->kernel[i];
+      }
+      dst[x]=accum;
+    }
+  }
+}
+
+static void blurColumnsJob(void *data, int band) {
+  blurJobObj *job = (blurJobObj*)data;
+  int length = job->radius*2+1, width = job->width;
+  int y = MS_MAX(band*job->bandrows, job->radius);
+  int ylast = MS_MIN((band+1)*job->bandrows, job->height-job->radius);
+
+  for(; y<ylast; y++) {
+    float *dst = job->values + (size_t)width*y;
+    int x0;
+    for(x0=0; x0<width; x0+=BLUR_STRIP_WIDTH) {
+      int x1 = MS_MIN(x0+BLUR_STRIP_WIDTH, width), i, x;
+      for(x=x0; x<x1; x++)
+        dst[x] = 0;
+      for(i=0; i<length; i++) {
+        const float *src = job->tmp + (size_t)width*(y+i-job->radius);
+        float k = job->kernel[i];
+        x = x0;
+#ifdef MS_KERNELDENSITY_USE_SSE2
+        {
+          __m128 vk = _mm_set1_ps(k);
+          for(; x+4 <= x1; x+=4)
+            _mm_storeu_ps(dst+x, _mm_add_ps(_mm_loadu_ps(dst+x), _mm_mul_ps(_mm_loadu_ps(src+x), vk)));
+        }
+#endif
+        for(; x<x1; x++)
+          dst[x] += src[x] * k;
+      }
+    }
+  }
+}
+
+static void gaussian_blur(float *values, int width, int height, int radius, int threads) {
+  blurJobObj job;
+  int length = radius*2+1, numbands;
   float sigma=radius/3.0;
-	float a=1.0/ sqrt(2.0*M_PI*sigma*sigma);
-	float den=2.0*sigma*sigma;
-	int i,x,y;
-
-	for (i=0; i<length; i++) {
-	  float x=i - radius;
-	  float v=a * exp(-(x*x) / den);
-	  kernel[i]=v;
-	}
-	memset(tmp,0,width*height*sizeof(float));
-
-	for(y=0; y<height; y++) {
-		float* src_row=values + width*y;
-		float* dst_row=tmp + width*y;
-
-		for(x=radius; x<width-radius; x++) {
-			float accum=0;
-			for(i=0; i<length; i++) {
-				accum+=src_row[x+i-radius] * kernel[i];
-			}
-			dst_row[x]=accum;
-		}
-	}
-
-	for(x=0; x<width; x++) {
-		float* src_col=tmp+x;
-		float* dst_col=values+x;
-
-		for(y=radius; y<height-radius; y++) {
-			float accum=0;
-			for (i=0; i<length; i++) {
-				accum+=src_col[width*(y+i-radius)] * kernel[i];
-			}
-			dst_col[y*width]=accum;
-		}
-	}
-  free(tmp);
-  free(kernel);
+  float a=1.0/ sqrt(2.0*M_PI*sigma*sigma);
+  float den=2.0*sigma*sigma;
+  int i;
+
+  job.values = values;
+  job.width = width;
+  job.height = height;
+  job.radius = radius;
+  job.tmp = (float*)msSmallCalloc((size_t)width*height, sizeof(float));
+  job.kernel = (float*)msSmallMalloc(length*sizeof(float));
+  for (i=0; i<length; i++) {
+    float x=i - radius;
+    float v=a * exp(-(x*x) / den);
+    job.kernel[i]=v;
+  }
+
+  /* a few bands per thread so that uneven bands even out */
+  numbands = MS_MAX(MS_MIN(threads*4, height), 1);
+  job.bandrows = (height + numbands - 1) / numbands;
+  numbands = (height + job.bandrows - 1) / job.bandrows;
+  threads = MS_MIN(threads, numbands);
+
+  msThreadRunJobs(threads, numbands, blurRowsJob, &job);
+  msThreadRunJobs(threads, numbands, blurColumnsJob, &job);
+
+  free(job.tmp);
+  free(job.kernel);
 }
 
 
@@ -86,7 +169,7 @@ int msComputeKernelDensityDataset(mapObj *map, imageObj *image, layerObj *kernel
   shapeObj shape;
   layerObj *layer;
   float *values = NULL;
-  int radius = 10, im_width = image->width, im_height = image->height;
+  int radius = 10, im_width = image->width, im_height = image->height, threads = 1;
   int expand_searchrect=1;
   float normalization_scale=0.0;
   double invcellsize = 1.0 / map->cellsize, georadius=0;
@@ -109,6 +192,10 @@ int msComputeKernelDensityDataset(mapObj *map, imageObj *image, layerObj *kernel
   else
     radius = 10;
 
+  pszProcessing = msLayerGetProcessingKey( kerneldensity_layer, "KERNELDENSITY_THREADS" );
+  if(pszProcessing)
+    threads = MS_MIN(MS_MAX(atoi(pszProcessing), 1), KERNELDENSITY_MAX_THREADS);
+
   pszProcessing = msLayerGetProcessingKey( kerneldensity_layer, "KERNELDENSITY_COMPUTE_BORDERS" );
   if(pszProcessing && strcasecmp(pszProcessing,"OFF"))
     expand_searchrect = 1;
@@ -256,7 +343,7 @@ int msComputeKernelDensityDataset(mapObj *map, imageObj *image, layerObj *kernel
 
 
   if(have_sample) { /* no use applying the filtering kernel if we have no samples */
-    gaussian_blur(values,im_width, im_height, radius);
+    gaussian_blur(values,im_width, im_height, radius, threads);
 
     if(normalization_scale == 0.0) {   /* auto normalization */
       for (j=radius; j<im_height-radius; j++) {
@@ -121,6 +121,8 @@ struct cluster_layer_info {
   int keep_locations;
   /* the maxdistance and the buffer parameters are specified in map units (scale independent clustering) */
   int use_map_units;
+  /* use the single pass grid clustering instead of the quadtree based one */
+  int use_grid;
   double rank;
   /* root node of the quad tree */
   clusterTreeNode* root;
@@ -563,6 +565,23 @@ static void UpdateShapeAttributes(layerObj* layer, clusterInfo* base, clusterInf
   }
 }
 
+/* refresh the feature count of an incrementally built cluster */
+static void UpdateShapeFeatureCount(layerObj* layer, clusterInfo* base)
+{
+  int i;
+  int* itemindexes = layer->iteminfo;
+
+  for (i = 0; i < layer->numitems; i++) {
+    if (base->shape.numvalues <= i)
+      break;
+
+    if (itemindexes[i] == MSCLUSTER_FEATURECOUNTINDEX) {
+      msFree(base->shape.values[i]);
+      base->shape.values[i] = msIntToString(base->numsiblings + 1);
+    }
+  }
+}
+
 static int BuildFeatureAttributes(layerObj* layer, msClusterLayerInfo* layerinfo, shapeObj* shape)
 {
   char** values;
@@ -871,6 +890,217 @@ static int ValidateTree(msClusterLayerInfo* layerinfo, clusterTreeNode *node)
 }
 #endif
 
+/*
+** Grid clustering (CLUSTER_ALGORITHM=GRID processing option)
+**
+** Single pass greedy clustering: the shapes are visited in the order they are
+** read and each one joins the nearest existing cluster whose region contains
+** it, or starts a new cluster otherwise. The cluster seeds are kept in a
+** spatial hash of cells sized to the cluster region, so only the 3x3 cells
+** around a shape need to be checked. The attributes are aggregated as the
+** shapes join. This scales linearly with the number of shapes, at the price
+** of a less balanced result than the ranking done on the quadtree.
+*/
+typedef struct {
+  clusterInfo** seeds;
+  int* cellx;
+  int* celly;
+  int* next;
+  int numseeds;
+  int maxseeds;
+  int* buckets;
+  unsigned int mask;
+  double minx, miny, sizex, sizey;
+} clusterGridObj;
+
+static unsigned int clusterGridHash(clusterGridObj* grid, int cellx, int celly)
+{
+  return (((unsigned int)cellx * 73856093U) ^ ((unsigned int)celly * 19349663U)) & grid->mask;
+}
+
+static void clusterGridInit(clusterGridObj* grid, rectObj *rect, double sizex, double sizey)
+{
+  int i;
+  grid->seeds = NULL;
+  grid->cellx = grid->celly = grid->next = NULL;
+  grid->numseeds = grid->maxseeds = 0;
+  grid->mask = 1023;
+  grid->buckets = (int*)msSmallMalloc(sizeof(int) * (grid->mask + 1));
+  for (i = 0; i <= (int)grid->mask; i++)
+    grid->buckets[i] = -1;
+  grid->minx = rect->minx;
+  grid->miny = rect->miny;
+  /* a zero distance still clusters the coincident shapes */
+  grid->sizex = (sizex > 0 ? sizex : 1);
+  grid->sizey = (sizey > 0 ? sizey : 1);
+}
+
+static void clusterGridFree(clusterGridObj* grid)
+{
+  msFree(grid->seeds);
+  msFree(grid->cellx);
+  msFree(grid->celly);
+  msFree(grid->next);
+  msFree(grid->buckets);
+}
+
+/* rehash the seeds when the chains get too long */
+static void clusterGridGrow(clusterGridObj* grid)
+{
+  int i;
+  msFree(grid->buckets);
+  grid->mask = grid->mask * 2 + 1;
+  grid->buckets = (int*)msSmallMalloc(sizeof(int) * (grid->mask + 1));
+  for (i = 0; i <= (int)grid->mask; i++)
+    grid->buckets[i] = -1;
+  for (i = 0; i < grid->numseeds; i++) {
+    unsigned int h = clusterGridHash(grid, grid->cellx[i], grid->celly[i]);
+    grid->next[i] = grid->buckets[h];
+    grid->buckets[h] = i;
+  }
+}
+
+/* add a shape to the nearest matching cluster or make it a new cluster seed */
+static void clusterGridAddShape(layerObj* layer, msClusterLayerInfo* layerinfo, clusterGridObj* grid, clusterInfo* current)
+{
+  int cellx = (int)floor((current->x - grid->minx) / grid->sizex);
+  int celly = (int)floor((current->y - grid->miny) / grid->sizey);
+  int i, j, k;
+  double dist, bestdist = 0;
+  clusterInfo* best = NULL;
+  unsigned int h;
+
+  for (j = celly - 1; j <= celly + 1; j++) {
+    for (i = cellx - 1; i <= cellx + 1; i++) {
+      for (k = grid->buckets[clusterGridHash(grid, i, j)]; k >= 0; k = grid->next[k]) {
+        clusterInfo* s = grid->seeds[k];
+        if (grid->cellx[k] != i || grid->celly[k] != j || !layerinfo->fnCompare(s, current))
+          continue;
+        dist = (s->x - current->x) * (s->x - current->x) + (s->y - current->y) * (s->y - current->y);
+        if (!best || dist < bestdist) {
+          best = s;
+          bestdist = dist;
+        }
+      }
+    }
+  }
+
+  if (best) {
+    /* join the cluster */
+    ++best->numsiblings;
+    best->avgx += (current->x - best->avgx) / (best->numsiblings + 1);
+    best->avgy += (current->y - best->avgy) / (best->numsiblings + 1);
+    UpdateShapeAttributes(layer, best, current);
+    current->next = best->siblings;
+    best->siblings = current;
+    return;
+  }
+
+  /* start a new cluster */
+  if (grid->numseeds == grid->maxseeds) {
+    grid->maxseeds = (grid->maxseeds ? grid->maxseeds * 2 : 1024);
+    grid->seeds = (clusterInfo**)msSmallRealloc(grid->seeds, sizeof(clusterInfo*) * grid->maxseeds);
+    grid->cellx = (int*)msSmallRealloc(grid->cellx, sizeof(int) * grid->maxseeds);
+    grid->celly = (int*)msSmallRealloc(grid->celly, sizeof(int) * grid->maxseeds);
+    grid->next = (int*)msSmallRealloc(grid->next, sizeof(int) * grid->maxseeds);
+  }
+  InitShapeAttributes(layer, current);
+  k = grid->numseeds++;
+  grid->seeds[k] = current;
+  grid->cellx[k] = cellx;
+  grid->celly[k] = celly;
+  h = clusterGridHash(grid, cellx, celly);
+  grid->next[k] = grid->buckets[h];
+  grid->buckets[h] = k;
+  if (grid->numseeds > (int)grid->mask + 1)
+    clusterGridGrow(grid);
+
+  /* the seeds are owned by the finalized list until the clusters are completed */
+  current->next = layerinfo->finalized;
+  layerinfo->finalized = current;
+}
+
+/* apply the filter to a single shape and put it into the finalized or the filtered list */
+static void clusterGridFinalizeSingle(layerObj* layer, msClusterLayerInfo* layerinfo, clusterInfo* s)
+{
+  s->numsiblings = 0;
+  s->avgx = s->x;
+  s->avgy = s->y;
+  InitShapeAttributes(layer, s);
+  if (layer->cluster.filter.string != NULL)
+    s->filter = msClusterEvaluateFilter(&layer->cluster.filter, &s->shape);
+  else
+    s->filter = MS_TRUE;
+
+  if (s->filter) {
+    s->next = layerinfo->finalized;
+    layerinfo->finalized = s;
+    ++layerinfo->numFinalized;
+  } else {
+    s->next = layerinfo->filtered;
+    layerinfo->filtered = s;
+    ++layerinfo->numFiltered;
+  }
+}
+
+/* build the final cluster list from the seeds */
+static void clusterGridFinalize(layerObj* layer, msClusterLayerInfo* layerinfo, clusterGridObj* grid)
+{
+  int k;
+  clusterInfo *s, *current, *next;
+
+  /* relink the finalized list in reading order */
+  layerinfo->finalized = NULL;
+  for (k = grid->numseeds - 1; k >= 0; k--) {
+    current = grid->seeds[k];
+    current->next = NULL;
+
+    if (current->numsiblings == 0) {
+      clusterGridFinalizeSingle(layer, layerinfo, current);
+      continue;
+    }
+
+    UpdateShapeFeatureCount(layer, current);
+    if (layer->cluster.filter.string != NULL)
+      current->filter = msClusterEvaluateFilter(&layer->cluster.filter, &current->shape);
+    else
+      current->filter = MS_TRUE;
+
+    if (!current->filter) {
+      /* the filtered shapes have no siblings, the members are returned by themselves */
+      s = current->siblings;
+      current->siblings = NULL;
+      current->numsiblings = 0;
+      current->next = layerinfo->filtered;
+      layerinfo->filtered = current;
+      ++layerinfo->numFiltered;
+      while (s) {
+        next = s->next;
+        clusterGridFinalizeSingle(layer, layerinfo, s);
+        s = next;
+      }
+      continue;
+    }
+
+    /* setting the average position of the members to the same value */
+    for (s = current->siblings; s; s = s->next) {
+      s->avgx = current->avgx;
+      s->avgy = current->avgy;
+      if (s->next == NULL && layerinfo->get_all_shapes == MS_TRUE) {
+        /* insert the siblings into the finalization list */
+        s->next = layerinfo->finalized;
+        layerinfo->finalized = current->siblings;
+        current->siblings = NULL;
+        break;
+      }
+    }
+
+    current->next = layerinfo->finalized;
+    layerinfo->finalized = current;
+    ++layerinfo->numFinalized;
+  }
+}
+
 /* rebuild the clusters according to the current extent */
 int RebuildClusters(layerObj *layer, int isQuery)
 {
@@ -881,6 +1111,8 @@ int RebuildClusters(layerObj *layer, int isQuery)
   int status;
   clusterInfo* current;
   int depth;
+  const char* algorithm;
+  clusterGridObj grid;
 #ifdef USE_CLUSTER_EXTERNAL
   int layerIndex;
 #endif
@@ -923,6 +1155,18 @@ int RebuildClusters(layerObj *layer, int isQuery)
   else
     layerinfo->use_map_units = MS_FALSE;
 
+  /* select the clustering algorithm */
+  layerinfo->use_grid = MS_FALSE;
+  algorithm = msLayerGetProcessingKey(layer, "CLUSTER_ALGORITHM");
+  if (algorithm) {
+    if (EQUAL(algorithm, "GRID"))
+      layerinfo->use_grid = MS_TRUE;
+    else if (!EQUAL(algorithm, "SIMPLE")) {
+      msSetError(MS_MISCERR, "Unsupported CLUSTER_ALGORITHM (%s) for layer %s, expected SIMPLE or GRID.", "RebuildClusters()", algorithm, layer->name);
+      return MS_FAILURE;
+    }
+  }
+
   /* identify the current extent */
   if(layer->transform == MS_TRUE)
     searchrect = map->extent;
@@ -992,17 +1236,21 @@ int RebuildClusters(layerObj *layer, int isQuery)
   /* create the root node */
   if (layerinfo->root)
     clusterTreeNodeDestroy(layerinfo, layerinfo->root);
-  layerinfo->root = clusterTreeNodeCreate(layerinfo, searchrect);
+  layerinfo->root = NULL;
+  if (layerinfo->use_grid)
+    clusterGridInit(&grid, &searchrect, maxDistanceX, maxDistanceY);
+  else
+    layerinfo->root = clusterTreeNodeCreate(layerinfo, searchrect);
 
   srcLayer = &layerinfo->srcLayer;
 
   /* start retrieving the shapes */
   status = msLayerWhichShapes(srcLayer, searchrect, isQuery);
-  if(status == MS_DONE) {
-    /* no overlap */
-    return MS_SUCCESS;
-  } else if(status != MS_SUCCESS) {
-    return MS_FAILURE;
+  if(status != MS_SUCCESS) {
+    if (layerinfo->use_grid)
+      clusterGridFree(&grid);
+    /* MS_DONE means no overlap */
+    return (status == MS_DONE ? MS_SUCCESS : MS_FAILURE);
   }
 
   /* step through the source shapes and populate the quadtree with the tentative clusters */
@@ -1042,6 +1290,12 @@ int RebuildClusters(layerObj *layer, int isQuery)
     if (layer->cluster.group.string)
       current->group = msClusterGetGroupText(&layer->cluster.group, &current->shape);
 
+    if (layerinfo->use_grid) {
+      clusterGridAddShape(layer, layerinfo, &grid, current);
+      current = clusterInfoCreate(layerinfo);
+      continue;
+    }
+
     /*start a query for the related shapes */
     findRelatedShapes(layerinfo, layerinfo->root, current);
 
@@ -1059,6 +1313,13 @@ int RebuildClusters(layerObj *layer, int isQuery)
 
   clusterInfoDestroyList(layerinfo, current);
 
+  if (layerinfo->use_grid) {
+    clusterGridFinalize(layer, layerinfo, &grid);
+    if (layer->debug >= MS_DEBUGLEVEL_VVV)
+      msDebug("Grid clustering completed: %d clusters from %d shapes.\n", layerinfo->numFinalized, layerinfo->numFeatures);
+    clusterGridFree(&grid);
+  }
+
   while (layerinfo->root) {
 #ifdef TESTCOUNT
     int n;
@@ -1410,6 +1671,7 @@ msClusterLayerInfo* msClusterInitialize(layerObj *layer)
   layerinfo->root = NULL;
 
   layerinfo->get_all_shapes = MS_FALSE;
+  layerinfo->use_grid = MS_FALSE;
 
   layerinfo->numFeatures = 0;
   layerinfo->numNodes = 0;
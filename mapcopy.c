@@ -499,7 +499,11 @@ int msCopyStyle(styleObj *dst, styleObj *src)
   MS_COPYSTELEM(maxwidth);
   MS_COPYSTELEM(offsetx);
   MS_COPYSTELEM(offsety);
+  MS_COPYSTELEM(polaroffsetpixel);
+  MS_COPYSTELEM(polaroffsetangle);
   MS_COPYSTELEM(angle);
+  MS_COPYSTELEM(autoangle);
+  MS_COPYSTELEM(position);
   MS_COPYSTELEM(minvalue);
   MS_COPYSTELEM(maxvalue);
   MS_COPYSTELEM(opacity);
@@ -1138,6 +1142,19 @@ int msCopyLayer(layerObj *dst, layerObj *src)
     msCopyCompositer(&dst->compositer, src->compositer);
   }
 
+  MS_COPYSTRING(dst->_geomtransform.string, src->_geomtransform.string);
+  MS_COPYSTELEM(_geomtransform.type);
+
+  MS_COPYSTRING(dst->utfitem, src->utfitem);
+  MS_COPYSTELEM(utfitemindex);
+  return_value = msCopyExpression(&(dst->utfdata), &(src->utfdata));
+  if (return_value != MS_SUCCESS) {
+    msSetError(MS_MEMERR, "Failed to copy utfdata.", "msCopyLayer()");
+    return MS_FAILURE;
+  }
+
+  msLayerSetSort(dst, &(src->sortBy));
+
   return MS_SUCCESS;
 }
 
@@ -1192,6 +1209,8 @@ int msCopyMap(mapObj *dst, mapObj *src)
   MS_COPYSTELEM(imagequality);
 
   MS_COPYRECT(&(dst->extent), &(src->extent));
+  MS_COPYSTELEM(gt);
+  MS_COPYRECT(&(dst->saved_extent), &(src->saved_extent));
 
   MS_COPYSTELEM(cellsize);
   MS_COPYSTELEM(units);
@@ -1226,8 +1245,8 @@ int msCopyMap(mapObj *dst, mapObj *src)
   /* set the active output format */
   MS_COPYSTRING(dst->imagetype, src->imagetype);
   format = msSelectOutputFormat( dst, dst->imagetype );
-  msApplyOutputFormat(&(dst->outputformat), format, MS_NOOVERRIDE,
-                      MS_NOOVERRIDE, MS_NOOVERRIDE );
+  msApplyOutputFormat(&(dst->outputformat), format, dst->transparent,
+                      dst->interlace, dst->imagequality );
 
   return_value = msCopyProjection(&(dst->projection),&(src->projection));
   if (return_value != MS_SUCCESS) {
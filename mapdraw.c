@@ -201,6 +201,217 @@ static int msCompositeRasterBuffer(imageObj *img, rasterBufferObj *rb, LayerComp
   return ret;
 }
 
+/*
+ * Parallel layer rendering.
+ *
+ * When the MS_LAYER_THREADS config option is set to more than 1, runs of
+ * consecutive layers that do not touch state shared with other layers are
+ * each drawn into their own transparent image on a pool of threads. The
+ * images are then composited into the map image in layerorder, exactly as
+ * msDrawLayer() does for layers with a COMPOSITE block, and the labels each
+ * layer added to its private label cache are appended to the map's one in
+ * the same order, so label placement is unchanged.
+ */
+typedef struct {
+  mapObj map; /* shallow copy of the map, with a private label cache */
+  layerObj *layer;
+  imageObj *image;
+  int status;
+  char *error;
+} layerDrawJobObj;
+
+static int msGetLayerThreads(mapObj *map)
+{
+#ifdef USE_THREAD
+  const char *value = msGetConfigOption(map, "MS_LAYER_THREADS");
+  if(value)
+    return MS_MAX(atoi(value), 1);
+#endif
+  return 1;
+}
+
+static int msStyleBindsSymbol(styleObj *style)
+{
+  return (style->numbindings > 0 && style->bindings[MS_STYLE_BINDING_SYMBOL].item != NULL);
+}
+
+static int msStyleUsesSVGSymbol(mapObj *map, styleObj *style)
+{
+  return (MS_IS_VALID_ARRAY_INDEX(style->symbol, map->symbolset.numsymbols) &&
+          map->symbolset.symbol[style->symbol]->type == MS_SYMBOL_SVG);
+}
+
+/*
+ * Returns MS_TRUE if the layer can be drawn on a worker thread. This rules
+ * out everything that lazily modifies the map or other layers while drawing:
+ * remote, union and plugin connections, masks, alternate renderers,
+ * reprojection, symbols resolved per feature, label cache flushes, and
+ * renderers other than AGG and SVG symbols, which keep state in the shared
+ * symbolObj (cairo surfaces, SVG rasterized at the last used scale).
+ */
+static int msLayerCanDrawInThread(mapObj *map, layerObj *layer, imageObj *image)
+{
+  rendererVTableObj *renderer;
+  char *value;
+  int c, s, l;
+
+  if(image->format->renderer != MS_RENDER_WITH_AGG)
+    return MS_FALSE;
+  renderer = MS_IMAGE_RENDERER(image);
+  if(!renderer->supports_pixel_buffer || !renderer->compositeRasterBuffer ||
+      !renderer->mergeRasterBuffer || !renderer->getRasterBufferHandle)
+    return MS_FALSE;
+
+  switch(layer->connectiontype) {
+    case MS_INLINE:
+    case MS_SHAPEFILE:
+    case MS_TILED_SHAPEFILE:
+    case MS_OGR:
+    case MS_POSTGIS:
+    case MS_RASTER:
+      break;
+    default:
+      return MS_FALSE;
+  }
+
+  if(layer->mask || layer->styleitem)
+    return MS_FALSE;
+  if(layer->compositer && !layer->compositer->next && layer->compositer->opacity == 0)
+    return MS_FALSE;
+  if(layer->tileindex && msGetLayerIndex(map, layer->tileindex) != -1)
+    return MS_FALSE;
+  if(msProjectionsDiffer(&(layer->projection), &(map->projection)))
+    return MS_FALSE;
+
+  if(msLayerGetProcessingKey(layer, "RENDERER") ||
+      msLayerGetProcessingKey(layer, "APPROXIMATION_SCALE"))
+    return MS_FALSE;
+  value = msLayerGetProcessingKey(layer, "FORCE_DRAW_LABEL_CACHE");
+  if(value && strncasecmp(value, "FLUSH", 5) == 0)
+    return MS_FALSE;
+
+  for(c=0; c<layer->numclasses; c++) {
+    classObj *class = layer->class[c];
+    for(s=0; s<class->numstyles; s++)
+      if(msStyleBindsSymbol(class->styles[s]) || msStyleUsesSVGSymbol(map, class->styles[s]))
+        return MS_FALSE;
+    for(l=0; l<class->numlabels; l++)
+      for(s=0; s<class->labels[l]->numstyles; s++)
+        if(msStyleBindsSymbol(class->labels[l]->styles[s]) || msStyleUsesSVGSymbol(map, class->labels[l]->styles[s]))
+          return MS_FALSE;
+  }
+
+  return MS_TRUE;
+}
+
+/*
+ * Image symbols are loaded on first use, which must not happen concurrently.
+ */
+static int msPreloadLayerSymbols(mapObj *map, layerObj *layer)
+{
+  int c, s, l;
+
+  for(c=0; c<layer->numclasses; c++) {
+    classObj *class = layer->class[c];
+    for(l=-1; l<class->numlabels; l++) {
+      int numstyles = (l == -1) ? class->numstyles : class->labels[l]->numstyles;
+      styleObj **styles = (l == -1) ? class->styles : class->labels[l]->styles;
+      for(s=0; s<numstyles; s++) {
+        symbolObj *symbol;
+        if(!MS_IS_VALID_ARRAY_INDEX(styles[s]->symbol, map->symbolset.numsymbols))
+          continue;
+        symbol = map->symbolset.symbol[styles[s]->symbol];
+        if(symbol->type == MS_SYMBOL_PIXMAP) {
+          if(msPreloadImageSymbol(MS_MAP_RENDERER(map), symbol) != MS_SUCCESS)
+            return MS_FAILURE;
+        }
+      }
+    }
+  }
+  return MS_SUCCESS;
+}
+
+static void msDrawLayerJob(void *data, int i)
+{
+  layerDrawJobObj *job = ((layerDrawJobObj *) data) + i;
+  layerObj *layer = job->layer;
+  LayerCompositer *compositer = layer->compositer;
+
+  /* the compositer is applied when the job image is merged into the map image */
+  layer->compositer = NULL;
+  job->status = msDrawLayer(&(job->map), layer, job->image);
+  layer->compositer = compositer;
+
+  if(job->status != MS_SUCCESS) {
+    job->error = msGetErrorString(" ");
+    msResetErrorList();
+  }
+}
+
+static int msDrawLayersInThreads(mapObj *map, layerObj **layers, int numlayers, imageObj *image, int numthreads)
+{
+  layerDrawJobObj *jobs;
+  int i, status = MS_SUCCESS;
+
+  jobs = (layerDrawJobObj *) msSmallCalloc(numlayers, sizeof(layerDrawJobObj));
+
+  for(i=0; i<numlayers && status == MS_SUCCESS; i++) {
+    jobs[i].map = *map;
+    jobs[i].layer = layers[i];
+    memset(&(jobs[i].map.labelcache), 0, sizeof(labelCacheObj));
+    if(msInitLabelCache(&(jobs[i].map.labelcache)) != MS_SUCCESS) {
+      status = MS_FAILURE;
+      break;
+    }
+    jobs[i].image = msImageCreate(image->width, image->height, image->format,
+                                  image->imagepath, image->imageurl, map->resolution, map->defresolution, NULL);
+    if(!jobs[i].image) {
+      msSetError(MS_MISCERR, "Unable to initialize temporary transparent image.", "msDrawLayersInThreads()");
+      status = MS_FAILURE;
+      break;
+    }
+    jobs[i].image->map = map;
+    status = msPreloadLayerSymbols(map, layers[i]);
+  }
+
+  if(status == MS_SUCCESS)
+    msThreadRunJobs(numthreads, numlayers, msDrawLayerJob, jobs);
+
+  for(i=0; i<numlayers && status == MS_SUCCESS; i++) {
+    layerObj *layer = jobs[i].layer;
+    rendererVTableObj *renderer = MS_IMAGE_RENDERER(image);
+    rasterBufferObj rb;
+
+    if(jobs[i].status != MS_SUCCESS) {
+      msSetError(MS_IMGERR, "Failed to draw layer named '%s': %s", "msDrawMap()",
+                 layer->name, jobs[i].error ? jobs[i].error : "");
+      status = MS_FAILURE;
+      break;
+    }
+
+    memset(&rb, 0, sizeof(rasterBufferObj));
+    status = renderer->getRasterBufferHandle(jobs[i].image, &rb);
+    if(status == MS_SUCCESS) {
+      if(!layer->compositer)
+        status = renderer->mergeRasterBuffer(image, &rb, 1.0, 0, 0, 0, 0, rb.width, rb.height);
+      else
+        status = msCompositeRasterBuffer(image, &rb, layer->compositer);
+    }
+    if(status == MS_SUCCESS)
+      status = msMergeLabelCache(&(map->labelcache), &(jobs[i].map.labelcache));
+  }
+
+  for(i=0; i<numlayers; i++) {
+    msFreeLabelCache(&(jobs[i].map.labelcache));
+    if(jobs[i].image)
+      msFreeImage(jobs[i].image);
+    msFree(jobs[i].error);
+  }
+  msFree(jobs);
+
+  return status;
+}
+
 /*
  * Generic function to render the map file.
  * The type of the image created is based on the imagetype parameter in the map file.
@@ -216,6 +427,8 @@ imageObj *msDrawMap(mapObj *map, int querymap)
   imageObj *image = NULL;
   struct mstimeval mapstarttime, mapendtime;
   struct mstimeval starttime, endtime;
+  int layerthreads;
+  layerObj **threadlayers = NULL;
 
 #if defined(USE_WMS_LYR) || defined(USE_WFS_LYR)
   enum MS_CONNECTION_TYPE lastconnectiontype;
@@ -327,6 +540,10 @@ imageObj *msDrawMap(mapObj *map, int querymap)
 #endif /* USE_WMS_LYR || USE_WFS_LYR */
 
   /* OK, now we can start drawing */
+  layerthreads = querymap ? 1 : msGetLayerThreads(map);
+  if(layerthreads > 1)
+    threadlayers = (layerObj **) msSmallMalloc(sizeof(layerObj *) * map->numlayers);
+
   for(i=0; i<map->numlayers; i++) {
 
     if(map->layerorder[i] != -1) {
@@ -341,6 +558,44 @@ imageObj *msDrawMap(mapObj *map, int querymap)
 
       if(!msLayerIsVisible(map, lp)) continue;
 
+      if(threadlayers && msLayerCanDrawInThread(map, lp, image)) {
+        int j, numthreadlayers = 0;
+
+        /* gather the run of visible layers that can be drawn concurrently */
+        for(j=i; j<map->numlayers; j++) {
+          layerObj *jlp;
+          if(map->layerorder[j] == -1) continue;
+          jlp = GET_LAYER(map, map->layerorder[j]);
+          if(jlp->postlabelcache || !msLayerIsVisible(map, jlp)) continue;
+          if(!msLayerCanDrawInThread(map, jlp, image)) break;
+          threadlayers[numthreadlayers++] = jlp;
+        }
+
+        if(numthreadlayers > 1) {
+          if(msDrawLayersInThreads(map, threadlayers, numthreadlayers, image, layerthreads) != MS_SUCCESS) {
+            msFreeImage(image);
+            msFree(threadlayers);
+#if defined(USE_WMS_LYR) || defined(USE_WFS_LYR)
+            if (pasOWSReqInfo) {
+              msHTTPFreeRequestObj(pasOWSReqInfo, numOWSRequests);
+              msFree(pasOWSReqInfo);
+            }
+#endif /* USE_WMS_LYR || USE_WFS_LYR */
+            return(NULL);
+          }
+          if(map->debug >= MS_DEBUGLEVEL_TUNING) {
+            msGettimeofday(&endtime, NULL);
+            msDebug("msDrawMap(): Layers %d to %d (%d layers on %d threads), %.3fs\n",
+                    map->layerorder[i], threadlayers[numthreadlayers-1]->index, numthreadlayers,
+                    MS_MIN(layerthreads, numthreadlayers),
+                    (endtime.tv_sec+endtime.tv_usec/1.0e6)-
+                    (starttime.tv_sec+starttime.tv_usec/1.0e6) );
+          }
+          i = j-1; /* resume with the first layer that was not part of the run */
+          continue;
+        }
+      }
+
       if(lp->connectiontype == MS_WMS) {
 #ifdef USE_WMS_LYR
         if(MS_RENDERER_PLUGIN(image->format) || MS_RENDERER_RAWDATA(image->format))
@@ -358,6 +613,7 @@ imageObj *msDrawMap(mapObj *map, int querymap)
                      "and make sure that the layer's connection URL is valid.",
                      "msDrawMap()", lp->name);
           msFreeImage(image);
+          msFree(threadlayers);
           msHTTPFreeRequestObj(pasOWSReqInfo, numOWSRequests);
           msFree(pasOWSReqInfo);
           return(NULL);
@@ -367,6 +623,7 @@ imageObj *msDrawMap(mapObj *map, int querymap)
 #else /* ndef USE_WMS_LYR */
         msSetError(MS_WMSCONNERR, "MapServer not built with WMS Client support, unable to render layer '%s'.", "msDrawMap()", lp->name);
         msFreeImage(image);
+        msFree(threadlayers);
         return(NULL);
 #endif
       } else { /* Default case: anything but WMS layers */
@@ -377,6 +634,7 @@ imageObj *msDrawMap(mapObj *map, int querymap)
         if(status == MS_FAILURE) {
           msSetError(MS_IMGERR, "Failed to draw layer named '%s'.", "msDrawMap()", lp->name);
           msFreeImage(image);
+          msFree(threadlayers);
 #if defined(USE_WMS_LYR) || defined(USE_WFS_LYR)
           if (pasOWSReqInfo) {
             msHTTPFreeRequestObj(pasOWSReqInfo, numOWSRequests);
@@ -402,6 +660,7 @@ imageObj *msDrawMap(mapObj *map, int querymap)
 	  msDebug("msDrawMap(): PROCESSING FORCE_DRAW_LABEL_CACHE=FLUSH found.\n");
 	if(msDrawLabelCache(map, image) != MS_SUCCESS) {
 	  msFreeImage(image);
+	  msFree(threadlayers);
 #if defined(USE_WMS_LYR) || defined(USE_WFS_LYR)
 	  if (pasOWSReqInfo) {
 	    msHTTPFreeRequestObj(pasOWSReqInfo, numOWSRequests);
@@ -416,6 +675,7 @@ imageObj *msDrawMap(mapObj *map, int querymap)
 
     }
   }
+  msFree(threadlayers);
 
   if(map->scalebar.status == MS_EMBED && !map->scalebar.postlabelcache) {
 
@@ -957,7 +1217,7 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image)
     return MS_FAILURE;
   }
 
-  /* step through the target shapes */
+  /* step through the target shapes, their buffers are recycled by the layer's pool if the reader uses one */
   msInitShape(&shape);
 
   nclasses = 0;
@@ -974,18 +1234,18 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image)
     if((shape.type == MS_SHAPE_LINE || shape.type == MS_SHAPE_POLYGON) && (minfeaturesize > 0) && (msShapeCheckSize(&shape, minfeaturesize) == MS_FALSE)) {
       if(layer->debug >= MS_DEBUGLEVEL_V)
         msDebug("msDrawVectorLayer(): Skipping shape (%ld) because LAYER::MINFEATURESIZE is bigger than shape size\n", shape.index);
-      msFreeShape(&shape);
+      msShapePoolFreeShape(layer->shapepool, &shape);
       continue;
     }
 
     shape.classindex = msShapeGetClass(layer, map, &shape, classgroup, nclasses);
     if((shape.classindex == -1) || (layer->class[shape.classindex]->status == MS_OFF)) {
-      msFreeShape(&shape);
+      msShapePoolFreeShape(layer->shapepool, &shape);
       continue;
     }
 
     if(maxfeatures >=0 && featuresdrawn >= maxfeatures) {
-      msFreeShape(&shape);
+      msShapePoolFreeShape(layer->shapepool, &shape);
       status = MS_DONE;
       break;
     }
@@ -1008,14 +1268,14 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image)
       if(strcasecmp(layer->styleitem, "AUTO") == 0) {
         if(msLayerGetAutoStyle(map, layer, layer->class[shape.classindex], &shape) != MS_SUCCESS) {
           retcode = MS_FAILURE;
-          msFreeShape(&shape);
+          msShapePoolFreeShape(layer->shapepool, &shape);
           break;
         }
       } else {
         /* Generic feature style handling as per RFC-61 */
         if(msLayerGetFeatureStyle(map, layer, layer->class[shape.classindex], &shape) != MS_SUCCESS) {
           retcode = MS_FAILURE;
-          msFreeShape(&shape);
+          msShapePoolFreeShape(layer->shapepool, &shape);
           break;
         }
       }
@@ -1063,19 +1323,19 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image)
     else
       status = msDrawShape(map, layer, &shape, image, -1, drawmode); /* all styles  */
     if(status != MS_SUCCESS) {
-      msFreeShape(&shape);
+      msShapePoolFreeShape(layer->shapepool, &shape);
       retcode = MS_FAILURE;
       break;
     }
     
     if(shape.numlines == 0) { /* once clipped the shape didn't need to be drawn */
-      msFreeShape(&shape);
+      msShapePoolFreeShape(layer->shapepool, &shape);
       continue;
     }
 
     if(cache) {
       if(insertFeatureList(&shpcache, &shape) == NULL) {
-        msFreeShape(&shape);
+        msShapePoolFreeShape(layer->shapepool, &shape);
         retcode = MS_FAILURE; /* problem adding to the cache */
         break;
       }
@@ -1083,7 +1343,7 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image)
 
     maxnumstyles = MS_MAX(maxnumstyles, layer->class[shape.classindex]->numstyles);
 
-    msFreeShape(&shape);
+    msShapePoolFreeShape(layer->shapepool, &shape);
   }
 
   if (classgroup)
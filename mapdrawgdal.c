@@ -1083,6 +1083,130 @@ static int ApplyLUT( int iColorIndex, layerObj *layer,
   return 0;
 }
 
+/************************************************************************/
+/*                         msGDALSelectOverview()                       */
+/*                                                                      */
+/*      Overview to read the source window from for the requested       */
+/*      output size, according to PROCESSING "OVERVIEW_LEVEL": AUTO     */
+/*      picks the most reduced overview that is still at least as       */
+/*      detailed as the output, a number selects that overview (0 is    */
+/*      the first one). Returns -1 to read through the dataset, which   */
+/*      leaves the choice to GDAL.                                      */
+/************************************************************************/
+
+static int
+msGDALSelectOverview( GDALDatasetH hDS, layerObj *layer, int band,
+                      int src_xsize, int src_ysize,
+                      int dst_xsize, int dst_ysize )
+
+{
+  const char *pszLevel = CSLFetchNameValue( layer->processing, "OVERVIEW_LEVEL" );
+  GDALRasterBandH hBand;
+  int nOverviews, iOverview, iBest = -1;
+  double dfTargetFactor, dfBestFactor = 1.0;
+
+  if( pszLevel == NULL )
+    return -1;
+
+  hBand = GDALGetRasterBand( hDS, band );
+  nOverviews = hBand ? GDALGetOverviewCount( hBand ) : 0;
+
+  if( !EQUAL(pszLevel,"AUTO") ) {
+    iOverview = atoi( pszLevel );
+    return (iOverview >= 0 && iOverview < nOverviews) ? iOverview : -1;
+  }
+
+  /* allow for rounding of the overview sizes */
+  dfTargetFactor = MS_MIN( (double) src_xsize / dst_xsize,
+                           (double) src_ysize / dst_ysize ) * 1.01;
+
+  for( iOverview = 0; iOverview < nOverviews; iOverview++ ) {
+    GDALRasterBandH hOverview = GDALGetOverview( hBand, iOverview );
+    double dfFactor;
+
+    if( hOverview == NULL || GDALGetRasterBandXSize( hOverview ) == 0 )
+      continue;
+
+    dfFactor = (double) GDALGetRasterBandXSize( hBand )
+               / GDALGetRasterBandXSize( hOverview );
+    if( dfFactor <= dfTargetFactor && dfFactor > dfBestFactor ) {
+      iBest = iOverview;
+      dfBestFactor = dfFactor;
+    }
+  }
+
+  if( iBest >= 0 && layer->debug )
+    msDebug( "msGDALSelectOverview(%s): reading overview %d, reduction %.2f for %.2f\n",
+             layer->name, iBest, dfBestFactor, dfTargetFactor / 1.01 );
+
+  return iBest;
+}
+
+/************************************************************************/
+/*                          msGDALReadBands()                           */
+/*                                                                      */
+/*      Band interleaved read of the source window, straight from the   */
+/*      overview chosen by msGDALSelectOverview() if any.               */
+/************************************************************************/
+
+static CPLErr
+msGDALReadBands( GDALDatasetH hDS, layerObj *layer,
+                 int *band_numbers, int band_count,
+                 int src_xoff, int src_yoff, int src_xsize, int src_ysize,
+                 void *pData, int dst_xsize, int dst_ysize,
+                 GDALDataType eType )
+
+{
+  int iOverview, iBand;
+  int nPixelSize = GDALGetDataTypeSize( eType ) / 8;
+
+  iOverview = msGDALSelectOverview( hDS, layer, band_numbers[0],
+                                    src_xsize, src_ysize, dst_xsize, dst_ysize );
+
+  for( iBand = 0; iOverview >= 0 && iBand < band_count; iBand++ ) {
+    GDALRasterBandH hBand = GDALGetRasterBand( hDS, band_numbers[iBand] );
+    if( hBand == NULL || GDALGetOverviewCount( hBand ) <= iOverview
+        || GDALGetOverview( hBand, iOverview ) == NULL )
+      iOverview = -1;
+  }
+
+  if( iOverview < 0 )
+    return GDALDatasetRasterIO( hDS, GF_Read,
+                                src_xoff, src_yoff, src_xsize, src_ysize,
+                                pData, dst_xsize, dst_ysize, eType,
+                                band_count, band_numbers,
+                                0,0,0);
+
+  for( iBand = 0; iBand < band_count; iBand++ ) {
+    GDALRasterBandH hOverview =
+      GDALGetOverview( GDALGetRasterBand( hDS, band_numbers[iBand] ), iOverview );
+    double dfRatioX = (double) GDALGetRasterBandXSize( hOverview ) / GDALGetRasterXSize( hDS );
+    double dfRatioY = (double) GDALGetRasterBandYSize( hOverview ) / GDALGetRasterYSize( hDS );
+    int ov_xoff, ov_yoff, ov_xsize, ov_ysize;
+    CPLErr eErr;
+
+    /* source window in overview pixels */
+    ov_xoff = (int) (src_xoff * dfRatioX + 0.5);
+    ov_yoff = (int) (src_yoff * dfRatioY + 0.5);
+    ov_xsize = (int) ((src_xoff + src_xsize) * dfRatioX + 0.5) - ov_xoff;
+    ov_ysize = (int) ((src_yoff + src_ysize) * dfRatioY + 0.5) - ov_yoff;
+    ov_xoff = MS_MIN( ov_xoff, GDALGetRasterBandXSize( hOverview ) - 1 );
+    ov_yoff = MS_MIN( ov_yoff, GDALGetRasterBandYSize( hOverview ) - 1 );
+    ov_xsize = MS_MAX( 1, MS_MIN( ov_xsize, GDALGetRasterBandXSize( hOverview ) - ov_xoff ) );
+    ov_ysize = MS_MAX( 1, MS_MIN( ov_ysize, GDALGetRasterBandYSize( hOverview ) - ov_yoff ) );
+
+    eErr = GDALRasterIO( hOverview, GF_Read,
+                         ov_xoff, ov_yoff, ov_xsize, ov_ysize,
+                         ((GByte *) pData)
+                         + (size_t) iBand * dst_xsize * dst_ysize * nPixelSize,
+                         dst_xsize, dst_ysize, eType, 0, 0 );
+    if( eErr != CE_None )
+      return eErr;
+  }
+
+  return CE_None;
+}
+
 /************************************************************************/
 /*                           LoadGDALImages()                           */
 /*                                                                      */
@@ -1138,12 +1262,9 @@ LoadGDALImages( GDALDatasetH hDS, int band_numbers[4], int band_count,
       && CSLFetchNameValue( layer->processing, "SCALE_2" ) == NULL
       && CSLFetchNameValue( layer->processing, "SCALE_3" ) == NULL
       && CSLFetchNameValue( layer->processing, "SCALE_4" ) == NULL ) {
-    eErr = GDALDatasetRasterIO( hDS, GF_Read,
-                                src_xoff, src_yoff, src_xsize, src_ysize,
-                                pabyWholeBuffer,
-                                dst_xsize, dst_ysize, GDT_Byte,
-                                band_count, band_numbers,
-                                0,0,0);
+    eErr = msGDALReadBands( hDS, layer, band_numbers, band_count,
+                            src_xoff, src_yoff, src_xsize, src_ysize,
+                            pabyWholeBuffer, dst_xsize, dst_ysize, GDT_Byte );
 
     if( eErr != CE_None ) {
       msSetError( MS_IOERR,
@@ -1193,12 +1314,9 @@ LoadGDALImages( GDALDatasetH hDS, int band_numbers[4], int band_count,
     return -1;
   }
 
-  eErr = GDALDatasetRasterIO(
-           hDS, GF_Read,
-           src_xoff, src_yoff, src_xsize, src_ysize,
-           pafWholeRawData, dst_xsize, dst_ysize, GDT_Float32,
-           band_count, band_numbers,
-           0, 0, 0 );
+  eErr = msGDALReadBands( hDS, layer, band_numbers, band_count,
+                          src_xoff, src_yoff, src_xsize, src_ysize,
+                          pafWholeRawData, dst_xsize, dst_ysize, GDT_Float32 );
 
   if( eErr != CE_None ) {
     msSetError( MS_IOERR, "GDALDatasetRasterIO() failed: %s",
@@ -0,0 +1,631 @@
+/******************************************************************************
+ * $Id$
+ *
+ * Project:  MapServer
+ * Purpose:  Compilation of logical expressions to a flat, typed node program
+ *           that can be evaluated without re-running the bison parser.
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2005 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+/*
+** The tokens produced by msTokenizeExpression() are normally fed through
+** yyparse() every time an expression is evaluated, i.e. once per shape and
+** per class. This file turns the token list of the most common logical
+** expressions (comparisons, arithmetic, and/or/not, in, regex, length and
+** round over numeric and string attribute bindings) into a small typed tree
+** stored in a single array, with literal sub-expressions folded and constant
+** regular expressions and IN lists prepared up front.
+**
+** Anything not handled here (time and shape expressions, string functions,
+** cellsize bindings, ...) is simply not compiled and msEvalExpression() keeps
+** using yyparse(), so the parser remains the reference for the semantics.
+** A layer can be kept on yyparse() with PROCESSING "COMPILE_EXPRESSIONS=NO",
+** which msautotest uses to check that both paths agree.
+*/
+
+#include <math.h>
+
+#include "mapserver.h"
+#include "mapparser.h" /* for the IN token */
+
+enum exprNodeType { EXPR_TYPE_BOOLEAN, EXPR_TYPE_NUMBER, EXPR_TYPE_STRING };
+
+enum exprNodeOp {
+  EXPR_OP_LITERAL, EXPR_OP_BINDING_NUMBER, EXPR_OP_BINDING_STRING,
+  EXPR_OP_AND, EXPR_OP_OR, EXPR_OP_NOT,
+  EXPR_OP_EQ, EXPR_OP_NE, EXPR_OP_GT, EXPR_OP_LT, EXPR_OP_GE, EXPR_OP_LE, EXPR_OP_IEQ,
+  EXPR_OP_RE, EXPR_OP_IRE, EXPR_OP_IN,
+  EXPR_OP_ADD, EXPR_OP_SUB, EXPR_OP_MUL, EXPR_OP_DIV, EXPR_OP_MOD, EXPR_OP_POW,
+  EXPR_OP_LENGTH, EXPR_OP_ROUND
+};
+
+typedef struct {
+  int op;
+  int type; /* result type, one of exprNodeType */
+  int left, right; /* child node indexes, -1 if unused */
+  int canfail; /* evaluation of this subtree may raise an error (e.g. division by zero) */
+
+  double dblval; /* number or boolean literal */
+  const char *strval; /* string literal, points into the expression tokens */
+  int itemindex; /* attribute bindings */
+
+  ms_regex_t *regex; /* pre-compiled regex for a literal pattern */
+  int regexstatus; /* MS_SUCCESS or MS_FAILURE (invalid pattern never matches) */
+
+  char **list; /* pre-split IN list for a literal right hand side */
+  double *dbllist;
+  int numlist;
+} exprNodeObj;
+
+struct exprProgramObj {
+  exprNodeObj *nodes;
+  int numnodes;
+  int root;
+};
+
+typedef struct {
+  int type;
+  double dblval;
+  const char *strval;
+} exprValueObj;
+
+typedef struct {
+  tokenListNodeObjPtr token; /* current token */
+  exprProgramObj *program;
+  int maxnodes;
+} exprCompilerObj;
+
+static int exprEvalNode(exprProgramObj *program, int n, shapeObj *shape, exprValueObj *value);
+
+/*
+** Binary operator precedence, mirrors the %left declarations in mapparser.y.
+*/
+#define EXPR_PREC_OR  1
+#define EXPR_PREC_AND 2
+#define EXPR_PREC_NOT 3
+#define EXPR_PREC_CMP 4
+#define EXPR_PREC_ADD 6
+#define EXPR_PREC_MUL 7
+#define EXPR_PREC_POW 9
+
+static int exprBinaryOperator(int token, int *op, int *prec)
+{
+  switch(token) {
+    case MS_TOKEN_LOGICAL_OR: *op = EXPR_OP_OR; *prec = EXPR_PREC_OR; break;
+    case MS_TOKEN_LOGICAL_AND: *op = EXPR_OP_AND; *prec = EXPR_PREC_AND; break;
+    case MS_TOKEN_COMPARISON_EQ: *op = EXPR_OP_EQ; *prec = EXPR_PREC_CMP; break;
+    case MS_TOKEN_COMPARISON_NE: *op = EXPR_OP_NE; *prec = EXPR_PREC_CMP; break;
+    case MS_TOKEN_COMPARISON_GT: *op = EXPR_OP_GT; *prec = EXPR_PREC_CMP; break;
+    case MS_TOKEN_COMPARISON_LT: *op = EXPR_OP_LT; *prec = EXPR_PREC_CMP; break;
+    case MS_TOKEN_COMPARISON_GE: *op = EXPR_OP_GE; *prec = EXPR_PREC_CMP; break;
+    case MS_TOKEN_COMPARISON_LE: *op = EXPR_OP_LE; *prec = EXPR_PREC_CMP; break;
+    case MS_TOKEN_COMPARISON_IEQ: *op = EXPR_OP_IEQ; *prec = EXPR_PREC_CMP; break;
+    case MS_TOKEN_COMPARISON_RE: *op = EXPR_OP_RE; *prec = EXPR_PREC_CMP; break;
+    case MS_TOKEN_COMPARISON_IRE: *op = EXPR_OP_IRE; *prec = EXPR_PREC_CMP; break;
+    case IN: *op = EXPR_OP_IN; *prec = EXPR_PREC_CMP; break;
+    case '+': *op = EXPR_OP_ADD; *prec = EXPR_PREC_ADD; break;
+    case '-': *op = EXPR_OP_SUB; *prec = EXPR_PREC_ADD; break;
+    case '*': *op = EXPR_OP_MUL; *prec = EXPR_PREC_MUL; break;
+    case '/': *op = EXPR_OP_DIV; *prec = EXPR_PREC_MUL; break;
+    case '%': *op = EXPR_OP_MOD; *prec = EXPR_PREC_MUL; break;
+    case '^': *op = EXPR_OP_POW; *prec = EXPR_PREC_POW; break;
+    default: return MS_FALSE;
+  }
+  return MS_TRUE;
+}
+
+static int exprNewNode(exprCompilerObj *c, int op, int type)
+{
+  exprNodeObj *node;
+
+  if(c->program->numnodes >= c->maxnodes) return -1; /* should never happen */
+
+  node = &(c->program->nodes[c->program->numnodes]);
+  memset(node, 0, sizeof(exprNodeObj));
+  node->op = op;
+  node->type = type;
+  node->left = node->right = -1;
+  node->itemindex = -1;
+  node->regexstatus = MS_SUCCESS;
+
+  return c->program->numnodes++;
+}
+
+/*
+** Checks operand types the same way the grammar does. Anything the grammar
+** would reject makes the compilation fail so that yyparse() reports the error.
+*/
+static int exprResultType(int op, int ltype, int rtype)
+{
+  switch(op) {
+    case EXPR_OP_AND:
+    case EXPR_OP_OR:
+      if(ltype == EXPR_TYPE_STRING || rtype == EXPR_TYPE_STRING) return -1;
+      return EXPR_TYPE_BOOLEAN;
+    case EXPR_OP_EQ:
+      if(ltype != rtype) return -1;
+      return EXPR_TYPE_BOOLEAN;
+    case EXPR_OP_NE:
+    case EXPR_OP_GT:
+    case EXPR_OP_LT:
+    case EXPR_OP_GE:
+    case EXPR_OP_LE:
+    case EXPR_OP_IEQ:
+      if(ltype != rtype || ltype == EXPR_TYPE_BOOLEAN) return -1;
+      return EXPR_TYPE_BOOLEAN;
+    case EXPR_OP_RE:
+    case EXPR_OP_IRE:
+      if(ltype != EXPR_TYPE_STRING || rtype != EXPR_TYPE_STRING) return -1;
+      return EXPR_TYPE_BOOLEAN;
+    case EXPR_OP_IN:
+      if(ltype == EXPR_TYPE_BOOLEAN || rtype != EXPR_TYPE_STRING) return -1;
+      return EXPR_TYPE_BOOLEAN;
+    default: /* arithmetic, string concatenation is left to the parser */
+      if(ltype != EXPR_TYPE_NUMBER || rtype != EXPR_TYPE_NUMBER) return -1;
+      return EXPR_TYPE_NUMBER;
+  }
+}
+
+/*
+** Splits an IN list on commas, unlike msStringSplit() empty items are kept
+** to match the parser.
+*/
+static char **exprSplitList(const char *string, int *numitems)
+{
+  const char *start, *end;
+  char **list;
+  int i, n = 1;
+
+  for(start=string; (start = strchr(start, ',')) != NULL; start++)
+    n++;
+
+  list = (char **) msSmallMalloc(sizeof(char *)*n);
+  start = string;
+  for(i=0; i<n-1; i++) {
+    end = strchr(start, ',');
+    list[i] = (char *) msSmallMalloc(end-start+1);
+    strlcpy(list[i], start, end-start+1);
+    start = end+1;
+  }
+  list[n-1] = msStrdup(start);
+
+  *numitems = n;
+  return list;
+}
+
+/*
+** Prepares constant operands (regex patterns, IN lists) and folds literal-only
+** sub-expressions into a single literal node.
+*/
+static void exprOptimizeNode(exprProgramObj *program, int n)
+{
+  exprNodeObj *node = &(program->nodes[n]);
+  exprNodeObj *right = (node->right >= 0)?&(program->nodes[node->right]):NULL;
+  exprValueObj value;
+
+  if((node->op == EXPR_OP_RE || node->op == EXPR_OP_IRE) && right->op == EXPR_OP_LITERAL) {
+    int flags = MS_REG_EXTENDED|MS_REG_NOSUB;
+    if(node->op == EXPR_OP_IRE) flags |= MS_REG_ICASE;
+    node->regex = (ms_regex_t *) msSmallMalloc(sizeof(ms_regex_t));
+    if(ms_regcomp(node->regex, right->strval, flags) != 0) {
+      msFree(node->regex);
+      node->regex = NULL;
+      node->regexstatus = MS_FAILURE;
+    }
+  } else if(node->op == EXPR_OP_IN && right->op == EXPR_OP_LITERAL) {
+    int i;
+    node->list = exprSplitList(right->strval, &(node->numlist));
+    if(program->nodes[node->left].type == EXPR_TYPE_NUMBER) {
+      node->dbllist = (double *) msSmallMalloc(sizeof(double)*node->numlist);
+      for(i=0; i<node->numlist; i++)
+        node->dbllist[i] = atof(node->list[i]);
+    }
+  }
+
+  /* fold the node if all of its operands are literals */
+  if(node->canfail || node->type == EXPR_TYPE_STRING) return;
+  if(node->left >= 0 && program->nodes[node->left].op != EXPR_OP_LITERAL) return;
+  if(node->right >= 0 && program->nodes[node->right].op != EXPR_OP_LITERAL) return;
+
+  if(exprEvalNode(program, n, NULL, &value) != MS_SUCCESS) return;
+
+  if(node->list) msFreeCharArray(node->list, node->numlist);
+  msFree(node->dbllist);
+  if(node->regex) {
+    ms_regfree(node->regex);
+    msFree(node->regex);
+  }
+  memset(node, 0, sizeof(exprNodeObj));
+  node->op = EXPR_OP_LITERAL;
+  node->type = value.type;
+  node->dblval = value.dblval;
+  node->left = node->right = -1;
+  node->itemindex = -1;
+}
+
+static int exprParse(exprCompilerObj *c, int minprec);
+
+static int exprParsePrimary(exprCompilerObj *c)
+{
+  tokenListNodeObjPtr token = c->token;
+  int n, arg1, arg2;
+
+  if(!token) return -1;
+  c->token = token->next;
+
+  switch(token->token) {
+    case MS_TOKEN_LITERAL_BOOLEAN:
+      if((n = exprNewNode(c, EXPR_OP_LITERAL, EXPR_TYPE_BOOLEAN)) < 0) return -1;
+      c->program->nodes[n].dblval = (int) token->tokenval.dblval;
+      return n;
+    case MS_TOKEN_LITERAL_NUMBER:
+      if((n = exprNewNode(c, EXPR_OP_LITERAL, EXPR_TYPE_NUMBER)) < 0) return -1;
+      c->program->nodes[n].dblval = token->tokenval.dblval;
+      return n;
+    case MS_TOKEN_LITERAL_STRING:
+      if((n = exprNewNode(c, EXPR_OP_LITERAL, EXPR_TYPE_STRING)) < 0) return -1;
+      c->program->nodes[n].strval = token->tokenval.strval;
+      return n;
+    case MS_TOKEN_BINDING_DOUBLE:
+    case MS_TOKEN_BINDING_INTEGER:
+      if(token->tokenval.bindval.index < 0) return -1;
+      if((n = exprNewNode(c, EXPR_OP_BINDING_NUMBER, EXPR_TYPE_NUMBER)) < 0) return -1;
+      c->program->nodes[n].itemindex = token->tokenval.bindval.index;
+      return n;
+    case MS_TOKEN_BINDING_STRING:
+      if(token->tokenval.bindval.index < 0) return -1;
+      if((n = exprNewNode(c, EXPR_OP_BINDING_STRING, EXPR_TYPE_STRING)) < 0) return -1;
+      c->program->nodes[n].itemindex = token->tokenval.bindval.index;
+      return n;
+    case '(':
+      if((n = exprParse(c, 0)) < 0) return -1;
+      if(!c->token || c->token->token != ')') return -1;
+      c->token = c->token->next;
+      return n;
+    case MS_TOKEN_LOGICAL_NOT:
+      if((arg1 = exprParse(c, EXPR_PREC_CMP)) < 0) return -1;
+      if(c->program->nodes[arg1].type == EXPR_TYPE_STRING) return -1;
+      if((n = exprNewNode(c, EXPR_OP_NOT, EXPR_TYPE_BOOLEAN)) < 0) return -1;
+      c->program->nodes[n].left = arg1;
+      c->program->nodes[n].canfail = c->program->nodes[arg1].canfail;
+      exprOptimizeNode(c->program, n);
+      return n;
+    case MS_TOKEN_FUNCTION_LENGTH:
+      if(!c->token || c->token->token != '(') return -1;
+      c->token = c->token->next;
+      if((arg1 = exprParse(c, 0)) < 0) return -1;
+      if(!c->token || c->token->token != ')') return -1;
+      c->token = c->token->next;
+      if(c->program->nodes[arg1].type != EXPR_TYPE_STRING) return -1;
+      if((n = exprNewNode(c, EXPR_OP_LENGTH, EXPR_TYPE_NUMBER)) < 0) return -1;
+      c->program->nodes[n].left = arg1;
+      return n;
+    case MS_TOKEN_FUNCTION_ROUND:
+      if(!c->token || c->token->token != '(') return -1;
+      c->token = c->token->next;
+      if((arg1 = exprParse(c, 0)) < 0) return -1;
+      if(!c->token || c->token->token != ',') return -1;
+      c->token = c->token->next;
+      if((arg2 = exprParse(c, 0)) < 0) return -1;
+      if(!c->token || c->token->token != ')') return -1;
+      c->token = c->token->next;
+      if(c->program->nodes[arg1].type != EXPR_TYPE_NUMBER || c->program->nodes[arg2].type != EXPR_TYPE_NUMBER) return -1;
+      if((n = exprNewNode(c, EXPR_OP_ROUND, EXPR_TYPE_NUMBER)) < 0) return -1;
+      c->program->nodes[n].left = arg1;
+      c->program->nodes[n].right = arg2;
+      c->program->nodes[n].canfail = c->program->nodes[arg1].canfail || c->program->nodes[arg2].canfail;
+      exprOptimizeNode(c->program, n);
+      return n;
+    default: /* unary minus, time, shape and string functions are left to the parser */
+      return -1;
+  }
+}
+
+/*
+** Precedence climbing over the token list.
+*/
+static int exprParse(exprCompilerObj *c, int minprec)
+{
+  int lhs, rhs, n, op, prec, type;
+
+  if((lhs = exprParsePrimary(c)) < 0) return -1;
+
+  while(c->token && exprBinaryOperator(c->token->token, &op, &prec) && prec >= minprec) {
+    c->token = c->token->next;
+
+    /* '^' is right associative, everything else is left associative */
+    if((rhs = exprParse(c, (op == EXPR_OP_POW)?prec:prec+1)) < 0) return -1;
+
+    if((type = exprResultType(op, c->program->nodes[lhs].type, c->program->nodes[rhs].type)) < 0) return -1;
+    if((n = exprNewNode(c, op, type)) < 0) return -1;
+    c->program->nodes[n].left = lhs;
+    c->program->nodes[n].right = rhs;
+    c->program->nodes[n].canfail = c->program->nodes[lhs].canfail || c->program->nodes[rhs].canfail || op == EXPR_OP_DIV || op == EXPR_OP_MOD;
+    exprOptimizeNode(c->program, n);
+    lhs = n;
+  }
+
+  return lhs;
+}
+
+static int exprStringInList(const char *value, const char *list)
+{
+  const char *start = list, *end;
+  size_t value_len = strlen(value);
+
+  while((end = strchr(start, ',')) != NULL) {
+    if(value_len == (size_t)(end-start) && strncmp(start, value, end-start) == 0) return MS_TRUE;
+    start = end+1;
+  }
+  return (strcmp(start, value) == 0)?MS_TRUE:MS_FALSE;
+}
+
+static int exprNumberInList(double value, const char *list)
+{
+  const char *start = list, *end;
+
+  while((end = strchr(start, ',')) != NULL) {
+    if(value == atof(start)) return MS_TRUE;
+    start = end+1;
+  }
+  return (value == atof(start))?MS_TRUE:MS_FALSE;
+}
+
+static int exprRegexMatch(exprNodeObj *node, const char *string, const char *pattern)
+{
+  ms_regex_t re;
+  int flags, status;
+
+  if(MS_STRING_IS_NULL_OR_EMPTY(string) == MS_TRUE) return MS_FALSE;
+
+  if(node->regex) return (ms_regexec(node->regex, string, 0, NULL, 0) == 0)?MS_TRUE:MS_FALSE;
+  if(node->regexstatus != MS_SUCCESS) return MS_FALSE; /* invalid literal pattern */
+
+  flags = MS_REG_EXTENDED|MS_REG_NOSUB;
+  if(node->op == EXPR_OP_IRE) flags |= MS_REG_ICASE;
+  if(ms_regcomp(&re, pattern, flags) != 0) return MS_FALSE;
+  status = (ms_regexec(&re, string, 0, NULL, 0) == 0)?MS_TRUE:MS_FALSE;
+  ms_regfree(&re);
+
+  return status;
+}
+
+#define EXPR_TRUTH(v) (((v).type == EXPR_TYPE_STRING)?MS_TRUE:((v).dblval != 0))
+
+static int exprEvalNode(exprProgramObj *program, int n, shapeObj *shape, exprValueObj *value)
+{
+  exprNodeObj *node = &(program->nodes[n]);
+  exprValueObj l, r;
+
+  value->type = node->type;
+  value->strval = NULL;
+
+  switch(node->op) {
+    case EXPR_OP_LITERAL:
+      value->dblval = node->dblval;
+      value->strval = node->strval;
+      return MS_SUCCESS;
+    case EXPR_OP_BINDING_NUMBER:
+    case EXPR_OP_BINDING_STRING:
+      if(!shape || node->itemindex >= shape->numvalues) {
+        msSetError(MS_MISCERR, "Invalid item index.", "msEvalCompiledExpression()");
+        return MS_FAILURE;
+      }
+      if(node->op == EXPR_OP_BINDING_NUMBER)
+        value->dblval = atof(shape->values[node->itemindex]);
+      else
+        value->strval = shape->values[node->itemindex];
+      return MS_SUCCESS;
+    case EXPR_OP_NOT:
+      if(exprEvalNode(program, node->left, shape, &l) != MS_SUCCESS) return MS_FAILURE;
+      value->dblval = !EXPR_TRUTH(l);
+      return MS_SUCCESS;
+    case EXPR_OP_AND:
+    case EXPR_OP_OR:
+      if(exprEvalNode(program, node->left, shape, &l) != MS_SUCCESS) return MS_FAILURE;
+      /* the parser always evaluates both sides, only short-circuit if that can't raise an error */
+      if(!program->nodes[node->right].canfail) {
+        if(node->op == EXPR_OP_AND && !EXPR_TRUTH(l)) {
+          value->dblval = MS_FALSE;
+          return MS_SUCCESS;
+        }
+        if(node->op == EXPR_OP_OR && EXPR_TRUTH(l)) {
+          value->dblval = MS_TRUE;
+          return MS_SUCCESS;
+        }
+      }
+      if(exprEvalNode(program, node->right, shape, &r) != MS_SUCCESS) return MS_FAILURE;
+      if(node->op == EXPR_OP_AND)
+        value->dblval = (EXPR_TRUTH(l) && EXPR_TRUTH(r))?MS_TRUE:MS_FALSE;
+      else
+        value->dblval = (EXPR_TRUTH(l) || EXPR_TRUTH(r))?MS_TRUE:MS_FALSE;
+      return MS_SUCCESS;
+    case EXPR_OP_LENGTH:
+      if(exprEvalNode(program, node->left, shape, &l) != MS_SUCCESS) return MS_FAILURE;
+      value->dblval = strlen(l.strval);
+      return MS_SUCCESS;
+    default:
+      break;
+  }
+
+  /* binary operators */
+  if(exprEvalNode(program, node->left, shape, &l) != MS_SUCCESS) return MS_FAILURE;
+  if(exprEvalNode(program, node->right, shape, &r) != MS_SUCCESS) return MS_FAILURE;
+
+  if(l.type == EXPR_TYPE_STRING && r.type == EXPR_TYPE_STRING) {
+    int cmp;
+    switch(node->op) {
+      case EXPR_OP_RE:
+      case EXPR_OP_IRE:
+        value->dblval = exprRegexMatch(node, l.strval, r.strval);
+        return MS_SUCCESS;
+      case EXPR_OP_IN:
+        if(node->list) {
+          int i;
+          value->dblval = MS_FALSE;
+          for(i=0; i<node->numlist; i++) {
+            if(strcmp(l.strval, node->list[i]) == 0) {
+              value->dblval = MS_TRUE;
+              break;
+            }
+          }
+        } else
+          value->dblval = exprStringInList(l.strval, r.strval);
+        return MS_SUCCESS;
+      case EXPR_OP_IEQ:
+        value->dblval = (strcasecmp(l.strval, r.strval) == 0);
+        return MS_SUCCESS;
+      default:
+        break;
+    }
+    cmp = strcmp(l.strval, r.strval);
+    switch(node->op) {
+      case EXPR_OP_EQ: value->dblval = (cmp == 0); break;
+      case EXPR_OP_NE: value->dblval = (cmp != 0); break;
+      case EXPR_OP_GT: value->dblval = (cmp > 0); break;
+      case EXPR_OP_LT: value->dblval = (cmp < 0); break;
+      case EXPR_OP_GE: value->dblval = (cmp >= 0); break;
+      case EXPR_OP_LE: value->dblval = (cmp <= 0); break;
+      default: return MS_FAILURE;
+    }
+    return MS_SUCCESS;
+  }
+
+  if(node->op == EXPR_OP_IN) { /* number in string list */
+    if(node->dbllist) {
+      int i;
+      value->dblval = MS_FALSE;
+      for(i=0; i<node->numlist; i++) {
+        if(l.dblval == node->dbllist[i]) {
+          value->dblval = MS_TRUE;
+          break;
+        }
+      }
+    } else
+      value->dblval = exprNumberInList(l.dblval, r.strval);
+    return MS_SUCCESS;
+  }
+
+  switch(node->op) {
+    case EXPR_OP_EQ:
+    case EXPR_OP_IEQ:
+      value->dblval = (l.dblval == r.dblval); break;
+    case EXPR_OP_NE: value->dblval = (l.dblval != r.dblval); break;
+    case EXPR_OP_GT: value->dblval = (l.dblval > r.dblval); break;
+    case EXPR_OP_LT: value->dblval = (l.dblval < r.dblval); break;
+    case EXPR_OP_GE: value->dblval = (l.dblval >= r.dblval); break;
+    case EXPR_OP_LE: value->dblval = (l.dblval <= r.dblval); break;
+    case EXPR_OP_ADD: value->dblval = l.dblval + r.dblval; break;
+    case EXPR_OP_SUB: value->dblval = l.dblval - r.dblval; break;
+    case EXPR_OP_MUL: value->dblval = l.dblval * r.dblval; break;
+    case EXPR_OP_DIV:
+      if(r.dblval == 0.0) {
+        msSetError(MS_PARSEERR, "Division by zero.", "msEvalCompiledExpression()");
+        return MS_FAILURE;
+      }
+      value->dblval = l.dblval / r.dblval;
+      break;
+    case EXPR_OP_MOD:
+      if((int)r.dblval == 0) {
+        msSetError(MS_PARSEERR, "Division by zero.", "msEvalCompiledExpression()");
+        return MS_FAILURE;
+      }
+      value->dblval = (int)l.dblval % (int)r.dblval;
+      break;
+    case EXPR_OP_POW: value->dblval = pow(l.dblval, r.dblval); break;
+    case EXPR_OP_ROUND: value->dblval = (MS_NINT(l.dblval/r.dblval))*r.dblval; break;
+    default:
+      return MS_FAILURE;
+  }
+
+  return MS_SUCCESS;
+}
+
+/*
+** Compiles the token list of an MS_EXPRESSION into expression->program. The
+** tokens must already be bound to the layer items (msLayerWhichItems()).
+** Returns MS_FAILURE, without setting an error, if the expression uses
+** constructs that must be evaluated through yyparse().
+*/
+int msCompileExpression(expressionObj *expression)
+{
+  exprCompilerObj c;
+  tokenListNodeObjPtr token;
+  int numtokens = 0;
+
+  if(expression->program) return MS_SUCCESS;
+  if(expression->type != MS_EXPRESSION || expression->tokens == NULL) return MS_FAILURE;
+
+  for(token=expression->tokens; token; token=token->next)
+    numtokens++;
+
+  c.program = (exprProgramObj *) msSmallMalloc(sizeof(exprProgramObj));
+  c.program->nodes = (exprNodeObj *) msSmallMalloc(sizeof(exprNodeObj)*numtokens);
+  c.program->numnodes = 0;
+  c.maxnodes = numtokens;
+  c.token = expression->tokens;
+
+  c.program->root = exprParse(&c, 0);
+  if(c.program->root < 0 || c.token != NULL) {
+    msFreeExpressionProgram(c.program);
+    return MS_FAILURE;
+  }
+
+  expression->program = c.program;
+  return MS_SUCCESS;
+}
+
+/*
+** Evaluates a compiled expression against a shape, the result follows the
+** MS_PARSE_TYPE_BOOLEAN rules of the parser.
+*/
+int msEvalCompiledExpression(expressionObj *expression, shapeObj *shape, int *result)
+{
+  exprValueObj value;
+
+  if(exprEvalNode(expression->program, expression->program->root, shape, &value) != MS_SUCCESS)
+    return MS_FAILURE;
+
+  *result = EXPR_TRUTH(value)?MS_TRUE:MS_FALSE;
+  return MS_SUCCESS;
+}
+
+void msFreeExpressionProgram(exprProgramObj *program)
+{
+  int i;
+
+  if(!program) return;
+
+  for(i=0; i<program->numnodes; i++) {
+    exprNodeObj *node = &(program->nodes[i]);
+    if(node->list) msFreeCharArray(node->list, node->numlist);
+    msFree(node->dbllist);
+    if(node->regex) {
+      ms_regfree(node->regex);
+      msFree(node->regex);
+    }
+  }
+  msFree(program->nodes);
+  msFree(program);
+}
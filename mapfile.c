@@ -60,6 +60,7 @@ extern int msyysource;
 extern int msyystate;
 extern char *msyystring;
 extern char *msyybasepath;
+extern hashTableObj *msyyincludes;
 extern int msyyreturncomments;
 extern char *msyystring_buffer;
 extern int msyystring_icase;
@@ -2161,6 +2162,8 @@ void msInitExpression(expressionObj *exp)
   exp->compiled = MS_FALSE;
   exp->flags = 0;
   exp->tokens = exp->curtoken = NULL;
+  exp->program = NULL;
+  exp->program_failed = MS_FALSE;
 }
 
 void msFreeExpressionTokens(expressionObj *exp)
@@ -2170,6 +2173,11 @@ void msFreeExpressionTokens(expressionObj *exp)
 
   if(!exp) return;
 
+  /* the compiled program refers to the tokens and their item indexes */
+  msFreeExpressionProgram(exp->program);
+  exp->program = NULL;
+  exp->program_failed = MS_FALSE;
+
   if(exp->tokens) {
     node = exp->tokens;
     while (node != NULL) {
@@ -3866,6 +3874,7 @@ int initLayer(layerObj *layer, mapObj *map)
   layer->orig_st = NULL;
 
   layer->compositer = NULL;
+  layer->shapepool = NULL;
 
   return(0);
 }
@@ -3995,6 +4004,7 @@ int freeLayer(layerObj *layer)
   msFree(layer->sortBy.properties);
 
   freeLayerCompositers(layer->compositer);
+  msFreeShapePool(layer->shapepool);
 
   return MS_SUCCESS;
 }
@@ -6098,6 +6108,9 @@ int initMap(mapObj *map)
     map->labelcache.slots[i].markercachesize = 0;
     map->labelcache.slots[i].nummarkers = 0;
   }
+  map->labelcache.rendered_text_symbols = NULL;
+  map->labelcache.num_allocated_rendered_members = map->labelcache.num_rendered_members = 0;
+  map->labelcache.grid = NULL;
 
   map->fontset.filename = NULL;
   map->fontset.numfonts = 0;
@@ -6245,6 +6258,7 @@ int msFreeLabelCache(labelCacheObj *cache)
 
   cache->num_allocated_rendered_members = cache->num_rendered_members = 0;
   msFree(cache->rendered_text_symbols);
+  msFreeLabelCacheGrid(cache);
 
   return MS_SUCCESS;
 }
@@ -6281,6 +6295,7 @@ int msInitLabelCache(labelCacheObj *cache)
   cache->gutter = 0;
   cache->num_allocated_rendered_members = cache->num_rendered_members = 0;
   cache->rendered_text_symbols = NULL;
+  cache->grid = NULL;
 
   return MS_SUCCESS;
 }
@@ -6675,6 +6690,16 @@ mapObj *msLoadMapFromString(char *buffer, char *new_mappath)
 ** Sets up file-based mapfile loading and calls loadMapInternal to do the work.
 */
 mapObj *msLoadMap(char *filename, char *new_mappath)
+{
+  return msLoadMapWithIncludes(filename, new_mappath, NULL);
+}
+
+/*
+** Same as msLoadMap(), but if includes is not NULL the full path of every
+** INCLUDEd file opened while parsing is added to it as a key (used by the
+** mapfile cache to detect changes in included files).
+*/
+mapObj *msLoadMapWithIncludes(char *filename, char *new_mappath, hashTableObj *includes)
 {
   mapObj *map;
   struct mstimeval starttime, endtime;
@@ -6768,8 +6793,10 @@ mapObj *msLoadMap(char *filename, char *new_mappath)
   }
 
   msyybasepath = map->mappath; /* for INCLUDEs */
+  msyyincludes = includes;
 
   if(loadMapInternal(map) != MS_SUCCESS) {
+    msyyincludes = NULL;
     msFreeMap(map);
     msReleaseLock( TLOCK_PARSER );
     if( msyyin ) {
@@ -6778,6 +6805,7 @@ mapObj *msLoadMap(char *filename, char *new_mappath)
     }
     return NULL;
   }
+  msyyincludes = NULL;
   msReleaseLock( TLOCK_PARSER );
 
   if (debuglevel >= MS_DEBUGLEVEL_TUNING) {
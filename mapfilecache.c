@@ -0,0 +1,316 @@
+/******************************************************************************
+ * $Id$
+ *
+ * Project:  MapServer
+ * Purpose:  Process-wide cache of parsed mapfiles for persistent servers
+ *           (FastCGI, mod_mapserver).
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2016 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "mapserver.h"
+#include "mapthread.h"
+
+/************************************************************************/
+/*                          mapFileCacheObj                             */
+/*                                                                      */
+/*      A pristine mapObj as returned by msLoadMap(), along with what    */
+/*      is needed to detect that it went stale: the modification time   */
+/*      and size of the mapfile and of every file it INCLUDEs. Entries  */
+/*      are kept in most recently used order, callers only ever get     */
+/*      their own copy of the cached mapObj.                             */
+/*                                                                      */
+/*      An entry is never modified once in the cache. The lock only     */
+/*      guards the list and the reference counts: parsing, checking     */
+/*      the files and copying the map are done without it, holding a    */
+/*      reference so that the entry outlives its eviction.              */
+/************************************************************************/
+typedef struct mapFileCacheObj {
+  char *filename;
+  time_t mtime;
+  off_t size;
+  hashTableObj *includes; /* full path -> "mtime:size" */
+  mapObj *map;
+  int refcount;
+  int evicted; /* no longer in the list, freed with the last reference */
+  struct mapFileCacheObj *next;
+} mapFileCacheObj;
+
+static mapFileCacheObj *mapFileCache = NULL;
+static int mapFileCacheSize = 0;
+
+static void freeMapFileCacheObj(mapFileCacheObj *entry)
+{
+  msFree(entry->filename);
+  msFreeHashTable(entry->includes);
+  msFreeMap(entry->map);
+  free(entry);
+}
+
+static void formatFileStat(char *buffer, size_t size, struct stat *sStat)
+{
+  snprintf(buffer, size, "%ld:%ld", (long) sStat->st_mtime, (long) sStat->st_size);
+}
+
+/*
+** Returns MS_TRUE if none of the files INCLUDEd by the cached mapfile has
+** been modified or removed since it was parsed.
+*/
+static int includesAreCurrent(mapFileCacheObj *entry)
+{
+  const char *path;
+  char szStat[64];
+  struct stat sStat;
+
+  for(path = msFirstKeyFromHashTable(entry->includes); path != NULL;
+      path = msNextKeyFromHashTable(entry->includes, path)) {
+    if(stat(path, &sStat) != 0)
+      return MS_FALSE;
+    formatFileStat(szStat, sizeof(szStat), &sStat);
+    if(strcmp(szStat, msLookupHashTable(entry->includes, path)) != 0)
+      return MS_FALSE;
+  }
+  return MS_TRUE;
+}
+
+/*
+** Unlinks an entry, which is freed now if unused or else by whoever releases
+** the last reference. Called with the lock held, entries to free are added
+** to *ppsFree.
+*/
+static void evictMapFileCacheObj(mapFileCacheObj **ppsEntry, mapFileCacheObj **ppsFree)
+{
+  mapFileCacheObj *entry = *ppsEntry;
+
+  *ppsEntry = entry->next;
+  entry->evicted = MS_TRUE;
+  entry->next = NULL;
+  if(entry->refcount == 0) {
+    entry->next = *ppsFree;
+    *ppsFree = entry;
+  }
+}
+
+/* Drops the least recently used entries beyond the configured size. */
+static void trimMapFileCache(mapFileCacheObj **ppsFree)
+{
+  mapFileCacheObj **ppsEntry = &mapFileCache;
+  int n = 0;
+
+  while(*ppsEntry) {
+    if(n >= mapFileCacheSize) {
+      evictMapFileCacheObj(ppsEntry, ppsFree);
+      continue;
+    }
+    n++;
+    ppsEntry = &((*ppsEntry)->next);
+  }
+}
+
+static void freeMapFileCacheList(mapFileCacheObj *entry)
+{
+  while(entry) {
+    mapFileCacheObj *next = entry->next;
+    freeMapFileCacheObj(entry);
+    entry = next;
+  }
+}
+
+static void releaseMapFileCacheObj(mapFileCacheObj *entry)
+{
+  int bFree;
+
+  msAcquireLock(TLOCK_MAPFILECACHE);
+  entry->refcount--;
+  bFree = (entry->evicted && entry->refcount == 0);
+  msReleaseLock(TLOCK_MAPFILECACHE);
+
+  if(bFree)
+    freeMapFileCacheObj(entry);
+}
+
+/*
+** Sets the maximum number of distinct mapfiles kept in the cache. A size of
+** 0 (the default) disables caching altogether.
+*/
+void msMapFileCacheSetSize(int size)
+{
+  mapFileCacheObj *psFree = NULL;
+
+  msAcquireLock(TLOCK_MAPFILECACHE);
+  mapFileCacheSize = MS_MAX(size, 0);
+  trimMapFileCache(&psFree);
+  msReleaseLock(TLOCK_MAPFILECACHE);
+
+  freeMapFileCacheList(psFree);
+}
+
+int msMapFileCacheGetSize(void)
+{
+  return mapFileCacheSize;
+}
+
+/*
+** Drop-in replacement for msLoadMap() for servers handling many requests in
+** the same process. The first call for a given mapfile parses it and keeps the
+** resulting mapObj, later calls return a copy of it (see msCopyMap()) for as
+** long as neither the mapfile nor any of its INCLUDEs changed on disk. The
+** returned mapObj belongs to the caller, who is free to modify it and must
+** release it with msFreeMap().
+**
+** Maps loaded with a new_mappath are never cached.
+*/
+mapObj *msLoadMapFromCache(char *filename, char *new_mappath)
+{
+  mapFileCacheObj *entry, **ppsEntry, *psFree = NULL;
+  mapObj *map;
+  struct stat sStat;
+  char szStat[64];
+  const char *path;
+
+  if(mapFileCacheSize <= 0 || new_mappath != NULL || filename == NULL)
+    return msLoadMap(filename, new_mappath);
+
+  /* let msLoadMap() report validation and i/o errors */
+  if(stat(filename, &sStat) != 0)
+    return msLoadMap(filename, NULL);
+
+  msAcquireLock(TLOCK_MAPFILECACHE);
+  for(entry = mapFileCache; entry != NULL; entry = entry->next) {
+    if(strcmp(entry->filename, filename) == 0) {
+      entry->refcount++;
+      break;
+    }
+  }
+  msReleaseLock(TLOCK_MAPFILECACHE);
+
+  if(entry && (entry->mtime != sStat.st_mtime || entry->size != sStat.st_size || !includesAreCurrent(entry))) {
+    if(entry->map->debug >= MS_DEBUGLEVEL_V)
+      msDebug("msLoadMapFromCache(): %s changed on disk, reloading.\n", filename);
+
+    msAcquireLock(TLOCK_MAPFILECACHE);
+    for(ppsEntry = &mapFileCache; *ppsEntry != NULL; ppsEntry = &((*ppsEntry)->next)) {
+      if(*ppsEntry == entry) {
+        evictMapFileCacheObj(ppsEntry, &psFree);
+        break;
+      }
+    }
+    msReleaseLock(TLOCK_MAPFILECACHE);
+    releaseMapFileCacheObj(entry);
+    entry = NULL;
+  }
+
+  if(!entry) {
+    hashTableObj *includes = msCreateHashTable();
+    map = msLoadMapWithIncludes(filename, NULL, includes);
+    if(!map) {
+      msFreeHashTable(includes);
+      freeMapFileCacheList(psFree);
+      return NULL;
+    }
+
+    /*
+    ** The mapfile itself was stat()ed before parsing so that a change made
+    ** while parsing triggers a reload, the INCLUDEs are only known now.
+    */
+    for(path = msFirstKeyFromHashTable(includes); path != NULL;
+        path = msNextKeyFromHashTable(includes, path)) {
+      struct stat sIncStat;
+      if(stat(path, &sIncStat) == 0)
+        formatFileStat(szStat, sizeof(szStat), &sIncStat);
+      else
+        strcpy(szStat, "");
+      msInsertHashTable(includes, path, szStat);
+    }
+
+    entry = (mapFileCacheObj *) msSmallMalloc(sizeof(mapFileCacheObj));
+    entry->filename = msStrdup(filename);
+    entry->mtime = sStat.st_mtime;
+    entry->size = sStat.st_size;
+    entry->includes = includes;
+    entry->map = map;
+    entry->refcount = 1;
+    entry->evicted = MS_FALSE;
+
+    /* another thread may have parsed the same mapfile meanwhile, ours is newer */
+    msAcquireLock(TLOCK_MAPFILECACHE);
+    ppsEntry = &mapFileCache;
+    while(*ppsEntry != NULL) {
+      if(strcmp((*ppsEntry)->filename, filename) == 0)
+        evictMapFileCacheObj(ppsEntry, &psFree);
+      else
+        ppsEntry = &((*ppsEntry)->next);
+    }
+    entry->next = mapFileCache;
+    mapFileCache = entry;
+    trimMapFileCache(&psFree);
+    msReleaseLock(TLOCK_MAPFILECACHE);
+  } else {
+    /* move it back in front */
+    msAcquireLock(TLOCK_MAPFILECACHE);
+    for(ppsEntry = &mapFileCache; *ppsEntry != NULL; ppsEntry = &((*ppsEntry)->next)) {
+      if(*ppsEntry == entry) {
+        *ppsEntry = entry->next;
+        entry->next = mapFileCache;
+        mapFileCache = entry;
+        break;
+      }
+    }
+    msReleaseLock(TLOCK_MAPFILECACHE);
+  }
+
+  freeMapFileCacheList(psFree);
+
+  map = msNewMapObj();
+  if(map && msCopyMap(map, entry->map) != MS_SUCCESS) {
+    msSetError(MS_MEMERR, "Failed to copy cached map %s.", "msLoadMapFromCache()", filename);
+    msFreeMap(map);
+    map = NULL;
+  }
+
+  /*
+  ** CONFIG options set process globals (MS_ERRORFILE, PROJ_LIB, GDAL/CPL
+  ** options) that another mapfile may have changed since this one was parsed.
+  */
+  if(map)
+    msApplyMapConfigOptions(map);
+
+  releaseMapFileCacheObj(entry);
+
+  return map;
+}
+
+void msMapFileCacheCleanup(void)
+{
+  mapFileCacheObj *entry;
+
+  msAcquireLock(TLOCK_MAPFILECACHE);
+  while((entry = mapFileCache) != NULL) {
+    mapFileCache = entry->next;
+    freeMapFileCacheObj(entry);
+  }
+  msReleaseLock(TLOCK_MAPFILECACHE);
+}
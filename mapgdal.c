@@ -45,6 +45,12 @@
 
 static int    bGDALInitialized = 0;
 
+/* most recently used first, each entry holds one reference on its dataset */
+static GDALDatasetH *pahDatasetCache = NULL;
+static int    nDatasetCacheCount = 0;
+
+static void msGDALTrimDatasetCache( int nCacheSize );
+
 /************************************************************************/
 /*                          msGDALInitialize()                          */
 /************************************************************************/
@@ -74,6 +80,10 @@ void msGDALCleanup( void )
     int iRepeat = 5;
     msAcquireLock( TLOCK_GDAL );
 
+    msGDALTrimDatasetCache( 0 );
+    free( pahDatasetCache );
+    pahDatasetCache = NULL;
+
 #if GDAL_RELEASE_DATE > 20101207
     {
       /*
@@ -555,10 +565,65 @@ int msInitDefaultGDALOutputFormat( outputFormatObj *format )
   return MS_SUCCESS;
 }
 
+/************************************************************************/
+/*                        msGDALTrimDatasetCache()                      */
+/************************************************************************/
+
+static void msGDALTrimDatasetCache( int nCacheSize )
+
+{
+  while( nDatasetCacheCount > MS_MAX(nCacheSize,0) )
+    GDALClose( pahDatasetCache[--nDatasetCacheCount] );
+}
+
+/************************************************************************/
+/*                         msGDALReleaseDataset()                       */
+/*                                                                      */
+/*      Give up a reference to a dataset opened with GDALOpenShared(),  */
+/*      keeping it open in a process wide cache of the nCacheSize most  */
+/*      recently released datasets so that the next request opening     */
+/*      the same file gets it back from GDALOpenShared() right away.    */
+/*      The least recently used datasets are closed. The cache keeps a  */
+/*      reference of its own, so a dataset in it is never closed from   */
+/*      under it. TLOCK_GDAL must be held, as for any use of the        */
+/*      datasets themselves.                                            */
+/************************************************************************/
+
+void msGDALReleaseDataset( void *hDSVoid, int nCacheSize )
+
+{
+  GDALDatasetH hDS = (GDALDatasetH) hDSVoid;
+  int i;
+
+  for( i = 0; i < nDatasetCacheCount; i++ ) {
+    if( pahDatasetCache[i] == hDS )
+      break;
+  }
+
+  if( i < nDatasetCacheCount ) {
+    /* already cached: drop the caller's reference, move to the front */
+    GDALDereferenceDataset( hDS );
+  } else if( nCacheSize <= 0 ) {
+    GDALClose( hDS );
+    return;
+  } else {
+    /* the cache takes over the caller's reference */
+    pahDatasetCache = (GDALDatasetH *)
+      msSmallRealloc( pahDatasetCache, sizeof(GDALDatasetH) * (nDatasetCacheCount + 1) );
+    i = nDatasetCacheCount++;
+  }
+
+  memmove( pahDatasetCache + 1, pahDatasetCache, sizeof(GDALDatasetH) * i );
+  pahDatasetCache[0] = hDS;
+
+  msGDALTrimDatasetCache( nCacheSize );
+}
+
 #else
 
 void msGDALInitialize( void ) {}
 void msGDALCleanup(void) {}
+void msGDALReleaseDataset( void *hDSVoid, int nCacheSize ) {}
 
 
 #endif /* def USE_GDAL */
@@ -1620,6 +1620,232 @@ void msGMLWriteWFSBounds(mapObj *map, FILE *stream, const char *tab,
 
 #endif
 
+#ifdef USE_WFS_SVR
+/*
+** Per layer state needed to write WFS features, shared by
+** msGMLWriteWFSQuery() and the streaming writer below.
+*/
+typedef struct {
+  layerObj *layer;
+  char *layerName;
+  const char *namespace_prefix;
+  int featureIdIndex; /* -1 if no feature id */
+  char *srs;
+  int bOutputGMLIdOnly;
+  int nSRSDimension;
+
+  gmlGroupListObj *groupList;
+  gmlItemListObj *itemList;
+  gmlConstantListObj *constantList;
+  gmlGeometryListObj *geometryList;
+} gmlWFSLayerInfo;
+
+static void gmlFreeWFSLayerInfo(gmlWFSLayerInfo *info)
+{
+  msFree(info->srs);
+  msFree(info->layerName);
+  msGMLFreeGroups(info->groupList);
+  msGMLFreeConstants(info->constantList);
+  msGMLFreeItems(info->itemList);
+  msGMLFreeGeometries(info->geometryList);
+  memset(info, 0, sizeof(gmlWFSLayerInfo));
+}
+
+static int gmlInitWFSLayerInfo(gmlWFSLayerInfo *info, mapObj *map, layerObj *lp,
+                               FILE *stream, const char *default_namespace_prefix,
+                               OWSGMLVersion outputformat, int bUseURN,
+                               int bGetPropertyValueRequest)
+{
+  const char *value;
+  const char *geomtype;
+  int j;
+
+  memset(info, 0, sizeof(gmlWFSLayerInfo));
+  info->layer = lp;
+  info->featureIdIndex = -1;
+  info->nSRSDimension = 2;
+
+  /* setup namespace, a layer can override the default */
+  info->namespace_prefix = msOWSLookupMetadata(&(lp->metadata), "OFG", "namespace_prefix");
+  if(!info->namespace_prefix) info->namespace_prefix = default_namespace_prefix;
+
+  geomtype = msOWSLookupMetadata(&(lp->metadata), "OFG", "geomtype");
+  if( geomtype != NULL && (strstr(geomtype, "25d") != NULL || strstr(geomtype, "25D") != NULL) )
+  {
+#ifdef USE_POINT_Z_M
+      info->nSRSDimension = 3;
+#else
+      msIO_fprintf(stream, "<!-- WARNING: 25d requested forn typename '%s' but MapServer compiled without USE_POINT_Z_M support. -->\n", lp->name);
+#endif
+  }
+
+  value = msOWSLookupMetadata(&(lp->metadata), "OFG", "featureid");
+  if(value) { /* find the featureid amongst the items for this layer */
+    for(j=0; j<lp->numitems; j++) {
+      if(strcasecmp(lp->items[j], value) == 0) { /* found it */
+        info->featureIdIndex = j;
+        break;
+      }
+    }
+
+    /* Produce a warning if a featureid was set but the corresponding item is not found. */
+    if (info->featureIdIndex == -1)
+      msIO_fprintf(stream, "<!-- WARNING: FeatureId item '%s' not found in typename '%s'. -->\n", value, lp->name);
+  }
+  else if( outputformat == OWS_GML32 )
+      msIO_fprintf(stream, "<!-- WARNING: No featureid defined for typename '%s'. Output will not validate. -->\n", lp->name);
+
+  /* populate item and group metadata structures */
+  info->itemList = msGMLGetItems(lp, "G");
+  info->constantList = msGMLGetConstants(lp, "G");
+  info->groupList = msGMLGetGroups(lp, "G");
+  info->geometryList = msGMLGetGeometries(lp, "GFO", MS_FALSE);
+  if (info->itemList == NULL || info->constantList == NULL ||
+      info->groupList == NULL || info->geometryList == NULL) {
+    msSetError(MS_MISCERR, "Unable to populate item and group metadata structures", "msGMLWriteWFSQuery()");
+    gmlFreeWFSLayerInfo(info);
+    return MS_FAILURE;
+  }
+
+  if( bGetPropertyValueRequest )
+  {
+    value = msOWSLookupMetadata(&(lp->metadata), "G", "include_items");
+    if( value != NULL && strcmp(value, "@gml:id") == 0 )
+        info->bOutputGMLIdOnly = MS_TRUE;
+  }
+
+  if (info->namespace_prefix) {
+    info->layerName = (char *) msSmallMalloc(strlen(info->namespace_prefix)+strlen(lp->name)+2);
+    sprintf(info->layerName, "%s:%s", info->namespace_prefix, lp->name);
+  } else {
+    info->layerName = msStrdup(lp->name);
+  }
+
+#ifdef USE_PROJ
+  if( bUseURN )
+  {
+      info->srs = msOWSGetProjURN(&(map->projection), NULL, "FGO", MS_TRUE);
+      if (!info->srs)
+        info->srs = msOWSGetProjURN(&(map->projection), &(map->web.metadata), "FGO", MS_TRUE);
+      if (!info->srs)
+        info->srs = msOWSGetProjURN(&(lp->projection), &(lp->metadata), "FGO", MS_TRUE);
+  }
+  else
+  {
+      const char* constsrs;
+      constsrs = msOWSGetEPSGProj(&(map->projection), NULL, "FGO", MS_TRUE);
+      if (!constsrs)
+        constsrs = msOWSGetEPSGProj(&(map->projection), &(map->web.metadata), "FGO", MS_TRUE);
+      if (!constsrs)
+        constsrs = msOWSGetEPSGProj(&(lp->projection), &(lp->metadata), "FGO", MS_TRUE);
+      if (constsrs)
+        info->srs = msStrdup(constsrs);
+  }
+#endif
+
+  return MS_SUCCESS;
+}
+
+/*
+** Write a single feature. The shape must already be in the map projection.
+*/
+static void gmlWriteWFSFeature(FILE *stream, gmlWFSLayerInfo *info, shapeObj *shape,
+                               OWSGMLVersion outputformat, int nWFSVersion,
+                               int bSwapAxis, int bGetPropertyValueRequest)
+{
+  const char *layerName = info->layerName;
+  const char *namespace_prefix = info->namespace_prefix;
+  gmlItemListObj *itemList = info->itemList;
+  gmlConstantListObj *constantList = info->constantList;
+  gmlGroupListObj *groupList = info->groupList;
+  gmlGeometryListObj *geometryList = info->geometryList;
+  gmlItemObj *item=NULL;
+  gmlConstantObj *constant=NULL;
+  char* pszFID;
+  int k;
+
+  if(info->featureIdIndex != -1) {
+      pszFID = (char*) msSmallMalloc( strlen(info->layer->name) + 1 + strlen(shape->values[info->featureIdIndex]) + 1 );
+      sprintf(pszFID, "%s.%s", info->layer->name, shape->values[info->featureIdIndex]);
+  }
+  else
+      pszFID = msStrdup("");
+
+
+  if( info->bOutputGMLIdOnly )
+  {
+      msIO_fprintf(stream, "    <wfs:member>%s</wfs:member>\n", pszFID);
+      msFree(pszFID);
+      return;
+  }
+
+  /*
+  ** start this feature
+  */
+  if( nWFSVersion == OWS_2_0_0 )
+      msIO_fprintf(stream, "    <wfs:member>\n");
+  else
+      msIO_fprintf(stream, "    <gml:featureMember>\n");
+  if(msIsXMLTagValid(layerName) == MS_FALSE)
+      msIO_fprintf(stream, "<!-- WARNING: The value '%s' is not valid in a XML tag context. -->\n", layerName);
+  if(info->featureIdIndex != -1) {
+      if( !bGetPropertyValueRequest )
+      {
+          if(outputformat == OWS_GML2)
+              msIO_fprintf(stream, "      <%s fid=\"%s\">\n", layerName, pszFID);
+          else  /* OWS_GML3 or OWS_GML32 */
+              msIO_fprintf(stream, "      <%s gml:id=\"%s\">\n", layerName, pszFID);
+      }
+  } else {
+      if( !bGetPropertyValueRequest )
+          msIO_fprintf(stream, "      <%s>\n", layerName);
+  }
+
+  if (bSwapAxis)
+    msAxisSwapShape(shape);
+
+  /* write the feature geometry and bounding box */
+  if(!(geometryList && geometryList->numgeometries == 1 &&
+      strcasecmp(geometryList->geometries[0].name, "none") == 0)) {
+    if( !bGetPropertyValueRequest )
+      gmlWriteBounds(stream, outputformat, &(shape->bounds), info->srs, "        ", "gml");
+    gmlWriteGeometry(stream, geometryList, outputformat, shape, info->srs,
+                     namespace_prefix, "        ", pszFID, info->nSRSDimension);
+  }
+
+  /* write any item/values */
+  for(k=0; k<itemList->numitems; k++) {
+    item = &(itemList->items[k]);
+    if(msItemInGroups(item->name, groupList) == MS_FALSE)
+      msGMLWriteItem(stream, item, shape->values[k], namespace_prefix,
+                     "        ", outputformat, pszFID);
+  }
+
+  /* write any constants */
+  for(k=0; k<constantList->numconstants; k++) {
+    constant = &(constantList->constants[k]);
+    if(msItemInGroups(constant->name, groupList) == MS_FALSE)
+      msGMLWriteConstant(stream, constant, namespace_prefix, "        ");
+  }
+
+  /* write any groups */
+  for(k=0; k<groupList->numgroups; k++)
+    msGMLWriteGroup(stream, &(groupList->groups[k]), shape, itemList,
+                    constantList, namespace_prefix, "        ", outputformat, pszFID);
+
+  if( !bGetPropertyValueRequest )
+      /* end this feature */
+      msIO_fprintf(stream, "      </%s>\n", layerName);
+
+  if( nWFSVersion == OWS_2_0_0 )
+    msIO_fprintf(stream, "    </wfs:member>\n");
+  else
+    msIO_fprintf(stream, "    </gml:featureMember>\n");
+
+  msFree(pszFID);
+}
+#endif /* USE_WFS_SVR */
+
 /*
 ** msGMLWriteWFSQuery()
 **
@@ -1631,18 +1857,9 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream, const char *default_namespace_
 {
 #ifdef USE_WFS_SVR
   int status;
-  int i,j,k;
+  int i,j;
   layerObj *lp=NULL;
   shapeObj shape;
-
-  gmlGroupListObj *groupList=NULL;
-  gmlItemListObj *itemList=NULL;
-  gmlConstantListObj *constantList=NULL;
-  gmlGeometryListObj *geometryList=NULL;
-  gmlItemObj *item=NULL;
-  gmlConstantObj *constant=NULL;
-
-  const char *namespace_prefix=NULL;
   int bSwapAxis;
 
   msInitShape(&shape);
@@ -1660,100 +1877,18 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream, const char *default_namespace_
     lp = GET_LAYER(map, map->layerorder[i]);
 
     if(lp->resultcache && lp->resultcache->numresults > 0)  { /* found results */
-      char *layerName;
-      const char *value;
-      int featureIdIndex=-1; /* no feature id */
-      char* srs = NULL;
-      int bOutputGMLIdOnly = MS_FALSE;
-      int nSRSDimension = 2;
-      const char* geomtype;
-
-      /* setup namespace, a layer can override the default */
-      namespace_prefix = msOWSLookupMetadata(&(lp->metadata), "OFG", "namespace_prefix");
-      if(!namespace_prefix) namespace_prefix = default_namespace_prefix;
-      
-      geomtype = msOWSLookupMetadata(&(lp->metadata), "OFG", "geomtype");
-      if( geomtype != NULL && (strstr(geomtype, "25d") != NULL || strstr(geomtype, "25D") != NULL) )
-      {
-#ifdef USE_POINT_Z_M
-          nSRSDimension = 3;
-#else
-          msIO_fprintf(stream, "<!-- WARNING: 25d requested forn typename '%s' but MapServer compiled without USE_POINT_Z_M support. -->\n", lp->name);
-#endif
-      }
+      gmlWFSLayerInfo info;
 
-      value = msOWSLookupMetadata(&(lp->metadata), "OFG", "featureid");
-      if(value) { /* find the featureid amongst the items for this layer */
-        for(j=0; j<lp->numitems; j++) {
-          if(strcasecmp(lp->items[j], value) == 0) { /* found it */
-            featureIdIndex = j;
-            break;
-          }
-        }
-
-        /* Produce a warning if a featureid was set but the corresponding item is not found. */
-        if (featureIdIndex == -1)
-          msIO_fprintf(stream, "<!-- WARNING: FeatureId item '%s' not found in typename '%s'. -->\n", value, lp->name);
-      }
-      else if( outputformat == OWS_GML32 )
-          msIO_fprintf(stream, "<!-- WARNING: No featureid defined for typename '%s'. Output will not validate. -->\n", lp->name);
-
-      /* populate item and group metadata structures */
-      itemList = msGMLGetItems(lp, "G");
-      constantList = msGMLGetConstants(lp, "G");
-      groupList = msGMLGetGroups(lp, "G");
-      geometryList = msGMLGetGeometries(lp, "GFO", MS_FALSE);
-      if (itemList == NULL || constantList == NULL || groupList == NULL || geometryList == NULL) {
-        msSetError(MS_MISCERR, "Unable to populate item and group metadata structures", "msGMLWriteWFSQuery()");
+      if( gmlInitWFSLayerInfo(&info, map, lp, stream, default_namespace_prefix,
+                              outputformat, bUseURN,
+                              bGetPropertyValueRequest) != MS_SUCCESS )
         return MS_FAILURE;
-      }
-      
-      if( bGetPropertyValueRequest )
-      {
-        const char* value = msOWSLookupMetadata(&(lp->metadata), "G", "include_items");
-        if( value != NULL && strcmp(value, "@gml:id") == 0 )
-            bOutputGMLIdOnly = MS_TRUE;
-      }
-
-      if (namespace_prefix) {
-        layerName = (char *) msSmallMalloc(strlen(namespace_prefix)+strlen(lp->name)+2);
-        sprintf(layerName, "%s:%s", namespace_prefix, lp->name);
-      } else {
-        layerName = msStrdup(lp->name);
-      }
-
-#ifdef USE_PROJ
-      if( bUseURN )
-      {
-          srs = msOWSGetProjURN(&(map->projection), NULL, "FGO", MS_TRUE);
-          if (!srs)
-            srs = msOWSGetProjURN(&(map->projection), &(map->web.metadata), "FGO", MS_TRUE);
-          if (!srs)
-            srs = msOWSGetProjURN(&(lp->projection), &(lp->metadata), "FGO", MS_TRUE);
-      }
-      else
-      {
-          const char* constsrs;
-          constsrs = msOWSGetEPSGProj(&(map->projection), NULL, "FGO", MS_TRUE);
-          if (!constsrs)
-            constsrs = msOWSGetEPSGProj(&(map->projection), &(map->web.metadata), "FGO", MS_TRUE);
-          if (!constsrs)
-            constsrs = msOWSGetEPSGProj(&(lp->projection), &(lp->metadata), "FGO", MS_TRUE);
-          if (constsrs)
-            srs = msStrdup(constsrs);
-      }
-#endif
 
       for(j=0; j<lp->resultcache->numresults; j++) {
-        char* pszFID;
 
         status = msLayerGetShape(lp, &shape, &(lp->resultcache->results[j]));
         if(status != MS_SUCCESS) {
-          msGMLFreeGroups(groupList);
-          msGMLFreeConstants(constantList);
-          msGMLFreeItems(itemList);
-          msGMLFreeGeometries(geometryList);
-          msFree(layerName);
+          gmlFreeWFSLayerInfo(&info);
           return(status);
         }
 
@@ -1763,100 +1898,14 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream, const char *default_namespace_
           msProjectShape(&lp->projection, &map->projection, &shape);
 #endif
 
-        if(featureIdIndex != -1) {
-            pszFID = (char*) msSmallMalloc( strlen(lp->name) + 1 + strlen(shape.values[featureIdIndex]) + 1 );
-            sprintf(pszFID, "%s.%s", lp->name, shape.values[featureIdIndex]);
-        }
-        else
-            pszFID = msStrdup("");
-
-
-        if( bOutputGMLIdOnly )
-        {
-            msIO_fprintf(stream, "    <wfs:member>%s</wfs:member>\n", pszFID);
-            msFree(pszFID);
-            msFreeShape(&shape); /* init too */
-            continue;
-        }
-
-        /*
-        ** start this feature
-        */
-        if( nWFSVersion == OWS_2_0_0 )
-            msIO_fprintf(stream, "    <wfs:member>\n");
-        else
-            msIO_fprintf(stream, "    <gml:featureMember>\n");
-        if(msIsXMLTagValid(layerName) == MS_FALSE)
-            msIO_fprintf(stream, "<!-- WARNING: The value '%s' is not valid in a XML tag context. -->\n", layerName);
-        if(featureIdIndex != -1) {
-            if( !bGetPropertyValueRequest )
-            {
-                if(outputformat == OWS_GML2)
-                    msIO_fprintf(stream, "      <%s fid=\"%s\">\n", layerName, pszFID);
-                else  /* OWS_GML3 or OWS_GML32 */
-                    msIO_fprintf(stream, "      <%s gml:id=\"%s\">\n", layerName, pszFID);
-            }
-        } else {
-            if( !bGetPropertyValueRequest )
-                msIO_fprintf(stream, "      <%s>\n", layerName);
-        }
-
-        if (bSwapAxis)
-          msAxisSwapShape(&shape);
-
-        /* write the feature geometry and bounding box */
-        if(!(geometryList && geometryList->numgeometries == 1 &&
-            strcasecmp(geometryList->geometries[0].name, "none") == 0)) {
-          if( !bGetPropertyValueRequest )
-            gmlWriteBounds(stream, outputformat, &(shape.bounds), srs, "        ", "gml");
-          gmlWriteGeometry(stream, geometryList, outputformat, &(shape), srs,
-                           namespace_prefix, "        ", pszFID, nSRSDimension);
-        }
-
-        /* write any item/values */
-        for(k=0; k<itemList->numitems; k++) {
-          item = &(itemList->items[k]);
-          if(msItemInGroups(item->name, groupList) == MS_FALSE)
-            msGMLWriteItem(stream, item, shape.values[k], namespace_prefix,
-                           "        ", outputformat, pszFID);
-        }
-
-        /* write any constants */
-        for(k=0; k<constantList->numconstants; k++) {
-          constant = &(constantList->constants[k]);
-          if(msItemInGroups(constant->name, groupList) == MS_FALSE)
-            msGMLWriteConstant(stream, constant, namespace_prefix, "        ");
-        }
-
-        /* write any groups */
-        for(k=0; k<groupList->numgroups; k++)
-          msGMLWriteGroup(stream, &(groupList->groups[k]), &shape, itemList,
-                          constantList, namespace_prefix, "        ", outputformat, pszFID);
-
-        if( !bGetPropertyValueRequest )
-            /* end this feature */
-            msIO_fprintf(stream, "      </%s>\n", layerName);
-
-        if( nWFSVersion == OWS_2_0_0 )
-          msIO_fprintf(stream, "    </wfs:member>\n");
-        else
-          msIO_fprintf(stream, "    </gml:featureMember>\n");
-
+        gmlWriteWFSFeature(stream, &info, &shape, outputformat, nWFSVersion,
+                           bSwapAxis, bGetPropertyValueRequest);
 
-        msFree(pszFID);
-        pszFID = NULL;
         msFreeShape(&shape); /* init too */
       }
 
-      msFree(srs);
-
       /* done with this layer, do a little clean-up */
-      msFree(layerName);
-
-      msGMLFreeGroups(groupList);
-      msGMLFreeConstants(constantList);
-      msGMLFreeItems(itemList);
-      msGMLFreeGeometries(geometryList);
+      gmlFreeWFSLayerInfo(&info);
 
       /* msLayerClose(lp); */
     }
@@ -1871,6 +1920,107 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream, const char *default_namespace_
 #endif /* USE_WFS_SVR */
 }
 
+#ifdef USE_WFS_SVR
+/*
+** Streaming variant of msGMLWriteWFSQuery(): features are written from
+** the query itself (see queryObj.result_callback) as msLayerNextShape()
+** returns them, so the result cache never holds the whole result set
+** and no msLayerGetShape() round-trip is needed. The collection bounds
+** are not known up front and are reported as unknown.
+*/
+struct msGMLWFSStream {
+  FILE *stream;
+  const char *default_namespace_prefix;
+  OWSGMLVersion outputformat;
+  int nWFSVersion;
+  int bUseURN;
+  int bSwapAxis;
+  int maxfeatures;  /* -1 for no limit */
+  int numwritten;
+  int status;
+  gmlWFSLayerInfo info; /* for the layer currently being written */
+};
+
+msGMLWFSStream *msGMLStartWFSStream(mapObj *map, FILE *stream,
+                                    const char *default_namespace_prefix,
+                                    OWSGMLVersion outputformat, int nWFSVersion,
+                                    int bUseURN, int maxfeatures)
+{
+  msGMLWFSStream *psStream;
+
+  psStream = (msGMLWFSStream *) msSmallCalloc(1, sizeof(msGMLWFSStream));
+  psStream->stream = stream;
+  psStream->default_namespace_prefix = default_namespace_prefix;
+  psStream->outputformat = outputformat;
+  psStream->nWFSVersion = nWFSVersion;
+  psStream->bUseURN = bUseURN;
+  psStream->bSwapAxis = msIsAxisInvertedProj(&(map->projection));
+  psStream->maxfeatures = maxfeatures;
+  psStream->status = MS_SUCCESS;
+
+  msIO_fprintf(stream, "      <gml:boundedBy>\n");
+  if(outputformat == OWS_GML3 || outputformat == OWS_GML32)
+    msIO_fprintf(stream, "        <gml:Null>unknown</gml:Null>\n");
+  else
+    msIO_fprintf(stream, "        <gml:null>unknown</gml:null>\n");
+  msIO_fprintf(stream, "      </gml:boundedBy>\n");
+
+  return psStream;
+}
+
+/*
+** Query result callback. The query may fetch one feature more than
+** requested to detect whether there are more, that one is not written.
+*/
+int msGMLWriteWFSStreamFeature(mapObj *map, layerObj *lp, shapeObj *shape,
+                               void *callback_data)
+{
+  msGMLWFSStream *psStream = (msGMLWFSStream *) callback_data;
+
+  if( psStream->maxfeatures >= 0 &&
+      psStream->numwritten >= psStream->maxfeatures )
+    return MS_SUCCESS;
+
+  if( psStream->info.layer != lp ) {
+    if( psStream->info.layer != NULL )
+      gmlFreeWFSLayerInfo(&(psStream->info));
+    if( gmlInitWFSLayerInfo(&(psStream->info), map, lp, psStream->stream,
+                            psStream->default_namespace_prefix,
+                            psStream->outputformat, psStream->bUseURN,
+                            MS_FALSE) != MS_SUCCESS ) {
+      psStream->status = MS_FAILURE;
+      return MS_FAILURE;
+    }
+  }
+
+  gmlWriteWFSFeature(psStream->stream, &(psStream->info), shape,
+                     psStream->outputformat, psStream->nWFSVersion,
+                     psStream->bSwapAxis, MS_FALSE);
+  psStream->numwritten ++;
+
+  return MS_SUCCESS;
+}
+
+/*
+** Release the stream, returns the number of features written or -1 if
+** the stream failed.
+*/
+int msGMLEndWFSStream(msGMLWFSStream *psStream)
+{
+  int numwritten;
+
+  if( psStream == NULL )
+    return -1;
+
+  numwritten = (psStream->status == MS_SUCCESS) ? psStream->numwritten : -1;
+  if( psStream->info.layer != NULL )
+    gmlFreeWFSLayerInfo(&(psStream->info));
+  msFree(psStream);
+
+  return numwritten;
+}
+#endif /* USE_WFS_SVR */
+
 
 #ifdef USE_LIBXML2
 
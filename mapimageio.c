@@ -28,7 +28,9 @@
  ****************************************************************************/
 
 #include "mapserver.h"
+#include "mapthread.h"
 #include <png.h>
+#include <zlib.h>
 #include <setjmp.h>
 #include <assert.h>
 #include <jpeglib.h>
@@ -305,18 +307,443 @@ int remapPaletteForPNG(rasterBufferObj *rb, rgbPixel *rgb, unsigned char *a, int
   return MS_SUCCESS;
 }
 
-int savePalettePNG(rasterBufferObj *rb, streamInfo *info, int compression)
+/*
+** Banded PNG encoder, used instead of libpng when the ENCODE_THREADS
+** FORMATOPTION is set. The image is split in bands of rows that are
+** filtered and deflated independently on msThreadRunJobs() workers. Every
+** band but the last ends with a sync flush so the raw deflate streams can
+** simply be concatenated, and each band is primed with the last 32K of
+** filtered data of the previous one so that compression barely suffers from
+** the split. With PNG_FILTER=ADAPTIVE, truecolor rows get the filter that
+** minimizes the sum of absolute differences, palette rows are always left
+** unfiltered as libpng does.
+*/
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MS_PNG_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define PNG_BAND_PAD 16 /* zeroed bytes in front of each unfiltered row */
+#define PNG_MAX_ENCODE_THREADS 16 /* more bands only cost compression */
+
+typedef struct {
+  unsigned char *data;
+  size_t size;
+  uLong adler;
+  int status;
+} pngBandObj;
+
+typedef struct {
+  rasterBufferObj *rb;
+  int bit_depth, bpp, rowbytes, adaptive, compression;
+  int numbands, bandrows;
+  unsigned char *filtered; /* height rows of 1 filter byte + rowbytes */
+  pngBandObj *bands;
+} pngEncoderObj;
+
+/* Builds the unfiltered png row from the raster buffer */
+static void pngPackRow(rasterBufferObj *rb, int row, int bit_depth, unsigned char *out)
+{
+  int col;
+  if(rb->type == MS_BUFFER_BYTE_PALETTE) {
+    unsigned char *pix = &(rb->data.palette.pixels[row*rb->width]);
+    if(bit_depth == 8) {
+      memcpy(out, pix, rb->width);
+    } else {
+      int ppb = 8 / bit_depth;
+      memset(out, 0, (rb->width + ppb - 1) / ppb);
+      for(col=0; col<rb->width; col++)
+        out[col/ppb] |= pix[col] << (8 - bit_depth * (col % ppb + 1));
+    }
+  } else {
+    unsigned char *a,*r,*g,*b;
+    r=rb->data.rgba.r+row*rb->data.rgba.row_step;
+    g=rb->data.rgba.g+row*rb->data.rgba.row_step;
+    b=rb->data.rgba.b+row*rb->data.rgba.row_step;
+    if(rb->data.rgba.a) {
+      a=rb->data.rgba.a+row*rb->data.rgba.row_step;
+      for(col=0; col<rb->width; col++) {
+        if(*a) {
+          double da = *a/255.0;
+          out[0] = *r/da;
+          out[1] = *g/da;
+          out[2] = *b/da;
+          out[3] = *a;
+        } else {
+          out[0] = out[1] = out[2] = out[3] = 0;
+        }
+        out+=4;
+        a+=rb->data.rgba.pixel_step;
+        r+=rb->data.rgba.pixel_step;
+        g+=rb->data.rgba.pixel_step;
+        b+=rb->data.rgba.pixel_step;
+      }
+    } else {
+      for(col=0; col<rb->width; col++) {
+        out[0] = *r;
+        out[1] = *g;
+        out[2] = *b;
+        out+=3;
+        r+=rb->data.rgba.pixel_step;
+        g+=rb->data.rgba.pixel_step;
+        b+=rb->data.rgba.pixel_step;
+      }
+    }
+  }
+}
+
+static unsigned char pngPaethPredictor(int a, int b, int c)
+{
+  int p = a + b - c;
+  int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  if(pa <= pb && pa <= pc) return a;
+  if(pb <= pc) return b;
+  return c;
+}
+
+/*
+** Applies filter type (1 to 4) to raw into out and returns the sum of the
+** absolute values of the filtered bytes taken as signed. raw and prior
+** must be preceded by bpp zeroed bytes.
+*/
+static unsigned long pngFilterRow(int type, const unsigned char *raw, const unsigned char *prior,
+                                  int rowbytes, int bpp, unsigned char *out)
+{
+  unsigned long sum = 0;
+  int x = 0;
+#ifdef MS_PNG_USE_SSE2
+  __m128i zero = _mm_setzero_si128(), acc = _mm_setzero_si128();
+  for(; x + 16 <= rowbytes; x += 16) {
+    __m128i cur = _mm_loadu_si128((const __m128i*)(raw + x));
+    __m128i left = _mm_loadu_si128((const __m128i*)(raw + x - bpp));
+    __m128i up = _mm_loadu_si128((const __m128i*)(prior + x));
+    __m128i res;
+    switch(type) {
+      case 1:
+        res = _mm_sub_epi8(cur, left);
+        break;
+      case 2:
+        res = _mm_sub_epi8(cur, up);
+        break;
+      case 3: {
+        /* _mm_avg_epu8 rounds up, png wants (left+up)>>1 */
+        __m128i avg = _mm_sub_epi8(_mm_avg_epu8(left, up),
+                                   _mm_and_si128(_mm_xor_si128(left, up), _mm_set1_epi8(1)));
+        res = _mm_sub_epi8(cur, avg);
+        break;
+      }
+      default: {
+        __m128i upleft = _mm_loadu_si128((const __m128i*)(prior + x - bpp));
+        __m128i pred[2];
+        int h;
+        for(h = 0; h < 2; h++) {
+          __m128i a = h ? _mm_unpackhi_epi8(left, zero) : _mm_unpacklo_epi8(left, zero);
+          __m128i b = h ? _mm_unpackhi_epi8(up, zero) : _mm_unpacklo_epi8(up, zero);
+          __m128i c = h ? _mm_unpackhi_epi8(upleft, zero) : _mm_unpacklo_epi8(upleft, zero);
+          __m128i pa = _mm_sub_epi16(b, c), pb = _mm_sub_epi16(a, c), pc, use_a, use_b;
+          pc = _mm_add_epi16(pa, pb);
+          pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+          pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+          pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+          /* a if pa <= pb && pa <= pc, else b if pb <= pc, else c */
+          use_a = _mm_andnot_si128(_mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc)),
+                                   _mm_set1_epi16(-1));
+          use_b = _mm_andnot_si128(_mm_cmpgt_epi16(pb, pc), _mm_set1_epi16(-1));
+          pred[h] = _mm_or_si128(_mm_and_si128(use_b, b), _mm_andnot_si128(use_b, c));
+          pred[h] = _mm_or_si128(_mm_and_si128(use_a, a), _mm_andnot_si128(use_a, pred[h]));
+        }
+        res = _mm_sub_epi8(cur, _mm_packus_epi16(pred[0], pred[1]));
+        break;
+      }
+    }
+    _mm_storeu_si128((__m128i*)(out + x), res);
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_min_epu8(res, _mm_sub_epi8(zero, res)), zero));
+  }
+  {
+    unsigned long long parts[2];
+    _mm_storeu_si128((__m128i*)parts, acc);
+    sum = (unsigned long)(parts[0] + parts[1]);
+  }
+#endif
+  for(; x < rowbytes; x++) {
+    unsigned char v;
+    switch(type) {
+      case 1:
+        v = raw[x] - raw[x - bpp];
+        break;
+      case 2:
+        v = raw[x] - prior[x];
+        break;
+      case 3:
+        v = raw[x] - ((raw[x - bpp] + prior[x]) >> 1);
+        break;
+      default:
+        v = raw[x] - pngPaethPredictor(raw[x - bpp], prior[x], prior[x - bpp]);
+        break;
+    }
+    out[x] = v;
+    sum += (v < 128) ? v : 256 - v;
+  }
+  return sum;
+}
+
+static unsigned long pngRowScore(const unsigned char *row, int rowbytes)
+{
+  unsigned long sum = 0;
+  int x;
+  for(x = 0; x < rowbytes; x++)
+    sum += (row[x] < 128) ? row[x] : 256 - row[x];
+  return sum;
+}
+
+static void pngFilterBandJob(void *data, int band)
+{
+  pngEncoderObj *enc = (pngEncoderObj*) data;
+  int stride = PNG_BAND_PAD + enc->rowbytes;
+  int first = band * enc->bandrows;
+  int last = MS_MIN(first + enc->bandrows, enc->rb->height);
+  unsigned char *rows = (unsigned char*) msSmallCalloc(2 * stride + 4 * enc->rowbytes, 1);
+  unsigned char *scratch = rows + 2 * stride;
+  unsigned char *raw = rows + PNG_BAND_PAD, *prior = rows + stride + PNG_BAND_PAD;
+  int row;
+
+  if(enc->adaptive && first > 0)
+    pngPackRow(enc->rb, first - 1, enc->bit_depth, prior);
+
+  for(row = first; row < last; row++) {
+    unsigned char *out = enc->filtered + (size_t)row * (enc->rowbytes + 1);
+    unsigned char *tmp;
+    pngPackRow(enc->rb, row, enc->bit_depth, raw);
+    if(!enc->adaptive) {
+      out[0] = 0;
+      memcpy(out + 1, raw, enc->rowbytes);
+    } else {
+      unsigned long best = pngRowScore(raw, enc->rowbytes), score;
+      int type, besttype = 0;
+      for(type = 1; type <= 4; type++) {
+        score = pngFilterRow(type, raw, prior, enc->rowbytes, enc->bpp, scratch + (type - 1) * enc->rowbytes);
+        if(score < best) {
+          best = score;
+          besttype = type;
+        }
+      }
+      out[0] = besttype;
+      memcpy(out + 1, besttype ? scratch + (besttype - 1) * enc->rowbytes : raw, enc->rowbytes);
+    }
+    tmp = raw;
+    raw = prior;
+    prior = tmp;
+  }
+  free(rows);
+}
+
+static void pngDeflateBandJob(void *data, int band)
+{
+  pngEncoderObj *enc = (pngEncoderObj*) data;
+  pngBandObj *out = enc->bands + band;
+  size_t linebytes = enc->rowbytes + 1;
+  size_t start = (size_t)band * enc->bandrows * linebytes;
+  size_t end = (size_t)MS_MIN((band + 1) * enc->bandrows, enc->rb->height) * linebytes;
+  int last = (band == enc->numbands - 1);
+  z_stream zs;
+
+  out->status = MS_FAILURE;
+  memset(&zs, 0, sizeof(zs));
+  if(deflateInit2(&zs, enc->compression, Z_DEFLATED, -15, 8,
+                  enc->adaptive ? Z_FILTERED : Z_DEFAULT_STRATEGY) != Z_OK)
+    return;
+
+  if(start > 0) {
+    size_t dictsize = MS_MIN(start, 32768);
+    deflateSetDictionary(&zs, enc->filtered + start - dictsize, (uInt)dictsize);
+  }
+
+  /* room for the sync flush marker on top of the deflateBound() worst case */
+  out->size = deflateBound(&zs, (uLong)(end - start)) + 16;
+  out->data = (unsigned char*) msSmallMalloc(out->size);
+  zs.next_in = enc->filtered + start;
+  zs.avail_in = (uInt)(end - start);
+  zs.next_out = out->data;
+  zs.avail_out = (uInt)out->size;
+  if(deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH) == (last ? Z_STREAM_END : Z_OK) && zs.avail_in == 0) {
+    out->size -= zs.avail_out;
+    out->adler = adler32(adler32(0L, Z_NULL, 0), enc->filtered + start, (uInt)(end - start));
+    out->status = MS_SUCCESS;
+  }
+  deflateEnd(&zs);
+}
+
+static void pngWriteBytes(streamInfo *info, const unsigned char *data, size_t length)
+{
+  if(info->fp)
+    msIO_fwrite(data,length,1,info->fp);
+  else
+    msBufferAppend(info->buffer,(void*)data,length);
+}
+
+static void pngWriteChunk(streamInfo *info, const char *type, const unsigned char *data, size_t length,
+                          const unsigned char *data2, size_t length2)
+{
+  unsigned char buf[4];
+  uLong crc = crc32(0L, Z_NULL, 0);
+  size_t total = length + length2;
+
+  buf[0] = (total >> 24) & 0xff;
+  buf[1] = (total >> 16) & 0xff;
+  buf[2] = (total >> 8) & 0xff;
+  buf[3] = total & 0xff;
+  pngWriteBytes(info, buf, 4);
+  pngWriteBytes(info, (const unsigned char*)type, 4);
+  crc = crc32(crc, (const Bytef*)type, 4);
+  if(length) {
+    pngWriteBytes(info, data, length);
+    crc = crc32(crc, data, (uInt)length);
+  }
+  if(length2) {
+    pngWriteBytes(info, data2, length2);
+    crc = crc32(crc, data2, (uInt)length2);
+  }
+  buf[0] = (crc >> 24) & 0xff;
+  buf[1] = (crc >> 16) & 0xff;
+  buf[2] = (crc >> 8) & 0xff;
+  buf[3] = crc & 0xff;
+  pngWriteBytes(info, buf, 4);
+}
+
+static int saveBandedPNG(rasterBufferObj *rb, streamInfo *info, int compression, int threads, int adaptive,
+                         int bit_depth, int color_type, rgbPixel *rgb, unsigned char *a, int num_a)
+{
+  static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+  pngEncoderObj enc;
+  unsigned char ihdr[13], zhdr[2], trailer[4];
+  int i, channels, flevel, status = MS_SUCCESS;
+  uLong adler;
+
+  switch(color_type) {
+    case PNG_COLOR_TYPE_RGB_ALPHA:
+      channels = 4;
+      break;
+    case PNG_COLOR_TYPE_RGB:
+      channels = 3;
+      break;
+    default:
+      channels = 1;
+      break;
+  }
+
+  memset(&enc, 0, sizeof(enc));
+  enc.rb = rb;
+  enc.bit_depth = bit_depth;
+  enc.bpp = MS_MAX(channels * bit_depth / 8, 1);
+  enc.rowbytes = (rb->width * channels * bit_depth + 7) / 8;
+  enc.adaptive = adaptive && (color_type != PNG_COLOR_TYPE_PALETTE);
+  enc.compression = (compression < 0) ? Z_DEFAULT_COMPRESSION : compression;
+  /* bands of at least 16 rows, the dictionary priming makes smaller ones pointless */
+  threads = MS_MIN(threads, PNG_MAX_ENCODE_THREADS);
+  enc.numbands = MS_MAX(MS_MIN(threads, rb->height / 16), 1);
+  enc.bandrows = (rb->height + enc.numbands - 1) / enc.numbands;
+  enc.numbands = (rb->height + enc.bandrows - 1) / enc.bandrows;
+  threads = MS_MIN(threads, enc.numbands);
+  enc.filtered = (unsigned char*) msSmallMalloc((size_t)rb->height * (enc.rowbytes + 1));
+  enc.bands = (pngBandObj*) msSmallCalloc(enc.numbands, sizeof(pngBandObj));
+
+  msThreadRunJobs(threads, enc.numbands, pngFilterBandJob, &enc);
+  msThreadRunJobs(threads, enc.numbands, pngDeflateBandJob, &enc);
+
+  for(i = 0; i < enc.numbands; i++) {
+    if(enc.bands[i].status != MS_SUCCESS) {
+      msSetError(MS_MISCERR,"zlib failed to compress band %d","saveBandedPNG()",i);
+      status = MS_FAILURE;
+      break;
+    }
+  }
+
+  if(status == MS_SUCCESS) {
+    pngWriteBytes(info, signature, 8);
+
+    ihdr[0] = (rb->width >> 24) & 0xff;
+    ihdr[1] = (rb->width >> 16) & 0xff;
+    ihdr[2] = (rb->width >> 8) & 0xff;
+    ihdr[3] = rb->width & 0xff;
+    ihdr[4] = (rb->height >> 24) & 0xff;
+    ihdr[5] = (rb->height >> 16) & 0xff;
+    ihdr[6] = (rb->height >> 8) & 0xff;
+    ihdr[7] = rb->height & 0xff;
+    ihdr[8] = bit_depth;
+    ihdr[9] = color_type;
+    ihdr[10] = ihdr[11] = ihdr[12] = 0; /* deflate, adaptive filtering, no interlace */
+    pngWriteChunk(info, "IHDR", ihdr, 13, NULL, 0);
+
+    if(color_type == PNG_COLOR_TYPE_PALETTE) {
+      pngWriteChunk(info, "PLTE", (unsigned char*)rgb, 3 * rb->data.palette.num_entries, NULL, 0);
+      if(num_a)
+        pngWriteChunk(info, "tRNS", a, num_a, NULL, 0);
+    }
+
+    /* zlib header for a 32K window, with the level hint deflate would use */
+    if(enc.compression == Z_DEFAULT_COMPRESSION || enc.compression == 6)
+      flevel = 2;
+    else if(enc.compression < 2)
+      flevel = 0;
+    else if(enc.compression < 6)
+      flevel = 1;
+    else
+      flevel = 3;
+    zhdr[0] = 0x78;
+    zhdr[1] = flevel << 6;
+    zhdr[1] += 31 - ((zhdr[0] * 256 + zhdr[1]) % 31);
+
+    adler = enc.bands[0].adler;
+    for(i = 1; i < enc.numbands; i++) {
+      size_t bandsize = (size_t)(MS_MIN((i + 1) * enc.bandrows, rb->height) - i * enc.bandrows) * (enc.rowbytes + 1);
+      adler = adler32_combine(adler, enc.bands[i].adler, (z_off_t)bandsize);
+    }
+    trailer[0] = (adler >> 24) & 0xff;
+    trailer[1] = (adler >> 16) & 0xff;
+    trailer[2] = (adler >> 8) & 0xff;
+    trailer[3] = adler & 0xff;
+
+    for(i = 0; i < enc.numbands; i++) {
+      pngWriteChunk(info, "IDAT", (i == 0) ? zhdr : NULL, (i == 0) ? 2 : 0, enc.bands[i].data, enc.bands[i].size);
+    }
+    pngWriteChunk(info, "IDAT", trailer, 4, NULL, 0);
+    pngWriteChunk(info, "IEND", NULL, 0, NULL, 0);
+  }
+
+  for(i = 0; i < enc.numbands; i++)
+    free(enc.bands[i].data);
+  free(enc.bands);
+  free(enc.filtered);
+  return status;
+}
+
+int savePalettePNG(rasterBufferObj *rb, streamInfo *info, int compression, int threads)
 {
   png_infop info_ptr;
   rgbPixel rgb[256];
   unsigned char a[256];
   int num_a;
   int row,sample_depth;
-  png_structp png_ptr = png_create_write_struct(
-                          PNG_LIBPNG_VER_STRING, NULL,NULL,NULL);
+  png_structp png_ptr;
 
   assert(rb->type == MS_BUFFER_BYTE_PALETTE);
 
+  if (rb->data.palette.num_entries <= 2)
+    sample_depth = 1;
+  else if (rb->data.palette.num_entries <= 4)
+    sample_depth = 2;
+  else if (rb->data.palette.num_entries <= 16)
+    sample_depth = 4;
+  else
+    sample_depth = 8;
+
+  if (threads > 0) {
+    if(remapPaletteForPNG(rb,rgb,a,&num_a) != MS_SUCCESS)
+      return MS_FAILURE;
+    return saveBandedPNG(rb, info, compression, threads, MS_FALSE, sample_depth, PNG_COLOR_TYPE_PALETTE, rgb, a, num_a);
+  }
+
+  png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL,NULL,NULL);
   if (!png_ptr)
     return (MS_FAILURE);
 
@@ -340,15 +767,6 @@ int savePalettePNG(rasterBufferObj *rb, streamInfo *info, int compression)
     png_set_write_fn(png_ptr,info, png_write_data_to_buffer, png_flush_data);
 
 
-  if (rb->data.palette.num_entries <= 2)
-    sample_depth = 1;
-  else if (rb->data.palette.num_entries <= 4)
-    sample_depth = 2;
-  else if (rb->data.palette.num_entries <= 16)
-    sample_depth = 4;
-  else
-    sample_depth = 8;
-
   png_set_IHDR(png_ptr, info_ptr, rb->width, rb->height,
                sample_depth, PNG_COLOR_TYPE_PALETTE,
                0, PNG_COMPRESSION_TYPE_DEFAULT,
@@ -424,11 +842,14 @@ int saveAsPNG(mapObj *map,rasterBufferObj *rb, streamInfo *info, outputFormatObj
 {
   int force_pc256 = MS_FALSE;
   int force_palette = MS_FALSE;
+  int octree = MS_FALSE;
 
   int ret = MS_FAILURE;
 
-  const char *force_string,*zlib_compression;
+  const char *force_string,*zlib_compression,*encode_threads;
   int compression = -1;
+  int threads = 0;
+  int adaptive = MS_FALSE;
 
   zlib_compression = msGetOutputFormatOption( format, "COMPRESSION", NULL);
   if(zlib_compression && *zlib_compression) {
@@ -440,6 +861,25 @@ int saveAsPNG(mapObj *map,rasterBufferObj *rb, streamInfo *info, outputFormatObj
     }
   }
 
+  /* ENCODE_THREADS=n selects the banded encoder, running on up to n threads (at most PNG_MAX_ENCODE_THREADS) */
+  encode_threads = msGetOutputFormatOption( format, "ENCODE_THREADS", NULL);
+  if(encode_threads && *encode_threads) {
+    char *endptr;
+    threads = strtol(encode_threads,&endptr,10);
+    if(*endptr || threads<0) {
+      msSetError(MS_MISCERR,"failed to parse FORMATOPTION \"ENCODE_THREADS=%s\", expecting a positive integer.","saveAsPNG()",encode_threads);
+      return MS_FAILURE;
+    }
+  }
+
+
+  /*
+  ** Map images are mostly flat colors that deflate handles best unfiltered,
+  ** PNG_FILTER=ADAPTIVE pays off for imagery and shaded reliefs.
+  */
+  force_string = msGetOutputFormatOption( format, "PNG_FILTER", NULL );
+  if( force_string && strcasecmp(force_string,"adaptive") == 0 )
+    adaptive = MS_TRUE;
 
   force_string = msGetOutputFormatOption( format, "QUANTIZE_FORCE", NULL );
   if( force_string && (strcasecmp(force_string,"on") == 0  || strcasecmp(force_string,"yes") == 0 || strcasecmp(force_string,"true") == 0) )
@@ -449,6 +889,14 @@ int saveAsPNG(mapObj *map,rasterBufferObj *rb, streamInfo *info, outputFormatObj
   if( force_string && (strcasecmp(force_string,"on") == 0  || strcasecmp(force_string,"yes") == 0 || strcasecmp(force_string,"true") == 0) )
     force_palette = MS_TRUE;
 
+  force_string = msGetOutputFormatOption( format, "QUANTIZE_METHOD", "MEDIANCUT" );
+  if( strcasecmp(force_string,"octree") == 0 )
+    octree = MS_TRUE;
+  else if( strcasecmp(force_string,"mediancut") != 0 ) {
+    msSetError(MS_MISCERR,"failed to parse FORMATOPTION \"QUANTIZE_METHOD=%s\", expecting MEDIANCUT or OCTREE.","saveAsPNG()",force_string);
+    return MS_FAILURE;
+  }
+
   if(force_pc256 || force_palette) {
     rasterBufferObj qrb;
     rgbaPixel palette[256], paletteGiven[256];
@@ -462,9 +910,13 @@ int saveAsPNG(mapObj *map,rasterBufferObj *rb, streamInfo *info, outputFormatObj
     if(force_pc256) {
       qrb.data.palette.palette = palette;
       qrb.data.palette.num_entries = atoi(msGetOutputFormatOption( format, "QUANTIZE_COLORS", "256"));
-      ret = msQuantizeRasterBuffer(rb,&(qrb.data.palette.num_entries),qrb.data.palette.palette,
-                                   NULL, 0,
-                                   &qrb.data.palette.scaling_maxval);
+      if(octree)
+        ret = msQuantizeRasterBufferOctree(rb,&(qrb.data.palette.num_entries),qrb.data.palette.palette,
+                                           NULL, 0);
+      else
+        ret = msQuantizeRasterBuffer(rb,&(qrb.data.palette.num_entries),qrb.data.palette.palette,
+                                     NULL, 0,
+                                     &qrb.data.palette.scaling_maxval);
     } else {
       int colorsWanted = atoi(msGetOutputFormatOption( format, "QUANTIZE_COLORS", "0"));
       const char *palettePath = msGetOutputFormatOption( format, "PALETTE", "palette.txt");
@@ -487,17 +939,24 @@ int saveAsPNG(mapObj *map,rasterBufferObj *rb, streamInfo *info, outputFormatObj
         /* quantize the image, and mix our colours in the resulting palette */
         qrb.data.palette.palette = palette;
         qrb.data.palette.num_entries = MS_MAX(colorsWanted,numPaletteGivenEntries);
-        ret = msQuantizeRasterBuffer(rb,&(qrb.data.palette.num_entries),qrb.data.palette.palette,
-                                     paletteGiven,numPaletteGivenEntries,
-                                     &qrb.data.palette.scaling_maxval);
+        if(octree)
+          ret = msQuantizeRasterBufferOctree(rb,&(qrb.data.palette.num_entries),qrb.data.palette.palette,
+                                             paletteGiven,numPaletteGivenEntries);
+        else
+          ret = msQuantizeRasterBuffer(rb,&(qrb.data.palette.num_entries),qrb.data.palette.palette,
+                                       paletteGiven,numPaletteGivenEntries,
+                                       &qrb.data.palette.scaling_maxval);
       }
     }
     if(ret != MS_FAILURE) {
       ret = msClassifyRasterBuffer(rb,&qrb);
-      ret = savePalettePNG(&qrb,info,compression);
+      ret = savePalettePNG(&qrb,info,compression,threads);
     }
     msFree(qrb.data.palette.pixels);
     return ret;
+  } else if(rb->type == MS_BUFFER_BYTE_RGBA && threads > 0) {
+    return saveBandedPNG(rb, info, compression, threads, adaptive, 8,
+                         rb->data.rgba.a ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB, NULL, NULL, 0);
   } else if(rb->type == MS_BUFFER_BYTE_RGBA) {
     png_infop info_ptr;
     int color_type;
@@ -510,7 +969,7 @@ int saveAsPNG(mapObj *map,rasterBufferObj *rb, streamInfo *info, outputFormatObj
       return (MS_FAILURE);
 
     png_set_compression_level(png_ptr, compression);
-    png_set_filter (png_ptr,0, PNG_FILTER_NONE);
+    png_set_filter (png_ptr,0, adaptive ? PNG_ALL_FILTERS : PNG_FILTER_NONE);
 
     info_ptr = png_create_info_struct(png_ptr);
     if (!info_ptr) {
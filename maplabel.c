@@ -36,6 +36,7 @@
 #include "mapserver.h"
 #include "fontcache.h"
 
+static void labelCacheGridInsert(labelCacheGridObj *grid, const rectObj *rect, int id, int priority);
 
 
 
@@ -417,6 +418,8 @@ int msAddLabelGroup(mapObj *map, imageObj *image, layerObj* layer, int classinde
     cacheslot->markers[cacheslot->nummarkers].id = cacheslot->numlabels;
 
     cachePtr->markerid = cacheslot->nummarkers;
+    if(map->labelcache.grid)
+      labelCacheGridInsert(map->labelcache.grid, &cacheslot->markers[cacheslot->nummarkers].bounds, cacheslot->nummarkers, priority-1);
     cacheslot->nummarkers++;
   }
   cachePtr->textsymbols = textsymbols;
@@ -619,6 +622,8 @@ int msAddLabel(mapObj *map, imageObj *image, labelObj *label, int layerindex, in
       cacheslot->markers[i].id = cacheslot->numlabels;
 
       cachePtr->markerid = i;
+      if(map->labelcache.grid)
+        labelCacheGridInsert(map->labelcache.grid, &cacheslot->markers[i].bounds, i, label->priority-1);
 
       cacheslot->nummarkers++;
     }
@@ -629,6 +634,58 @@ int msAddLabel(mapObj *map, imageObj *image, labelObj *label, int layerindex, in
   return(MS_SUCCESS);
 }
 
+/*
+** Appends the labels and markers collected in src to the end of the matching
+** priority slots of dst, as if they had been added to dst by msAddLabel()
+** directly. Ownership of the label members is transferred, src is left empty.
+*/
+int msMergeLabelCache(labelCacheObj *dst, labelCacheObj *src)
+{
+  int p, i;
+
+  for(p=0; p<MS_MAX_LABEL_PRIORITY; p++) {
+    labelCacheSlotObj *dstslot = &(dst->slots[p]);
+    labelCacheSlotObj *srcslot = &(src->slots[p]);
+    int labeloffset = dstslot->numlabels;
+    int markeroffset = dstslot->nummarkers;
+
+    if(srcslot->numlabels == 0)
+      continue;
+
+    if(dstslot->numlabels + srcslot->numlabels > dstslot->cachesize) {
+      dstslot->cachesize = dstslot->numlabels + srcslot->numlabels + MS_LABELCACHEINCREMENT;
+      dstslot->labels = (labelCacheMemberObj *) realloc(dstslot->labels, sizeof(labelCacheMemberObj)*dstslot->cachesize);
+      MS_CHECK_ALLOC(dstslot->labels, sizeof(labelCacheMemberObj)*dstslot->cachesize, MS_FAILURE);
+    }
+    if(dstslot->nummarkers + srcslot->nummarkers > dstslot->markercachesize) {
+      dstslot->markercachesize = dstslot->nummarkers + srcslot->nummarkers + MS_LABELCACHEINCREMENT;
+      dstslot->markers = (markerCacheMemberObj *) realloc(dstslot->markers, sizeof(markerCacheMemberObj)*dstslot->markercachesize);
+      MS_CHECK_ALLOC(dstslot->markers, sizeof(markerCacheMemberObj)*dstslot->markercachesize, MS_FAILURE);
+    }
+
+    for(i=0; i<srcslot->numlabels; i++) {
+      labelCacheMemberObj *cachePtr = &(dstslot->labels[dstslot->numlabels++]);
+      *cachePtr = srcslot->labels[i];
+      if(cachePtr->markerid != -1)
+        cachePtr->markerid += markeroffset;
+    }
+    for(i=0; i<srcslot->nummarkers; i++) {
+      markerCacheMemberObj *markerPtr = &(dstslot->markers[dstslot->nummarkers]);
+      *markerPtr = srcslot->markers[i];
+      markerPtr->id += labeloffset;
+      if(dst->grid)
+        labelCacheGridInsert(dst->grid, &markerPtr->bounds, dstslot->nummarkers, p);
+      dstslot->nummarkers++;
+    }
+
+    /* the members now belong to dst */
+    srcslot->numlabels = 0;
+    srcslot->nummarkers = 0;
+  }
+
+  return(MS_SUCCESS);
+}
+
 /*
 ** Is a label completely in the image, reserving a gutter (in pixels) inside
 ** image for no labels (effectively making image larger. The gutter can be
@@ -661,6 +718,128 @@ static int labelInImage(int width, int height, lineObj *lpoly, rectObj *bounds,
   return(MS_TRUE);
 }
 
+/*
+** Label cache grid: a uniform grid over the image in which the rendered labels
+** and the cached markers are registered in every cell their bounds touch, so
+** that collision tests only look at what is near the candidate. Bounds that
+** fall outside of the image are clamped to the border cells. A candidate and
+** an entry are only tested in the first cell they share, so no pair is
+** tested twice.
+*/
+#define MS_LABELCACHE_GRID_CELLSIZE 64
+
+typedef struct {
+  int id; /* index in rendered_text_symbols, or in the markers of slot priority */
+  int priority; /* -1 for rendered labels */
+  int cellx, celly; /* first cell covered by the entry */
+} labelCacheGridEntryObj;
+
+typedef struct {
+  labelCacheGridEntryObj *entries;
+  int numentries;
+  int maxentries;
+} labelCacheGridCellObj;
+
+struct labelCacheGridObj {
+  int width, height; /* in cells */
+  labelCacheGridCellObj *cells;
+};
+
+static int labelCacheGridCoord(double v, int n)
+{
+  double c = floor(v / MS_LABELCACHE_GRID_CELLSIZE);
+  if(!(c > 0)) return 0; /* also catches NaN */
+  if(c >= n) return n - 1;
+  return (int)c;
+}
+
+static void labelCacheGridRange(labelCacheGridObj *grid, const rectObj *rect, int *x0, int *y0, int *x1, int *y1)
+{
+  *x0 = labelCacheGridCoord(rect->minx, grid->width);
+  *y0 = labelCacheGridCoord(rect->miny, grid->height);
+  *x1 = labelCacheGridCoord(rect->maxx, grid->width);
+  *y1 = labelCacheGridCoord(rect->maxy, grid->height);
+}
+
+static void labelCacheGridInsert(labelCacheGridObj *grid, const rectObj *rect, int id, int priority)
+{
+  int x, y, x0, y0, x1, y1;
+
+  labelCacheGridRange(grid, rect, &x0, &y0, &x1, &y1);
+  for(y=y0; y<=y1; y++) {
+    for(x=x0; x<=x1; x++) {
+      labelCacheGridCellObj *cell = &grid->cells[y * grid->width + x];
+      labelCacheGridEntryObj *entry;
+      if(cell->numentries == cell->maxentries) {
+        cell->maxentries = cell->maxentries ? cell->maxentries * 2 : 8;
+        cell->entries = msSmallRealloc(cell->entries, cell->maxentries * sizeof(labelCacheGridEntryObj));
+      }
+      entry = &cell->entries[cell->numentries++];
+      entry->id = id;
+      entry->priority = priority;
+      entry->cellx = x0;
+      entry->celly = y0;
+    }
+  }
+}
+
+static void labelCacheGridInsertMember(labelCacheGridObj *grid, labelCacheMemberObj *cachePtr, int id)
+{
+  rectObj rect = cachePtr->bbox;
+
+  if(cachePtr->leaderbbox) {
+    rect.minx = MS_MIN(rect.minx, cachePtr->leaderbbox->minx);
+    rect.miny = MS_MIN(rect.miny, cachePtr->leaderbbox->miny);
+    rect.maxx = MS_MAX(rect.maxx, cachePtr->leaderbbox->maxx);
+    rect.maxy = MS_MAX(rect.maxy, cachePtr->leaderbbox->maxy);
+  }
+  labelCacheGridInsert(grid, &rect, id, -1);
+}
+
+void msFreeLabelCacheGrid(labelCacheObj *cache)
+{
+  int i;
+
+  if(!cache->grid)
+    return;
+  for(i=0; i<cache->grid->width * cache->grid->height; i++)
+    msFree(cache->grid->cells[i].entries);
+  msFree(cache->grid->cells);
+  msFree(cache->grid);
+  cache->grid = NULL;
+}
+
+/*
+** Returns the grid of the label cache, building it from the markers and
+** rendered labels cached so far on first use. Once built it is kept up to date
+** by msAddLabel(), msAddLabelGroup() and insertRenderedLabelMember().
+*/
+static labelCacheGridObj *msGetLabelCacheGrid(mapObj *map)
+{
+  labelCacheObj *labelcache = &(map->labelcache);
+  labelCacheGridObj *grid;
+  int p, i;
+
+  if(labelcache->grid || map->width <= 0 || map->height <= 0)
+    return labelcache->grid;
+
+  grid = (labelCacheGridObj *) msSmallMalloc(sizeof(labelCacheGridObj));
+  grid->width = (map->width + MS_LABELCACHE_GRID_CELLSIZE - 1) / MS_LABELCACHE_GRID_CELLSIZE;
+  grid->height = (map->height + MS_LABELCACHE_GRID_CELLSIZE - 1) / MS_LABELCACHE_GRID_CELLSIZE;
+  grid->cells = (labelCacheGridCellObj *) msSmallCalloc(grid->width * grid->height, sizeof(labelCacheGridCellObj));
+
+  for(p=0; p<MS_MAX_LABEL_PRIORITY; p++) {
+    labelCacheSlotObj *cacheslot = &(labelcache->slots[p]);
+    for(i=0; i<cacheslot->nummarkers; i++)
+      labelCacheGridInsert(grid, &cacheslot->markers[i].bounds, i, p);
+  }
+  for(i=0; i<labelcache->num_rendered_members; i++)
+    labelCacheGridInsertMember(grid, labelcache->rendered_text_symbols[i], i);
+
+  labelcache->grid = grid;
+  return grid;
+}
+
 void insertRenderedLabelMember(mapObj *map, labelCacheMemberObj *cachePtr) {
   if(map->labelcache.num_rendered_members == map->labelcache.num_allocated_rendered_members) {
     if(map->labelcache.num_rendered_members == 0) {
@@ -671,6 +850,8 @@ void insertRenderedLabelMember(mapObj *map, labelCacheMemberObj *cachePtr) {
     map->labelcache.rendered_text_symbols = msSmallRealloc(map->labelcache.rendered_text_symbols,
             map->labelcache.num_allocated_rendered_members * sizeof(labelCacheMemberObj*));
   }
+  if(map->labelcache.grid)
+    labelCacheGridInsertMember(map->labelcache.grid, cachePtr, map->labelcache.num_rendered_members);
   map->labelcache.rendered_text_symbols[map->labelcache.num_rendered_members++] = cachePtr;
 }
 
@@ -714,42 +895,67 @@ static inline int testSegmentLabelBBoxIntersection(const rectObj *leaderbbox, co
   return MS_TRUE;
 }
 
+static int testRenderedLabelLeaderCollision(labelCacheMemberObj *curCachePtr, rectObj *leaderbbox, pointObj *lp1, pointObj *lp2) {
+  if(msRectOverlap(leaderbbox, &(curCachePtr->bbox))) {
+  /* leaderbbox interesects with the curCachePtr's global bbox */
+    int t;
+    for(t=0; t<curCachePtr->numtextsymbols; t++) {
+      int s;
+      textSymbolObj *ts = curCachePtr->textsymbols[t];
+      /* check for intersect with textpath */
+      if(ts->textpath && testSegmentLabelBBoxIntersection(leaderbbox, lp1, lp2, &ts->textpath->bounds) == MS_FALSE) {
+        return MS_FALSE;
+      }
+      /* check for intersect with label's labelpnt styles */
+      if(ts->style_bounds) {
+        for(s=0; s<ts->label->numstyles; s++) {
+          if(ts->label->styles[s]->_geomtransform.type == MS_GEOMTRANSFORM_LABELPOINT) {
+            if(testSegmentLabelBBoxIntersection(leaderbbox, lp1,lp2, ts->style_bounds[s]) == MS_FALSE) {
+              return MS_FALSE;
+            }
+          }
+        }
+      }
+    }
+    if(curCachePtr->leaderbbox) {
+      if(msIntersectSegments(lp1,lp2,&(curCachePtr->leaderline->point[0]), &(curCachePtr->leaderline->point[1])) ==  MS_TRUE) {
+        return MS_FALSE;
+      }
+    }
+  }
+  return MS_TRUE;
+}
+
 int msTestLabelCacheLeaderCollision(mapObj *map, pointObj *lp1, pointObj *lp2) {
   int p;
   rectObj leaderbbox;
+  labelCacheGridObj *grid = msGetLabelCacheGrid(map);
   leaderbbox.minx = MS_MIN(lp1->x,lp2->x);
   leaderbbox.maxx = MS_MAX(lp1->x,lp2->x);
   leaderbbox.miny = MS_MIN(lp1->y,lp2->y);
   leaderbbox.maxy = MS_MAX(lp1->y,lp2->y);
-  for(p=0; p<map->labelcache.num_rendered_members; p++) {
-    labelCacheMemberObj *curCachePtr= map->labelcache.rendered_text_symbols[p];
-    if(msRectOverlap(&leaderbbox, &(curCachePtr->bbox))) {
-    /* leaderbbox interesects with the curCachePtr's global bbox */
-      int t;
-      for(t=0; t<curCachePtr->numtextsymbols; t++) {
-        int s;
-        textSymbolObj *ts = curCachePtr->textsymbols[t];
-        /* check for intersect with textpath */
-        if(ts->textpath && testSegmentLabelBBoxIntersection(&leaderbbox, lp1, lp2, &ts->textpath->bounds) == MS_FALSE) {
-          return MS_FALSE;
-        }
-        /* check for intersect with label's labelpnt styles */
-        if(ts->style_bounds) {
-          for(s=0; s<ts->label->numstyles; s++) {
-            if(ts->label->styles[s]->_geomtransform.type == MS_GEOMTRANSFORM_LABELPOINT) {
-              if(testSegmentLabelBBoxIntersection(&leaderbbox, lp1,lp2, ts->style_bounds[s]) == MS_FALSE) {
-                return MS_FALSE;
-              }
-            }
-          }
-        }
-      }
-      if(curCachePtr->leaderbbox) {
-        if(msIntersectSegments(lp1,lp2,&(curCachePtr->leaderline->point[0]), &(curCachePtr->leaderline->point[1])) ==  MS_TRUE) {
-          return MS_FALSE;
+
+  if(grid) {
+    int x, y, x0, y0, x1, y1;
+    labelCacheGridRange(grid, &leaderbbox, &x0, &y0, &x1, &y1);
+    for(y=y0; y<=y1; y++) {
+      for(x=x0; x<=x1; x++) {
+        labelCacheGridCellObj *cell = &grid->cells[y * grid->width + x];
+        for(p=0; p<cell->numentries; p++) {
+          labelCacheGridEntryObj *entry = &cell->entries[p];
+          if(entry->priority >= 0 || x != MS_MAX(x0, entry->cellx) || y != MS_MAX(y0, entry->celly))
+            continue; /* a marker, or tested in another cell */
+          if(testRenderedLabelLeaderCollision(map->labelcache.rendered_text_symbols[entry->id], &leaderbbox, lp1, lp2) == MS_FALSE)
+            return MS_FALSE;
         }
       }
     }
+    return MS_TRUE;
+  }
+
+  for(p=0; p<map->labelcache.num_rendered_members; p++) {
+    if(testRenderedLabelLeaderCollision(map->labelcache.rendered_text_symbols[p], &leaderbbox, lp1, lp2) == MS_FALSE)
+      return MS_FALSE;
   }
   return MS_TRUE;
 }
@@ -764,11 +970,44 @@ int msTestLabelCacheLeaderCollision(mapObj *map, pointObj *lp1, pointObj *lp2) {
 int msTestLabelCacheCollisions(mapObj *map, labelCacheMemberObj *cachePtr, label_bounds *bounds,
               int current_priority, int current_label);
 */
+static int testRenderedLabelCollision(labelCacheMemberObj *curCachePtr, label_bounds *lb)
+{
+  int i;
+
+  if(msRectOverlap(&curCachePtr->bbox,&lb->bbox)) {
+    for(i=0; i<curCachePtr->numtextsymbols; i++) {
+      int j;
+      textSymbolObj *ts = curCachePtr->textsymbols[i];
+      if(ts->textpath && intersectLabelPolygons(ts->textpath->bounds.poly, &ts->textpath->bounds.bbox, lb->poly, &lb->bbox) == MS_TRUE ) {
+        return MS_FALSE;
+      }
+      if(ts->style_bounds) {
+        for(j=0;j<ts->label->numstyles;j++) {
+          if(ts->style_bounds[j] && ts->label->styles[j]->_geomtransform.type == MS_GEOMTRANSFORM_LABELPOINT) {
+            if(intersectLabelPolygons(ts->style_bounds[j]->poly, &ts->style_bounds[j]->bbox,
+                lb->poly, &lb->bbox)) {
+              return MS_FALSE;
+            }
+          }
+        }
+      }
+    }
+  }
+  if(curCachePtr->leaderline) {
+    if(testSegmentLabelBBoxIntersection(curCachePtr->leaderbbox, &curCachePtr->leaderline->point[0],
+        &curCachePtr->leaderline->point[1], lb) == MS_FALSE) {
+      return MS_FALSE;
+    }
+  }
+  return MS_TRUE;
+}
+
 int msTestLabelCacheCollisions(mapObj *map, labelCacheMemberObj *cachePtr, label_bounds *lb,
         int current_priority, int current_label)
 {
   labelCacheObj *labelcache = &(map->labelcache);
-  int i, p, ll;
+  labelCacheGridObj *grid;
+  int p, ll;
 
   /*
    * Check against image bounds first
@@ -779,6 +1018,38 @@ int msTestLabelCacheCollisions(mapObj *map, labelCacheMemberObj *cachePtr, label
     }
   }
 
+  /*
+   * Only look at the markers and labels registered in the grid cells around
+   * the candidate, if we have a grid
+   */
+  grid = msGetLabelCacheGrid(map);
+  if(grid) {
+    int x, y, x0, y0, x1, y1;
+    labelCacheGridRange(grid, &lb->bbox, &x0, &y0, &x1, &y1);
+    for(y=y0; y<=y1; y++) {
+      for(x=x0; x<=x1; x++) {
+        labelCacheGridCellObj *cell = &grid->cells[y * grid->width + x];
+        for(ll=0; ll<cell->numentries; ll++) {
+          labelCacheGridEntryObj *entry = &cell->entries[ll];
+          if(x != MS_MAX(x0, entry->cellx) || y != MS_MAX(y0, entry->celly))
+            continue; /* tested in another cell */
+          if(entry->priority < 0) {
+            if(testRenderedLabelCollision(labelcache->rendered_text_symbols[entry->id], lb) == MS_FALSE)
+              return MS_FALSE;
+          } else if(entry->priority >= current_priority) {
+            markerCacheMemberObj *marker = &(labelcache->slots[entry->priority].markers[entry->id]);
+            if ( !(entry->priority == current_priority && current_label == marker->id ) ) {  /* labels can overlap their own marker */
+              if ( intersectLabelPolygons(NULL, &marker->bounds, lb->poly, &lb->bbox ) == MS_TRUE ) {
+                return MS_FALSE;
+              }
+            }
+          }
+        }
+      }
+    }
+    return MS_TRUE;
+  }
+
   /* Compare against all rendered markers from this priority level and higher.
   ** Labels can overlap their own marker and markers from lower priority levels
   */
@@ -796,32 +1067,8 @@ int msTestLabelCacheCollisions(mapObj *map, labelCacheMemberObj *cachePtr, label
   }
 
   for(p=0; p<labelcache->num_rendered_members; p++) {
-    labelCacheMemberObj *curCachePtr= labelcache->rendered_text_symbols[p];
-    if(msRectOverlap(&curCachePtr->bbox,&lb->bbox)) {
-      for(i=0; i<curCachePtr->numtextsymbols; i++) {
-        int j;
-        textSymbolObj *ts = curCachePtr->textsymbols[i];
-        if(ts->textpath && intersectLabelPolygons(ts->textpath->bounds.poly, &ts->textpath->bounds.bbox, lb->poly, &lb->bbox) == MS_TRUE ) {
-          return MS_FALSE;
-        }
-        if(ts->style_bounds) {
-          for(j=0;j<ts->label->numstyles;j++) {
-            if(ts->style_bounds[j] && ts->label->styles[j]->_geomtransform.type == MS_GEOMTRANSFORM_LABELPOINT) {
-              if(intersectLabelPolygons(ts->style_bounds[j]->poly, &ts->style_bounds[j]->bbox,
-                  lb->poly, &lb->bbox)) {
-                return MS_FALSE;
-              }
-            }
-          }
-        }
-      }
-    }
-    if(curCachePtr->leaderline) {
-      if(testSegmentLabelBBoxIntersection(curCachePtr->leaderbbox, &curCachePtr->leaderline->point[0],
-          &curCachePtr->leaderline->point[1], lb) == MS_FALSE) {
-        return MS_FALSE;
-      }
-    }
+    if(testRenderedLabelCollision(labelcache->rendered_text_symbols[p], lb) == MS_FALSE)
+      return MS_FALSE;
   }
   return MS_TRUE;
 }
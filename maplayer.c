@@ -437,6 +437,10 @@ void msLayerClose(layerObj *layer)
     layer->vtable->LayerClose(layer);
   }
   msLayerRestoreFromScaletokens(layer);
+
+  /* the recycled shape buffers only live as long as the layer is open */
+  msFreeShapePool(layer->shapepool);
+  layer->shapepool = NULL;
 }
 
 /*
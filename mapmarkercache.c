@@ -0,0 +1,437 @@
+/******************************************************************************
+ * $Id$
+ *
+ * Project:  MapServer
+ * Purpose:  Process-wide cache of rasterized marker symbols.
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2016 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "mapserver.h"
+#include "mapthread.h"
+#include "fontcache.h"
+
+/* rotations are rendered to the nearest step, in degrees */
+#define MS_MARKERCACHE_ROTATION_STEP 1.0
+/* positions are rendered to the nearest 1/MS_MARKERCACHE_SUBPIXELS pixel */
+#define MS_MARKERCACHE_SUBPIXELS 8
+/* larger sprites are not worth keeping */
+#define MS_MARKERCACHE_MAX_SPRITE 256
+#define MS_MARKERCACHE_BUCKETS 1024
+/* symbol files are checked for changes at most this often, in seconds */
+#define MS_MARKERCACHE_STAT_INTERVAL 1
+
+/************************************************************************/
+/*                          markerCacheObj                              */
+/*                                                                      */
+/*      A marker symbol rendered once on a transparent square sprite,   */
+/*      centered on the sprite center shifted by the sub-pixel offset   */
+/*      that is part of the key. Entries are found through a hash       */
+/*      table and kept in most recently used order. An evicted entry    */
+/*      still being drawn by another thread is freed by its last user.  */
+/************************************************************************/
+typedef struct markerCacheObj {
+  char *key;
+  unsigned int hash;
+  rasterBufferObj sprite;
+  size_t size;
+  int refcount;
+  int evicted;
+  struct markerCacheObj *hashnext;
+  struct markerCacheObj *prev, *next;
+} markerCacheObj;
+
+static markerCacheObj *markerCacheBuckets[MS_MARKERCACHE_BUCKETS];
+static markerCacheObj *markerCacheHead = NULL, *markerCacheTail = NULL;
+static size_t markerCacheMaxSize = 0;
+static size_t markerCacheUsed = 0;
+static long markerCacheHits = 0, markerCacheMisses = 0;
+
+/*
+** Modification time and size of the symbol files, which are part of the
+** keys so that a replaced image or font gets new sprites.
+*/
+typedef struct markerSourceObj {
+  char *path;
+  time_t checked;
+  char stamp[64];
+  struct markerSourceObj *next;
+} markerSourceObj;
+
+static markerSourceObj *markerSources = NULL;
+
+static unsigned int markerCacheHash(const char *key)
+{
+  unsigned int hash = 2166136261U;
+  while(*key) {
+    hash ^= (unsigned char) *key++;
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+static void freeMarkerCacheObj(markerCacheObj *entry)
+{
+  msFree(entry->key);
+  msFreeRasterBuffer(&entry->sprite);
+  free(entry);
+}
+
+static void markerCacheUnlinkLRU(markerCacheObj *entry)
+{
+  if(entry->prev) entry->prev->next = entry->next;
+  else markerCacheHead = entry->next;
+  if(entry->next) entry->next->prev = entry->prev;
+  else markerCacheTail = entry->prev;
+  entry->prev = entry->next = NULL;
+}
+
+static void markerCachePushLRU(markerCacheObj *entry)
+{
+  entry->prev = NULL;
+  entry->next = markerCacheHead;
+  if(markerCacheHead) markerCacheHead->prev = entry;
+  markerCacheHead = entry;
+  if(!markerCacheTail) markerCacheTail = entry;
+}
+
+/* Removes an entry from the cache, must be called with the lock held. */
+static void markerCacheEvict(markerCacheObj *entry)
+{
+  markerCacheObj **ppsEntry = &markerCacheBuckets[entry->hash % MS_MARKERCACHE_BUCKETS];
+
+  while(*ppsEntry != entry)
+    ppsEntry = &((*ppsEntry)->hashnext);
+  *ppsEntry = entry->hashnext;
+  markerCacheUnlinkLRU(entry);
+  markerCacheUsed -= entry->size;
+
+  if(entry->refcount == 0)
+    freeMarkerCacheObj(entry);
+  else
+    entry->evicted = MS_TRUE;
+}
+
+/* Drops the least recently used entries beyond the memory budget. */
+static void trimMarkerCache(void)
+{
+  while(markerCacheTail && markerCacheUsed > markerCacheMaxSize)
+    markerCacheEvict(markerCacheTail);
+}
+
+static markerCacheObj *markerCacheLookup(const char *key, unsigned int hash)
+{
+  markerCacheObj *entry = markerCacheBuckets[hash % MS_MARKERCACHE_BUCKETS];
+
+  while(entry) {
+    if(entry->hash == hash && strcmp(entry->key, key) == 0)
+      return entry;
+    entry = entry->hashnext;
+  }
+  return NULL;
+}
+
+static void markerCacheRelease(markerCacheObj *entry)
+{
+  msAcquireLock(TLOCK_MARKERCACHE);
+  entry->refcount--;
+  if(entry->evicted && entry->refcount == 0)
+    freeMarkerCacheObj(entry);
+  msReleaseLock(TLOCK_MARKERCACHE);
+}
+
+static void formatColor(char *buffer, size_t size, colorObj *color)
+{
+  if(color)
+    snprintf(buffer, size, "%d,%d,%d,%d", color->red, color->green, color->blue, color->alpha);
+  else
+    strlcpy(buffer, "-", size);
+}
+
+static void markerCacheSourceStamp(const char *path, char *stamp, size_t size)
+{
+  markerSourceObj *source;
+  struct stat sStat;
+  time_t now = time(NULL);
+
+  msAcquireLock(TLOCK_MARKERCACHE);
+  for(source = markerSources; source != NULL; source = source->next) {
+    if(strcmp(source->path, path) == 0)
+      break;
+  }
+  if(source && now - source->checked < MS_MARKERCACHE_STAT_INTERVAL) {
+    strlcpy(stamp, source->stamp, size);
+    msReleaseLock(TLOCK_MARKERCACHE);
+    return;
+  }
+  msReleaseLock(TLOCK_MARKERCACHE);
+
+  if(stat(path, &sStat) == 0)
+    snprintf(stamp, size, "%ld:%ld", (long) sStat.st_mtime, (long) sStat.st_size);
+  else
+    strlcpy(stamp, "-", size);
+
+  msAcquireLock(TLOCK_MARKERCACHE);
+  for(source = markerSources; source != NULL; source = source->next) {
+    if(strcmp(source->path, path) == 0)
+      break;
+  }
+  if(!source) {
+    source = (markerSourceObj *) msSmallCalloc(1, sizeof(markerSourceObj));
+    source->path = msStrdup(path);
+    source->next = markerSources;
+    markerSources = source;
+  }
+  source->checked = now;
+  strlcpy(source->stamp, stamp, sizeof(source->stamp));
+  msReleaseLock(TLOCK_MARKERCACHE);
+}
+
+/*
+** Sets the memory budget of the cache, in bytes. A size of 0 (the default)
+** disables it altogether.
+*/
+void msMarkerCacheSetSize(size_t size)
+{
+  msAcquireLock(TLOCK_MARKERCACHE);
+  markerCacheMaxSize = size;
+  trimMarkerCache();
+  msReleaseLock(TLOCK_MARKERCACHE);
+}
+
+size_t msMarkerCacheGetSize(void)
+{
+  return markerCacheMaxSize;
+}
+
+/* Called by msSetup(), MS_MARKER_CACHE_SIZE is the budget in kilobytes */
+void msMarkerCacheSetup(void)
+{
+  if(getenv("MS_MARKER_CACHE_SIZE"))
+    msMarkerCacheSetSize((size_t) atoi(getenv("MS_MARKER_CACHE_SIZE")) * 1024);
+}
+
+void msMarkerCacheGetStats(long *hits, long *misses, size_t *used)
+{
+  msAcquireLock(TLOCK_MARKERCACHE);
+  if(hits) *hits = markerCacheHits;
+  if(misses) *misses = markerCacheMisses;
+  if(used) *used = markerCacheUsed;
+  msReleaseLock(TLOCK_MARKERCACHE);
+}
+
+/*
+** Draws a pixmap, SVG or truetype marker centered on (x,y) from a sprite
+** rasterized once per process for a given symbol source, size, rotation,
+** colors and sub-pixel position, so that icons repeated thousands of times
+** across features and requests are only blended, not re-rendered.
+**
+** Only done for the AGG renderer, whose buffers the sprites are blended
+** back into as is. Rotations are rounded to MS_MARKERCACHE_ROTATION_STEP
+** degrees and positions to 1/MS_MARKERCACHE_SUBPIXELS pixel.
+**
+** Returns MS_DONE when the marker is not cacheable and must be rendered
+** directly by the caller.
+*/
+int msMarkerCacheDrawSymbol(mapObj *map, imageObj *image, symbolObj *symbol,
+                            symbolStyleObj *s, double x, double y)
+{
+  rendererVTableObj *renderer = MS_IMAGE_RENDERER(image);
+  markerCacheObj *entry, *other;
+  const char *source = NULL;
+  char key[MS_MAXPATHLEN + 320];
+  char color[32], outlinecolor[32], backgroundcolor[32], stamp[64];
+  unsigned int hash;
+  double rotation, qx, qy;
+  int rotationbucket, ix, iy, fx, fy;
+  int status;
+
+  if(markerCacheMaxSize == 0 || image->format->renderer != MS_RENDER_WITH_AGG)
+    return MS_DONE;
+
+  switch(symbol->type) {
+    case MS_SYMBOL_PIXMAP:
+      /* unscaled and unrotated pixmaps are already a plain copy */
+      if(s->scale == 1 && s->rotation == 0)
+        return MS_DONE;
+      source = symbol->full_pixmap_path ? symbol->full_pixmap_path : symbol->imagepath;
+      break;
+    case MS_SYMBOL_SVG:
+      source = symbol->full_pixmap_path;
+      break;
+    case MS_SYMBOL_TRUETYPE:
+      if(symbol->font && symbol->character)
+        source = msLookupHashTable(&(map->fontset.fonts), symbol->font);
+      break;
+    default:
+      break;
+  }
+  /* inline images and vector symbols have no identity outside their mapfile */
+  if(!source)
+    return MS_DONE;
+
+  rotation = s->rotation * MS_RAD_TO_DEG;
+  rotationbucket = (int) floor(rotation / MS_MARKERCACHE_ROTATION_STEP + 0.5);
+  rotationbucket %= (int) (360 / MS_MARKERCACHE_ROTATION_STEP);
+  if(rotationbucket < 0)
+    rotationbucket += (int) (360 / MS_MARKERCACHE_ROTATION_STEP);
+
+  qx = floor(x * MS_MARKERCACHE_SUBPIXELS + 0.5) / MS_MARKERCACHE_SUBPIXELS;
+  qy = floor(y * MS_MARKERCACHE_SUBPIXELS + 0.5) / MS_MARKERCACHE_SUBPIXELS;
+  ix = (int) floor(qx);
+  iy = (int) floor(qy);
+  fx = (int) ((qx - ix) * MS_MARKERCACHE_SUBPIXELS);
+  fy = (int) ((qy - iy) * MS_MARKERCACHE_SUBPIXELS);
+
+  markerCacheSourceStamp(source, stamp, sizeof(stamp));
+  formatColor(color, sizeof(color), s->color);
+  formatColor(outlinecolor, sizeof(outlinecolor), s->outlinecolor);
+  formatColor(backgroundcolor, sizeof(backgroundcolor), s->backgroundcolor);
+  if(snprintf(key, sizeof(key), "%d|%d|%s|%s|%s|%d|%d|%.3f|%d|%.2f|%s|%s|%s|%d|%d",
+              image->format->renderer, symbol->type, source, stamp,
+              symbol->character ? symbol->character : "",
+              symbol->transparent, symbol->transparentcolor,
+              s->scale, rotationbucket, s->outlinewidth,
+              color, outlinecolor, backgroundcolor, fx, fy) >= (int) sizeof(key))
+    return MS_DONE;
+  hash = markerCacheHash(key);
+
+  msAcquireLock(TLOCK_MARKERCACHE);
+  entry = markerCacheLookup(key, hash);
+  if(entry) {
+    markerCacheHits++;
+    entry->refcount++;
+    markerCacheUnlinkLRU(entry);
+    markerCachePushLRU(entry);
+  } else {
+    markerCacheMisses++;
+  }
+  msReleaseLock(TLOCK_MARKERCACHE);
+
+  if(!entry) {
+    /* rasterize outside of the lock, another thread may do the same */
+    symbolStyleObj ss = *s;
+    double width, height;
+    int size;
+    imageObj *spriteimg;
+
+    if(symbol->type == MS_SYMBOL_PIXMAP) {
+      width = symbol->pixmap_buffer->width * s->scale;
+      height = symbol->pixmap_buffer->height * s->scale;
+    } else if(symbol->type == MS_SYMBOL_SVG) {
+      width = symbol->sizex * s->scale;
+      height = symbol->sizey * s->scale;
+    } else {
+      unsigned int unicode;
+      glyph_element *glyphc;
+      face_element *face = msGetFontFace(symbol->font, &map->fontset);
+      if(!face)
+        return MS_DONE;
+      msUTF8ToUniChar(symbol->character, &unicode);
+      unicode = msGetGlyphIndex(face, unicode);
+      glyphc = msGetGlyphByIndex(face, MS_MAX(MS_NINT(s->scale),1), unicode);
+      if(!glyphc)
+        return MS_DONE;
+      width = glyphc->metrics.maxx - glyphc->metrics.minx;
+      height = glyphc->metrics.maxy - glyphc->metrics.miny;
+    }
+
+    /* room for any rotation, the outline and antialiasing */
+    size = (int) ceil(sqrt(width * width + height * height) + 2 * s->outlinewidth) + 4;
+    size += size & 1;
+    if(size > MS_MARKERCACHE_MAX_SPRITE)
+      return MS_DONE;
+
+    spriteimg = msImageCreate(size, size, image->format, NULL, NULL,
+                              image->resolution, image->resolution, NULL);
+    if(!spriteimg)
+      return MS_FAILURE;
+
+    ss.rotation = rotationbucket * MS_MARKERCACHE_ROTATION_STEP * MS_DEG_TO_RAD;
+    status = msRenderMarkerSymbol(map, spriteimg, symbol, &ss,
+                                  size / 2.0 + (double) fx / MS_MARKERCACHE_SUBPIXELS,
+                                  size / 2.0 + (double) fy / MS_MARKERCACHE_SUBPIXELS);
+
+    entry = (markerCacheObj *) msSmallCalloc(1, sizeof(markerCacheObj));
+    if(status == MS_SUCCESS)
+      status = renderer->getRasterBufferCopy(spriteimg, &entry->sprite);
+    msFreeImage(spriteimg);
+    if(status != MS_SUCCESS) {
+      free(entry);
+      return MS_FAILURE;
+    }
+
+    entry->key = msStrdup(key);
+    entry->hash = hash;
+    entry->size = sizeof(markerCacheObj) + strlen(key) + 1 +
+                  (size_t) entry->sprite.height * entry->sprite.data.rgba.row_step;
+    entry->refcount = 1;
+
+    msAcquireLock(TLOCK_MARKERCACHE);
+    other = markerCacheLookup(key, hash);
+    if(other) {
+      /* lost the race, use the sprite already there */
+      freeMarkerCacheObj(entry);
+      entry = other;
+      entry->refcount++;
+    } else {
+      entry->hashnext = markerCacheBuckets[hash % MS_MARKERCACHE_BUCKETS];
+      markerCacheBuckets[hash % MS_MARKERCACHE_BUCKETS] = entry;
+      markerCachePushLRU(entry);
+      markerCacheUsed += entry->size;
+      trimMarkerCache(); /* may evict entry itself, our reference keeps it alive */
+    }
+    msReleaseLock(TLOCK_MARKERCACHE);
+  }
+
+  status = renderer->mergeRasterBuffer(image, &entry->sprite, 1.0, 0, 0,
+                                       ix - entry->sprite.width / 2,
+                                       iy - entry->sprite.height / 2,
+                                       entry->sprite.width, entry->sprite.height);
+  markerCacheRelease(entry);
+
+  return status;
+}
+
+void msMarkerCacheCleanup(void)
+{
+  msAcquireLock(TLOCK_MARKERCACHE);
+  if(msGetGlobalDebugLevel() >= MS_DEBUGLEVEL_V && (markerCacheHits || markerCacheMisses))
+    msDebug("msMarkerCacheCleanup(): %ld hits, %ld misses, %ld bytes in use.\n",
+            markerCacheHits, markerCacheMisses, (long) markerCacheUsed);
+  while(markerCacheTail)
+    markerCacheEvict(markerCacheTail);
+  while(markerSources) {
+    markerSourceObj *next = markerSources->next;
+    msFree(markerSources->path);
+    free(markerSources);
+    markerSources = next;
+  }
+  markerCacheHits = markerCacheMisses = 0;
+  msReleaseLock(TLOCK_MARKERCACHE);
+}
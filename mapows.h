@@ -423,6 +423,15 @@ void msGMLWriteWFSBounds(mapObj *map, FILE *stream, const char *tab,
 MS_DLL_EXPORT int msGMLWriteWFSQuery(mapObj *map, FILE *stream, const char *wfs_namespace,
                                      OWSGMLVersion outputformat, int nWFSVersion, int bUseURN,
                                      int bGetPropertyValueRequest);
+
+typedef struct msGMLWFSStream msGMLWFSStream;
+msGMLWFSStream *msGMLStartWFSStream(mapObj *map, FILE *stream,
+                                    const char *default_namespace_prefix,
+                                    OWSGMLVersion outputformat, int nWFSVersion,
+                                    int bUseURN, int maxfeatures);
+int msGMLWriteWFSStreamFeature(mapObj *map, layerObj *lp, shapeObj *shape,
+                               void *callback_data);
+int msGMLEndWFSStream(msGMLWFSStream *psStream);
 #endif
 
 
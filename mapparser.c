@@ -2489,11 +2489,17 @@ yyreduce:
 
   case 68:
 #line 619 "mapparser.y"
-    { (yyval.dblval) = (int)(yyvsp[(1) - (3)].dblval) % (int)(yyvsp[(3) - (3)].dblval); }
+    {
+    if((int)(yyvsp[(3) - (3)].dblval) == 0) {
+      yyerror(p, "Division by zero.");
+      return(-1);
+    } else
+      (yyval.dblval) = (int)(yyvsp[(1) - (3)].dblval) % (int)(yyvsp[(3) - (3)].dblval);
+  }
     break;
 
   case 69:
-#line 620 "mapparser.y"
+#line 626 "mapparser.y"
     {
     if((yyvsp[(3) - (3)].dblval) == 0.0) {
       yyerror(p, "Division by zero.");
@@ -2504,22 +2510,22 @@ yyreduce:
     break;
 
   case 70:
-#line 627 "mapparser.y"
+#line 633 "mapparser.y"
     { (yyval.dblval) = (yyvsp[(2) - (2)].dblval); }
     break;
 
   case 71:
-#line 628 "mapparser.y"
+#line 634 "mapparser.y"
     { (yyval.dblval) = pow((yyvsp[(1) - (3)].dblval), (yyvsp[(3) - (3)].dblval)); }
     break;
 
   case 72:
-#line 629 "mapparser.y"
+#line 635 "mapparser.y"
     { (yyval.dblval) = strlen((yyvsp[(3) - (4)].strval)); }
     break;
 
   case 73:
-#line 630 "mapparser.y"
+#line 636 "mapparser.y"
     {
     if((yyvsp[(3) - (4)].shpval)->type != MS_SHAPE_POLYGON) {
       yyerror(p, "Area can only be computed for polygon shapes.");
@@ -2531,17 +2537,17 @@ yyreduce:
     break;
 
   case 74:
-#line 638 "mapparser.y"
+#line 644 "mapparser.y"
     { (yyval.dblval) = (MS_NINT((yyvsp[(3) - (6)].dblval)/(yyvsp[(5) - (6)].dblval)))*(yyvsp[(5) - (6)].dblval); }
     break;
 
   case 76:
-#line 642 "mapparser.y"
+#line 648 "mapparser.y"
     { (yyval.shpval) = (yyvsp[(2) - (3)].shpval); }
     break;
 
   case 77:
-#line 643 "mapparser.y"
+#line 649 "mapparser.y"
     {
     shapeObj *s;
     s = msGEOSBuffer((yyvsp[(3) - (6)].shpval), (yyvsp[(5) - (6)].dblval));
@@ -2555,7 +2561,7 @@ yyreduce:
     break;
 
   case 78:
-#line 653 "mapparser.y"
+#line 659 "mapparser.y"
     {
     shapeObj *s;
     s = msGEOSDifference((yyvsp[(3) - (6)].shpval), (yyvsp[(5) - (6)].shpval));
@@ -2569,7 +2575,7 @@ yyreduce:
     break;
 
   case 79:
-#line 663 "mapparser.y"
+#line 669 "mapparser.y"
     {
     shapeObj *s;
     s = msGEOSSimplify((yyvsp[(3) - (6)].shpval), (yyvsp[(5) - (6)].dblval));
@@ -2583,7 +2589,7 @@ yyreduce:
     break;
 
   case 80:
-#line 673 "mapparser.y"
+#line 679 "mapparser.y"
     {
     shapeObj *s;
     s = msGEOSTopologyPreservingSimplify((yyvsp[(3) - (6)].shpval), (yyvsp[(5) - (6)].dblval));
@@ -2597,7 +2603,7 @@ yyreduce:
     break;
 
   case 81:
-#line 683 "mapparser.y"
+#line 689 "mapparser.y"
     {
     shapeObj *s;
     s = msGeneralize((yyvsp[(3) - (6)].shpval), (yyvsp[(5) - (6)].dblval));
@@ -2611,7 +2617,7 @@ yyreduce:
     break;
 
   case 82:
-#line 693 "mapparser.y"
+#line 699 "mapparser.y"
     {
     shapeObj *s;
     s = msSmoothShapeSIA((yyvsp[(3) - (4)].shpval), 3, 1, NULL);
@@ -2625,7 +2631,7 @@ yyreduce:
     break;
 
   case 83:
-#line 703 "mapparser.y"
+#line 709 "mapparser.y"
     {
     shapeObj *s;
     s = msSmoothShapeSIA((yyvsp[(3) - (6)].shpval), (yyvsp[(5) - (6)].dblval), 1, NULL);
@@ -2639,7 +2645,7 @@ yyreduce:
     break;
 
   case 84:
-#line 713 "mapparser.y"
+#line 719 "mapparser.y"
     {
     shapeObj *s;
     s = msSmoothShapeSIA((yyvsp[(3) - (8)].shpval), (yyvsp[(5) - (8)].dblval), (yyvsp[(7) - (8)].dblval), NULL);
@@ -2653,7 +2659,7 @@ yyreduce:
     break;
 
   case 85:
-#line 723 "mapparser.y"
+#line 729 "mapparser.y"
     {
     shapeObj *s;
     s = msSmoothShapeSIA((yyvsp[(3) - (10)].shpval), (yyvsp[(5) - (10)].dblval), (yyvsp[(7) - (10)].dblval), (yyvsp[(9) - (10)].strval));
@@ -2668,7 +2674,7 @@ yyreduce:
     break;
 
   case 86:
-#line 734 "mapparser.y"
+#line 740 "mapparser.y"
     {
 #ifdef USE_V8_MAPSCRIPT
     shapeObj *s;
@@ -2688,12 +2694,12 @@ yyreduce:
     break;
 
   case 88:
-#line 753 "mapparser.y"
+#line 759 "mapparser.y"
     { (yyval.strval) = (yyvsp[(2) - (3)].strval); }
     break;
 
   case 89:
-#line 754 "mapparser.y"
+#line 760 "mapparser.y"
     { 
     (yyval.strval) = (char *)malloc(strlen((yyvsp[(1) - (3)].strval)) + strlen((yyvsp[(3) - (3)].strval)) + 1);
     sprintf((yyval.strval), "%s%s", (yyvsp[(1) - (3)].strval), (yyvsp[(3) - (3)].strval)); free((yyvsp[(1) - (3)].strval)); free((yyvsp[(3) - (3)].strval)); 
@@ -2701,7 +2707,7 @@ yyreduce:
     break;
 
   case 90:
-#line 758 "mapparser.y"
+#line 764 "mapparser.y"
     {
     (yyval.strval) = (char *) malloc(strlen((yyvsp[(5) - (6)].strval)) + 64); /* Plenty big? Should use snprintf below... */
     sprintf((yyval.strval), (yyvsp[(5) - (6)].strval), (yyvsp[(3) - (6)].dblval));
@@ -2709,7 +2715,7 @@ yyreduce:
     break;
 
   case 91:
-#line 762 "mapparser.y"
+#line 768 "mapparser.y"
     {  
     (yyvsp[(3) - (4)].strval) = msCommifyString((yyvsp[(3) - (4)].strval)); 
     (yyval.strval) = (yyvsp[(3) - (4)].strval); 
@@ -2717,7 +2723,7 @@ yyreduce:
     break;
 
   case 92:
-#line 766 "mapparser.y"
+#line 772 "mapparser.y"
     {  
     msStringToUpper((yyvsp[(3) - (4)].strval)); 
     (yyval.strval) = (yyvsp[(3) - (4)].strval); 
@@ -2725,7 +2731,7 @@ yyreduce:
     break;
 
   case 93:
-#line 770 "mapparser.y"
+#line 776 "mapparser.y"
     {  
     msStringToLower((yyvsp[(3) - (4)].strval)); 
     (yyval.strval) = (yyvsp[(3) - (4)].strval); 
@@ -2733,7 +2739,7 @@ yyreduce:
     break;
 
   case 94:
-#line 774 "mapparser.y"
+#line 780 "mapparser.y"
     {  
     msStringInitCap((yyvsp[(3) - (4)].strval)); 
     (yyval.strval) = (yyvsp[(3) - (4)].strval); 
@@ -2741,7 +2747,7 @@ yyreduce:
     break;
 
   case 95:
-#line 778 "mapparser.y"
+#line 784 "mapparser.y"
     {  
     msStringFirstCap((yyvsp[(3) - (4)].strval)); 
     (yyval.strval) = (yyvsp[(3) - (4)].strval); 
@@ -2749,7 +2755,7 @@ yyreduce:
     break;
 
   case 97:
-#line 785 "mapparser.y"
+#line 791 "mapparser.y"
     { (yyval.tmval) = (yyvsp[(2) - (3)].tmval); }
     break;
 
@@ -2969,7 +2975,7 @@ yyreturn:
 }
 
 
-#line 788 "mapparser.y"
+#line 794 "mapparser.y"
 
 
 /*
@@ -616,7 +616,13 @@ math_exp: NUMBER
   | math_exp '+' math_exp { $$ = $1 + $3; }
   | math_exp '-' math_exp { $$ = $1 - $3; }
   | math_exp '*' math_exp { $$ = $1 * $3; }
-  | math_exp '%' math_exp { $$ = (int)$1 % (int)$3; }
+  | math_exp '%' math_exp {
+    if((int)$3 == 0) {
+      yyerror(p, "Division by zero.");
+      return(-1);
+    } else
+      $$ = (int)$1 % (int)$3;
+  }
   | math_exp '/' math_exp {
     if($3 == 0.0) {
       yyerror(p, "Division by zero.");
@@ -113,6 +113,11 @@ msPostGISLayerInfo *msPostGISCreateLayerInfo(void)
   layerinfo->rownum = 0;
   layerinfo->version = 0;
   layerinfo->paging = MS_TRUE;
+  layerinfo->binarywkb = MS_FALSE;
+  layerinfo->fetchsize = 0;
+  layerinfo->cursor = NULL;
+  layerinfo->cursortransaction = MS_FALSE;
+  layerinfo->rowoffset = 0;
 #ifdef USE_POINT_Z_M
   layerinfo->force2d = MS_FALSE;
 #else
@@ -121,6 +126,73 @@ msPostGISLayerInfo *msPostGISCreateLayerInfo(void)
   return layerinfo;
 }
 
+/*
+** msPostGISCloseCursor()
+**
+** Closes the cursor opened by msPostGISLayerWhichShapes(), if any, and ends
+** the transaction it was declared in. Cursors are only declared on a
+** connection with no transaction in progress, so no other layer's cursor
+** can be open in that transaction.
+*/
+static void msPostGISCloseCursor(msPostGISLayerInfo *layerinfo)
+{
+  char strSQL[128];
+  PGresult *pgresult;
+
+  if ( ! layerinfo->cursor )
+    return;
+
+  snprintf(strSQL, sizeof(strSQL), "CLOSE %s", layerinfo->cursor);
+  pgresult = PQexec(layerinfo->pgconn, strSQL);
+  if ( pgresult ) PQclear(pgresult);
+
+  if ( layerinfo->cursortransaction ) {
+    pgresult = PQexec(layerinfo->pgconn, "COMMIT");
+    if ( pgresult ) PQclear(pgresult);
+    layerinfo->cursortransaction = MS_FALSE;
+  }
+
+  free(layerinfo->cursor);
+  layerinfo->cursor = NULL;
+  layerinfo->rowoffset = 0;
+}
+
+/*
+** msPostGISFetchCursor()
+**
+** Replaces pgresult with the next batch of rows of the open cursor.
+*/
+static int msPostGISFetchCursor(layerObj *layer, msPostGISLayerInfo *layerinfo)
+{
+  char strSQL[128];
+  PGresult *pgresult;
+
+  snprintf(strSQL, sizeof(strSQL), "FETCH %d FROM %s", layerinfo->fetchsize, layerinfo->cursor);
+  pgresult = PQexecParams(layerinfo->pgconn, strSQL, 0, NULL, NULL, NULL, NULL, layerinfo->binarywkb);
+
+  if (!pgresult || PQresultStatus(pgresult) != PGRES_TUPLES_OK) {
+    msDebug("msPostGISFetchCursor(): Error (%s) executing query: %s\n", PQerrorMessage(layerinfo->pgconn), strSQL);
+    msSetError(MS_QUERYERR, "Error fetching from cursor. Check server logs","msPostGISFetchCursor()");
+    if (pgresult) {
+      PQclear(pgresult);
+    }
+    return MS_FAILURE;
+  }
+
+  if ( layer->debug > 1 ) {
+    msDebug("msPostGISFetchCursor got %d records.\n", PQntuples(pgresult));
+  }
+
+  if(layerinfo->pgresult) {
+    layerinfo->rowoffset += PQntuples(layerinfo->pgresult);
+    PQclear(layerinfo->pgresult);
+  }
+  layerinfo->pgresult = pgresult;
+  layerinfo->rownum = 0;
+
+  return MS_SUCCESS;
+}
+
 /*
 ** msPostGISFreeLayerInfo()
 */
@@ -128,6 +200,7 @@ void msPostGISFreeLayerInfo(layerObj *layer)
 {
   msPostGISLayerInfo *layerinfo = NULL;
   layerinfo = (msPostGISLayerInfo*)layer->layerinfo;
+  if ( layerinfo->cursor && layerinfo->pgconn ) msPostGISCloseCursor(layerinfo);
   if ( layerinfo->sql ) free(layerinfo->sql);
   if ( layerinfo->uid ) free(layerinfo->uid);
   if ( layerinfo->srid ) free(layerinfo->srid);
@@ -356,6 +429,16 @@ wkbReadPoint(wkbObj *w, int nZMFlag)
   return p;
 }
 
+/*
+** Allocate from the layer's shape pool, failing like msSmallMalloc().
+*/
+static void *
+wkbPoolAlloc(shapePoolObj *pool, size_t size)
+{
+  void *ptr = msShapePoolAlloc(pool, size);
+  return ptr ? ptr : msSmallMalloc(size);
+}
+
 /*
 ** Read a "point array" and return an allocated lineObj.
 ** A point array is a WKB fragment that starts with a
@@ -371,7 +454,7 @@ wkbReadLine(wkbObj *w, lineObj *line, int nZMFlag)
   int npoints = wkbReadInt(w);
 
   line->numpoints = npoints;
-  line->point = msSmallMalloc(npoints * sizeof(pointObj));
+  line->point = wkbPoolAlloc(w->pool, npoints * sizeof(pointObj));
   for ( i = 0; i < npoints; i++ ) {
     wkbReadPointP(w, &p, nZMFlag);
     line->point[i] = p;
@@ -439,7 +522,7 @@ wkbConvPointToShape(wkbObj *w, shapeObj *shape)
 
   if( ! (shape->type == MS_SHAPE_POINT) ) return MS_FAILURE;
   line.numpoints = 1;
-  line.point = msSmallMalloc(sizeof(pointObj));
+  line.point = wkbPoolAlloc(w->pool, sizeof(pointObj));
   line.point[0] = wkbReadPoint(w, nZMFlag);
   msAddLineDirectly(shape, &line);
   return MS_SUCCESS;
@@ -1692,6 +1775,9 @@ char *msPostGISBuildSQLItems(layerObj *layer)
     ** data once we get it. Forcing to 2D (via the AsBinary function
     ** which includes a 2D force in it) removes ordinates we don't
     ** need, saving transfer and encode/decode time.
+    **
+    ** In binary mode the rows are fetched in binary result format, so the
+    ** WKB comes through as is and the uid is cast to text to keep it readable.
     */
     char *force2d = "";
 #if TRANSFER_ENCODING == 64
@@ -1699,6 +1785,8 @@ char *msPostGISBuildSQLItems(layerObj *layer)
 #else
     const char *strGeomTemplate = "encode(ST_AsBinary(%s(\"%s\"),'%s'),'hex') as geom,\"%s\"";
 #endif
+    if( layerinfo->binarywkb )
+      strGeomTemplate = "ST_AsBinary(%s(\"%s\"),'%s') as geom,\"%s\"::text";
     if( layerinfo->force2d ) {
       if( layerinfo->version >= 20100 )
         force2d = "ST_Force2D";
@@ -1713,6 +1801,8 @@ char *msPostGISBuildSQLItems(layerObj *layer)
 #else
         strGeomTemplate = "encode(AsEWKB(%s(\"%s\"),'%s'),'hex') as geom,\"%s\"";
 #endif
+        if( layerinfo->binarywkb )
+          strGeomTemplate = "AsEWKB(%s(\"%s\"),'%s') as geom,\"%s\"::text";
     }
     strGeom = (char*)msSmallMalloc(strlen(strGeomTemplate) + strlen(force2d) + strlen(strEndian) + strlen(layerinfo->geomcolumn) + strlen(layerinfo->uid) + 1);
     sprintf(strGeom, strGeomTemplate, force2d, layerinfo->geomcolumn, strEndian, layerinfo->uid);
@@ -1735,14 +1825,15 @@ char *msPostGISBuildSQLItems(layerObj *layer)
     int length = strlen(strGeom) + 2;
     int t;
     for ( t = 0; t < layer->numitems; t++ ) {
-      length += strlen(layer->items[t]) + 3; /* itemname + "", */
+      length += strlen(layer->items[t]) + 9; /* itemname + ""::text, */
     }
     strItems = (char*)msSmallMalloc(length);
     strItems[0] = '\0';
     for ( t = 0; t < layer->numitems; t++ ) {
       strlcat(strItems, "\"", length);
       strlcat(strItems, layer->items[t], length);
-      strlcat(strItems, "\",", length);
+      /* in binary mode, text values come back as their plain text bytes */
+      strlcat(strItems, layerinfo->binarywkb ? "\"::text," : "\",", length);
     }
     strlcat(strItems, strGeom, length);
   }
@@ -2189,26 +2280,47 @@ int msPostGISReadShape(layerObj *layer, shapeObj *shape)
     return MS_FAILURE;
   }
 
-  if(wkbstrlen > wkbstaticsize) {
-    wkb = calloc(wkbstrlen, sizeof(char));
+  if( layerinfo->binarywkb ) {
+    /*
+    ** Binary results hold the WKB as is. Read it in place, unless the
+    ** SRID of a pre-2.0 EWKB has to be stripped, which rewrites the buffer.
+    */
+    if( layerinfo->version < 20000 && layerinfo->force2d == MS_FALSE ) {
+      if(wkbstrlen > wkbstaticsize) {
+        wkb = malloc(wkbstrlen);
+        MS_CHECK_ALLOC(wkb, wkbstrlen, MS_FAILURE);
+      } else {
+        wkb = wkbstatic;
+      }
+      memcpy(wkb, wkbstr, wkbstrlen);
+      w.wkb = (char*)wkb;
+    } else {
+      w.wkb = wkbstr;
+    }
+    w.size = wkbstrlen;
   } else {
-    wkb = wkbstatic;
-  }
+    if(wkbstrlen > wkbstaticsize) {
+      wkb = calloc(wkbstrlen, sizeof(char));
+    } else {
+      wkb = wkbstatic;
+    }
 #if TRANSFER_ENCODING == 64
-  result = msPostGISBase64Decode(wkb, wkbstr, wkbstrlen - 1);
+    result = msPostGISBase64Decode(wkb, wkbstr, wkbstrlen - 1);
 #else
-  result = msPostGISHexDecode(wkb, wkbstr, wkbstrlen);
+    result = msPostGISHexDecode(wkb, wkbstr, wkbstrlen);
 #endif
 
-  if( ! result ) {
-    if(wkb!=wkbstatic) free(wkb);
-    return MS_FAILURE;
+    if( ! result ) {
+      if(wkb!=wkbstatic) free(wkb);
+      return MS_FAILURE;
+    }
+    w.wkb = (char*)wkb;
+    w.size = (wkbstrlen - 1)/2;
   }
 
   /* Initialize our wkbObj */
-  w.wkb = (char*)wkb;
   w.ptr = w.wkb;
-  w.size = (wkbstrlen - 1)/2;
+  w.pool = layer->shapepool;
 
   /* Set the type map according to what version of PostGIS we are dealing with */
   if( layerinfo->version >= 20000 ) /* PostGIS 2.0+ */
@@ -2268,7 +2380,7 @@ int msPostGISReadShape(layerObj *layer, shapeObj *shape)
   }
 
   /* All done with WKB geometry, free it! */
-  if(wkb!=wkbstatic) free(wkb);
+  if(wkb && wkb!=wkbstatic) free(wkb);
 
   if (result != MS_FAILURE) {
     int t;
@@ -2276,7 +2388,7 @@ int msPostGISReadShape(layerObj *layer, shapeObj *shape)
     char *tmp;
     /* Found a drawable shape, so now retreive the attributes. */
 
-    shape->values = (char**) msSmallMalloc(sizeof(char*) * layer->numitems);
+    shape->values = (char**) wkbPoolAlloc(layer->shapepool, sizeof(char*) * layer->numitems);
     for ( t = 0; t < layer->numitems; t++) {
       int size = PQgetlength(layerinfo->pgresult, layerinfo->rownum, t);
       char *val = (char*)PQgetvalue(layerinfo->pgresult, layerinfo->rownum, t);
@@ -2284,7 +2396,7 @@ int msPostGISReadShape(layerObj *layer, shapeObj *shape)
       if ( isnull ) {
         shape->values[t] = msStrdup("");
       } else {
-        shape->values[t] = (char*) msSmallMalloc(size + 1);
+        shape->values[t] = (char*) wkbPoolAlloc(layer->shapepool, size + 1);
         memcpy(shape->values[t], val, size);
         shape->values[t][size] = '\0'; /* null terminate it */
         msStringTrimBlanks(shape->values[t]);
@@ -2309,7 +2421,7 @@ int msPostGISReadShape(layerObj *layer, shapeObj *shape)
       msDebug("msPostGISReadShape: Setting shape->resultindex = %ld\n", layerinfo->rownum);
     }
     shape->index = uid;
-    shape->resultindex = layerinfo->rownum;
+    shape->resultindex = layerinfo->rowoffset + layerinfo->rownum;
 
     if( layer->debug > 2 ) {
       msDebug("msPostGISReadShape: [index] %ld\n",  shape->index);
@@ -2345,6 +2457,8 @@ int msPostGISLayerOpen(layerObj *layer)
   msPostGISLayerInfo  *layerinfo;
   int order_test = 1;
   const char* force2d_processing;
+  const char* binarywkb_processing;
+  const char* fetchsize_processing;
 
   assert(layer != NULL);
 
@@ -2369,6 +2483,10 @@ int msPostGISLayerOpen(layerObj *layer)
   **/
   layerinfo = msPostGISCreateLayerInfo();
 
+  /* features are read into recycled buffers, released by msDrawVectorLayer() */
+  if(!layer->shapepool)
+    layer->shapepool = msCreateShapePool();
+
   if (((char*) &order_test)[0] == 1) {
     layerinfo->endian = LITTLE_ENDIAN;
   } else {
@@ -2475,6 +2593,18 @@ int msPostGISLayerOpen(layerObj *layer)
   if (layer->debug)
     msDebug("msPostGISLayerOpen: Forcing 2D geometries: %s.\n", (layerinfo->force2d)?"yes":"no");
 
+  fetchsize_processing = msLayerGetProcessingKey( layer, "CURSOR_FETCH_SIZE" );
+  if(fetchsize_processing && atoi(fetchsize_processing) > 0) {
+    layerinfo->fetchsize = atoi(fetchsize_processing);
+  }
+
+  binarywkb_processing = msLayerGetProcessingKey( layer, "BINARY_WKB" );
+  if(binarywkb_processing && !strcasecmp(binarywkb_processing,"yes")) {
+    layerinfo->binarywkb = MS_TRUE;
+  }
+  if (layer->debug)
+    msDebug("msPostGISLayerOpen: Binary WKB transfer: %s.\n", (layerinfo->binarywkb)?"yes":"no");
+
   /* Save the layerinfo in the layerObj. */
   layer->layerinfo = (void*)layerinfo;
 
@@ -2664,10 +2794,74 @@ int msPostGISLayerWhichShapes(layerObj *layer, rectObj rect, int isQuery)
 
   // fprintf(stderr, "SQL: %s\n", strSQL);
 
+  /* Drop any cursor left over from a previous request. */
+  msPostGISCloseCursor(layerinfo);
+
+  /*
+  ** When drawing, read the rows through a cursor a batch at a time, so that
+  ** only one batch is held in memory. Queries keep the whole result as the
+  ** result cache refers back to rows by index.
+  **
+  ** The cursor lives in a transaction of our own that is committed when it is
+  ** closed. A pooled connection may already be in a transaction holding
+  ** another layer's cursor, which that layer will commit while ours is still
+  ** being read, so in that case fall back to fetching all rows at once.
+  */
+  if(layerinfo->fetchsize > 0 && !isQuery && num_bind_values == 0 &&
+      PQtransactionStatus(layerinfo->pgconn) == PQTRANS_IDLE) {
+    char *strDeclare;
+    char strCursor[64];
+
+    snprintf(strCursor, sizeof(strCursor), "mscursor_%d", layer->index);
+    strDeclare = (char*)msSmallMalloc(strlen(strSQL) + strlen(strCursor) + 40);
+    sprintf(strDeclare, "DECLARE %s NO SCROLL CURSOR FOR %s", strCursor, strSQL);
+
+    pgresult = PQexec(layerinfo->pgconn, "BEGIN");
+    if(pgresult && PQresultStatus(pgresult) == PGRES_COMMAND_OK)
+      layerinfo->cursortransaction = MS_TRUE;
+    if(pgresult) PQclear(pgresult);
+
+    pgresult = PQexec(layerinfo->pgconn, strDeclare);
+    free(strDeclare);
+    if(pgresult && PQresultStatus(pgresult) == PGRES_COMMAND_OK) {
+      PQclear(pgresult);
+
+      layerinfo->cursor = msStrdup(strCursor);
+      layerinfo->rowoffset = 0;
+      if(layerinfo->pgresult) PQclear(layerinfo->pgresult);
+      layerinfo->pgresult = NULL;
+
+      free(bind_key);
+      free(layer_bind_values);
+
+      if(layerinfo->sql) free(layerinfo->sql);
+      layerinfo->sql = strSQL;
+
+      if(msPostGISFetchCursor(layer, layerinfo) != MS_SUCCESS) {
+        msPostGISCloseCursor(layerinfo);
+        return MS_FAILURE;
+      }
+      return MS_SUCCESS;
+    }
+
+    msDebug("msPostGISLayerWhichShapes(): Error (%s) declaring cursor: %s\n", PQerrorMessage(layerinfo->pgconn), strSQL);
+    msSetError(MS_QUERYERR, "Error executing query. Check server logs","msPostGISLayerWhichShapes()");
+    if(pgresult) PQclear(pgresult);
+    if(layerinfo->cursortransaction) {
+      pgresult = PQexec(layerinfo->pgconn, "ROLLBACK");
+      if(pgresult) PQclear(pgresult);
+      layerinfo->cursortransaction = MS_FALSE;
+    }
+    free(bind_key);
+    free(layer_bind_values);
+    free(strSQL);
+    return MS_FAILURE;
+  }
+
   if(num_bind_values > 0) {
     pgresult = PQexecParams(layerinfo->pgconn, strSQL, num_bind_values, NULL, (const char**)layer_bind_values, NULL, NULL, 1);
   } else {
-    pgresult = PQexecParams(layerinfo->pgconn, strSQL,0, NULL, NULL, NULL, NULL, 0);
+    pgresult = PQexecParams(layerinfo->pgconn, strSQL,0, NULL, NULL, NULL, NULL, layerinfo->binarywkb);
   }
 
   /* free bind values */
@@ -2737,6 +2931,12 @@ int msPostGISLayerNextShape(layerObj *layer, shapeObj *shape)
   ** Roll through pgresult until we hit non-null shape (usually right away).
   */
   while (shape->type == MS_SHAPE_NULL) {
+    /* Pull the next batch from the cursor once this one is used up. */
+    if (layerinfo->cursor && layerinfo->rownum >= PQntuples(layerinfo->pgresult) &&
+        PQntuples(layerinfo->pgresult) == layerinfo->fetchsize) {
+      if (msPostGISFetchCursor(layer, layerinfo) != MS_SUCCESS)
+        return MS_FAILURE;
+    }
     if (layerinfo->rownum < PQntuples(layerinfo->pgresult)) {
       /* Retrieve this shape, cursor access mode. */
       msPostGISReadShape(layer, shape);
@@ -2792,6 +2992,17 @@ int msPostGISLayerGetShape(layerObj *layer, shapeObj *shape, resultObj *record)
 
     layerinfo = (msPostGISLayerInfo*) layer->layerinfo;
 
+    /* Only the current batch of a cursor is at hand. */
+    if ( layerinfo->cursor ) {
+      resultindex -= layerinfo->rowoffset;
+      if ( resultindex < 0 ) {
+        msSetError( MS_MISCERR,
+                    "Record already read past in the cursor.",
+                    "msPostGISLayerGetShape()");
+        return MS_FAILURE;
+      }
+    }
+
     /* Check the validity of the open result. */
     pgresult = layerinfo->pgresult;
     if ( ! pgresult ) {
@@ -2855,7 +3066,10 @@ int msPostGISLayerGetShape(layerObj *layer, shapeObj *shape, resultObj *record)
       msDebug("msPostGISLayerGetShape query: %s\n", strSQL);
     }
 
-    pgresult = PQexecParams(layerinfo->pgconn, strSQL,0, NULL, NULL, NULL, NULL, 0);
+    /* The result we are about to replace may be a cursor batch. */
+    msPostGISCloseCursor(layerinfo);
+
+    pgresult = PQexecParams(layerinfo->pgconn, strSQL,0, NULL, NULL, NULL, NULL, layerinfo->binarywkb);
 
     /* Something went wrong. */
     if ( (!pgresult) || (PQresultStatus(pgresult) != PGRES_TUPLES_OK) ) {
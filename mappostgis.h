@@ -65,6 +65,11 @@ typedef struct {
   int         version;     /* PostGIS version of the database */
   int         paging;      /* Driver handling of pagination, enabled by default */
   int         force2d;     /* Pass geometry through ST_Force2D */
+  int         binarywkb;   /* Fetch rows in binary result format, geometry as raw WKB */
+  int         fetchsize;   /* Rows per FETCH when drawing through a cursor, 0 to fetch all rows at once */
+  char        *cursor;     /* Name of the open cursor pgresult is read from, NULL if none */
+  int         cursortransaction; /* The cursor runs in a transaction we started */
+  long        rowoffset;   /* Rows of the cursor consumed before the current pgresult */
 }
 msPostGISLayerInfo;
 
@@ -78,6 +83,7 @@ typedef struct {
   char *ptr; /* Pointer to current write point */
   size_t size; /* Size of allocated space */
   int *typemap; /* Look-up array to valid OGC types */
+  shapePoolObj *pool; /* Recycled point buffers of the layer, may be NULL */
 } wkbObj;
 
 /*
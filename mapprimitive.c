@@ -170,6 +170,121 @@ void msFreeShape(shapeObj *shape)
   msInitShape(shape); /* now reset */
 }
 
+/*
+** Shape buffer pool, see shapePoolObj in mapprimitive.h.
+*/
+shapePoolObj *msCreateShapePool(void)
+{
+  return (shapePoolObj *)msSmallCalloc(1, sizeof(shapePoolObj));
+}
+
+void msFreeShapePool(shapePoolObj *pool)
+{
+  int i, j;
+
+  if(!pool) return;
+
+  for(i=0; i<MS_SHAPEPOOL_BINS; i++)
+    for(j=0; j<pool->count[i]; j++)
+      free(pool->bins[i][j].ptr);
+  free(pool);
+}
+
+static int msShapePoolBin(size_t size)
+{
+  int bin = -1;
+  while(size) {
+    size >>= 1;
+    bin++;
+  }
+  return bin;
+}
+
+/*
+** Returns a buffer of at least size bytes, to be released with
+** msShapePoolRelease() or plain free(). A NULL pool falls back to malloc().
+*/
+void *msShapePoolAlloc(shapePoolObj *pool, size_t size)
+{
+  int bin, i;
+  void *ptr;
+
+  if(pool && size > 0 && (bin = msShapePoolBin(size)) < MS_SHAPEPOOL_BINS) {
+    /* buffers in this bin may be smaller than requested, the next ones are not */
+    for(i=pool->count[bin]-1; i>=0; i--) {
+      if(pool->bins[bin][i].size >= size) {
+        ptr = pool->bins[bin][i].ptr;
+        pool->bins[bin][i] = pool->bins[bin][--pool->count[bin]];
+        return ptr;
+      }
+    }
+    if(bin+1 < MS_SHAPEPOOL_BINS && pool->count[bin+1] > 0)
+      return pool->bins[bin+1][--pool->count[bin+1]].ptr;
+  }
+
+  return malloc(size);
+}
+
+char *msShapePoolStrdup(shapePoolObj *pool, const char *string)
+{
+  size_t size = strlen(string) + 1;
+  char *copy = (char *)msShapePoolAlloc(pool, size);
+  MS_CHECK_ALLOC(copy, size, NULL);
+  memcpy(copy, string, size);
+  return copy;
+}
+
+/*
+** Hands a buffer back to the pool, size being the number of bytes known to
+** be allocated (the used size for buffers of unknown origin).
+*/
+void msShapePoolRelease(shapePoolObj *pool, void *ptr, size_t size)
+{
+  int bin;
+
+  if(!ptr) return;
+
+  if(pool && size > 0 && (bin = msShapePoolBin(size)) < MS_SHAPEPOOL_BINS
+      && pool->count[bin] < MS_SHAPEPOOL_BINDEPTH) {
+    pool->bins[bin][pool->count[bin]].ptr = ptr;
+    pool->bins[bin][pool->count[bin]].size = size;
+    pool->count[bin]++;
+  } else
+    free(ptr);
+}
+
+/*
+** Same as msFreeShape(), but keeps the point, line and attribute arrays in
+** the pool for the next shapes read.
+*/
+void msShapePoolFreeShape(shapePoolObj *pool, shapeObj *shape)
+{
+  int c;
+
+  if(!pool) {
+    msFreeShape(shape);
+    return;
+  }
+
+  for (c= 0; c < shape->numlines; c++)
+    msShapePoolRelease(pool, shape->line[c].point, sizeof(pointObj) * shape->line[c].numpoints);
+  msShapePoolRelease(pool, shape->line, sizeof(lineObj) * shape->numlines);
+
+  if(shape->values) {
+    for (c= 0; c < shape->numvalues; c++)
+      if(shape->values[c])
+        msShapePoolRelease(pool, shape->values[c], strlen(shape->values[c]) + 1);
+    msShapePoolRelease(pool, shape->values, sizeof(char *) * shape->numvalues);
+  }
+  if(shape->text) free(shape->text);
+
+#ifdef USE_GEOS
+  msGEOSFreeGeometry(shape);
+#endif
+
+  msInitShape(shape); /* now reset */
+}
+
 void msFreeLabelPathObj(labelPathObj *path)
 {
   msFreeShape(&(path->bounds));
@@ -94,6 +94,26 @@ typedef struct {
 
 typedef lineObj multipointObj;
 
+#ifndef SWIG
+/*
+** Recycles the point, line and attribute arrays of the shapes read by a
+** layer: buffers released with msShapePoolFreeShape() are handed out again
+** by msShapePoolAlloc(), binned by the power of two below their size. Every
+** buffer remains an ordinary malloc() block, so shapes filled from a pool
+** may still be freed, reallocated or kept by the caller.
+*/
+#define MS_SHAPEPOOL_BINS 18 /* buffers up to 256KB */
+#define MS_SHAPEPOOL_BINDEPTH 32
+
+typedef struct {
+  struct {
+    void *ptr;
+    size_t size;
+  } bins[MS_SHAPEPOOL_BINS][MS_SHAPEPOOL_BINDEPTH];
+  int count[MS_SHAPEPOOL_BINS];
+} shapePoolObj;
+#endif
+
 #ifndef SWIG
 /* attribute primatives */
 typedef struct {
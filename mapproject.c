@@ -61,6 +61,287 @@ int msIsAxisInverted(int epsg_code)
     return MS_FALSE;
 }
 
+#ifdef USE_PROJ
+/************************************************************************/
+/*                         Projection pair cache                        */
+/*                                                                      */
+/*      msProjectionsDiffer() has to normalize both definitions         */
+/*      through PROJ.4 before concluding, and it gets called for        */
+/*      every layer of every request with the same few projection       */
+/*      pairs, and msProjectRect() initializes a "+over" variant of     */
+/*      both projections on every call. Each thread keeps both for the  */
+/*      pairs it saw last, keyed by a hash of the arguments of the two  */
+/*      projections (projectionObjs are copied around, their address    */
+/*      is useless). Being per thread, the PROJ.4 objects are never     */
+/*      shared. The cache of a thread that exits is emptied and parked  */
+/*      (thread_id NULL) for the next thread rather than freed, as the  */
+/*      head of the list is read without the lock.                      */
+/************************************************************************/
+
+#define MS_PROJ_PAIR_CACHE_SIZE 16
+
+typedef struct {
+  unsigned int hash;
+  char *key;    /* arguments of both projections, see msProjectionPairKey() */
+  geotransformObj in_gt, out_gt;
+  int differ;   /* what msProjectionsDiffer() returns */
+  int identity; /* MS_TRUE if reprojecting between the two is a no-op */
+  int north_pole; /* in maps the north pole to (0,0), -1 if not known yet */
+  projectionObj *in_over, *out_over; /* for msProjectRect(), or NULL */
+} projPairObj;
+
+typedef struct {
+  int numpairs;
+  projPairObj pairs[MS_PROJ_PAIR_CACHE_SIZE]; /* most recently used first */
+} projPairCacheObj;
+
+#ifdef USE_THREAD
+typedef struct projPairThreadCache projPairThreadCache;
+struct projPairThreadCache {
+  void *thread_id;
+  projPairThreadCache *next;
+  projPairCacheObj cache;
+};
+static projPairThreadCache *proj_pair_caches = NULL;
+#else
+static projPairCacheObj global_proj_pair_cache;
+#endif
+
+static projPairCacheObj *msGetProjectionPairCache( void )
+{
+#ifndef USE_THREAD
+  return &global_proj_pair_cache;
+#else
+  void *nThreadId = msGetThreadId();
+  projPairThreadCache *prev = NULL, *cur = proj_pair_caches;
+  projPairThreadCache *parked = NULL, *parked_prev = NULL;
+
+  if( cur != NULL && cur->thread_id == nThreadId )
+    return &cur->cache;
+
+  msAcquireLock( TLOCK_PROJ );
+
+  cur = proj_pair_caches;
+  while( cur != NULL && cur->thread_id != nThreadId ) {
+    if( cur->thread_id == NULL && parked == NULL ) {
+      parked = cur;
+      parked_prev = prev;
+    }
+    prev = cur;
+    cur = cur->next;
+  }
+
+  if( cur == NULL && parked != NULL ) { /* adopt the cache of an exited thread */
+    cur = parked;
+    prev = parked_prev;
+    cur->thread_id = nThreadId;
+  }
+
+  if( cur != NULL ) {
+    if( prev != NULL ) { /* move to front for faster finding next time */
+      prev->next = cur->next;
+      cur->next = proj_pair_caches;
+      proj_pair_caches = cur;
+    }
+  } else {
+    cur = (projPairThreadCache *) msSmallCalloc(1, sizeof(projPairThreadCache));
+    cur->thread_id = nThreadId;
+    cur->next = proj_pair_caches;
+    proj_pair_caches = cur;
+  }
+
+  msReleaseLock( TLOCK_PROJ );
+  return &cur->cache;
+#endif
+}
+
+static void msFreeProjectionPair( projPairObj *pair )
+{
+  msFree(pair->key);
+  if( pair->in_over ) {
+    msFreeProjection(pair->in_over);
+    msFree(pair->in_over);
+  }
+  if( pair->out_over ) {
+    msFreeProjection(pair->out_over);
+    msFree(pair->out_over);
+  }
+}
+
+static void msFreeProjectionPairCache( projPairCacheObj *cache )
+{
+  int i;
+  for( i = 0; i < cache->numpairs; i++ )
+    msFreeProjectionPair(cache->pairs + i);
+  cache->numpairs = 0;
+}
+
+/*
+** The key holds the arguments of both projections, each one terminated by
+** a '\001' and each projection by a '\002'. Geotransforms are compared
+** separately.
+*/
+static unsigned int msProjectionPairHash( projectionObj *p, unsigned int hash )
+{
+  int i;
+  const unsigned char *c;
+
+  for( i = 0; i < p->numargs; i++ ) {
+    for( c = (const unsigned char *) p->args[i]; *c; c++ )
+      hash = (hash ^ *c) * 16777619U;
+    hash = (hash ^ 1) * 16777619U;
+  }
+  return (hash ^ 2) * 16777619U;
+}
+
+static char *msProjectionPairKey( projectionObj *p, char *key )
+{
+  int i;
+  for( i = 0; i < p->numargs; i++ ) {
+    key = msStringConcatenate(key, p->args[i]);
+    key = msStringConcatenate(key, "\001");
+  }
+  return msStringConcatenate(key, "\002");
+}
+
+/* Returns a pointer past the part of key matching p, or NULL. */
+static const char *msProjectionPairMatch( projectionObj *p, const char *key )
+{
+  int i;
+  for( i = 0; i < p->numargs; i++ ) {
+    size_t len = strlen(p->args[i]);
+    if( strncmp(key, p->args[i], len) != 0 || key[len] != '\001' )
+      return NULL;
+    key += len + 1;
+  }
+  if( *key != '\002' )
+    return NULL;
+  return key + 1;
+}
+
+static int msGeotransformsMatch( const geotransformObj *gt1, const geotransformObj *gt2 )
+{
+  if( gt1->need_geotransform != gt2->need_geotransform )
+    return MS_FALSE;
+  return !gt1->need_geotransform ||
+         memcmp(gt1->geotransform, gt2->geotransform, sizeof(gt1->geotransform)) == 0;
+}
+
+static int msProjectionsDifferInternal( projectionObj *proj1, projectionObj *proj2 );
+static projectionObj* msGetProjectNormalized( const projectionObj* p );
+
+/*
+** Looks up (computing it on first use) the cached comparison of the
+** in and out projections.
+*/
+static projPairObj *msGetProjectionPair( projectionObj *in, projectionObj *out )
+{
+  projPairCacheObj *cache = msGetProjectionPairCache();
+  projPairObj pair;
+  unsigned int hash;
+  int i;
+
+  hash = msProjectionPairHash(out, msProjectionPairHash(in, 2166136261U));
+
+  for( i = 0; i < cache->numpairs; i++ ) {
+    const char *rest;
+    if( cache->pairs[i].hash != hash ||
+        !msGeotransformsMatch(&(cache->pairs[i].in_gt), &(in->gt)) ||
+        !msGeotransformsMatch(&(cache->pairs[i].out_gt), &(out->gt)) )
+      continue;
+    rest = msProjectionPairMatch(in, cache->pairs[i].key);
+    if( rest == NULL || (rest = msProjectionPairMatch(out, rest)) == NULL || *rest != '\0' )
+      continue;
+    if( i > 0 ) {
+      pair = cache->pairs[i];
+      memmove(cache->pairs + 1, cache->pairs, i * sizeof(projPairObj));
+      cache->pairs[0] = pair;
+    }
+    return &(cache->pairs[0]);
+  }
+
+  pair.hash = hash;
+  pair.key = msProjectionPairKey(out, msProjectionPairKey(in, NULL));
+  pair.in_gt = in->gt;
+  pair.out_gt = out->gt;
+  pair.north_pole = -1;
+  pair.in_over = pair.out_over = NULL;
+  pair.differ = msProjectionsDifferInternal(in, out);
+  if( pair.differ ) {
+    projectionObj* p1normalized;
+    projectionObj* p2normalized;
+
+    p1normalized = msGetProjectNormalized( in );
+    p2normalized = msGetProjectNormalized( out );
+    pair.differ = msProjectionsDifferInternal(p1normalized, p2normalized);
+    msFreeProjection(p1normalized);
+    msFree(p1normalized);
+    msFreeProjection(p2normalized);
+    msFree(p2normalized);
+  }
+  /* msProjectionsDiffer() also says "no" when a side is undefined */
+  pair.identity = !pair.differ && in->numargs > 0 && out->numargs > 0 &&
+                  in->proj != NULL && out->proj != NULL;
+
+  if( cache->numpairs == MS_PROJ_PAIR_CACHE_SIZE )
+    msFreeProjectionPair(cache->pairs + --cache->numpairs);
+  memmove(cache->pairs + 1, cache->pairs, cache->numpairs * sizeof(projPairObj));
+  cache->pairs[0] = pair;
+  cache->numpairs++;
+
+  return &(cache->pairs[0]);
+}
+
+/*
+** Returns MS_TRUE when projecting from in to out leaves coordinates
+** unchanged (same definition once normalized, no geotransform).
+*/
+static int msProjectionIsIdentity( projectionObj *in, projectionObj *out )
+{
+  if( in == NULL || out == NULL || in->proj == NULL || out->proj == NULL )
+    return MS_FALSE;
+  return msGetProjectionPair(in, out)->identity;
+}
+
+void msProjectionCacheCleanup( void )
+{
+#ifndef USE_THREAD
+  msFreeProjectionPairCache(&global_proj_pair_cache);
+#else
+  projPairThreadCache *cur, *next;
+
+  msAcquireLock( TLOCK_PROJ );
+  for( cur = proj_pair_caches; cur != NULL; cur = next ) {
+    next = cur->next;
+    msFreeProjectionPairCache(&cur->cache);
+    free(cur);
+  }
+  proj_pair_caches = NULL;
+  msReleaseLock( TLOCK_PROJ );
+#endif
+}
+
+/* Empties and parks the cache of the calling thread, when it is about to exit */
+void msProjectionCacheThreadCleanup( void )
+{
+#ifdef USE_THREAD
+  void *nThreadId = msGetThreadId();
+  projPairThreadCache *cur;
+
+  msAcquireLock( TLOCK_PROJ );
+  for( cur = proj_pair_caches; cur != NULL; cur = cur->next ) {
+    if( cur->thread_id == nThreadId ) {
+      /* only the owning thread ever reads the pairs */
+      msFreeProjectionPairCache(&cur->cache);
+      cur->thread_id = NULL;
+      break;
+    }
+  }
+  msReleaseLock( TLOCK_PROJ );
+#endif
+}
+#endif /* USE_PROJ */
+
 /************************************************************************/
 /*                           msProjectPoint()                           */
 /************************************************************************/
@@ -184,6 +465,212 @@ int msProjectPoint(projectionObj *in, projectionObj *out, pointObj *point)
 #endif
 }
 
+#ifdef USE_PROJ
+#ifdef USE_PROJ_FASTPATHS
+#define MAXEXTENT 20037508.34
+#define M_PIby360 .0087266462599716479
+#define MAXEXTENTby180 111319.4907777777777777777
+
+/* x and y of a pointObj are adjacent, so SSE2 can handle both at once */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MS_PROJ_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+/************************************************************************/
+/*                    msProjectPointsLonLatToGMerc()                    */
+/*                    msProjectPointsGMercToLonLat()                    */
+/*                                                                      */
+/*      Spherical mercator <-> lat/long fast paths. Only the log, tan,  */
+/*      atan and exp calls are done one coordinate at a time, scaling   */
+/*      and clamping are vectorized. Results are bit for bit those of   */
+/*      the scalar code (clamping keeps NaNs, like the if()s did).      */
+/************************************************************************/
+static void msProjectPointsLonLatToGMerc( pointObj *points, int count )
+{
+  int i;
+#ifdef MS_PROJ_USE_SSE2
+  const __m128d scale = _mm_set1_pd(MAXEXTENTby180);
+  const __m128d hi = _mm_set1_pd(MAXEXTENT), lo = _mm_set1_pd(-MAXEXTENT);
+
+  for( i = 0; i < count; i++ ) {
+    __m128d v = _mm_set_pd(log(tan((90 + points[i].y) * M_PIby360)) * MS_RAD_TO_DEG,
+                           points[i].x);
+    v = _mm_mul_pd(v, scale);
+    v = _mm_max_pd(lo, _mm_min_pd(hi, v));
+    _mm_storel_pd(&(points[i].x), v);
+    _mm_storeh_pd(&(points[i].y), v);
+  }
+#else
+  for( i = 0; i < count; i++ ) {
+    double x = points[i].x * MAXEXTENTby180;
+    double y = log(tan((90 + points[i].y) * M_PIby360)) * MS_RAD_TO_DEG * MAXEXTENTby180;
+    if (x > MAXEXTENT) x = MAXEXTENT;
+    else if (x < -MAXEXTENT) x = -MAXEXTENT;
+    if (y > MAXEXTENT) y = MAXEXTENT;
+    else if (y < -MAXEXTENT) y = -MAXEXTENT;
+    points[i].x = x;
+    points[i].y = y;
+  }
+#endif
+}
+
+static void msProjectPointsGMercToLonLat( pointObj *points, int count )
+{
+  int i;
+#ifdef MS_PROJ_USE_SSE2
+  const __m128d extent = _mm_set1_pd(MAXEXTENT), deg = _mm_set1_pd(180);
+  const __m128d hi = _mm_set1_pd(MAXEXTENT), lo = _mm_set1_pd(-MAXEXTENT);
+
+  for( i = 0; i < count; i++ ) {
+    __m128d v = _mm_loadu_pd(&(points[i].x));
+    v = _mm_max_pd(lo, _mm_min_pd(hi, v));
+    v = _mm_mul_pd(_mm_div_pd(v, extent), deg);
+    _mm_storel_pd(&(points[i].x), v);
+    _mm_storeh_pd(&(points[i].y), v);
+    points[i].y = MS_RAD_TO_DEG * (2 * atan(exp(points[i].y * MS_DEG_TO_RAD)) - MS_PI2);
+  }
+#else
+  for( i = 0; i < count; i++ ) {
+    double x = points[i].x, y = points[i].y;
+    if (x > MAXEXTENT) x = MAXEXTENT;
+    else if (x < -MAXEXTENT) x = -MAXEXTENT;
+    if (y > MAXEXTENT) y = MAXEXTENT;
+    else if (y < -MAXEXTENT) y = -MAXEXTENT;
+    x = (x / MAXEXTENT) * 180;
+    y = (y / MAXEXTENT) * 180;
+    points[i].x = x;
+    points[i].y = MS_RAD_TO_DEG * (2 * atan(exp(y * MS_DEG_TO_RAD)) - MS_PI2);
+  }
+#endif
+}
+#endif /* USE_PROJ_FASTPATHS */
+
+static void msProjectPointsGeotransform( double *gt, pointObj *points, int count )
+{
+  int i;
+  for( i = 0; i < count; i++ ) {
+    double x_out, y_out;
+
+    if( points[i].x == HUGE_VAL || points[i].y == HUGE_VAL )
+      continue;
+    x_out = gt[0] + gt[1] * points[i].x + gt[2] * points[i].y;
+    y_out = gt[3] + gt[4] * points[i].x + gt[5] * points[i].y;
+    points[i].x = x_out;
+    points[i].y = y_out;
+  }
+}
+#endif /* USE_PROJ */
+
+/************************************************************************/
+/*                          msProjectPoints()                           */
+/*                                                                      */
+/*      Same as calling msProjectPoint() on each point of the array,    */
+/*      but all of them go through a single pj_transform() call.       */
+/*      Points that could not be projected are set to HUGE_VAL, MS_-    */
+/*      FAILURE is only returned if some of them could not.             */
+/************************************************************************/
+int msProjectPoints(projectionObj *in, projectionObj *out, pointObj *points, int count)
+{
+#ifdef USE_PROJ
+  int i, status = MS_SUCCESS;
+
+  if( count <= 0 )
+    return MS_SUCCESS;
+  if( count == 1 || !(in && in->proj && out && out->proj) ||
+      (in->numargs == 1 && out->numargs == 1 && strcmp(in->args[0],out->args[0]) == 0) ) {
+    /* nothing to batch, msProjectPoint() handles those cases itself */
+    for( i = 0; i < count; i++ ) {
+      if( msProjectPoint(in, out, points + i) != MS_SUCCESS ) {
+        points[i].x = points[i].y = HUGE_VAL;
+        status = MS_FAILURE;
+      }
+    }
+    return status;
+  }
+
+#ifdef USE_PROJ_FASTPATHS
+  if( in->wellknownprojection == wkp_lonlat && out->wellknownprojection == wkp_gmerc ) {
+    if( in->gt.need_geotransform )
+      msProjectPointsGeotransform(in->gt.geotransform, points, count);
+    msProjectPointsLonLatToGMerc(points, count);
+  } else if( in->wellknownprojection == wkp_gmerc && out->wellknownprojection == wkp_lonlat ) {
+    if( in->gt.need_geotransform )
+      msProjectPointsGeotransform(in->gt.geotransform, points, count);
+    msProjectPointsGMercToLonLat(points, count);
+  } else
+#endif
+  {
+    /*
+    ** pointObj members are doubles, pj_transform() can stride over them. It
+    ** strides over z as well, which is zero like in msProjectPoint().
+    */
+    const int stride = sizeof(pointObj) / sizeof(double);
+    pointObj *saved = (pointObj *) msSmallMalloc(sizeof(pointObj) * count);
+    double *z = (double *) msSmallCalloc((size_t)count * stride, sizeof(double));
+    int error;
+
+    /* taken before the geotransform, msProjectPoint() applies it again */
+    memcpy(saved, points, sizeof(pointObj) * count);
+
+    if( in->gt.need_geotransform )
+      msProjectPointsGeotransform(in->gt.geotransform, points, count);
+
+    if( pj_is_latlong(in->proj) ) {
+      for( i = 0; i < count; i++ ) {
+        points[i].x *= DEG_TO_RAD;
+        points[i].y *= DEG_TO_RAD;
+      }
+    }
+
+#if PJ_VERSION < 480
+    msAcquireLock( TLOCK_PROJ );
+#endif
+    error = pj_transform( in->proj, out->proj, count, stride,
+                          &(points[0].x), &(points[0].y), z );
+#if PJ_VERSION < 480
+    msReleaseLock( TLOCK_PROJ );
+#endif
+    free(z);
+
+    if( error ) {
+      /*
+      ** Some errors fail the whole batch rather than the offending points
+      ** only, go through them one by one to find out which ones.
+      */
+      memcpy(points, saved, sizeof(pointObj) * count);
+      free(saved);
+      for( i = 0; i < count; i++ ) {
+        if( msProjectPoint(in, out, points + i) != MS_SUCCESS ) {
+          points[i].x = points[i].y = HUGE_VAL;
+          status = MS_FAILURE;
+        }
+      }
+      return status;
+    }
+    free(saved);
+
+    for( i = 0; i < count; i++ ) {
+      if( points[i].x == HUGE_VAL || points[i].y == HUGE_VAL ) {
+        points[i].x = points[i].y = HUGE_VAL;
+        status = MS_FAILURE;
+      } else if( pj_is_latlong(out->proj) ) {
+        points[i].x *= RAD_TO_DEG;
+        points[i].y *= RAD_TO_DEG;
+      }
+    }
+  }
+
+  if( out->gt.need_geotransform )
+    msProjectPointsGeotransform(out->gt.invgeotransform, points, count);
+
+  return status;
+#else
+  msSetError(MS_PROJERR, "Projection support is not available.", "msProjectPoints()");
+  return(MS_FAILURE);
+#endif
+}
+
 /************************************************************************/
 /*                         msProjectGrowRect()                          */
 /************************************************************************/
@@ -307,43 +794,24 @@ msProjectShapeLine(projectionObj *in, projectionObj *out,
   int numpoints_in = line->numpoints;
   int line_alloc = numpoints_in;
   int wrap_test;
+  pointObj *projected;
 
 #ifdef USE_PROJ_FASTPATHS
-#define MAXEXTENT 20037508.34
-#define M_PIby360 .0087266462599716479
-#define MAXEXTENTby180 111319.4907777777777777777
-#define p_x line->point[i].x
-#define p_y line->point[i].y
   if(in->wellknownprojection == wkp_lonlat && out->wellknownprojection == wkp_gmerc) {
-    for( i = line->numpoints-1; i >= 0; i-- ) {
-      p_x *= MAXEXTENTby180;
-      p_y = log(tan((90 + p_y) * M_PIby360)) * MS_RAD_TO_DEG;
-      p_y *= MAXEXTENTby180;
-      if (p_x > MAXEXTENT) p_x = MAXEXTENT;
-      if (p_x < -MAXEXTENT) p_x = -MAXEXTENT;
-      if (p_y > MAXEXTENT) p_y = MAXEXTENT;
-      if (p_y < -MAXEXTENT) p_y = -MAXEXTENT;
-    }
+    msProjectPointsLonLatToGMerc( line->point, line->numpoints );
     return MS_SUCCESS;
   }
   if(in->wellknownprojection == wkp_gmerc && out->wellknownprojection == wkp_lonlat) {
-    for( i = line->numpoints-1; i >= 0; i-- ) {
-      if (p_x > MAXEXTENT) p_x = MAXEXTENT;
-      else if (p_x < -MAXEXTENT) p_x = -MAXEXTENT;
-      if (p_y > MAXEXTENT) p_y = MAXEXTENT;
-      else if (p_y < -MAXEXTENT) p_y = -MAXEXTENT;
-      p_x = (p_x / MAXEXTENT) * 180;
-      p_y = (p_y / MAXEXTENT) * 180;
-      p_y = MS_RAD_TO_DEG * (2 * atan(exp(p_y * MS_DEG_TO_RAD)) - MS_PI2);
-    }
+    msProjectPointsGMercToLonLat( line->point, line->numpoints );
     msComputeBounds( shape ); /* fixes bug 1586 */
     return MS_SUCCESS;
   }
-#undef p_x
-#undef p_y
 #endif
 
-
+  /* project all the points at once, the loop below only looks up results */
+  projected = (pointObj *) msSmallMalloc(sizeof(pointObj) * MS_MAX(numpoints_in, 1));
+  memcpy( projected, line->point, sizeof(pointObj) * numpoints_in );
+  msProjectPoints( in, out, projected, numpoints_in );
 
   wrap_test = out != NULL && out->proj != NULL && pj_is_latlong(out->proj)
               && !pj_is_latlong(in->proj);
@@ -357,9 +825,10 @@ msProjectShapeLine(projectionObj *in, projectionObj *out,
   /* -------------------------------------------------------------------- */
   for( i=0; i < numpoints_in; i++ ) {
     int ms_err;
-    wrkPoint = thisPoint = line->point[i];
+    thisPoint = line->point[i];
+    wrkPoint = projected[i];
 
-    ms_err = msProjectPoint(in, out, &wrkPoint );
+    ms_err = (wrkPoint.x == HUGE_VAL || wrkPoint.y == HUGE_VAL) ? MS_FAILURE : MS_SUCCESS;
 
     /* -------------------------------------------------------------------- */
     /*      Apply wrap logic.                                               */
@@ -482,6 +951,8 @@ msProjectShapeLine(projectionObj *in, projectionObj *out,
     lastPoint = thisPoint;
   }
 
+  free( projected );
+
   /* -------------------------------------------------------------------- */
   /*      Make sure that polygons are closed, even if the trip over       */
   /*      the horizon left them unclosed.                                 */
@@ -506,43 +977,25 @@ int msProjectShape(projectionObj *in, projectionObj *out, shapeObj *shape)
 {
 #ifdef USE_PROJ
   int i;
-#ifdef USE_PROJ_FASTPATHS
-  int j;
 
-#define p_x shape->line[i].point[j].x
-#define p_y shape->line[i].point[j].y
+  if( shape->numlines > 0 && msProjectionIsIdentity(in, out) ) {
+    msComputeBounds( shape );
+    return MS_SUCCESS;
+  }
+
+#ifdef USE_PROJ_FASTPATHS
   if(in->wellknownprojection == wkp_lonlat && out->wellknownprojection == wkp_gmerc) {
-    for( i = shape->numlines-1; i >= 0; i-- ) {
-      for( j = shape->line[i].numpoints-1; j >= 0; j-- ) {
-        p_x *= MAXEXTENTby180;
-        p_y = log(tan((90 + p_y) * M_PIby360)) * MS_RAD_TO_DEG;
-        p_y *= MAXEXTENTby180;
-        if (p_x > MAXEXTENT) p_x = MAXEXTENT;
-        else if (p_x < -MAXEXTENT) p_x = -MAXEXTENT;
-        if (p_y > MAXEXTENT) p_y = MAXEXTENT;
-        else if (p_y < -MAXEXTENT) p_y = -MAXEXTENT;
-      }
-    }
+    for( i = shape->numlines-1; i >= 0; i-- )
+      msProjectPointsLonLatToGMerc( shape->line[i].point, shape->line[i].numpoints );
     msComputeBounds( shape ); /* fixes bug 1586 */
     return MS_SUCCESS;
   }
   if(in->wellknownprojection == wkp_gmerc && out->wellknownprojection == wkp_lonlat) {
-    for( i = shape->numlines-1; i >= 0; i-- ) {
-      for( j = shape->line[i].numpoints-1; j >= 0; j-- ) {
-        if (p_x > MAXEXTENT) p_x = MAXEXTENT;
-        else if (p_x < -MAXEXTENT) p_x = -MAXEXTENT;
-        if (p_y > MAXEXTENT) p_y = MAXEXTENT;
-        else if (p_y < -MAXEXTENT) p_y = -MAXEXTENT;
-        p_x = (p_x / MAXEXTENT) * 180;
-        p_y = (p_y / MAXEXTENT) * 180;
-        p_y = MS_RAD_TO_DEG * (2 * atan(exp(p_y * MS_DEG_TO_RAD)) - MS_PI2);
-      }
-    }
+    for( i = shape->numlines-1; i >= 0; i-- )
+      msProjectPointsGMercToLonLat( shape->line[i].point, shape->line[i].numpoints );
     msComputeBounds( shape ); /* fixes bug 1586 */
     return MS_SUCCESS;
   }
-#undef p_x
-#undef p_y
 #endif
 
 
@@ -588,19 +1041,26 @@ int msProjectLine(projectionObj *in, projectionObj *out, lineObj *line)
 
   if( be_careful ) {
     pointObj  startPoint, thisPoint; /* locations in projected space */
+    pointObj *original;
+
+    if( line->numpoints == 0 )
+      return(MS_SUCCESS);
 
     startPoint = line->point[0];
 
+    original = (pointObj *) msSmallMalloc(sizeof(pointObj) * line->numpoints);
+    memcpy(original, line->point, sizeof(pointObj) * line->numpoints);
+    msProjectPoints(in, out, line->point, line->numpoints);
+
     for(i=0; i<line->numpoints; i++) {
       double  dist;
 
-      thisPoint = line->point[i];
+      thisPoint = original[i];
 
       /*
       ** Read comments before msTestNeedWrap() to better understand
       ** this dateline wrapping logic.
       */
-      msProjectPoint(in, out, &(line->point[i]));
       if( i > 0 ) {
         dist = line->point[i].x - line->point[0].x;
         if( fabs(dist) > 180.0 ) {
@@ -616,11 +1076,9 @@ int msProjectLine(projectionObj *in, projectionObj *out, lineObj *line)
 
       }
     }
+    free(original);
   } else {
-    for(i=0; i<line->numpoints; i++) {
-      if( msProjectPoint(in, out, &(line->point[i])) == MS_FAILURE )
-        return MS_FAILURE;
-    }
+    return msProjectPoints(in, out, line->point, line->numpoints);
   }
 
   return(MS_SUCCESS);
@@ -954,6 +1412,15 @@ int msProjectRect(projectionObj *in, projectionObj *out, rectObj *rect)
   char *over = "+over";
   int ret;
   projectionObj in_over,out_over,*inp,*outp;
+#ifdef USE_PROJ
+  projPairObj *pair = NULL;
+
+  if( in && in->proj && out && out->proj ) {
+    pair = msGetProjectionPair(in, out);
+    if( pair->identity )
+      return MS_SUCCESS;
+  }
+#endif
 
 #if USE_PROJ
   /* Detect projecting from north polar stereographic to longlat */
@@ -961,11 +1428,17 @@ int msProjectRect(projectionObj *in, projectionObj *out, rectObj *rect)
       out && !out->gt.need_geotransform &&
       !pj_is_latlong(in->proj) && pj_is_latlong(out->proj) )
   {
-      pointObj p;
-      p.x = 0.0;
-      p.y = 0.0;
-      if( msProjectPoint(in, out, &p) == MS_SUCCESS &&
-          fabs(p.y - 90) < 1e-8 )
+      int north_pole = pair ? pair->north_pole : -1;
+      if( north_pole < 0 ) {
+        pointObj p;
+        p.x = 0.0;
+        p.y = 0.0;
+        north_pole = msProjectPoint(in, out, &p) == MS_SUCCESS &&
+                     fabs(p.y - 90) < 1e-8;
+        if( pair )
+          pair->north_pole = north_pole;
+      }
+      if( north_pole )
       {
         /* Is the pole in the rectangle ? */
         if( 0 >= rect->minx && 0 >= rect->miny &&
@@ -997,6 +1470,20 @@ int msProjectRect(projectionObj *in, projectionObj *out, rectObj *rect)
    *  To enforce this, we clone the input projections and add the "+over" proj 
    *  parameter in order to disable dateline wrapping.
    */ 
+#ifdef USE_PROJ
+  /* the "+over" variants of a cached pair are initialized once per thread */
+  if( pair ) {
+    if( pair->in_over == NULL ) {
+      pair->in_over = (projectionObj *) msSmallMalloc(sizeof(projectionObj));
+      msInitProjection(pair->in_over);
+      msCopyProjectionExtended(pair->in_over,in,&over,1);
+      pair->out_over = (projectionObj *) msSmallMalloc(sizeof(projectionObj));
+      msInitProjection(pair->out_over);
+      msCopyProjectionExtended(pair->out_over,out,&over,1);
+    }
+    return msProjectRectAsPolygon(pair->in_over, pair->out_over, rect );
+  }
+#endif
   if(out) {
     msInitProjection(&out_over);
     msCopyProjectionExtended(&out_over,out,&over,1);
@@ -1129,23 +1616,10 @@ static int msProjectionsDifferInternal( projectionObj *proj1, projectionObj *pro
 int msProjectionsDiffer( projectionObj *proj1, projectionObj *proj2 )
 {
 #ifdef USE_PROJ
-    int ret;
-
-    ret = msProjectionsDifferInternal(proj1, proj2); 
-    if( ret ) 
-    {
-        projectionObj* p1normalized;
-        projectionObj* p2normalized;
-
-        p1normalized = msGetProjectNormalized( proj1 );
-        p2normalized = msGetProjectNormalized( proj2 );
-        ret = msProjectionsDifferInternal(p1normalized, p2normalized);
-        msFreeProjection(p1normalized);
-        msFree(p1normalized);
-        msFreeProjection(p2normalized);
-        msFree(p2normalized);
-    }
-    return ret;
+    /* cheap cases first, the cache is only worth it for the normalization */
+    if( !msProjectionsDifferInternal(proj1, proj2) )
+        return MS_FALSE;
+    return msGetProjectionPair(proj1, proj2)->differ;
 #else
     return msProjectionsDifferInternal(proj1, proj2);
 #endif
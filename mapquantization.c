@@ -106,9 +106,6 @@ static acolorhist_vector pam_computeacolorhist
 static acolorhash_table pam_computeacolorhash
 (rgbaPixel** apixels, int cols, int rows, int maxacolors, int* acolorsP);
 static acolorhash_table pam_allocacolorhash (void);
-static int pam_addtoacolorhash
-(acolorhash_table acht, rgbaPixel *acolorP, int value);
-static int pam_lookupacolor (acolorhash_table acht, rgbaPixel* acolorP);
 static void pam_freeacolorhist (acolorhist_vector achv);
 static void pam_freeacolorhash (acolorhash_table acht);
 
@@ -195,71 +192,373 @@ int msQuantizeRasterBuffer(rasterBufferObj *rb,
 }
 
 
+/*
+** Nearest palette entry search used by msClassifyRasterBuffer(). The palette
+** is stored as interleaved 16 bit (r,g) and (b,a) pairs so that SSE2 computes
+** four squared distances per iteration with two multiply-adds, and is padded
+** to a multiple of four with entries too far away to ever be picked. As in
+** the scalar loop, ties go to the lowest index.
+*/
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MS_QUANTIZE_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define PALETTE_SEARCH_PAD 1000
+
+typedef struct {
+  int numentries, padded;
+  short rg[2*260], ba[2*260];
+} paletteSearchObj;
+
+static void initPaletteSearch(paletteSearchObj *ps, rgbaPixel *palette, int numentries)
+{
+  int i;
+  ps->numentries = numentries;
+  ps->padded = (numentries + 3) & ~3;
+  for(i = 0; i < ps->padded; i++) {
+    if(i < numentries) {
+      ps->rg[2*i] = PAM_GETR(palette[i]);
+      ps->rg[2*i+1] = PAM_GETG(palette[i]);
+      ps->ba[2*i] = PAM_GETB(palette[i]);
+      ps->ba[2*i+1] = PAM_GETA(palette[i]);
+    } else {
+      ps->rg[2*i] = ps->rg[2*i+1] = ps->ba[2*i] = ps->ba[2*i+1] = PALETTE_SEARCH_PAD;
+    }
+  }
+}
+
+static int paletteSearchNearest(const paletteSearchObj *ps, const rgbaPixel *pP)
+{
+  int i, ind = 0;
+#ifdef MS_QUANTIZE_USE_SSE2
+  __m128i prg = _mm_set1_epi32((PAM_GETG(*pP) << 16) | PAM_GETR(*pP));
+  __m128i pba = _mm_set1_epi32((PAM_GETA(*pP) << 16) | PAM_GETB(*pP));
+  __m128i best = _mm_set1_epi32(0x7fffffff), bestind = _mm_setzero_si128();
+  __m128i cur = _mm_setr_epi32(0, 1, 2, 3), four = _mm_set1_epi32(4);
+  int dists[4], inds[4], dist;
+
+  for(i = 0; i < ps->padded; i += 4) {
+    __m128i drg = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(ps->rg + 2*i)), prg);
+    __m128i dba = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(ps->ba + 2*i)), pba);
+    __m128i d = _mm_add_epi32(_mm_madd_epi16(drg, drg), _mm_madd_epi16(dba, dba));
+    __m128i closer = _mm_cmplt_epi32(d, best);
+    best = _mm_or_si128(_mm_and_si128(closer, d), _mm_andnot_si128(closer, best));
+    bestind = _mm_or_si128(_mm_and_si128(closer, cur), _mm_andnot_si128(closer, bestind));
+    cur = _mm_add_epi32(cur, four);
+  }
+  _mm_storeu_si128((__m128i*)dists, best);
+  _mm_storeu_si128((__m128i*)inds, bestind);
+  dist = dists[0];
+  ind = inds[0];
+  for(i = 1; i < 4; i++) {
+    if(dists[i] < dist || (dists[i] == dist && inds[i] < ind)) {
+      dist = dists[i];
+      ind = inds[i];
+    }
+  }
+#else
+  long dist = 2000000000, newdist;
+  int r1 = PAM_GETR(*pP), g1 = PAM_GETG(*pP), b1 = PAM_GETB(*pP), a1 = PAM_GETA(*pP);
+  for(i = 0; i < ps->numentries; i++) {
+    int dr = r1 - ps->rg[2*i], dg = g1 - ps->rg[2*i+1];
+    int db = b1 - ps->ba[2*i], da = a1 - ps->ba[2*i+1];
+    newdist = dr*dr + dg*dg + db*db + da*da;
+    if(newdist < dist) {
+      ind = i;
+      dist = newdist;
+    }
+  }
+#endif
+  return ind;
+}
+
+/*
+** Pixels are first looked up in a direct mapped table keyed on their full
+** rgba value, so the exhaustive search only runs once per distinct color
+** (barring collisions). Map images rarely have more than a few thousand.
+*/
+#define CLASSIFY_TABLE_BITS 14
+
+typedef struct {
+  unsigned int color;
+  int ind;
+} classifyTableEntry;
+
 int msClassifyRasterBuffer(rasterBufferObj *rb, rasterBufferObj *qrb)
 {
-  register int ind;
-  unsigned char *outrow,*pQ;
-  register rgbaPixel *pP;
-  acolorhash_table acht;
-  int usehash, row, col;
-  /*
-   ** Step 4: map the colors in the image to their closest match in the
-   ** new colormap, and write 'em out.
-   */
-  acht = pam_allocacolorhash( );
-  usehash = 1;
+  unsigned char *pQ;
+  rgbaPixel *pP;
+  paletteSearchObj ps;
+  classifyTableEntry *table;
+  int row, col;
+
+  initPaletteSearch(&ps, qrb->data.palette.palette, qrb->data.palette.num_entries);
+  table = (classifyTableEntry*) msSmallMalloc(sizeof(classifyTableEntry) << CLASSIFY_TABLE_BITS);
+  for(col = 0; col < (1 << CLASSIFY_TABLE_BITS); col++)
+    table[col].ind = -1;
 
   for ( row = 0; row < qrb->height; ++row ) {
-    outrow = &(qrb->data.palette.pixels[row*qrb->width]);
-    col = 0;
-    pP = (rgbaPixel*)(&(rb->data.rgba.pixels[row * rb->data.rgba.row_step]));;
-    pQ = outrow;
-    do {
-      /* Check hash table to see if we have already matched this color. */
-      ind = pam_lookupacolor( acht, pP );
-      if ( ind == -1 ) {
-        /* No; search acolormap for closest match. */
-        register int i, r1, g1, b1, a1, r2, g2, b2, a2;
-        register long dist, newdist;
-
-        r1 = PAM_GETR( *pP );
-        g1 = PAM_GETG( *pP );
-        b1 = PAM_GETB( *pP );
-        a1 = PAM_GETA( *pP );
-        dist = 2000000000;
-        for ( i = 0; i < qrb->data.palette.num_entries; ++i ) {
-          r2 = PAM_GETR( qrb->data.palette.palette[i] );
-          g2 = PAM_GETG( qrb->data.palette.palette[i] );
-          b2 = PAM_GETB( qrb->data.palette.palette[i] );
-          a2 = PAM_GETA( qrb->data.palette.palette[i] );
-          /* GRR POSSIBLE BUG */
-          newdist = ( r1 - r2 ) * ( r1 - r2 ) +  /* may overflow? */
-                    ( g1 - g2 ) * ( g1 - g2 ) +
-                    ( b1 - b2 ) * ( b1 - b2 ) +
-                    ( a1 - a2 ) * ( a1 - a2 );
-          if ( newdist < dist ) {
-            ind = i;
-            dist = newdist;
-          }
-        }
-        if ( usehash ) {
-          if ( pam_addtoacolorhash( acht, pP, ind ) < 0 ) {
-            usehash = 0;
-          }
-        }
+    pP = (rgbaPixel*)(&(rb->data.rgba.pixels[row * rb->data.rgba.row_step]));
+    pQ = &(qrb->data.palette.pixels[row*qrb->width]);
+    for ( col = 0; col < rb->width; ++col, ++pP, ++pQ ) {
+      unsigned int color;
+      classifyTableEntry *entry;
+      memcpy(&color, pP, sizeof(color));
+      entry = table + ((color * 2654435761U) >> (32 - CLASSIFY_TABLE_BITS));
+      if ( entry->ind == -1 || entry->color != color ) {
+        entry->color = color;
+        entry->ind = paletteSearchNearest(&ps, pP);
       }
+      *pQ = (unsigned char)entry->ind;
+    }
+  }
+  free(table);
+
+  return MS_SUCCESS;
+}
+
+
+/*
+** Octree quantizer, an alternative to median cut selected with the
+** QUANTIZE_METHOD=OCTREE format option. Pixels are inserted in a 16-way
+** tree indexed by one bit of each of r, g, b and a per level. The tree lives
+** in a fixed pool of nodes: when it is exhausted the deepest level is folded
+** into its parents, so memory does not depend on the number of colors in
+** the image. The palette is then obtained by merging, deepest level first
+** and smallest population first, the nodes whose children are all leaves
+** until there are no more leaves than requested colors. Images with fewer
+** distinct colors than that are reproduced exactly, without ever lowering
+** the color depth.
+*/
+#define OCTREE_MAX_NODES 8192
+#define OCTREE_DEPTH 8
+
+typedef struct {
+  double r, g, b, a;     /* color sums, leaves only */
+  double count;          /* pixels in the subtree, see octreeComputeCounts() */
+  int children[16];      /* 0 means none, the root is never a child */
+  unsigned char level, leaf, numchildren, alive;
+} octreeNodeObj;
+
+typedef struct {
+  octreeNodeObj *nodes;
+  int numnodes;          /* high water mark of the pool */
+  int *freenodes, numfree;
+  int numleaves, maxdepth;
+} octreeObj;
+
+static int octreeNewNode(octreeObj *tree, int level)
+{
+  int i;
+  octreeNodeObj *node;
+  if(tree->numfree > 0)
+    i = tree->freenodes[--tree->numfree];
+  else
+    i = tree->numnodes++;
+  node = tree->nodes + i;
+  memset(node, 0, sizeof(octreeNodeObj));
+  node->level = level;
+  node->alive = MS_TRUE;
+  if(level == tree->maxdepth) {
+    node->leaf = MS_TRUE;
+    tree->numleaves++;
+  }
+  return i;
+}
+
+/* Turns an internal node whose children are all leaves into a leaf */
+static void octreeMergeNode(octreeObj *tree, octreeNodeObj *node)
+{
+  int c;
+  node->count = 0;
+  for(c = 0; c < 16; c++) {
+    if(node->children[c]) {
+      octreeNodeObj *child = tree->nodes + node->children[c];
+      node->r += child->r;
+      node->g += child->g;
+      node->b += child->b;
+      node->a += child->a;
+      node->count += child->count;
+      child->alive = MS_FALSE;
+      tree->freenodes[tree->numfree++] = node->children[c];
+      node->children[c] = 0;
+      tree->numleaves--;
+    }
+  }
+  node->numchildren = 0;
+  node->leaf = MS_TRUE;
+  tree->numleaves++;
+}
+
+/* Folds the deepest level of the tree into its parents */
+static void octreeReduceDepth(octreeObj *tree)
+{
+  int i;
+  tree->maxdepth--;
+  for(i = 0; i < tree->numnodes; i++) {
+    octreeNodeObj *node = tree->nodes + i;
+    if(node->alive && !node->leaf && node->level == tree->maxdepth)
+      octreeMergeNode(tree, node);
+  }
+}
+
+/*
+** Returns the leaf the color falls in, creating the branch as needed. May
+** fold the tree, which invalidates previously returned leaves.
+*/
+static int octreeFindLeaf(octreeObj *tree, const rgbaPixel *pP)
+{
+  int r = PAM_GETR(*pP), g = PAM_GETG(*pP), b = PAM_GETB(*pP), a = PAM_GETA(*pP);
+  int i = 0;
+
+  /* a new branch needs at most maxdepth nodes */
+  while(tree->numnodes - tree->numfree + tree->maxdepth > OCTREE_MAX_NODES && tree->maxdepth > 1)
+    octreeReduceDepth(tree);
+
+  while(!tree->nodes[i].leaf) {
+    octreeNodeObj *node = tree->nodes + i;
+    int shift = 7 - node->level;
+    int c = ((r >> shift) & 1) | (((g >> shift) & 1) << 1) | (((b >> shift) & 1) << 2) | (((a >> shift) & 1) << 3);
+    if(!node->children[c]) {
+      node->children[c] = octreeNewNode(tree, node->level + 1);
+      node->numchildren++;
+    }
+    i = node->children[c];
+  }
+  return i;
+}
+
+/* Leaves are counted as pixels are added, internal nodes only once done */
+static double octreeComputeCounts(octreeObj *tree, int i)
+{
+  octreeNodeObj *node = tree->nodes + i;
+  int c;
+  if(!node->leaf) {
+    node->count = 0;
+    for(c = 0; c < 16; c++) {
+      if(node->children[c])
+        node->count += octreeComputeCounts(tree, node->children[c]);
+    }
+  }
+  return node->count;
+}
 
-      /*          *pP = acolormap[ind].acolor;  */
-      *pQ = (unsigned char)ind;
+typedef struct {
+  double count;
+  int node;
+} octreeCandidate;
 
-      ++col;
-      ++pP;
-      ++pQ;
+static int octreeCandidateCompare(const void *c1, const void *c2)
+{
+  double d = ((const octreeCandidate*)c1)->count - ((const octreeCandidate*)c2)->count;
+  if(d < 0) return -1;
+  if(d > 0) return 1;
+  return ((const octreeCandidate*)c1)->node - ((const octreeCandidate*)c2)->node;
+}
+
+int msQuantizeRasterBufferOctree(rasterBufferObj *rb, unsigned int *reqcolors, rgbaPixel *palette,
+                                 rgbaPixel *forced_palette, int num_forced_palette_entries)
+{
+  octreeObj tree;
+  octreeCandidate *candidates;
+  classifyTableEntry *table;
+  int row, col, level, i, n, target;
+
+  assert(rb->type == MS_BUFFER_BYTE_RGBA);
 
-    } while ( col != rb->width );
+  if(*reqcolors > 256)
+    *reqcolors = 256;
+  num_forced_palette_entries = MS_MIN(num_forced_palette_entries, (int)*reqcolors - 1);
+  if(!forced_palette || num_forced_palette_entries < 0)
+    num_forced_palette_entries = 0;
+  target = MS_MAX((int)*reqcolors - num_forced_palette_entries, 1);
+
+  memset(&tree, 0, sizeof(tree));
+  tree.nodes = (octreeNodeObj*) msSmallMalloc(sizeof(octreeNodeObj) * OCTREE_MAX_NODES);
+  tree.freenodes = (int*) msSmallMalloc(sizeof(int) * OCTREE_MAX_NODES);
+  tree.maxdepth = OCTREE_DEPTH;
+  octreeNewNode(&tree, 0);
+
+  /*
+  ** Runs of identical pixels are added at once, and the leaf of each color
+  ** is remembered in the same kind of table msClassifyRasterBuffer() uses,
+  ** emptied whenever the tree gets folded.
+  */
+  table = (classifyTableEntry*) msSmallMalloc(sizeof(classifyTableEntry) << CLASSIFY_TABLE_BITS);
+  for(i = 0; i < (1 << CLASSIFY_TABLE_BITS); i++)
+    table[i].ind = -1;
+  for ( row = 0; row < rb->height; ++row ) {
+    rgbaPixel *pP = (rgbaPixel*)(&(rb->data.rgba.pixels[row * rb->data.rgba.row_step]));
+    for ( col = 0; col < rb->width; ) {
+      unsigned int color;
+      classifyTableEntry *entry;
+      octreeNodeObj *leaf;
+      int run = 1, ind;
+      while(col + run < rb->width && PAM_EQUAL(pP[run], pP[0]))
+        run++;
+      memcpy(&color, pP, sizeof(color));
+      entry = table + ((color * 2654435761U) >> (32 - CLASSIFY_TABLE_BITS));
+      if(entry->ind != -1 && entry->color == color) {
+        ind = entry->ind;
+      } else {
+        int depth = tree.maxdepth;
+        ind = octreeFindLeaf(&tree, pP);
+        if(tree.maxdepth != depth) {
+          for(i = 0; i < (1 << CLASSIFY_TABLE_BITS); i++)
+            table[i].ind = -1;
+        }
+        entry->color = color;
+        entry->ind = ind;
+      }
+      leaf = tree.nodes + ind;
+      leaf->count += run;
+      leaf->r += (double)PAM_GETR(*pP) * run;
+      leaf->g += (double)PAM_GETG(*pP) * run;
+      leaf->b += (double)PAM_GETB(*pP) * run;
+      leaf->a += (double)PAM_GETA(*pP) * run;
+      pP += run;
+      col += run;
+    }
   }
-  pam_freeacolorhash(acht);
+  free(table);
+  octreeComputeCounts(&tree, 0);
+
+  candidates = (octreeCandidate*) msSmallMalloc(sizeof(octreeCandidate) * OCTREE_MAX_NODES);
+  for(level = tree.maxdepth - 1; level >= 0 && tree.numleaves > target; level--) {
+    n = 0;
+    for(i = 0; i < tree.numnodes; i++) {
+      octreeNodeObj *node = tree.nodes + i;
+      if(node->alive && !node->leaf && node->level == level) {
+        candidates[n].count = node->count;
+        candidates[n].node = i;
+        n++;
+      }
+    }
+    qsort(candidates, n, sizeof(octreeCandidate), octreeCandidateCompare);
+    for(i = 0; i < n && tree.numleaves > target; i++)
+      octreeMergeNode(&tree, tree.nodes + candidates[i].node);
+  }
+  free(candidates);
+
+  for(i = 0; i < num_forced_palette_entries; i++)
+    palette[i] = forced_palette[i];
+  n = num_forced_palette_entries;
+  for(i = 0; i < tree.numnodes; i++) {
+    octreeNodeObj *node = tree.nodes + i;
+    if(node->alive && node->leaf && node->count > 0) {
+      PAM_ASSIGN(palette[n],
+                 (unsigned char)(node->r / node->count + 0.5),
+                 (unsigned char)(node->g / node->count + 0.5),
+                 (unsigned char)(node->b / node->count + 0.5),
+                 (unsigned char)(node->a / node->count + 0.5));
+      n++;
+    }
+  }
+  *reqcolors = n;
 
+  free(tree.nodes);
+  free(tree.freenodes);
   return MS_SUCCESS;
 }
 
@@ -673,27 +972,6 @@ pam_allocacolorhash( )
 
 
 
-static int
-pam_addtoacolorhash( acht, acolorP, value )
-acolorhash_table acht;
-rgbaPixel* acolorP;
-int value;
-{
-  register int hash;
-  register acolorhist_list achl;
-
-  achl = (acolorhist_list) msSmallMalloc( sizeof(struct acolorhist_list_item) );
-
-  hash = pam_hashapixel( *acolorP );
-  achl->ch.acolor = *acolorP;
-  achl->ch.value = value;
-  achl->next = acht[hash];
-  acht[hash] = achl;
-  return 0;
-}
-
-
-
 static acolorhist_vector
 pam_acolorhashtoacolorhist( acht, maxacolors )
 acolorhash_table acht;
@@ -726,24 +1004,6 @@ int maxacolors;
 
 
 
-static int
-pam_lookupacolor( acht, acolorP )
-acolorhash_table acht;
-rgbaPixel* acolorP;
-{
-  int hash;
-  acolorhist_list achl;
-
-  hash = pam_hashapixel( *acolorP );
-  for ( achl = acht[hash]; achl != (acolorhist_list) 0; achl = achl->next )
-    if ( PAM_EQUAL( achl->ch.acolor, *acolorP ) )
-      return achl->ch.value;
-
-  return -1;
-}
-
-
-
 static void
 pam_freeacolorhist( achv )
 acolorhist_vector achv;
@@ -52,6 +52,8 @@ int msInitQuery(queryObj *query) {
   query->maxfeatures = -1;
   query->startindex = -1;
   query->only_cache_result_count = 0;
+  query->result_callback = NULL;
+  query->result_callback_data = NULL;
   
   query->filteritem = NULL;
   msInitExpression(&query->filter);
@@ -1065,6 +1067,15 @@ int msQueryByRect(mapObj *map)
         }
         if( map->query.only_cache_result_count )
             lp->resultcache->numresults ++;
+        else if( map->query.result_callback ) {
+          /* streamed to the caller, only keep the count */
+          if( map->query.result_callback(map, lp, &shape, map->query.result_callback_data) != MS_SUCCESS ) {
+            msFreeShape(&shape);
+            status = MS_FAILURE;
+            break;
+          }
+          lp->resultcache->numresults ++;
+        }
         else
             addResult(lp->resultcache, &shape);
         --map->query.maxfeatures;
@@ -841,6 +841,14 @@ int msDrawRasterLayerLow(mapObj *map, layerObj *layer, imageObj *image,
       if( close_connection != NULL
           && strcasecmp(close_connection,"DEFER") == 0 ) {
         GDALDereferenceDataset( hDS );
+      } else if( close_connection == NULL ) {
+        /*
+        ** Tile index members stay open in a bounded cache shared by
+        ** the requests of the process when MS_GDAL_DATASET_CACHE_SIZE
+        ** is set, closed right away otherwise.
+        */
+        const char *cache_size = msGetConfigOption( map, "MS_GDAL_DATASET_CACHE_SIZE" );
+        msGDALReleaseDataset( hDS, cache_size ? atoi(cache_size) : 0 );
       } else {
         GDALClose( hDS );
       }
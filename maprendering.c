@@ -831,6 +831,60 @@ cleanup:
   return ret;
 }
 
+/*
+** Render a marker symbol centered on (x,y), no caching involved.
+*/
+int msRenderMarkerSymbol(mapObj *map, imageObj *image, symbolObj *symbol,
+                         symbolStyleObj *s, double x, double y)
+{
+  rendererVTableObj *renderer = image->format->vtable;
+  int ret = MS_SUCCESS;
+
+  switch (symbol->type) {
+    case (MS_SYMBOL_TRUETYPE): {
+      unsigned int unicode;
+      glyph_element *glyphc;
+      face_element *face = msGetFontFace(symbol->font, &map->fontset);
+      if(UNLIKELY(!face)) return MS_FAILURE;
+      msUTF8ToUniChar(symbol->character,&unicode);
+      unicode = msGetGlyphIndex(face,unicode);
+      glyphc = msGetGlyphByIndex(face, MS_MAX(MS_NINT(s->scale),1), unicode);
+      if(UNLIKELY(!glyphc)) return MS_FAILURE;
+      ret = drawGlyphMarker(image, face, glyphc, x, y, s->scale, s->rotation, s->color, s->outlinecolor, s->outlinewidth);
+    }
+    break;
+    case (MS_SYMBOL_PIXMAP): {
+      assert(symbol->pixmap_buffer);
+      ret = renderer->renderPixmapSymbol(image,x,y,symbol,s);
+    }
+    break;
+    case (MS_SYMBOL_ELLIPSE): {
+      ret = renderer->renderEllipseSymbol(image, x, y,symbol, s);
+    }
+    break;
+    case (MS_SYMBOL_VECTOR): {
+      ret = renderer->renderVectorSymbol(image, x, y, symbol, s);
+    }
+    break;
+    case (MS_SYMBOL_SVG): {
+      if (renderer->supports_svg) {
+        ret = renderer->renderSVGSymbol(image, x, y, symbol, s);
+      } else {
+#if defined(USE_SVG_CAIRO) || defined(USE_RSVG)
+        ret = msRenderRasterizedSVGSymbol(image, x,y, symbol, s);
+#else
+        msSetError(MS_SYMERR, "SVG symbol support is not enabled.", "msRenderMarkerSymbol()");
+        return MS_FAILURE;
+#endif
+      }
+    }
+    break;
+    default:
+      break;
+  }
+  return ret;
+}
+
 int msDrawMarkerSymbol(mapObj *map, imageObj *image, pointObj *p, styleObj *style,
                        double scalefactor)
 {
@@ -914,49 +968,10 @@ int msDrawMarkerSymbol(mapObj *map, imageObj *image, pointObj *p, styleObj *styl
           return MS_FAILURE;
         }
       }
-      switch (symbol->type) {
-        case (MS_SYMBOL_TRUETYPE): {
-          unsigned int unicode;
-          glyph_element *glyphc;
-          face_element *face = msGetFontFace(symbol->font, &map->fontset);
-          if(UNLIKELY(!face)) return MS_FAILURE;
-          msUTF8ToUniChar(symbol->character,&unicode);
-          unicode = msGetGlyphIndex(face,unicode);
-          glyphc = msGetGlyphByIndex(face, MS_MAX(MS_NINT(s.scale),1), unicode);
-          if(UNLIKELY(!glyphc)) return MS_FAILURE;
-          ret = drawGlyphMarker(image, face, glyphc, p_x, p_y, s.scale, s.rotation, s.color, s.outlinecolor, s.outlinewidth);
-        }
-        break;
-        case (MS_SYMBOL_PIXMAP): {
-          assert(symbol->pixmap_buffer);
-          ret = renderer->renderPixmapSymbol(image,p_x,p_y,symbol,&s);
-        }
-        break;
-        case (MS_SYMBOL_ELLIPSE): {
-          ret = renderer->renderEllipseSymbol(image, p_x, p_y,symbol, &s);
-        }
-        break;
-        case (MS_SYMBOL_VECTOR): {
-          ret = renderer->renderVectorSymbol(image, p_x, p_y, symbol, &s);
-        }
-        break;
-        case (MS_SYMBOL_SVG): {
-          if (renderer->supports_svg) {
-            ret = renderer->renderSVGSymbol(image, p_x, p_y, symbol, &s);
-          } else {
-#if defined(USE_SVG_CAIRO) || defined(USE_RSVG)
-            ret = msRenderRasterizedSVGSymbol(image, p_x,p_y, symbol, &s);
-#else
-            msSetError(MS_SYMERR, "SVG symbol support is not enabled.", "msDrawMarkerSymbol()");
-            return MS_FAILURE;
-#endif
-          }
-        }
-        break;
-        default:
-          break;
-      }
-      return ret;
+      ret = msMarkerCacheDrawSymbol(map, image, symbol, &s, p_x, p_y);
+      if(ret != MS_DONE)
+        return ret;
+      return msRenderMarkerSymbol(map, image, symbol, &s, p_x, p_y);
     } else if( MS_RENDERER_IMAGEMAP(image->format) )
       msDrawMarkerSymbolIM(map, image, p, style, scalefactor);
 
@@ -31,6 +31,11 @@
 #include "mapresample.h"
 #include "mapthread.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MS_RESAMPLE_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 
 
 #define SKIP_MASK(x,y) (mask_rb && !*(mask_rb->data.rgba.a+(y)*mask_rb->data.rgba.row_step+(x)*mask_rb->data.rgba.pixel_step))
@@ -84,14 +89,14 @@ msNearestRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
                           int *panCMap,
                           SimpleTransformer pfnTransform, void *pCBData,
                           int debug, rasterBufferObj *mask_rb,
-                          int bWrapAtLeftRight )
+                          int bWrapAtLeftRight,
+                          int nDstYMin, int nDstYMax )
 
 {
   double  *x, *y;
   int   nDstX, nDstY;
   int         *panSuccess;
   int   nDstXSize = psDstImage->width;
-  int   nDstYSize = psDstImage->height;
   int   nSrcXSize = psSrcImage->width;
   int   nSrcYSize = psSrcImage->height;
   int   nFailedPoints = 0, nSetPoints = 0;
@@ -102,7 +107,7 @@ msNearestRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
   y = (double *) msSmallMalloc( sizeof(double) * nDstXSize );
   panSuccess = (int *) msSmallMalloc( sizeof(int) * nDstXSize );
 
-  for( nDstY = 0; nDstY < nDstYSize; nDstY++ ) {
+  for( nDstY = nDstYMin; nDstY < nDstYMax; nDstY++ ) {
     for( nDstX = 0; nDstX < nDstXSize; nDstX++ ) {
       x[nDstX] = nDstX + 0.5;
       y[nDstX] = nDstY + 0.5;
@@ -217,7 +222,6 @@ msNearestRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
   free( panSuccess );
   free( x );
   free( y );
-  msFree(mask_rb);
 
   /* -------------------------------------------------------------------- */
   /*      Some debugging output.                                          */
@@ -307,14 +311,14 @@ msBilinearRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
                            int *panCMap,
                            SimpleTransformer pfnTransform, void *pCBData,
                            int debug, rasterBufferObj *mask_rb,
-                           int bWrapAtLeftRight )
+                           int bWrapAtLeftRight,
+                           int nDstYMin, int nDstYMax )
 
 {
   double  *x, *y;
   int   nDstX, nDstY, i;
   int         *panSuccess;
   int   nDstXSize = psDstImage->width;
-  int   nDstYSize = psDstImage->height;
   int   nSrcXSize = psSrcImage->width;
   int   nSrcYSize = psSrcImage->height;
   int   nFailedPoints = 0, nSetPoints = 0;
@@ -329,7 +333,7 @@ msBilinearRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
   y = (double *) msSmallMalloc( sizeof(double) * nDstXSize );
   panSuccess = (int *) msSmallMalloc( sizeof(int) * nDstXSize );
 
-  for( nDstY = 0; nDstY < nDstYSize; nDstY++ ) {
+  for( nDstY = nDstYMin; nDstY < nDstYMax; nDstY++ ) {
     for( nDstX = 0; nDstX < nDstXSize; nDstX++ ) {
       x[nDstX] = nDstX + 0.5;
       y[nDstX] = nDstY + 0.5;
@@ -450,7 +454,6 @@ msBilinearRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
   free( panSuccess );
   free( x );
   free( y );
-  msFree(mask_rb);
 
   /* -------------------------------------------------------------------- */
   /*      Some debugging output.                                          */
@@ -527,14 +530,14 @@ msAverageRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
                           imageObj *psDstImage, rasterBufferObj *dst_rb,
                           int *panCMap,
                           SimpleTransformer pfnTransform, void *pCBData,
-                          int debug, rasterBufferObj *mask_rb )
+                          int debug, rasterBufferObj *mask_rb,
+                          int nDstYMin, int nDstYMax )
 
 {
   double  *x1, *y1, *x2, *y2;
   int   nDstX, nDstY;
   int         *panSuccess1, *panSuccess2;
   int   nDstXSize = psDstImage->width;
-  int   nDstYSize = psDstImage->height;
   int   nFailedPoints = 0, nSetPoints = 0;
   double     *padfPixelSum;
 
@@ -551,7 +554,7 @@ msAverageRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
   panSuccess1 = (int *) msSmallMalloc( sizeof(int) * (nDstXSize+1) );
   panSuccess2 = (int *) msSmallMalloc( sizeof(int) * (nDstXSize+1) );
 
-  for( nDstY = 0; nDstY < nDstYSize; nDstY++ ) {
+  for( nDstY = nDstYMin; nDstY < nDstYMax; nDstY++ ) {
     for( nDstX = 0; nDstX <= nDstXSize; nDstX++ ) {
       x1[nDstX] = nDstX;
       y1[nDstX] = nDstY;
@@ -648,7 +651,6 @@ msAverageRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
   free( panSuccess2 );
   free( x2 );
   free( y2 );
-  msFree(mask_rb);
 
   /* -------------------------------------------------------------------- */
   /*      Some debugging output.                                          */
@@ -975,6 +977,379 @@ static int msApproxTransformer( void *pCBData, int nPoints,
   return 1;
 }
 
+/************************************************************************/
+/* ==================================================================== */
+/*      Grid transformer.                                               */
+/*                                                                      */
+/*      The destination image is covered with square cells whose       */
+/*      corners are transformed once per request. A cell is split in    */
+/*      four while bilinear interpolation of its corners misses the     */
+/*      exact position of the middles of its edges or of its centre by  */
+/*      more than the tolerance; these five points are the new corners  */
+/*      of the children so no transformation is wasted. Points are      */
+/*      interpolated in the leaf cell they fall in, points in leaves    */
+/*      that could not be split further go through the base             */
+/*      transformer.                                                    */
+/* ==================================================================== */
+/************************************************************************/
+
+#define GRID_CELL_SIZE      64
+#define GRID_MIN_CELL_SIZE  4
+
+typedef struct {
+  double dfX0, dfY0, dfSize;
+  double adfSrcX[4], adfSrcY[4]; /* top-left, top-right, bottom-left, bottom-right */
+  int nChild; /* first of the four children, -1 for a leaf */
+  int bExact; /* leaf whose points use the base transformer */
+} msGridCell;
+
+typedef struct {
+  SimpleTransformer pfnBaseTransformer;
+  void             *pBaseCBData;
+
+  double        dfMaxError;
+
+  int           nCellsX, nCellsY;
+  msGridCell   *pasCells;
+  int           nCells, nMaxCells;
+} msGridTransformInfo;
+
+/************************************************************************/
+/*                          msGridRefineCell()                          */
+/************************************************************************/
+
+static void msGridRefineCell( msGridTransformInfo *psGTInfo, int iCell,
+                              const int *panCornerSuccess )
+
+{
+  msGridCell *psCell = psGTInfo->pasCells + iCell;
+  double x[5], y[5], adfNodeX[9], adfNodeY[9];
+  double dfX0 = psCell->dfX0, dfY0 = psCell->dfY0;
+  double dfSize = psCell->dfSize, dfHalf = dfSize * 0.5;
+  int anSuccess[5], anNodeSuccess[9], i, bSplit;
+  int bCornersOK = panCornerSuccess[0] && panCornerSuccess[1]
+                   && panCornerSuccess[2] && panCornerSuccess[3];
+
+  /* middles of the top, left, right and bottom edges, and centre */
+  x[0] = dfX0 + dfHalf;
+  y[0] = dfY0;
+  x[1] = dfX0;
+  y[1] = dfY0 + dfHalf;
+  x[2] = dfX0 + dfHalf;
+  y[2] = dfY0 + dfHalf;
+  x[3] = dfX0 + dfSize;
+  y[3] = dfY0 + dfHalf;
+  x[4] = dfX0 + dfHalf;
+  y[4] = dfY0 + dfSize;
+
+  psGTInfo->pfnBaseTransformer( psGTInfo->pBaseCBData, 5, x, y, anSuccess );
+
+  bSplit = !bCornersOK;
+  for( i = 0; i < 5 && !bSplit; i++ ) {
+    /* test points sit at u,v in {0, 0.5, 1} */
+    static const double adfU[5] = { 0.5, 0.0, 0.5, 1.0, 0.5 };
+    static const double adfV[5] = { 0.0, 0.5, 0.5, 0.5, 1.0 };
+    double dfX, dfY;
+
+    if( !anSuccess[i] ) {
+      bSplit = MS_TRUE;
+      break;
+    }
+
+    dfX = (1.0 - adfV[i]) * ((1.0 - adfU[i]) * psCell->adfSrcX[0] + adfU[i] * psCell->adfSrcX[1])
+          + adfV[i] * ((1.0 - adfU[i]) * psCell->adfSrcX[2] + adfU[i] * psCell->adfSrcX[3]);
+    dfY = (1.0 - adfV[i]) * ((1.0 - adfU[i]) * psCell->adfSrcY[0] + adfU[i] * psCell->adfSrcY[1])
+          + adfV[i] * ((1.0 - adfU[i]) * psCell->adfSrcY[2] + adfU[i] * psCell->adfSrcY[3]);
+
+    if( fabs(dfX - x[i]) + fabs(dfY - y[i]) > psGTInfo->dfMaxError )
+      bSplit = MS_TRUE;
+  }
+
+  if( !bSplit )
+    return;
+
+  if( dfSize <= GRID_MIN_CELL_SIZE ) {
+    psCell->bExact = MS_TRUE;
+    return;
+  }
+
+  /* -------------------------------------------------------------------- */
+  /*      Split in four, the 3x3 nodes of the children are the corners    */
+  /*      of this cell and the points just transformed.                   */
+  /* -------------------------------------------------------------------- */
+  adfNodeX[0] = psCell->adfSrcX[0];
+  adfNodeY[0] = psCell->adfSrcY[0];
+  anNodeSuccess[0] = panCornerSuccess[0];
+  adfNodeX[1] = x[0];
+  adfNodeY[1] = y[0];
+  anNodeSuccess[1] = anSuccess[0];
+  adfNodeX[2] = psCell->adfSrcX[1];
+  adfNodeY[2] = psCell->adfSrcY[1];
+  anNodeSuccess[2] = panCornerSuccess[1];
+  adfNodeX[3] = x[1];
+  adfNodeY[3] = y[1];
+  anNodeSuccess[3] = anSuccess[1];
+  adfNodeX[4] = x[2];
+  adfNodeY[4] = y[2];
+  anNodeSuccess[4] = anSuccess[2];
+  adfNodeX[5] = x[3];
+  adfNodeY[5] = y[3];
+  anNodeSuccess[5] = anSuccess[3];
+  adfNodeX[6] = psCell->adfSrcX[2];
+  adfNodeY[6] = psCell->adfSrcY[2];
+  anNodeSuccess[6] = panCornerSuccess[2];
+  adfNodeX[7] = x[4];
+  adfNodeY[7] = y[4];
+  anNodeSuccess[7] = anSuccess[4];
+  adfNodeX[8] = psCell->adfSrcX[3];
+  adfNodeY[8] = psCell->adfSrcY[3];
+  anNodeSuccess[8] = panCornerSuccess[3];
+
+  if( psGTInfo->nCells + 4 > psGTInfo->nMaxCells ) {
+    psGTInfo->nMaxCells = psGTInfo->nMaxCells * 2 + 4;
+    psGTInfo->pasCells = (msGridCell *)
+      msSmallRealloc( psGTInfo->pasCells, sizeof(msGridCell) * psGTInfo->nMaxCells );
+  }
+  psCell = psGTInfo->pasCells + iCell;
+  psCell->nChild = psGTInfo->nCells;
+  psGTInfo->nCells += 4;
+
+  for( i = 0; i < 4; i++ ) {
+    msGridCell *psChild = psGTInfo->pasCells + psCell->nChild + i;
+    int iCorner;
+
+    psChild->dfX0 = dfX0 + (i % 2) * dfHalf;
+    psChild->dfY0 = dfY0 + (i / 2) * dfHalf;
+    psChild->dfSize = dfHalf;
+    psChild->nChild = -1;
+    psChild->bExact = MS_FALSE;
+    for( iCorner = 0; iCorner < 4; iCorner++ ) {
+      int iNode = (i / 2 + iCorner / 2) * 3 + (i % 2 + iCorner % 2);
+      psChild->adfSrcX[iCorner] = adfNodeX[iNode];
+      psChild->adfSrcY[iCorner] = adfNodeY[iNode];
+    }
+  }
+
+  /* the cells array may move while refining, address children by index */
+  for( i = 0; i < 4; i++ ) {
+    int iCorner, anChildSuccess[4];
+
+    for( iCorner = 0; iCorner < 4; iCorner++ ) {
+      int iNode = (i / 2 + iCorner / 2) * 3 + (i % 2 + iCorner % 2);
+      anChildSuccess[iCorner] = anNodeSuccess[iNode];
+    }
+    msGridRefineCell( psGTInfo, psGTInfo->pasCells[iCell].nChild + i, anChildSuccess );
+  }
+}
+
+/************************************************************************/
+/*                       msInitGridTransformer()                        */
+/************************************************************************/
+
+static void *msInitGridTransformer( SimpleTransformer pfnBaseTransformer,
+                                    void *pBaseCBData,
+                                    int nDstXSize, int nDstYSize,
+                                    double dfMaxError )
+
+{
+  msGridTransformInfo *psGTInfo;
+  double *x, *y;
+  int *panSuccess, nNodesX, nNodesY, iX, iY;
+
+  psGTInfo = (msGridTransformInfo *) msSmallCalloc(1,sizeof(msGridTransformInfo));
+  psGTInfo->pfnBaseTransformer = pfnBaseTransformer;
+  psGTInfo->pBaseCBData = pBaseCBData;
+  psGTInfo->dfMaxError = dfMaxError;
+
+  /* cover [0,nDstXSize]x[0,nDstYSize] inclusive, corners are sampled too */
+  psGTInfo->nCellsX = nDstXSize / GRID_CELL_SIZE + 1;
+  psGTInfo->nCellsY = nDstYSize / GRID_CELL_SIZE + 1;
+  psGTInfo->nCells = psGTInfo->nCellsX * psGTInfo->nCellsY;
+  psGTInfo->nMaxCells = psGTInfo->nCells * 2;
+  psGTInfo->pasCells = (msGridCell *) msSmallMalloc( sizeof(msGridCell) * psGTInfo->nMaxCells );
+
+  /* -------------------------------------------------------------------- */
+  /*      Transform the corners of the top level cells in one go.         */
+  /* -------------------------------------------------------------------- */
+  nNodesX = psGTInfo->nCellsX + 1;
+  nNodesY = psGTInfo->nCellsY + 1;
+  x = (double *) msSmallMalloc( sizeof(double) * nNodesX * nNodesY );
+  y = (double *) msSmallMalloc( sizeof(double) * nNodesX * nNodesY );
+  panSuccess = (int *) msSmallMalloc( sizeof(int) * nNodesX * nNodesY );
+
+  /* row by row, so that a failure does not take the whole grid with it */
+  for( iY = 0; iY < nNodesY; iY++ ) {
+    for( iX = 0; iX < nNodesX; iX++ ) {
+      x[iY * nNodesX + iX] = (double) iX * GRID_CELL_SIZE;
+      y[iY * nNodesX + iX] = (double) iY * GRID_CELL_SIZE;
+    }
+    pfnBaseTransformer( pBaseCBData, nNodesX, x + iY * nNodesX, y + iY * nNodesX,
+                        panSuccess + iY * nNodesX );
+  }
+
+  for( iY = 0; iY < psGTInfo->nCellsY; iY++ ) {
+    for( iX = 0; iX < psGTInfo->nCellsX; iX++ ) {
+      msGridCell *psCell = psGTInfo->pasCells + iY * psGTInfo->nCellsX + iX;
+      int iCorner, anCornerSuccess[4];
+
+      psCell->dfX0 = (double) iX * GRID_CELL_SIZE;
+      psCell->dfY0 = (double) iY * GRID_CELL_SIZE;
+      psCell->dfSize = GRID_CELL_SIZE;
+      psCell->nChild = -1;
+      psCell->bExact = MS_FALSE;
+      for( iCorner = 0; iCorner < 4; iCorner++ ) {
+        int iNode = (iY + iCorner / 2) * nNodesX + iX + iCorner % 2;
+        psCell->adfSrcX[iCorner] = x[iNode];
+        psCell->adfSrcY[iCorner] = y[iNode];
+        anCornerSuccess[iCorner] = panSuccess[iNode];
+      }
+      msGridRefineCell( psGTInfo, iY * psGTInfo->nCellsX + iX, anCornerSuccess );
+    }
+  }
+
+  free( x );
+  free( y );
+  free( panSuccess );
+
+  return psGTInfo;
+}
+
+/************************************************************************/
+/*                       msFreeGridTransformer()                        */
+/************************************************************************/
+
+static void msFreeGridTransformer( void * pCBData )
+
+{
+  msGridTransformInfo *psGTInfo = (msGridTransformInfo *) pCBData;
+
+  free( psGTInfo->pasCells );
+  free( psGTInfo );
+}
+
+/************************************************************************/
+/*                          msGridFindCell()                            */
+/************************************************************************/
+
+static const msGridCell *msGridFindCell( const msGridTransformInfo *psGTInfo,
+                                         double dfX, double dfY )
+
+{
+  const msGridCell *psCell;
+  int iX, iY;
+
+  if( !(dfX >= 0.0) || !(dfY >= 0.0) )
+    return NULL;
+
+  iX = (int) (dfX / GRID_CELL_SIZE);
+  iY = (int) (dfY / GRID_CELL_SIZE);
+  if( iX >= psGTInfo->nCellsX || iY >= psGTInfo->nCellsY )
+    return NULL;
+
+  psCell = psGTInfo->pasCells + iY * psGTInfo->nCellsX + iX;
+  while( psCell->nChild >= 0 ) {
+    double dfHalf = psCell->dfSize * 0.5;
+
+    psCell = psGTInfo->pasCells + psCell->nChild
+             + (dfX >= psCell->dfX0 + dfHalf) + 2 * (dfY >= psCell->dfY0 + dfHalf);
+  }
+
+  return psCell;
+}
+
+/************************************************************************/
+/*                          msGridTransformer                           */
+/*                                                                      */
+/*      Only reads the grid, so it can be shared by concurrent callers. */
+/************************************************************************/
+
+static int msGridTransformer( void *pCBData, int nPoints,
+                              double *x, double *y, int *panSuccess )
+
+{
+  msGridTransformInfo *psGTInfo = (msGridTransformInfo *) pCBData;
+  double *padfExactX = NULL, *padfExactY = NULL;
+  int *panExact = NULL, *panExactSuccess = NULL;
+  int i = 0, j, nExact = 0;
+
+  while( i < nPoints ) {
+    const msGridCell *psCell = msGridFindCell( psGTInfo, x[i], y[i] );
+    double dfY, dfXEnd, dfInvSize, dfV, dfAX, dfBX, dfAY, dfBY, dfX0;
+
+    if( psCell == NULL || psCell->bExact ) {
+      if( panExact == NULL ) {
+        padfExactX = (double *) msSmallMalloc( sizeof(double) * nPoints );
+        padfExactY = (double *) msSmallMalloc( sizeof(double) * nPoints );
+        panExact = (int *) msSmallMalloc( sizeof(int) * nPoints );
+        panExactSuccess = (int *) msSmallMalloc( sizeof(int) * nPoints );
+      }
+      padfExactX[nExact] = x[i];
+      padfExactY[nExact] = y[i];
+      panExact[nExact++] = i++;
+      continue;
+    }
+
+    /* -------------------------------------------------------------------- */
+    /*      Along a row the interpolation within a cell is linear, find    */
+    /*      the run of points of the same row inside the cell.             */
+    /* -------------------------------------------------------------------- */
+    dfY = y[i];
+    dfX0 = psCell->dfX0;
+    dfXEnd = dfX0 + psCell->dfSize;
+    for( j = i + 1; j < nPoints && y[j] == dfY && x[j] >= dfX0 && x[j] < dfXEnd; j++ ) {}
+
+    dfInvSize = 1.0 / psCell->dfSize;
+    dfV = (dfY - psCell->dfY0) * dfInvSize;
+    dfAX = psCell->adfSrcX[0] + (psCell->adfSrcX[2] - psCell->adfSrcX[0]) * dfV;
+    dfBX = psCell->adfSrcX[1] + (psCell->adfSrcX[3] - psCell->adfSrcX[1]) * dfV - dfAX;
+    dfAY = psCell->adfSrcY[0] + (psCell->adfSrcY[2] - psCell->adfSrcY[0]) * dfV;
+    dfBY = psCell->adfSrcY[1] + (psCell->adfSrcY[3] - psCell->adfSrcY[1]) * dfV - dfAY;
+
+#ifdef MS_RESAMPLE_USE_SSE2
+    {
+      __m128d vX0 = _mm_set1_pd( dfX0 ), vInvSize = _mm_set1_pd( dfInvSize );
+      __m128d vAX = _mm_set1_pd( dfAX ), vBX = _mm_set1_pd( dfBX );
+      __m128d vAY = _mm_set1_pd( dfAY ), vBY = _mm_set1_pd( dfBY );
+
+      for( ; i + 2 <= j; i += 2 ) {
+        __m128d vU = _mm_mul_pd( _mm_sub_pd( _mm_loadu_pd( x + i ), vX0 ), vInvSize );
+        _mm_storeu_pd( x + i, _mm_add_pd( vAX, _mm_mul_pd( vBX, vU ) ) );
+        _mm_storeu_pd( y + i, _mm_add_pd( vAY, _mm_mul_pd( vBY, vU ) ) );
+        panSuccess[i] = 1;
+        panSuccess[i+1] = 1;
+      }
+    }
+#endif
+    for( ; i < j; i++ ) {
+      double dfU = (x[i] - dfX0) * dfInvSize;
+      x[i] = dfAX + dfBX * dfU;
+      y[i] = dfAY + dfBY * dfU;
+      panSuccess[i] = 1;
+    }
+  }
+
+  /* -------------------------------------------------------------------- */
+  /*      Points outside of the grid or in cells that could not be        */
+  /*      interpolated go through the base transformer in one batch.      */
+  /* -------------------------------------------------------------------- */
+  if( nExact > 0 ) {
+    psGTInfo->pfnBaseTransformer( psGTInfo->pBaseCBData, nExact,
+                                  padfExactX, padfExactY, panExactSuccess );
+    for( i = 0; i < nExact; i++ ) {
+      x[panExact[i]] = padfExactX[i];
+      y[panExact[i]] = padfExactY[i];
+      panSuccess[panExact[i]] = panExactSuccess[i];
+    }
+  }
+
+  free( padfExactX );
+  free( padfExactY );
+  free( panExact );
+  free( panExactSuccess );
+
+  return 1;
+}
+
 /************************************************************************/
 /*                       msTransformMapToSource()                       */
 /*                                                                      */
@@ -1270,6 +1645,101 @@ static int msTransformMapToSource( int nDstXSize, int nDstYSize,
   return MS_TRUE;
 }
 
+/************************************************************************/
+/*                         msResampleRowsJob()                          */
+/*                                                                      */
+/*      Resampling of a band of rows of the destination image. Bands    */
+/*      write disjoint rows of the destination, the source image and    */
+/*      the grid transformer are only read. The approximate             */
+/*      transformer is cheap to set up and gets a private copy per      */
+/*      band when bands run on several threads, a band whose copy       */
+/*      cannot be set up is flagged in panJobStatus.                    */
+/************************************************************************/
+
+typedef struct {
+  imageObj *psSrcImage;
+  rasterBufferObj *src_rb;
+  imageObj *psDstImage;
+  rasterBufferObj *dst_rb;
+  int *panCMap;
+  SimpleTransformer pfnTransform;
+  void *pCBData;
+  int debug;
+  rasterBufferObj *mask_rb;
+  int bWrapAtLeftRight;
+  const char *resampleMode;
+
+  int bPrivateTransformer;
+  projectionObj *psSrcProj;
+  double *padfSrcGeoTransform;
+  projectionObj *psDstProj;
+  double *padfDstGeoTransform;
+
+  int nRowsPerJob;
+  int *panJobStatus; /* MS_SUCCESS or MS_FAILURE per band */
+} msResampleJobObj;
+
+static void msResampleRowsJob( void *pData, int iJob )
+
+{
+  msResampleJobObj *psJob = (msResampleJobObj *) pData;
+  int nDstYMin = iJob * psJob->nRowsPerJob;
+  int nDstYMax = MS_MIN( nDstYMin + psJob->nRowsPerJob, psJob->psDstImage->height );
+  void *pTCBData = NULL, *pCBData = psJob->pCBData;
+
+  if( psJob->bPrivateTransformer ) {
+    pTCBData = msInitProjTransformer( psJob->psSrcProj, psJob->padfSrcGeoTransform,
+                                      psJob->psDstProj, psJob->padfDstGeoTransform );
+    if( pTCBData == NULL ) {
+      psJob->panJobStatus[iJob] = MS_FAILURE;
+      return;
+    }
+    pCBData = msInitApproxTransformer( msProjTransformer, pTCBData, 0.333 );
+  }
+
+  if( EQUAL(psJob->resampleMode,"AVERAGE") )
+    msAverageRasterResampler( psJob->psSrcImage, psJob->src_rb,
+                              psJob->psDstImage, psJob->dst_rb,
+                              psJob->panCMap, psJob->pfnTransform, pCBData,
+                              psJob->debug, psJob->mask_rb,
+                              nDstYMin, nDstYMax );
+  else if( EQUAL(psJob->resampleMode,"BILINEAR") )
+    msBilinearRasterResampler( psJob->psSrcImage, psJob->src_rb,
+                               psJob->psDstImage, psJob->dst_rb,
+                               psJob->panCMap, psJob->pfnTransform, pCBData,
+                               psJob->debug, psJob->mask_rb,
+                               psJob->bWrapAtLeftRight, nDstYMin, nDstYMax );
+  else
+    msNearestRasterResampler( psJob->psSrcImage, psJob->src_rb,
+                              psJob->psDstImage, psJob->dst_rb,
+                              psJob->panCMap, psJob->pfnTransform, pCBData,
+                              psJob->debug, psJob->mask_rb,
+                              psJob->bWrapAtLeftRight, nDstYMin, nDstYMax );
+
+  if( psJob->bPrivateTransformer ) {
+    msFreeApproxTransformer( pCBData );
+    msFreeProjTransformer( pTCBData );
+  }
+}
+
+/************************************************************************/
+/*                       msGetResampleThreads()                         */
+/*                                                                      */
+/*      Number of threads resampling a raster layer, from the           */
+/*      MS_RESAMPLE_THREADS config option.                              */
+/************************************************************************/
+
+static int msGetResampleThreads( mapObj *map )
+
+{
+#ifdef USE_THREAD
+  const char *value = msGetConfigOption( map, "MS_RESAMPLE_THREADS" );
+  if( value )
+    return MS_MAX( atoi(value), 1 );
+#endif
+  return 1;
+}
+
 #endif /* def USE_PROJ */
 
 #ifdef USE_GDAL
@@ -1300,6 +1770,7 @@ int msResampleGDALToMap( mapObj *map, layerObj *layer, imageObj *image,
   imageObj   *srcImage;
   void  *pTCBData;
   void  *pACBData;
+  SimpleTransformer pfnTransform;
   int         anCMap[256];
   char       **papszAlteredProcessing = NULL;
   int         nLoadImgXSize, nLoadImgYSize;
@@ -1679,6 +2150,22 @@ int msResampleGDALToMap( mapObj *map, layerObj *layer, imageObj *image,
   /*      error is modest (less than 0.333 pixels).                       */
   /* -------------------------------------------------------------------- */
   pACBData = msInitApproxTransformer( msProjTransformer, pTCBData, 0.333 );
+  pfnTransform = msApproxTransformer;
+
+  /* -------------------------------------------------------------------- */
+  /*      Or, with RESAMPLE_TRANSFORM=GRID, interpolate every pixel from  */
+  /*      a grid of control points transformed once for the request.      */
+  /* -------------------------------------------------------------------- */
+  {
+    const char *transformMode = CSLFetchNameValue( layer->processing,
+                                "RESAMPLE_TRANSFORM" );
+    if( transformMode != NULL && EQUAL(transformMode,"GRID") ) {
+      msFreeApproxTransformer( pACBData );
+      pACBData = msInitGridTransformer( msProjTransformer, pTCBData,
+                                        nDstXSize, nDstYSize, 0.333 );
+      pfnTransform = msGridTransformer;
+    }
+  }
 
   if( pj_is_latlong(layer->projection.proj) )
   {
@@ -1688,23 +2175,64 @@ int msResampleGDALToMap( mapObj *map, layerObj *layer, imageObj *image,
   }
 
   /* -------------------------------------------------------------------- */
-  /*      Perform the resampling.                                         */
+  /*      Perform the resampling, in bands of rows spread over up to      */
+  /*      MS_RESAMPLE_THREADS threads.                                    */
   /* -------------------------------------------------------------------- */
-  if( EQUAL(resampleMode,"AVERAGE") )
-    result =
-      msAverageRasterResampler( srcImage, psrc_rb, image, rb,
-                                anCMap, msApproxTransformer, pACBData,
-                                layer->debug, mask_rb );
-  else if( EQUAL(resampleMode,"BILINEAR") )
-    result =
-      msBilinearRasterResampler( srcImage, psrc_rb, image, rb,
-                                 anCMap, msApproxTransformer, pACBData,
-                                 layer->debug, mask_rb, bWrapAtLeftRight );
-  else
-    result =
-      msNearestRasterResampler( srcImage, psrc_rb, image, rb,
-                                anCMap, msApproxTransformer, pACBData,
-                                layer->debug, mask_rb, bWrapAtLeftRight );
+  {
+    msResampleJobObj sJob;
+    int nThreads = msGetResampleThreads( map );
+    int nJobs, iJob;
+
+    /* band boundaries must not share a word of the RAWDATA validity mask */
+    if( MS_RENDERER_RAWDATA(image->format) && image->format->bands > 1
+        && (nDstXSize * nDstYSize) % 32 != 0 )
+      nThreads = 1;
+
+    memset( &sJob, 0, sizeof(sJob) );
+    sJob.psSrcImage = srcImage;
+    sJob.src_rb = psrc_rb;
+    sJob.psDstImage = image;
+    sJob.dst_rb = rb;
+    sJob.panCMap = anCMap;
+    sJob.pfnTransform = pfnTransform;
+    sJob.pCBData = pACBData;
+    sJob.debug = layer->debug;
+    sJob.mask_rb = mask_rb;
+    sJob.bWrapAtLeftRight = bWrapAtLeftRight;
+    sJob.resampleMode = resampleMode;
+    sJob.psSrcProj = &(layer->projection);
+    sJob.padfSrcGeoTransform = adfSrcGeoTransform;
+    sJob.psDstProj = &(map->projection);
+    sJob.padfDstGeoTransform = adfDstGeoTransform;
+
+    if( nThreads > 1 ) {
+      /* a few bands per thread to even out the load, 32 rows aligned */
+      sJob.nRowsPerJob = (nDstYSize + nThreads * 4 - 1) / (nThreads * 4);
+      sJob.nRowsPerJob = (sJob.nRowsPerJob + 31) / 32 * 32;
+      sJob.bPrivateTransformer = (pfnTransform == msApproxTransformer);
+    } else
+      sJob.nRowsPerJob = MS_MAX(nDstYSize, 1);
+
+    nJobs = (nDstYSize + sJob.nRowsPerJob - 1) / sJob.nRowsPerJob;
+    sJob.panJobStatus = (int *) msSmallCalloc( MS_MAX(nJobs, 1), sizeof(int) );
+    for( iJob = 0; iJob < nJobs; iJob++ )
+      sJob.panJobStatus[iJob] = MS_SUCCESS;
+
+    msThreadRunJobs( nThreads, nJobs, msResampleRowsJob, &sJob );
+
+    result = 0;
+    for( iJob = 0; iJob < nJobs; iJob++ ) {
+      if( sJob.panJobStatus[iJob] != MS_SUCCESS ) {
+        msSetError( MS_PROJERR,
+                    "Failed to set up the transformer of a resampling band.",
+                    "msResampleGDALToMap()" );
+        result = -1;
+        break;
+      }
+    }
+    msFree( sJob.panJobStatus );
+  }
+  msFree( mask_rb );
 
   /* -------------------------------------------------------------------- */
   /*      cleanup                                                         */
@@ -1713,8 +2241,11 @@ int msResampleGDALToMap( mapObj *map, layerObj *layer, imageObj *image,
     msFreeRasterBuffer(psrc_rb);
   msFreeImage( srcImage );
 
+  if( pfnTransform == msGridTransformer )
+    msFreeGridTransformer( pACBData );
+  else
+    msFreeApproxTransformer( pACBData );
   msFreeProjTransformer( pTCBData );
-  msFreeApproxTransformer( pACBData );
 
   return result;
 #endif
@@ -236,6 +236,10 @@ int main(int argc, char *argv[])
 #ifdef USE_FASTCGI
   msIO_installFastCGIRedirect();
 
+  /* Keep parsed mapfiles between requests, see msLoadMapFromCache() */
+  if(getenv("MS_MAPFILE_CACHE_SIZE"))
+    msMapFileCacheSetSize(atoi(getenv("MS_MAPFILE_CACHE_SIZE")));
+
   /* In FastCGI case we loop accepting multiple requests.  In normal CGI */
   /* use we only accept and process one request.  */
   while( FCGI_Accept() >= 0 ) {
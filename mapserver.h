@@ -235,6 +235,7 @@ extern "C" {
 #define MS_TEMPLATE_EXPR "\\.(xml|wml|html|htm|svg|kml|gml|js|tmpl)$"
 
 #define MS_INDEX_EXTENSION ".qix"
+#define MS_PACKED_INDEX_EXTENSION ".pqx"
 
 #define MS_QUERY_RESULTS_MAGIC_STRING "MapServer Query Results"
 #define MS_QUERY_PARAMS_MAGIC_STRING "MapServer Query Params"
@@ -740,6 +741,8 @@ extern "C" {
 
   typedef tokenListNodeObj * tokenListNodeObjPtr;
 
+  typedef struct exprProgramObj exprProgramObj; /* opaque, see mapexprcompile.c */
+
   typedef struct {
     char *string;
     int type;
@@ -750,6 +753,8 @@ extern "C" {
     /* logical expression options */
     tokenListNodeObjPtr tokens;
     tokenListNodeObjPtr curtoken;
+    exprProgramObj *program; /* compiled form of the tokens, NULL if not (yet) compiled */
+    int program_failed; /* tokens can't be compiled, always use yyparse() */
 
     /* regular expression options */
     ms_regex_t regex; /* compiled regular expression to be matched */
@@ -874,6 +879,11 @@ extern "C" {
     int  maxfeatures; /* global maxfeatures */    
     int  startindex;
     int  only_cache_result_count; /* set to 1 sometimes by WFS 2.0 GetFeature request */
+
+    /* when set, msQueryByRect() hands each matching shape to this function */
+    /* instead of storing it in the result cache, which then only holds a count */
+    int (*result_callback)(mapObj *map, layerObj *layer, shapeObj *shape, void *callback_data);
+    void *result_callback_data;
     
     expressionObj filter; /* by filter */
     char *filteritem;
@@ -1282,6 +1292,8 @@ extern "C" {
   /************************************************************************/
   /*                            labelCacheObj                             */
   /************************************************************************/
+  typedef struct labelCacheGridObj labelCacheGridObj;
+
   typedef struct {
     /* One labelCacheSlotObj for each priority level */
     labelCacheSlotObj slots[MS_MAX_LABEL_PRIORITY];
@@ -1289,6 +1301,9 @@ extern "C" {
     labelCacheMemberObj **rendered_text_symbols;
     int num_allocated_rendered_members;
     int num_rendered_members;
+#ifndef SWIG
+    labelCacheGridObj *grid; /* spatial index of rendered labels and markers, built on demand */
+#endif
   } labelCacheObj;
 
   /************************************************************************/
@@ -1767,12 +1782,23 @@ extern "C" {
 #endif
     
     LayerCompositer *compositer;
+
+#ifndef SWIG
+    shapePoolObj *shapepool; /* recycled shape buffers, only while the layer is open */
+#endif
   };
 
 
 #ifndef SWIG
 void msFontCacheSetup();
 void msFontCacheCleanup();
+void msFontCacheThreadStart(void *owner);
+void msFontCacheThreadEnd(void *owner);
+MS_DLL_EXPORT void msGlyphCacheSetSize(size_t size);
+MS_DLL_EXPORT size_t msGlyphCacheGetSize(void);
+MS_DLL_EXPORT void msGlyphCacheGetStats(long *hits, long *misses, size_t *used);
+MS_DLL_EXPORT void msTextLayoutCacheSetSize(size_t size);
+MS_DLL_EXPORT size_t msTextLayoutCacheGetSize(void);
 
 typedef struct {
   double minx,miny,maxx,maxy,advance;
@@ -2087,6 +2113,7 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   MS_DLL_EXPORT int msGetLayerIndex(mapObj *map, const char *name);
   MS_DLL_EXPORT int msGetSymbolIndex(symbolSetObj *set, char *name, int try_addimage_if_notfound);
   MS_DLL_EXPORT mapObj  *msLoadMap(char *filename, char *new_mappath);
+  MS_DLL_EXPORT mapObj  *msLoadMapWithIncludes(char *filename, char *new_mappath, hashTableObj *includes);
   MS_DLL_EXPORT int msTransformXmlMapfile(const char *stylesheet, const char *xmlMapfile, FILE *tmpfile);
   MS_DLL_EXPORT int msSaveMap(mapObj *map, char *filename);
   MS_DLL_EXPORT void msFreeCharArray(char **array, int num_items);
@@ -2121,6 +2148,7 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   MS_DLL_EXPORT char **msTokenizeMap(char *filename, int *numtokens);
   MS_DLL_EXPORT int msInitLabelCache(labelCacheObj *cache);
   MS_DLL_EXPORT int msFreeLabelCache(labelCacheObj *cache);
+  MS_DLL_EXPORT void msFreeLabelCacheGrid(labelCacheObj *cache);
   MS_DLL_EXPORT int msCheckConnection(layerObj * layer); /* connection pooling functions (mapfile.c) */
   MS_DLL_EXPORT void msCloseConnections(mapObj *map);
 
@@ -2128,6 +2156,7 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   MS_DLL_EXPORT void msOGRCleanup(void);
   MS_DLL_EXPORT void msGDALCleanup(void);
   MS_DLL_EXPORT void msGDALInitialize(void);
+  MS_DLL_EXPORT void msGDALReleaseDataset(void *hDS, int nCacheSize);
 
   MS_DLL_EXPORT imageObj *msDrawScalebar(mapObj *map); /* in mapscale.c */
   MS_DLL_EXPORT int msCalculateScale(rectObj extent, int units, int width, int height, double resolution, double *scaledenom);
@@ -2311,12 +2340,21 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
 
   MS_DLL_EXPORT int WARN_UNUSED msAddLabel(mapObj *map, imageObj *image, labelObj *label, int layerindex, int classindex, shapeObj *shape, pointObj *point, double featuresize, textSymbolObj *ts);
   MS_DLL_EXPORT int WARN_UNUSED msAddLabelGroup(mapObj *map, imageObj *image, layerObj *layer, int classindex, shapeObj *shape, pointObj *point, double featuresize);
+  MS_DLL_EXPORT int msMergeLabelCache(labelCacheObj *dst, labelCacheObj *src);
   MS_DLL_EXPORT void insertRenderedLabelMember(mapObj *map, labelCacheMemberObj *cachePtr);
   MS_DLL_EXPORT int msTestLabelCacheCollisions(mapObj *map, labelCacheMemberObj *cachePtr, label_bounds *lb, int current_priority, int current_label);
   MS_DLL_EXPORT int msTestLabelCacheLeaderCollision(mapObj *map, pointObj *lp1, pointObj *lp2);
   MS_DLL_EXPORT labelCacheMemberObj *msGetLabelCacheMember(labelCacheObj *labelcache, int i);
 
   MS_DLL_EXPORT void msFreeShape(shapeObj *shape); /* in mapprimitive.c */
+#ifndef SWIG
+  MS_DLL_EXPORT shapePoolObj *msCreateShapePool(void);
+  MS_DLL_EXPORT void msFreeShapePool(shapePoolObj *pool);
+  MS_DLL_EXPORT void *msShapePoolAlloc(shapePoolObj *pool, size_t size);
+  MS_DLL_EXPORT char *msShapePoolStrdup(shapePoolObj *pool, const char *string);
+  MS_DLL_EXPORT void msShapePoolRelease(shapePoolObj *pool, void *ptr, size_t size);
+  MS_DLL_EXPORT void msShapePoolFreeShape(shapePoolObj *pool, shapeObj *shape);
+#endif
   MS_DLL_EXPORT void msFreeLabelPathObj(labelPathObj *path);
   MS_DLL_EXPORT shapeObj *msShapeFromWKT(const char *string);
   MS_DLL_EXPORT char *msShapeToWKT(shapeObj *shape);
@@ -2628,6 +2666,9 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   MS_DLL_EXPORT int msValidateContexts(mapObj *map);
   MS_DLL_EXPORT int msEvalContext(mapObj *map, layerObj *layer, char *context);
   MS_DLL_EXPORT int msEvalExpression(layerObj *layer, shapeObj *shape, expressionObj *expression, int itemindex);
+  MS_DLL_EXPORT int msCompileExpression(expressionObj *expression);
+  MS_DLL_EXPORT int msEvalCompiledExpression(expressionObj *expression, shapeObj *shape, int *result);
+  MS_DLL_EXPORT void msFreeExpressionProgram(exprProgramObj *program);
   MS_DLL_EXPORT int msShapeGetClass(layerObj *layer, mapObj *map, shapeObj *shape, int *classgroup, int numclasses);
   MS_DLL_EXPORT int msShapeCheckSize(shapeObj *shape, double minfeaturesize);
   MS_DLL_EXPORT char* msShapeGetLabelAnnotation(layerObj *layer, shapeObj *shape, labelObj *lbl);
@@ -2791,6 +2832,23 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   /*      end prototypes for functions in mapcopy                         */
   /* ==================================================================== */
 
+  /* ==================================================================== */
+  /*      mapfilecache.c: cache of parsed mapfiles.                       */
+  /* ==================================================================== */
+  MS_DLL_EXPORT mapObj *msLoadMapFromCache(char *filename, char *new_mappath);
+  MS_DLL_EXPORT void msMapFileCacheSetSize(int size);
+  MS_DLL_EXPORT int msMapFileCacheGetSize(void);
+  MS_DLL_EXPORT void msMapFileCacheCleanup(void);
+
+  /* ==================================================================== */
+  /*      mapmarkercache.c: cache of rasterized marker symbols.           */
+  /* ==================================================================== */
+  MS_DLL_EXPORT void msMarkerCacheSetSize(size_t size);
+  MS_DLL_EXPORT size_t msMarkerCacheGetSize(void);
+  MS_DLL_EXPORT void msMarkerCacheGetStats(long *hits, long *misses, size_t *used);
+  MS_DLL_EXPORT void msMarkerCacheCleanup(void);
+  void msMarkerCacheSetup(void);
+
   /* ==================================================================== */
   /*      mappool.c: connection pooling API.                              */
   /* ==================================================================== */
@@ -3043,6 +3101,8 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   int msQuantizeRasterBuffer(rasterBufferObj *rb, unsigned int *reqcolors, rgbaPixel *palette,
                              rgbaPixel *forced_palette, int num_forced_palette_entries,
                              unsigned int *palette_scaling_maxval);
+  int msQuantizeRasterBufferOctree(rasterBufferObj *rb, unsigned int *reqcolors, rgbaPixel *palette,
+                                   rgbaPixel *forced_palette, int num_forced_palette_entries);
   int msClassifyRasterBuffer(rasterBufferObj *rb, rasterBufferObj *qrb);
   int msSaveRasterBuffer(mapObj *map, rasterBufferObj *data, FILE *stream, outputFormatObj *format);
   int msSaveRasterBufferToBuffer(rasterBufferObj *data, bufferObj *buffer, outputFormatObj *format);
@@ -3123,6 +3183,8 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
     int (*cleanup)(void *renderer_data);
   } ;
   MS_DLL_EXPORT int msRenderRasterizedSVGSymbol(imageObj* img, double x, double y, symbolObj* symbol, symbolStyleObj* style);
+  int WARN_UNUSED msRenderMarkerSymbol(mapObj *map, imageObj *image, symbolObj *symbol, symbolStyleObj *s, double x, double y);
+  int WARN_UNUSED msMarkerCacheDrawSymbol(mapObj *map, imageObj *image, symbolObj *symbol, symbolStyleObj *s, double x, double y);
 
 #define MS_IMAGE_RENDERER(im) ((im)->format->vtable)
 #define MS_RENDERER_CACHE(renderer) ((renderer)->renderer_data)
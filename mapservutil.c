@@ -205,14 +205,14 @@ mapObj *msCGILoadMap(mapservObj *mapserv)
   if(i == mapserv->request->NumParams) {
     char *ms_mapfile = getenv("MS_MAPFILE");
     if(ms_mapfile) {
-      map = msLoadMap(ms_mapfile,NULL);
+      map = msLoadMapFromCache(ms_mapfile,NULL);
     } else {
       msSetError(MS_WEBERR, "CGI variable \"map\" is not set.", "msCGILoadMap()"); /* no default, outta here */
       return NULL;
     }
   } else {
     if(getenv(mapserv->request->ParamValues[i])) /* an environment variable references the actual file to use */
-      map = msLoadMap(getenv(mapserv->request->ParamValues[i]), NULL);
+      map = msLoadMapFromCache(getenv(mapserv->request->ParamValues[i]), NULL);
     else {
       /* by here we know the request isn't for something in an environment variable */
       if(getenv("MS_MAP_NO_PATH")) {
@@ -226,7 +226,7 @@ mapObj *msCGILoadMap(mapservObj *mapserv)
       }
 
       /* ok to try to load now */
-      map = msLoadMap(mapserv->request->ParamValues[i], NULL);
+      map = msLoadMapFromCache(mapserv->request->ParamValues[i], NULL);
     }
   }
   
@@ -1495,8 +1495,9 @@ int msCGIDispatchQueryRequest(mapservObj *mapserv)
 
 int msCGIDispatchImageRequest(mapservObj *mapserv)
 {
-  int status;
+  int status, cachedsize = 0;
   imageObj *img = NULL;
+  unsigned char *cached = NULL;
   switch(mapserv->Mode) {
     case MAP:
       if(mapserv->QueryFile) {
@@ -1515,7 +1516,10 @@ int msCGIDispatchImageRequest(mapservObj *mapserv)
       break;
     case TILE:
       msTileSetExtent(mapserv);
-      img = msTileDraw(mapserv);
+      /* a neighbouring tile may have rendered this one as part of its metatile */
+      cached = msTileGetCached(mapserv, &cachedsize);
+      if(!cached)
+        img = msTileDraw(mapserv);
       break;
     case LEGEND:
     case MAPLEGEND:
@@ -1526,7 +1530,7 @@ int msCGIDispatchImageRequest(mapservObj *mapserv)
       break;
   }
 
-  if(!img) return MS_FAILURE;
+  if(!img && !cached) return MS_FAILURE;
 
   /*
    ** Set the Cache control headers if the option is set.
@@ -1548,7 +1552,15 @@ int msCGIDispatchImageRequest(mapservObj *mapserv)
     msIO_sendHeaders();
   }
 
-  if( mapserv->Mode == MAP || mapserv->Mode == TILE )
+  if( cached ) {
+    status = (msIO_fwrite(cached, 1, cachedsize, stdout) == (size_t) cachedsize) ? MS_SUCCESS : MS_FAILURE;
+    free(cached);
+    if(status != MS_SUCCESS) {
+      msSetError(MS_IOERR, "Failed to write cached tile.", "msCGIDispatchImageRequest()");
+      return MS_FAILURE;
+    }
+    return MS_SUCCESS;
+  } else if( mapserv->Mode == MAP || mapserv->Mode == TILE )
     status = msSaveImage(mapserv->map, img, NULL);
   else
     status = msSaveImage(NULL,img, NULL);
@@ -38,12 +38,19 @@
 #include <assert.h>
 #include "mapserver.h"
 #include "mapows.h"
+#include "mapthread.h"
 
 #if defined(USE_GDAL) || defined(USE_OGR)
 #include <cpl_conv.h>
 #include <ogr_srs_api.h>
 #endif
 
+#ifdef HAVE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
 /* Only use this macro on 32-bit integers! */
 #define SWAP_FOUR_BYTES(data) \
   ( ((data >> 24) & 0x000000FF) | ((data >>  8) & 0x0000FF00) | \
@@ -82,6 +89,149 @@ static void * SfRealloc( void * pMem, int nNewSize )
   return realloc(pMem, nNewSize);
 }
 
+/************************************************************************/
+/*                            msSHPMapFile()                            */
+/*                                                                      */
+/*      Read-only mappings of shapefile components. A file is mapped    */
+/*      once per process and shared by all the handles opened on it.    */
+/*      Up to SHP_MAP_MAX_UNUSED mappings are kept after their last     */
+/*      handle is closed (least recently used ones are unmapped first)  */
+/*      so that the next request does not have to map the file again.   */
+/*      A mapping is dropped when the file is found to have changed.    */
+/*                                                                      */
+/*      Mapped files must not be rewritten in place: reading a part     */
+/*      that was truncated away raises SIGBUS. Update data by writing   */
+/*      new files and renaming them over the old ones, which leaves     */
+/*      the mapped (old) inode intact.                                  */
+/************************************************************************/
+#ifdef HAVE_MMAP
+#define SHP_MAP_MAX_UNUSED 64
+
+typedef struct shpMapObj {
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  time_t mtime;
+  uchar *pabyMap;
+  int refcount;
+  struct shpMapObj *next;
+} shpMapObj;
+
+static shpMapObj *shpMaps = NULL; /* most recently used first */
+
+/* Unmaps the least recently used unused mappings beyond SHP_MAP_MAX_UNUSED. */
+static void msSHPTrimMaps( void )
+{
+  shpMapObj *psMap, **ppsMap = &shpMaps;
+  int nUnused = 0;
+
+  while( (psMap = *ppsMap) != NULL ) {
+    if( psMap->refcount == 0 && ++nUnused > SHP_MAP_MAX_UNUSED ) {
+      munmap( psMap->pabyMap, (size_t) psMap->size );
+      *ppsMap = psMap->next;
+      free( psMap );
+      continue;
+    }
+    ppsMap = &(psMap->next);
+  }
+}
+#endif
+
+uchar *msSHPMapFile( FILE *fp, size_t *pnSize )
+{
+#ifdef HAVE_MMAP
+  struct stat sStat;
+  shpMapObj *psMap, **ppsMap;
+  uchar *pabyMap = NULL;
+
+  if( fstat( fileno(fp), &sStat ) != 0 || sStat.st_size <= 0 )
+    return NULL;
+
+  msAcquireLock( TLOCK_SHPMAP );
+
+  ppsMap = &shpMaps;
+  while( (psMap = *ppsMap) != NULL ) {
+    if( psMap->dev == sStat.st_dev && psMap->ino == sStat.st_ino ) {
+      if( psMap->size == sStat.st_size && psMap->mtime == sStat.st_mtime ) {
+        psMap->refcount++;
+        pabyMap = psMap->pabyMap;
+        *pnSize = (size_t) psMap->size;
+        /* move it in front */
+        *ppsMap = psMap->next;
+        psMap->next = shpMaps;
+        shpMaps = psMap;
+        break;
+      }
+      if( psMap->refcount == 0 ) { /* stale and unused */
+        munmap( psMap->pabyMap, (size_t) psMap->size );
+        *ppsMap = psMap->next;
+        free( psMap );
+        continue;
+      }
+    }
+    ppsMap = &(psMap->next);
+  }
+
+  if( pabyMap == NULL ) {
+    void *pMap = mmap( NULL, (size_t) sStat.st_size, PROT_READ, MAP_SHARED, fileno(fp), 0 );
+    if( pMap != MAP_FAILED ) {
+      psMap = (shpMapObj *) msSmallMalloc( sizeof(shpMapObj) );
+      psMap->dev = sStat.st_dev;
+      psMap->ino = sStat.st_ino;
+      psMap->size = sStat.st_size;
+      psMap->mtime = sStat.st_mtime;
+      psMap->pabyMap = (uchar *) pMap;
+      psMap->refcount = 1;
+      psMap->next = shpMaps;
+      shpMaps = psMap;
+      pabyMap = psMap->pabyMap;
+      *pnSize = (size_t) psMap->size;
+    }
+  }
+
+  msReleaseLock( TLOCK_SHPMAP );
+
+  return pabyMap;
+#else
+  return NULL;
+#endif
+}
+
+void msSHPUnmapFile( uchar *pabyMap )
+{
+#ifdef HAVE_MMAP
+  shpMapObj *psMap;
+
+  if( pabyMap == NULL )
+    return;
+
+  msAcquireLock( TLOCK_SHPMAP );
+  for( psMap = shpMaps; psMap != NULL; psMap = psMap->next ) {
+    if( psMap->pabyMap == pabyMap ) {
+      if( --psMap->refcount == 0 )
+        msSHPTrimMaps();
+      break;
+    }
+  }
+  msReleaseLock( TLOCK_SHPMAP );
+#endif
+}
+
+void msSHPMapCleanup( void )
+{
+#ifdef HAVE_MMAP
+  shpMapObj *psMap;
+
+  msAcquireLock( TLOCK_SHPMAP );
+  while( (psMap = shpMaps) != NULL ) {
+    shpMaps = psMap->next;
+    munmap( psMap->pabyMap, (size_t) psMap->size );
+    free( psMap );
+  }
+  msReleaseLock( TLOCK_SHPMAP );
+#endif
+}
+
 /************************************************************************/
 /*                          writeHeader()                               */
 /*                                                                      */
@@ -191,7 +341,25 @@ static void writeHeader( SHPHandle psSHP )
 /*      Open the .shp and .shx files based on the basename of the       */
 /*      files or either file name.                                      */
 /************************************************************************/
+static SHPHandle msSHPOpenInternal( const char * pszLayer, const char * pszAccess, int bMapped );
+
 SHPHandle msSHPOpen( const char * pszLayer, const char * pszAccess )
+{
+  return msSHPOpenInternal( pszLayer, pszAccess, MS_FALSE );
+}
+
+/************************************************************************/
+/*                           msSHPOpenMapped()                          */
+/*                                                                      */
+/*      Open the .shp and .shx files read-only, records are decoded     */
+/*      straight from a memory mapping of the files when possible.      */
+/************************************************************************/
+SHPHandle msSHPOpenMapped( const char * pszLayer )
+{
+  return msSHPOpenInternal( pszLayer, "rb", MS_TRUE );
+}
+
+static SHPHandle msSHPOpenInternal( const char * pszLayer, const char * pszAccess, int bMapped )
 {
   char *pszFullname, *pszBasename;
   SHPHandle psSHP;
@@ -230,6 +398,10 @@ SHPHandle msSHPOpen( const char * pszLayer, const char * pszAccess )
   psSHP->panParts = NULL;
   psSHP->nBufSize = psSHP->nPartMax = 0;
 
+  psSHP->pabySHPMap = psSHP->pabySHXMap = NULL;
+  psSHP->nSHPMapSize = psSHP->nSHXMapSize = 0;
+  psSHP->pool = NULL;
+
   /* -------------------------------------------------------------------- */
   /*  Compute the base (layer) name.  If there is any extension     */
   /*  on the passed in filename we will strip it off.         */
@@ -395,6 +567,14 @@ SHPHandle msSHPOpen( const char * pszLayer, const char * pszAccess )
     return( NULL );
   }
 
+  /* -------------------------------------------------------------------- */
+  /*  Map the files if requested, a file that can't be mapped is      */
+  /*  simply read through stdio.                                          */
+  /* -------------------------------------------------------------------- */
+  if( bMapped && strcmp(pszAccess,"rb") == 0 ) {
+    psSHP->pabySHPMap = msSHPMapFile( psSHP->fpSHP, &(psSHP->nSHPMapSize) );
+    psSHP->pabySHXMap = msSHPMapFile( psSHP->fpSHX, &(psSHP->nSHXMapSize) );
+  }
 
   return( psSHP );
 }
@@ -423,6 +603,9 @@ void msSHPClose(SHPHandle psSHP )
   free(psSHP->pabyRec);
   free(psSHP->panParts);
 
+  msSHPUnmapFile( psSHP->pabySHPMap );
+  msSHPUnmapFile( psSHP->pabySHXMap );
+
   fclose( psSHP->fpSHX );
   fclose( psSHP->fpSHP );
 
@@ -1043,12 +1226,46 @@ static int msSHPReadAllocateBuffer( SHPHandle psSHP, int hEntity, const char* ps
   return MS_SUCCESS;
 }
 
+/*
+** msSHPReadRecord() - Returns the raw record of a shape, pointing straight
+** into the .shp mapping if there is one or read into the record buffer.
+*/
+static uchar *msSHPReadRecord( SHPHandle psSHP, int hEntity, int nEntitySize, const char* pszCallingFunction)
+{
+  int nOffset = msSHXReadOffset( psSHP, hEntity );
+
+  if( psSHP->pabySHPMap ) {
+    if( nOffset < 0 || (size_t) nOffset + nEntitySize > psSHP->nSHPMapSize ) {
+      msSetError(MS_SHPERR, "Corrupted feature encountered.  hEntity=%d, nEntitySize=%d", pszCallingFunction,
+                 hEntity, nEntitySize);
+      return NULL;
+    }
+    return psSHP->pabySHPMap + nOffset;
+  }
+
+  if (msSHPReadAllocateBuffer(psSHP, hEntity, pszCallingFunction) == MS_FAILURE) {
+    return NULL;
+  }
+
+  if( 0 != fseek( psSHP->fpSHP, nOffset, 0 )) {
+    msSetError(MS_IOERR, "failed to seek offset", pszCallingFunction);
+    return NULL;
+  }
+  if( 1 != fread( psSHP->pabyRec, nEntitySize, 1, psSHP->fpSHP )) {
+    msSetError(MS_IOERR, "failed to fread record", pszCallingFunction);
+    return NULL;
+  }
+
+  return psSHP->pabyRec;
+}
+
 /*
 ** msSHPReadPoint() - Reads a single point from a POINT shape file.
 */
 int msSHPReadPoint( SHPHandle psSHP, int hEntity, pointObj *point )
 {
   int nEntitySize;
+  uchar *pabyRec;
 
   /* -------------------------------------------------------------------- */
   /*      Only valid for point shapefiles                                 */
@@ -1077,25 +1294,15 @@ int msSHPReadPoint( SHPHandle psSHP, int hEntity, pointObj *point )
     return(MS_FAILURE);
   }
 
-  if (msSHPReadAllocateBuffer(psSHP, hEntity, "msSHPReadPoint()") == MS_FAILURE) {
-    return MS_FAILURE;
-  }
-
   /* -------------------------------------------------------------------- */
   /*      Read the record.                                                */
   /* -------------------------------------------------------------------- */
-  if( 0 != fseek( psSHP->fpSHP, msSHXReadOffset( psSHP, hEntity), 0 )) {
-    msSetError(MS_IOERR, "failed to seek offset", "msSHPReadPoint()");
-    return(MS_FAILURE);
-  }
-  if( 1 != fread( psSHP->pabyRec, nEntitySize, 1, psSHP->fpSHP )) {
-    msSetError(MS_IOERR, "failed to fread record", "msSHPReadPoint()");
+  if( (pabyRec = msSHPReadRecord( psSHP, hEntity, nEntitySize, "msSHPReadPoint()" )) == NULL ) {
     return(MS_FAILURE);
   }
 
-
-  memcpy( &(point->x), psSHP->pabyRec + 12, 8 );
-  memcpy( &(point->y), psSHP->pabyRec + 20, 8 );
+  memcpy( &(point->x), pabyRec + 12, 8 );
+  memcpy( &(point->y), pabyRec + 20, 8 );
 
   if( bBigEndian ) {
     SwapWord( 8, &(point->x));
@@ -1212,6 +1419,16 @@ int msSHXReadOffset( SHPHandle psSHP, int hEntity )
   if( hEntity < 0 || hEntity >= psSHP->nRecords )
     return(MS_FAILURE);
 
+  if( psSHP->pabySHXMap ) {
+    ms_int32 nValue;
+
+    if( 100 + 8 * (size_t) hEntity + 8 > psSHP->nSHXMapSize )
+      return 0;
+    memcpy( &nValue, psSHP->pabySHXMap + 100 + 8 * (size_t) hEntity + 0, 4 );
+    if( !bBigEndian ) nValue = SWAP_FOUR_BYTES( nValue );
+    return nValue * 2;
+  }
+
   if( ! (psSHP->panRecAllLoaded || msGetBit(psSHP->panRecLoaded, shxBufferPage)) ) {
     msSHXLoadPage( psSHP, shxBufferPage );
   }
@@ -1229,6 +1446,16 @@ int msSHXReadSize( SHPHandle psSHP, int hEntity )
   if( hEntity < 0 || hEntity >= psSHP->nRecords )
     return(MS_FAILURE);
 
+  if( psSHP->pabySHXMap ) {
+    ms_int32 nValue;
+
+    if( 100 + 8 * (size_t) hEntity + 8 > psSHP->nSHXMapSize )
+      return 0;
+    memcpy( &nValue, psSHP->pabySHXMap + 100 + 8 * (size_t) hEntity + 4, 4 );
+    if( !bBigEndian ) nValue = SWAP_FOUR_BYTES( nValue );
+    return nValue * 2;
+  }
+
   if( ! (psSHP->panRecAllLoaded || msGetBit(psSHP->panRecLoaded, shxBufferPage)) ) {
     msSHXLoadPage( psSHP, shxBufferPage );
   }
@@ -1247,6 +1474,7 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
   int nOffset = 0;
 #endif
   int nEntitySize, nRequiredSize;
+  uchar *pabyRec;
 
   msInitShape(shape); /* initialize the shape */
 
@@ -1262,21 +1490,11 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
   }
 
   nEntitySize = msSHXReadSize(psSHP, hEntity) + 8;
-  if (msSHPReadAllocateBuffer(psSHP, hEntity, "msSHPReadShape()") == MS_FAILURE) {
-    shape->type = MS_SHAPE_NULL;
-    return;
-  }
 
   /* -------------------------------------------------------------------- */
   /*      Read the record.                                                */
   /* -------------------------------------------------------------------- */
-  if( 0 != fseek( psSHP->fpSHP, msSHXReadOffset( psSHP, hEntity), 0 )) {
-    msSetError(MS_IOERR, "failed to seek offset", "msSHPReadShape()");
-    shape->type = MS_SHAPE_NULL;
-    return;
-  }
-  if( 1 != fread( psSHP->pabyRec, nEntitySize, 1, psSHP->fpSHP )) {
-    msSetError(MS_IOERR, "failed to fread record", "msSHPReadPoint()");
+  if( (pabyRec = msSHPReadRecord( psSHP, hEntity, nEntitySize, "msSHPReadShape()" )) == NULL ) {
     shape->type = MS_SHAPE_NULL;
     return;
   }
@@ -1297,10 +1515,10 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
     }
 
     /* copy the bounding box */
-    memcpy( &shape->bounds.minx, psSHP->pabyRec + 8 + 4, 8 );
-    memcpy( &shape->bounds.miny, psSHP->pabyRec + 8 + 12, 8 );
-    memcpy( &shape->bounds.maxx, psSHP->pabyRec + 8 + 20, 8 );
-    memcpy( &shape->bounds.maxy, psSHP->pabyRec + 8 + 28, 8 );
+    memcpy( &shape->bounds.minx, pabyRec + 8 + 4, 8 );
+    memcpy( &shape->bounds.miny, pabyRec + 8 + 12, 8 );
+    memcpy( &shape->bounds.maxx, pabyRec + 8 + 20, 8 );
+    memcpy( &shape->bounds.maxy, pabyRec + 8 + 28, 8 );
 
     if( bBigEndian ) {
       SwapWord( 8, &shape->bounds.minx);
@@ -1309,8 +1527,8 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
       SwapWord( 8, &shape->bounds.maxy);
     }
 
-    memcpy( &nPoints, psSHP->pabyRec + 40 + 8, 4 );
-    memcpy( &nParts, psSHP->pabyRec + 36 + 8, 4 );
+    memcpy( &nPoints, pabyRec + 40 + 8, 4 );
+    memcpy( &nParts, pabyRec + 36 + 8, 4 );
 
     if( bBigEndian ) {
       nPoints = SWAP_FOUR_BYTES(nPoints);
@@ -1357,7 +1575,7 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
       return;
     }
 
-    memcpy( psSHP->panParts, psSHP->pabyRec + 44 + 8, 4 * nParts );
+    memcpy( psSHP->panParts, pabyRec + 44 + 8, 4 * nParts );
     if( bBigEndian ) {
       for( i = 0; i < nParts; i++ ) {
         *(psSHP->panParts+i) = SWAP_FOUR_BYTES(*(psSHP->panParts+i));
@@ -1367,7 +1585,7 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
     /* -------------------------------------------------------------------- */
     /*      Fill the shape structure.                                       */
     /* -------------------------------------------------------------------- */
-    shape->line = (lineObj *)malloc(sizeof(lineObj)*nParts);
+    shape->line = (lineObj *)msShapePoolAlloc(psSHP->pool, sizeof(lineObj)*nParts);
     MS_CHECK_ALLOC_NO_RET(shape->line, sizeof(lineObj)*nParts);
 
     shape->numlines = nParts;
@@ -1390,7 +1608,7 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
         return;
       }
 
-      if( (shape->line[i].point = (pointObj *)malloc(sizeof(pointObj)*shape->line[i].numpoints)) == NULL ) {
+      if( (shape->line[i].point = (pointObj *)msShapePoolAlloc(psSHP->pool, sizeof(pointObj)*shape->line[i].numpoints)) == NULL ) {
         while(--i >= 0)
           free(shape->line[i].point);
         free(shape->line);
@@ -1402,8 +1620,8 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
 
       /* nOffset = 44 + 8 + 4*nParts; */
       for( j = 0; j < shape->line[i].numpoints; j++ ) {
-        memcpy(&(shape->line[i].point[j].x), psSHP->pabyRec + 44 + 4*nParts + 8 + k * 16, 8 );
-        memcpy(&(shape->line[i].point[j].y), psSHP->pabyRec + 44 + 4*nParts + 8 + k * 16 + 8, 8 );
+        memcpy(&(shape->line[i].point[j].x), pabyRec + 44 + 4*nParts + 8 + k * 16, 8 );
+        memcpy(&(shape->line[i].point[j].y), pabyRec + 44 + 4*nParts + 8 + k * 16 + 8, 8 );
 
         if( bBigEndian ) {
           SwapWord( 8, &(shape->line[i].point[j].x) );
@@ -1418,7 +1636,7 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
         if (psSHP->nShapeType == SHP_POLYGONZ || psSHP->nShapeType == SHP_ARCZ) {
           nOffset = 44 + 8 + (4*nParts) + (16*nPoints) ;
           if( nEntitySize >= nOffset + 16 + 8*nPoints ) {
-            memcpy(&(shape->line[i].point[j].z), psSHP->pabyRec + nOffset + 16 + k*8, 8 );
+            memcpy(&(shape->line[i].point[j].z), pabyRec + nOffset + 16 + k*8, 8 );
             if( bBigEndian ) SwapWord( 8, &(shape->line[i].point[j].z) );
           }
         }
@@ -1430,7 +1648,7 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
         if (psSHP->nShapeType == SHP_POLYGONM || psSHP->nShapeType == SHP_ARCM) {
           nOffset = 44 + 8 + (4*nParts) + (16*nPoints) ;
           if( nEntitySize >= nOffset + 16 + 8*nPoints ) {
-            memcpy(&(shape->line[i].point[j].m), psSHP->pabyRec + nOffset + 16 + k*8, 8 );
+            memcpy(&(shape->line[i].point[j].m), pabyRec + nOffset + 16 + k*8, 8 );
             if( bBigEndian ) SwapWord( 8, &(shape->line[i].point[j].m) );
           }
         }
@@ -1463,10 +1681,10 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
     }
 
     /* copy the bounding box */
-    memcpy( &shape->bounds.minx, psSHP->pabyRec + 8 + 4, 8 );
-    memcpy( &shape->bounds.miny, psSHP->pabyRec + 8 + 12, 8 );
-    memcpy( &shape->bounds.maxx, psSHP->pabyRec + 8 + 20, 8 );
-    memcpy( &shape->bounds.maxy, psSHP->pabyRec + 8 + 28, 8 );
+    memcpy( &shape->bounds.minx, pabyRec + 8 + 4, 8 );
+    memcpy( &shape->bounds.miny, pabyRec + 8 + 12, 8 );
+    memcpy( &shape->bounds.maxx, pabyRec + 8 + 20, 8 );
+    memcpy( &shape->bounds.maxy, pabyRec + 8 + 28, 8 );
 
     if( bBigEndian ) {
       SwapWord( 8, &shape->bounds.minx);
@@ -1475,13 +1693,13 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
       SwapWord( 8, &shape->bounds.maxy);
     }
 
-    memcpy( &nPoints, psSHP->pabyRec + 44, 4 );
+    memcpy( &nPoints, pabyRec + 44, 4 );
     if( bBigEndian ) nPoints = SWAP_FOUR_BYTES(nPoints);
 
     /* -------------------------------------------------------------------- */
     /*      Fill the shape structure.                                       */
     /* -------------------------------------------------------------------- */
-    if( (shape->line = (lineObj *)malloc(sizeof(lineObj))) == NULL ) {
+    if( (shape->line = (lineObj *)msShapePoolAlloc(psSHP->pool, sizeof(lineObj))) == NULL ) {
       shape->type = MS_SHAPE_NULL;
       msSetError(MS_MEMERR, "Out of memory", "msSHPReadShape()");
       return;
@@ -1508,7 +1726,7 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
 
     shape->numlines = 1;
     shape->line[0].numpoints = nPoints;
-    shape->line[0].point = (pointObj *) malloc( nPoints * sizeof(pointObj) );
+    shape->line[0].point = (pointObj *) msShapePoolAlloc(psSHP->pool, nPoints * sizeof(pointObj) );
     if (shape->line[0].point == NULL) {
       free(shape->line);
       shape->numlines = 0;
@@ -1518,8 +1736,8 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
     }
 
     for( i = 0; i < nPoints; i++ ) {
-      memcpy(&(shape->line[0].point[i].x), psSHP->pabyRec + 48 + 16 * i, 8 );
-      memcpy(&(shape->line[0].point[i].y), psSHP->pabyRec + 48 + 16 * i + 8, 8 );
+      memcpy(&(shape->line[0].point[i].x), pabyRec + 48 + 16 * i, 8 );
+      memcpy(&(shape->line[0].point[i].y), pabyRec + 48 + 16 * i + 8, 8 );
 
       if( bBigEndian ) {
         SwapWord( 8, &(shape->line[0].point[i].x) );
@@ -1533,7 +1751,7 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
       shape->line[0].point[i].z = 0; /* initialize */
       if (psSHP->nShapeType == SHP_MULTIPOINTZ) {
         nOffset = 48 + 16*nPoints;
-        memcpy(&(shape->line[0].point[i].z), psSHP->pabyRec + nOffset + 16 + i*8, 8 );
+        memcpy(&(shape->line[0].point[i].z), pabyRec + nOffset + 16 + i*8, 8 );
         if( bBigEndian ) SwapWord( 8, &(shape->line[0].point[i].z));
       }
 
@@ -1543,7 +1761,7 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
       shape->line[0].point[i].m = 0; /* initialize */
       if (psSHP->nShapeType == SHP_MULTIPOINTM) {
         nOffset = 48 + 16*nPoints;
-        memcpy(&(shape->line[0].point[i].m), psSHP->pabyRec + nOffset + 16 + i*8, 8 );
+        memcpy(&(shape->line[0].point[i].m), pabyRec + nOffset + 16 + i*8, 8 );
         if( bBigEndian ) SwapWord( 8, &(shape->line[0].point[i].m));
       }
 #endif /* USE_POINT_Z_M */
@@ -1568,15 +1786,22 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
     /* -------------------------------------------------------------------- */
     /*      Fill the shape structure.                                       */
     /* -------------------------------------------------------------------- */
-    shape->line = (lineObj *)malloc(sizeof(lineObj));
+    shape->line = (lineObj *)msShapePoolAlloc(psSHP->pool, sizeof(lineObj));
     MS_CHECK_ALLOC_NO_RET(shape->line, sizeof(lineObj));
 
+    shape->line[0].point = (pointObj *)msShapePoolAlloc(psSHP->pool, sizeof(pointObj));
+    if (shape->line[0].point == NULL) {
+      free(shape->line);
+      shape->line = NULL;
+      shape->type = MS_SHAPE_NULL;
+      msSetError(MS_MEMERR, "Out of memory", "msSHPReadShape()");
+      return;
+    }
     shape->numlines = 1;
     shape->line[0].numpoints = 1;
-    shape->line[0].point = (pointObj *) msSmallMalloc(sizeof(pointObj));
 
-    memcpy( &(shape->line[0].point[0].x), psSHP->pabyRec + 12, 8 );
-    memcpy( &(shape->line[0].point[0].y), psSHP->pabyRec + 20, 8 );
+    memcpy( &(shape->line[0].point[0].x), pabyRec + 12, 8 );
+    memcpy( &(shape->line[0].point[0].y), pabyRec + 20, 8 );
 
     if( bBigEndian ) {
       SwapWord( 8, &(shape->line[0].point[0].x));
@@ -1591,7 +1816,7 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
     if (psSHP->nShapeType == SHP_POINTZ) {
       nOffset = 20 + 8;
       if( nEntitySize >= nOffset + 8 ) {
-        memcpy(&(shape->line[0].point[0].z), psSHP->pabyRec + nOffset, 8 );
+        memcpy(&(shape->line[0].point[0].z), pabyRec + nOffset, 8 );
         if( bBigEndian ) SwapWord( 8, &(shape->line[0].point[0].z));
       }
     }
@@ -1603,7 +1828,7 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
     if (psSHP->nShapeType == SHP_POINTM) {
       nOffset = 20 + 8;
       if( nEntitySize >= nOffset + 8 ) {
-        memcpy(&(shape->line[0].point[0].m), psSHP->pabyRec + nOffset, 8 );
+        memcpy(&(shape->line[0].point[0].m), pabyRec + nOffset, 8 );
         if( bBigEndian ) SwapWord( 8, &(shape->line[0].point[0].m));
       }
     }
@@ -1621,6 +1846,32 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
   return;
 }
 
+/*
+** msSHPReadBytes() - Copies nSize bytes at nOffset of the .shp file into
+** pBuffer, from the mapping if there is one.
+*/
+static int msSHPReadBytes( SHPHandle psSHP, int nOffset, void *pBuffer, size_t nSize, const char *pszCallingFunction )
+{
+  if( psSHP->pabySHPMap ) {
+    if( nOffset < 0 || (size_t) nOffset + nSize > psSHP->nSHPMapSize ) {
+      msSetError(MS_IOERR, "failed to fread record", pszCallingFunction);
+      return(MS_FAILURE);
+    }
+    memcpy( pBuffer, psSHP->pabySHPMap + nOffset, nSize );
+    return(MS_SUCCESS);
+  }
+
+  if( 0 != fseek( psSHP->fpSHP, nOffset, 0 )) {
+    msSetError(MS_IOERR, "failed to seek offset", pszCallingFunction);
+    return(MS_FAILURE);
+  }
+  if( 1 != fread( pBuffer, nSize, 1, psSHP->fpSHP )) {
+    msSetError(MS_IOERR, "failed to fread record", pszCallingFunction);
+    return(MS_FAILURE);
+  }
+  return(MS_SUCCESS);
+}
+
 int msSHPReadBounds( SHPHandle psSHP, int hEntity, rectObj *padBounds)
 {
   /* -------------------------------------------------------------------- */
@@ -1647,14 +1898,8 @@ int msSHPReadBounds( SHPHandle psSHP, int hEntity, rectObj *padBounds)
     }
 
     if( psSHP->nShapeType != SHP_POINT && psSHP->nShapeType != SHP_POINTZ && psSHP->nShapeType != SHP_POINTM) {
-      if( 0 != fseek( psSHP->fpSHP, msSHXReadOffset( psSHP, hEntity) + 12, 0 )) {
-        msSetError(MS_IOERR, "failed to seek offset", "msSHPReadBounds()");
+      if( msSHPReadBytes( psSHP, msSHXReadOffset( psSHP, hEntity) + 12, padBounds, sizeof(double)*4, "msSHPReadBounds()" ) != MS_SUCCESS )
         return(MS_FAILURE);
-      }
-      if( 1 != fread( padBounds, sizeof(double)*4, 1, psSHP->fpSHP )) {
-        msSetError(MS_IOERR, "failed to fread record", "msSHPReadBounds()");
-        return(MS_FAILURE);
-      }
 
       if( bBigEndian ) {
         SwapWord( 8, &(padBounds->minx) );
@@ -1673,14 +1918,8 @@ int msSHPReadBounds( SHPHandle psSHP, int hEntity, rectObj *padBounds)
       /*      minimum and maximum bound.                                      */
       /* -------------------------------------------------------------------- */
 
-      if( 0 != fseek( psSHP->fpSHP, msSHXReadOffset( psSHP, hEntity) + 12, 0 )) {
-        msSetError(MS_IOERR, "failed to seek offset", "msSHPReadBounds()");
-        return(MS_FAILURE);
-      }
-      if( 1 != fread( padBounds, sizeof(double)*2, 1, psSHP->fpSHP )) {
-        msSetError(MS_IOERR, "failed to fread record", "msSHPReadBounds()");
+      if( msSHPReadBytes( psSHP, msSHXReadOffset( psSHP, hEntity) + 12, padBounds, sizeof(double)*2, "msSHPReadBounds()" ) != MS_SUCCESS )
         return(MS_FAILURE);
-      }
 
       if( bBigEndian ) {
         SwapWord( 8, &(padBounds->minx) );
@@ -1695,7 +1934,11 @@ int msSHPReadBounds( SHPHandle psSHP, int hEntity, rectObj *padBounds)
   return MS_SUCCESS;
 }
 
-int msShapefileOpen(shapefileObj *shpfile, const char *mode, const char *filename, int log_failures)
+/* bColumnCache values */
+#define SHP_COLUMN_CACHE_READ 1  /* use an up to date .dbf.col sidecar */
+#define SHP_COLUMN_CACHE_BUILD 2 /* and (re)build it when missing or stale */
+
+static int msShapefileOpenInternal(shapefileObj *shpfile, const char *mode, const char *filename, int log_failures, int bMapped, int bColumnCache)
 {
   int i;
   char *dbfFilename;
@@ -1711,9 +1954,13 @@ int msShapefileOpen(shapefileObj *shpfile, const char *mode, const char *filenam
   shpfile->status = NULL;
   shpfile->lastshape = -1;
   shpfile->isopen = MS_FALSE;
+  shpfile->packedindex = MS_FALSE;
+  shpfile->packedtree = NULL;
 
   /* open the shapefile file (appending ok) and get basic info */
-  if(!mode)
+  if(bMapped)
+    shpfile->hSHP = msSHPOpenMapped( filename );
+  else if(!mode)
     shpfile->hSHP = msSHPOpen( filename, "rb");
   else
     shpfile->hSHP = msSHPOpen( filename, mode);
@@ -1745,7 +1992,12 @@ int msShapefileOpen(shapefileObj *shpfile, const char *mode, const char *filenam
 
   strlcat(dbfFilename, ".dbf", bufferSize);
 
-  shpfile->hDBF = msDBFOpen(dbfFilename, "rb");
+  if(bColumnCache)
+    shpfile->hDBF = msDBFOpenCached(dbfFilename, bMapped, bColumnCache == SHP_COLUMN_CACHE_BUILD);
+  else if(bMapped)
+    shpfile->hDBF = msDBFOpenMapped(dbfFilename);
+  else
+    shpfile->hDBF = msDBFOpen(dbfFilename, "rb");
 
   if(!shpfile->hDBF) {
     if( log_failures )
@@ -1759,6 +2011,81 @@ int msShapefileOpen(shapefileObj *shpfile, const char *mode, const char *filenam
   return(0); /* all o.k. */
 }
 
+int msShapefileOpen(shapefileObj *shpfile, const char *mode, const char *filename, int log_failures)
+{
+  return msShapefileOpenInternal(shpfile, mode, filename, log_failures, MS_FALSE, MS_FALSE);
+}
+
+/*
+** Shapefile layers read their files through read-only memory mappings when
+** asked to with PROCESSING "SHAPEFILE_MMAP=ON" or the MS_SHAPEFILE_MMAP
+** config option. Their files must then be replaced, never rewritten in
+** place (see msSHPMapFile()).
+*/
+static int msSHPLayerUseMmap(layerObj *layer)
+{
+  const char *value = msLayerGetProcessingKey(layer, "SHAPEFILE_MMAP");
+
+  if(value)
+    return (strcasecmp(value, "ON") == 0 || strcasecmp(value, "YES") == 0 || strcasecmp(value, "TRUE") == 0);
+
+  return msTestConfigOption(layer->map, "MS_SHAPEFILE_MMAP", MS_FALSE);
+}
+
+/*
+** Attributes are read from the column cache sidecar of the .dbf, when there
+** is an up to date one (see the dbfcolumns utility), with PROCESSING
+** "DBF_COLUMN_CACHE=ON" or the MS_DBF_COLUMN_CACHE config option. With the
+** value BUILD a missing or stale sidecar is written while serving the
+** request, which needs a writable data directory.
+*/
+static int msSHPLayerUseColumnCache(layerObj *layer)
+{
+  const char *value = msLayerGetProcessingKey(layer, "DBF_COLUMN_CACHE");
+
+  if(!value)
+    value = msGetConfigOption(layer->map, "MS_DBF_COLUMN_CACHE");
+  if(!value)
+    return MS_FALSE;
+
+  if(strcasecmp(value, "BUILD") == 0)
+    return SHP_COLUMN_CACHE_BUILD;
+  if(strcasecmp(value, "ON") == 0 || strcasecmp(value, "YES") == 0 || strcasecmp(value, "TRUE") == 0)
+    return SHP_COLUMN_CACHE_READ;
+  return MS_FALSE;
+}
+
+/*
+** Shapefile layers look for a packed spatial index (.pqx, see shptree) before
+** the .qix with PROCESSING "SHAPEFILE_PACKED_INDEX=ON" or the
+** MS_SHAPEFILE_PACKED_INDEX config option.
+*/
+static int msSHPLayerUsePackedIndex(layerObj *layer)
+{
+  const char *value = msLayerGetProcessingKey(layer, "SHAPEFILE_PACKED_INDEX");
+
+  if(value)
+    return (strcasecmp(value, "ON") == 0 || strcasecmp(value, "YES") == 0 || strcasecmp(value, "TRUE") == 0);
+
+  return msTestConfigOption(layer->map, "MS_SHAPEFILE_PACKED_INDEX", MS_FALSE);
+}
+
+static int msShapefileOpenLayer(layerObj *layer, shapefileObj *shpfile, const char *filename, int log_failures)
+{
+  if(msShapefileOpenInternal(shpfile, "rb", filename, log_failures, msSHPLayerUseMmap(layer), msSHPLayerUseColumnCache(layer)) == -1)
+    return -1;
+
+  shpfile->packedindex = msSHPLayerUsePackedIndex(layer);
+
+  /* the shapes of the layer are read into recycled buffers, released by msDrawVectorLayer() */
+  if(!layer->shapepool)
+    layer->shapepool = msCreateShapePool();
+  shpfile->hSHP->pool = layer->shapepool;
+  if(shpfile->hDBF)
+    shpfile->hDBF->pool = layer->shapepool;
+  return 0;
+}
+
 /* Creates a new shapefile */
 int msShapefileCreate(shapefileObj *shpfile, char *filename, int type)
 {
@@ -1787,6 +2114,8 @@ int msShapefileCreate(shapefileObj *shpfile, char *filename, int type)
   shpfile->status = NULL;
   shpfile->lastshape = -1;
   shpfile->isopen = MS_TRUE;
+  shpfile->packedindex = MS_FALSE;
+  shpfile->packedtree = NULL;
 
   shpfile->hDBF = NULL; /* XBase file is NOT created here... */
   return(0);
@@ -1797,6 +2126,8 @@ void msShapefileClose(shapefileObj *shpfile)
   if (shpfile && shpfile->isopen == MS_TRUE) { /* Silently return if called with NULL shpfile by freeLayer() */
     if(shpfile->hSHP) msSHPClose(shpfile->hSHP);
     if(shpfile->hDBF) msDBFClose(shpfile->hDBF);
+    if(shpfile->packedtree) msSHPPackedTreeClose(shpfile->packedtree);
+    shpfile->packedtree = NULL;
     free(shpfile->status);
     shpfile->isopen = MS_FALSE;
   }
@@ -1845,7 +2176,17 @@ int msShapefileWhichShapes(shapefileObj *shpfile, rectObj rect, int debug)
 
     sprintf(filename, "%s%s", sourcename, MS_INDEX_EXTENSION);
 
-    shpfile->status = msSearchDiskTree(filename, rect, debug);
+    /* prefer the packed index when asked to, falling back to the .qix */
+    if(shpfile->packedindex && !shpfile->packedtree) {
+      /* loaded (or mapped) once, later searches only walk it */
+      shpfile->packedtree = msSHPPackedTreeOpen(filename, debug, shpfile->hSHP->pabySHPMap != NULL);
+      if(!shpfile->packedtree)
+        shpfile->packedindex = MS_FALSE; /* don't look again for this file */
+    }
+    if(shpfile->packedtree)
+      shpfile->status = msSearchPackedTree(shpfile->packedtree, rect);
+    if(!shpfile->status)
+      shpfile->status = msSearchDiskTree(filename, rect, debug);
     free(filename);
     free(sourcename);
 
@@ -1902,9 +2243,9 @@ int msTiledSHPTryOpen(shapefileObj *shpfile, layerObj *layer, char *tiFileAbsDir
   if( ignore_missing == MS_MISSING_DATA_IGNORE )
     log_failures = MS_FALSE;
 
-  if(msShapefileOpen(shpfile, "rb", msBuildPath3(szPath, layer->map->mappath, layer->map->shapepath, filename), log_failures) == -1) {
-    if(msShapefileOpen(shpfile, "rb", msBuildPath3(szPath, tiFileAbsDir, layer->map->shapepath, filename), log_failures) == -1) {
-      if(msShapefileOpen(shpfile, "rb", msBuildPath(szPath, layer->map->mappath, filename), log_failures) == -1) {
+  if(msShapefileOpenLayer(layer, shpfile, msBuildPath3(szPath, layer->map->mappath, layer->map->shapepath, filename), log_failures) == -1) {
+    if(msShapefileOpenLayer(layer, shpfile, msBuildPath3(szPath, tiFileAbsDir, layer->map->shapepath, filename), log_failures) == -1) {
+      if(msShapefileOpenLayer(layer, shpfile, msBuildPath(szPath, layer->map->mappath, filename), log_failures) == -1) {
         if(ignore_missing == MS_MISSING_DATA_FAIL) {
           msSetError(MS_IOERR, "Unable to open shapefile '%s' for layer '%s' ... fatal error.", "msTiledSHPTryOpen()", filename, layer->name);
           return(MS_FAILURE);
@@ -1926,6 +2267,236 @@ int msTiledSHPTryOpen(shapefileObj *shpfile, layerObj *layer, char *tiFileAbsDir
   return(MS_SUCCESS);
 }
 
+/*
+** Tiled shapefile layers keep their most recently used tiles open with
+** PROCESSING "TILE_HANDLE_CACHE=n" (or the MS_TILE_HANDLE_CACHE config
+** option), and open and search the next n tiles selected in the tileindex
+** on as many threads ahead of their use with PROCESSING "TILE_PREFETCH=n"
+** (or the MS_TILE_PREFETCH config option). Both default to 0, and are
+** capped at MS_TILE_HANDLE_CACHE_MAX and MS_TILE_PREFETCH_MAX: every tile
+** kept open holds up to three file descriptors.
+*/
+#define MS_TILE_HANDLE_CACHE_MAX 64
+#define MS_TILE_PREFETCH_MAX 16
+
+static int msTiledSHPGetOption(layerObj *layer, const char *key, const char *option, int max)
+{
+  const char *value = msLayerGetProcessingKey(layer, key);
+
+  if(!value)
+    value = msGetConfigOption(layer->map, option);
+  return value ? MS_MIN(MS_MAX(atoi(value), 0), max) : 0;
+}
+
+/* Returns the file name of a tile, in tilename or in a buffer of the tileindex dbf. */
+static char *msTiledSHPTileName(layerObj *layer, msTiledSHPLayerInfo *tSHP, int tile, char *tilename)
+{
+  if(!layer->data) /* assume whole filename is in attribute field */
+    return (char *) msDBFReadStringAttribute(tSHP->tileshpfile->hDBF, tile, layer->tileitemindex);
+  snprintf(tilename, MS_MAXPATHLEN, "%s/%s", msDBFReadStringAttribute(tSHP->tileshpfile->hDBF, tile, layer->tileitemindex), layer->data);
+  return tilename;
+}
+
+static int msTiledSHPFindTile(msTiledSHPLayerInfo *tSHP, int tile)
+{
+  int i;
+
+  for(i=0; i<tSHP->numtiles; i++)
+    if(tSHP->tiles[i].tileindex == tile) return i;
+  return -1;
+}
+
+/* Returns a free slot of the tile cache, closing the least recently used tile if needed. */
+static msTiledSHPTileObj *msTiledSHPGetFreeSlot(msTiledSHPLayerInfo *tSHP)
+{
+  int i;
+  msTiledSHPTileObj *slot = NULL;
+
+  for(i=0; i<tSHP->numtiles; i++) {
+    msTiledSHPTileObj *cur = tSHP->tiles + i;
+    if(cur->tileindex == -1) return cur;
+    /* tiles prefetched for the current search go last */
+    if(!slot || (slot->searched != -1 && cur->searched == -1) ||
+        ((slot->searched == -1) == (cur->searched == -1) && cur->lastused < slot->lastused))
+      slot = cur;
+  }
+  msShapefileClose(&slot->shpfile);
+  slot->tileindex = -1;
+  return slot;
+}
+
+/* Closes the tile open in tSHP->shpfile, keeping it in the tile cache if there is one. */
+static void msTiledSHPReleaseTile(msTiledSHPLayerInfo *tSHP)
+{
+  msTiledSHPTileObj *slot;
+
+  if(tSHP->handlecache == 0 || tSHP->shpfiletile < 0 || tSHP->shpfile->isopen != MS_TRUE) {
+    msShapefileClose(tSHP->shpfile);
+    tSHP->shpfiletile = -1;
+    return;
+  }
+
+  free(tSHP->shpfile->status);
+  tSHP->shpfile->status = NULL;
+  slot = msTiledSHPGetFreeSlot(tSHP);
+  slot->tileindex = tSHP->shpfiletile;
+  slot->searched = -1;
+  slot->lastused = ++tSHP->tileclock;
+  slot->shpfile = *(tSHP->shpfile);
+
+  tSHP->shpfile->isopen = MS_FALSE;
+  tSHP->shpfiletile = -1;
+}
+
+/*
+** Moves a tile from the tile cache to tSHP->shpfile, returns MS_FALSE if it
+** is not there or failed to open ahead of use (the slot is freed then).
+*/
+static int msTiledSHPTakeTile(msTiledSHPLayerInfo *tSHP, int tile, int *searched)
+{
+  int i = msTiledSHPFindTile(tSHP, tile);
+
+  if(i == -1) return MS_FALSE;
+  if(tSHP->tiles[i].shpfile.isopen != MS_TRUE) {
+    tSHP->tiles[i].tileindex = -1;
+    return MS_FALSE;
+  }
+  *(tSHP->shpfile) = tSHP->tiles[i].shpfile;
+  if(searched) *searched = tSHP->tiles[i].searched;
+  tSHP->tiles[i].tileindex = -1;
+  tSHP->shpfiletile = tile;
+  return MS_TRUE;
+}
+
+typedef struct {
+  layerObj *layer;
+  char *tiFileAbsDir;
+  rectObj rect;
+  char **filenames;
+  shapefileObj *shpfiles;
+  int *status;
+} msTiledSHPPrefetchObj;
+
+static void msTiledSHPPrefetchJob(void *pData, int iJob)
+{
+  msTiledSHPPrefetchObj *psPrefetch = (msTiledSHPPrefetchObj *) pData;
+  layerObj *layer = psPrefetch->layer;
+  shapefileObj *shpfile = psPrefetch->shpfiles + iJob;
+  char *filename = psPrefetch->filenames[iJob];
+  char szPath[MS_MAXPATHLEN];
+
+  /* missing tiles are left for msTiledSHPTryOpen() to report */
+  psPrefetch->status[iJob] = MS_FAILURE;
+  if(msShapefileOpenLayer(layer, shpfile, msBuildPath3(szPath, layer->map->mappath, layer->map->shapepath, filename), MS_FALSE) == -1)
+    if(msShapefileOpenLayer(layer, shpfile, msBuildPath3(szPath, psPrefetch->tiFileAbsDir, layer->map->shapepath, filename), MS_FALSE) == -1)
+      if(msShapefileOpenLayer(layer, shpfile, msBuildPath(szPath, layer->map->mappath, filename), MS_FALSE) == -1)
+        return;
+
+  psPrefetch->status[iJob] = msShapefileWhichShapes(shpfile, psPrefetch->rect, layer->debug);
+  if(psPrefetch->status[iJob] == MS_FAILURE)
+    msShapefileClose(shpfile);
+}
+
+/*
+** Opens and searches the tiles selected in the tileindex from record first
+** on, up to TILE_PREFETCH of them at once, and stores them in the tile
+** cache for msTiledSHPAcquireTile(). Tiles that fail to open or search are
+** stored closed, so that reaching them does not start another batch that
+** would evict the tiles prefetched along with them; the caller then opens
+** them itself and reports the error.
+*/
+static void msTiledSHPPrefetchTiles(layerObj *layer, msTiledSHPLayerInfo *tSHP, int first, char *tiFileAbsDir, rectObj rect)
+{
+  msTiledSHPPrefetchObj sPrefetch;
+  char tilename[MS_MAXPATHLEN];
+  int *tiles, i, n = 0;
+
+  tiles = (int *) msSmallMalloc(tSHP->prefetch * sizeof(int));
+  sPrefetch.filenames = (char **) msSmallMalloc(tSHP->prefetch * sizeof(char *));
+  for(i=first; i<tSHP->tileshpfile->numshapes && n<tSHP->prefetch; i++) {
+    char *filename;
+    if(!msGetBit(tSHP->tileshpfile->status, i) || msTiledSHPFindTile(tSHP, i) != -1) continue;
+    /* the tileindex dbf is not safe to read from several threads */
+    filename = msTiledSHPTileName(layer, tSHP, i, tilename);
+    if(strlen(filename) == 0) continue;
+    sPrefetch.filenames[n] = msStrdup(filename);
+    tiles[n++] = i;
+  }
+
+  if(n > 1) {
+    sPrefetch.layer = layer;
+    sPrefetch.tiFileAbsDir = tiFileAbsDir;
+    sPrefetch.rect = rect;
+    sPrefetch.shpfiles = (shapefileObj *) msSmallCalloc(n, sizeof(shapefileObj));
+    sPrefetch.status = (int *) msSmallMalloc(n * sizeof(int));
+    if(!layer->shapepool)
+      layer->shapepool = msCreateShapePool();
+
+    msThreadRunJobs(tSHP->prefetch, n, msTiledSHPPrefetchJob, &sPrefetch);
+
+    for(i=0; i<n; i++) {
+      msTiledSHPTileObj *slot = msTiledSHPGetFreeSlot(tSHP);
+      slot->tileindex = tiles[i];
+      slot->searched = sPrefetch.status[i];
+      slot->lastused = ++tSHP->tileclock;
+      slot->shpfile = sPrefetch.shpfiles[i];
+    }
+    free(sPrefetch.shpfiles);
+    free(sPrefetch.status);
+  }
+
+  for(i=0; i<n; i++)
+    free(sPrefetch.filenames[i]);
+  free(sPrefetch.filenames);
+  free(tiles);
+}
+
+/*
+** Opens record tile of the tileindex in tSHP->shpfile, from the tile cache
+** when it is there, and searches it for rect.
+**
+** Returns
+** MS_SUCCESS - the tile has shapes in rect
+** MS_DONE - the tile is missing (and the map ignores it) or has no shapes in rect
+** MS_FAILURE - error
+*/
+static int msTiledSHPAcquireTile(layerObj *layer, msTiledSHPLayerInfo *tSHP, int tile, char *tiFileAbsDir, char *filename, rectObj rect)
+{
+  int status, searched = -1;
+  char tilename[MS_MAXPATHLEN];
+
+  if(tSHP->prefetch > 0 && tSHP->tilelayerindex == -1 && msTiledSHPFindTile(tSHP, tile) == -1) {
+    /* filename may live in the tileindex dbf buffer, which the prefetch reads over */
+    strlcpy(tilename, filename, sizeof(tilename));
+    filename = tilename;
+    msTiledSHPPrefetchTiles(layer, tSHP, tile, tiFileAbsDir, rect);
+  }
+
+  if(msTiledSHPTakeTile(tSHP, tile, &searched)) {
+    if(searched != -1 && memcmp(&tSHP->shpfile->statusbounds, &rect, sizeof(rectObj)) == 0) {
+      status = searched;
+      tSHP->shpfile->lastshape = -1;
+    } else {
+      status = msShapefileWhichShapes(tSHP->shpfile, rect, layer->debug);
+    }
+  } else {
+    status = msTiledSHPTryOpen(tSHP->shpfile, layer, tiFileAbsDir, filename);
+    if(status != MS_SUCCESS)
+      return(status); /* MS_DONE or MS_FAILURE */
+    tSHP->shpfiletile = tile;
+    status = msShapefileWhichShapes(tSHP->shpfile, rect, layer->debug);
+  }
+
+  if(status == MS_DONE) {
+    /* Close and continue to next tile */
+    msTiledSHPReleaseTile(tSHP);
+  } else if(status != MS_SUCCESS) {
+    msShapefileClose(tSHP->shpfile);
+    tSHP->shpfiletile = -1;
+  }
+  return(status);
+}
+
 int msTiledSHPOpenFile(layerObj *layer)
 {
   int i;
@@ -1955,6 +2526,11 @@ int msTiledSHPOpenFile(layerObj *layer)
   
   tSHP->shpfile->isopen = MS_FALSE; /* in case of error: do not try to close the shpfile */
   tSHP->tileshpfile = NULL; /* may need this if not using a tile layer, look for malloc later */
+  tSHP->shpfiletile = -1;
+  tSHP->tiles = NULL;
+  tSHP->numtiles = tSHP->tileclock = 0;
+  tSHP->handlecache = msTiledSHPGetOption(layer, "TILE_HANDLE_CACHE", "MS_TILE_HANDLE_CACHE", MS_TILE_HANDLE_CACHE_MAX);
+  tSHP->prefetch = msTiledSHPGetOption(layer, "TILE_PREFETCH", "MS_TILE_PREFETCH", MS_TILE_PREFETCH_MAX);
   layer->layerinfo = tSHP;
 
   tSHP->tilelayerindex = msGetLayerIndex(layer->map, layer->tileindex);
@@ -1992,8 +2568,8 @@ int msTiledSHPOpenFile(layerObj *layer)
     }
 
 
-    if(msShapefileOpen(tSHP->tileshpfile, "rb", msBuildPath3(szPath, layer->map->mappath, layer->map->shapepath, layer->tileindex), MS_TRUE) == -1)
-      if(msShapefileOpen(tSHP->tileshpfile, "rb", msBuildPath(szPath, layer->map->mappath, layer->tileindex), MS_TRUE) == -1)
+    if(msShapefileOpenLayer(layer, tSHP->tileshpfile, msBuildPath3(szPath, layer->map->mappath, layer->map->shapepath, layer->tileindex), MS_TRUE) == -1)
+      if(msShapefileOpenLayer(layer, tSHP->tileshpfile, msBuildPath(szPath, layer->map->mappath, layer->tileindex), MS_TRUE) == -1)
         return(MS_FAILURE);
   }
 
@@ -2008,6 +2584,13 @@ int msTiledSHPOpenFile(layerObj *layer)
 
   msTileIndexAbsoluteDir(tiFileAbsDir, layer);
 
+  tSHP->numtiles = tSHP->handlecache + tSHP->prefetch;
+  if(tSHP->numtiles > 0) {
+    tSHP->tiles = (msTiledSHPTileObj *) msSmallCalloc(tSHP->numtiles, sizeof(msTiledSHPTileObj));
+    for(i=0; i<tSHP->numtiles; i++)
+      tSHP->tiles[i].tileindex = -1;
+  }
+
   /* position the source at the FIRST tile to use as a template, this is so the functions that fill the iteminfo array have something to work from */
   for(i=0; i<tSHP->tileshpfile->numshapes; i++) {
     int try_open;
@@ -2027,6 +2610,7 @@ int msTiledSHPOpenFile(layerObj *layer)
     else if (try_open == MS_FAILURE )
       return(MS_FAILURE);
 
+    tSHP->shpfiletile = i;
     return(MS_SUCCESS); /* found a template, ok to proceed */
   }
 
@@ -2052,7 +2636,7 @@ int msTiledSHPWhichShapes(layerObj *layer, rectObj rect, int isQuery)
     return(MS_FAILURE);
   }
 
-  msShapefileClose(tSHP->shpfile); /* close previously opened files */
+  msTiledSHPReleaseTile(tSHP); /* close previously opened files */
 
   if(tSHP->tilelayerindex != -1) {  /* does the tileindex reference another layer */
     layerObj *tlp;
@@ -2066,34 +2650,17 @@ int msTiledSHPWhichShapes(layerObj *layer, rectObj rect, int isQuery)
 
     msInitShape(&tshape);
     while((status = msLayerNextShape(tlp, &tshape)) == MS_SUCCESS) {
-      int try_open;
-
       /* TODO: seems stupid to read the tileitem seperately from the shape, need to fix msTiledSHPOpenFile */
-      if(!layer->data) /* assume whole filename is in attribute field */
-        filename = (char *) msDBFReadStringAttribute(tSHP->tileshpfile->hDBF, tshape.index, layer->tileitemindex);
-      else {
-        snprintf(tilename, sizeof(tilename), "%s/%s", msDBFReadStringAttribute(tSHP->tileshpfile->hDBF, tshape.index, layer->tileitemindex) , layer->data);
-        filename = tilename;
-      }
+      filename = msTiledSHPTileName(layer, tSHP, tshape.index, tilename);
 
       if(strlen(filename) == 0) continue; /* check again */
 
-      try_open = msTiledSHPTryOpen(tSHP->shpfile, layer, tiFileAbsDir, filename);
-      if( try_open == MS_DONE )
+      status = msTiledSHPAcquireTile(layer, tSHP, tshape.index, tiFileAbsDir, filename, rect);
+      if(status == MS_DONE)
         continue;
-      else if (try_open == MS_FAILURE )
+      else if(status != MS_SUCCESS)
         return(MS_FAILURE);
 
-      status = msShapefileWhichShapes(tSHP->shpfile, rect, layer->debug);
-      if(status == MS_DONE) {
-        /* Close and continue to next tile */
-        msShapefileClose(tSHP->shpfile);
-        continue;
-      } else if(status != MS_SUCCESS) {
-        msShapefileClose(tSHP->shpfile);
-        return(MS_FAILURE);
-      }
-
       /* the layer functions keeps track of this */
       /* tSHP->tileshpfile->lastshape = tshape.index; */
       break;
@@ -2101,8 +2668,6 @@ int msTiledSHPWhichShapes(layerObj *layer, rectObj rect, int isQuery)
     return(status); /* if we reach here we either 1) ran out of tiles or 2) had an error reading a tile */
 
   } else { /* or reference a shapefile directly */
-    int try_open;
-
     status = msShapefileWhichShapes(tSHP->tileshpfile, rect, layer->debug);
     if(status != MS_SUCCESS) return(status); /* could be MS_DONE or MS_FAILURE */
 
@@ -2111,30 +2676,15 @@ int msTiledSHPWhichShapes(layerObj *layer, rectObj rect, int isQuery)
     /* position the source at the FIRST shapefile */
     for(i=0; i<tSHP->tileshpfile->numshapes; i++) {
       if(msGetBit(tSHP->tileshpfile->status,i)) {
-        if(!layer->data) /* assume whole filename is in attribute field */
-          filename = (char *) msDBFReadStringAttribute(tSHP->tileshpfile->hDBF, i, layer->tileitemindex);
-        else {
-          snprintf(tilename, sizeof(tilename), "%s/%s", msDBFReadStringAttribute(tSHP->tileshpfile->hDBF, i, layer->tileitemindex) , layer->data);
-          filename = tilename;
-        }
+        filename = msTiledSHPTileName(layer, tSHP, i, tilename);
 
         if(strlen(filename) == 0) continue; /* check again */
 
-        try_open = msTiledSHPTryOpen(tSHP->shpfile, layer, tiFileAbsDir, filename);
-        if( try_open == MS_DONE )
-          continue;
-        else if (try_open == MS_FAILURE )
-          return(MS_FAILURE);
-
-        status = msShapefileWhichShapes(tSHP->shpfile, rect, layer->debug);
-        if(status == MS_DONE) {
-          /* Close and continue to next tile */
-          msShapefileClose(tSHP->shpfile);
+        status = msTiledSHPAcquireTile(layer, tSHP, i, tiFileAbsDir, filename, rect);
+        if(status == MS_DONE)
           continue;
-        } else if(status != MS_SUCCESS) {
-          msShapefileClose(tSHP->shpfile);
+        else if(status != MS_SUCCESS)
           return(MS_FAILURE);
-        }
 
         tSHP->tileshpfile->lastshape = i;
         break;
@@ -2174,13 +2724,12 @@ int msTiledSHPNextShape(layerObj *layer, shapeObj *shape)
     while(i<tSHP->shpfile->numshapes && !msGetBit(tSHP->shpfile->status,i)) i++; /* next "in" shape */
 
     if(i == tSHP->shpfile->numshapes) { /* done with this tile, need a new one */
-      msShapefileClose(tSHP->shpfile); /* clean up */
+      msTiledSHPReleaseTile(tSHP); /* clean up */
 
       /* position the source to the NEXT shapefile based on the tileindex */
       if(tSHP->tilelayerindex != -1) { /* does the tileindex reference another layer */
         layerObj *tlp;
         shapeObj tshape;
-        int try_open;
 
         tlp = (GET_LAYER(layer->map, tSHP->tilelayerindex));
 
@@ -2188,28 +2737,14 @@ int msTiledSHPNextShape(layerObj *layer, shapeObj *shape)
         while((status = msLayerNextShape(tlp, &tshape)) == MS_SUCCESS) {
 
           /* TODO: seems stupid to read the tileitem seperately from the shape, need to fix msTiledSHPOpenFile */
-          if(!layer->data) /* assume whole filename is in attribute field */
-            filename = (char *) msDBFReadStringAttribute(tSHP->tileshpfile->hDBF, tshape.index, layer->tileitemindex);
-          else {
-            snprintf(tilename, sizeof(tilename),"%s/%s", msDBFReadStringAttribute(tSHP->tileshpfile->hDBF, tshape.index, layer->tileitemindex) , layer->data);
-            filename = tilename;
-          }
+          filename = msTiledSHPTileName(layer, tSHP, tshape.index, tilename);
 
           if(strlen(filename) == 0) continue; /* check again */
 
-          try_open = msTiledSHPTryOpen(tSHP->shpfile, layer, tiFileAbsDir, filename);
-          if( try_open == MS_DONE )
-            continue;
-          else if (try_open == MS_FAILURE )
-            return(MS_FAILURE);
-
-          status = msShapefileWhichShapes(tSHP->shpfile, tSHP->tileshpfile->statusbounds, layer->debug);
-          if(status == MS_DONE) {
-            /* Close and continue to next tile */
-            msShapefileClose(tSHP->shpfile);
+          status = msTiledSHPAcquireTile(layer, tSHP, tshape.index, tiFileAbsDir, filename, tSHP->tileshpfile->statusbounds);
+          if(status == MS_DONE)
             continue;
-          } else if(status != MS_SUCCESS) {
-            msShapefileClose(tSHP->shpfile);
+          else if(status != MS_SUCCESS) {
             tSHP->tileshpfile->lastshape = -1;
             return(MS_FAILURE);
           }
@@ -2232,30 +2767,14 @@ int msTiledSHPNextShape(layerObj *layer, shapeObj *shape)
 
         for(i=(tSHP->tileshpfile->lastshape + 1); i<tSHP->tileshpfile->numshapes; i++) {
           if(msGetBit(tSHP->tileshpfile->status,i)) {
-            int try_open;
-
-            if(!layer->data) /* assume whole filename is in attribute field */
-              filename = (char*)msDBFReadStringAttribute(tSHP->tileshpfile->hDBF, i, layer->tileitemindex);
-            else {
-              snprintf(tilename, sizeof(tilename),"%s/%s", msDBFReadStringAttribute(tSHP->tileshpfile->hDBF, i, layer->tileitemindex) , layer->data);
-              filename = tilename;
-            }
+            filename = msTiledSHPTileName(layer, tSHP, i, tilename);
 
             if(strlen(filename) == 0) continue; /* check again */
 
-            try_open = msTiledSHPTryOpen(tSHP->shpfile, layer, tiFileAbsDir, filename);
-            if( try_open == MS_DONE )
-              continue;
-            else if (try_open == MS_FAILURE )
-              return(MS_FAILURE);
-
-            status = msShapefileWhichShapes(tSHP->shpfile, tSHP->tileshpfile->statusbounds, layer->debug);
-            if(status == MS_DONE) {
-              /* Close and continue to next tile */
-              msShapefileClose(tSHP->shpfile);
+            status = msTiledSHPAcquireTile(layer, tSHP, i, tiFileAbsDir, filename, tSHP->tileshpfile->statusbounds);
+            if(status == MS_DONE)
               continue;
-            } else if(status != MS_SUCCESS) {
-              msShapefileClose(tSHP->shpfile);
+            else if(status != MS_SUCCESS) {
               tSHP->tileshpfile->lastshape = -1;
               return(MS_FAILURE);
             }
@@ -2320,26 +2839,23 @@ int msTiledSHPGetShape(layerObj *layer, shapeObj *shape, resultObj *record)
 
   if((tileindex < 0) || (tileindex >= tSHP->tileshpfile->numshapes)) return(MS_FAILURE); /* invalid tile id */
 
-  if(tileindex != tSHP->tileshpfile->lastshape) { /* correct tile is not currenly open so open the correct tile */
-    msShapefileClose(tSHP->shpfile); /* close current tile */
+  if(tileindex != tSHP->tileshpfile->lastshape || tileindex != tSHP->shpfiletile) { /* correct tile is not currenly open so open the correct tile */
+    msTiledSHPReleaseTile(tSHP); /* close current tile */
+  }
 
-    if(!layer->data) /* assume whole filename is in attribute field */
-      filename = (char*) msDBFReadStringAttribute(tSHP->tileshpfile->hDBF, tileindex, layer->tileitemindex);
-    else {
-      snprintf(tilename, sizeof(tilename), "%s/%s", msDBFReadStringAttribute(tSHP->tileshpfile->hDBF, tileindex, layer->tileitemindex) , layer->data);
-      filename = tilename;
-    }
+  if(tSHP->shpfile->isopen != MS_TRUE && !msTiledSHPTakeTile(tSHP, tileindex, NULL)) {
+    filename = msTiledSHPTileName(layer, tSHP, tileindex, tilename);
 
     /* open the shapefile, since a specific tile was request an error should be generated if that tile does not exist */
     if(strlen(filename) == 0) return(MS_FAILURE);
-    if(msShapefileOpen(tSHP->shpfile, "rb", msBuildPath3(szPath, tiFileAbsDir, layer->map->shapepath, filename), MS_TRUE) == -1) {
-      if(msShapefileOpen(tSHP->shpfile, "rb", msBuildPath3(szPath, layer->map->mappath, layer->map->shapepath, filename), MS_TRUE) == -1) {
-        if(msShapefileOpen(tSHP->shpfile, "rb", msBuildPath(szPath, layer->map->mappath, filename), MS_TRUE) == -1) {
+    if(msShapefileOpenLayer(layer, tSHP->shpfile, msBuildPath3(szPath, tiFileAbsDir, layer->map->shapepath, filename), MS_TRUE) == -1) {
+      if(msShapefileOpenLayer(layer, tSHP->shpfile, msBuildPath3(szPath, layer->map->mappath, layer->map->shapepath, filename), MS_TRUE) == -1) {
+        if(msShapefileOpenLayer(layer, tSHP->shpfile, msBuildPath(szPath, layer->map->mappath, filename), MS_TRUE) == -1) {
           return(MS_FAILURE);
         }
       }
     }
-
+    tSHP->shpfiletile = tileindex;
   }
 
   if((shapeindex < 0) || (shapeindex >= tSHP->shpfile->numshapes)) return(MS_FAILURE);
@@ -2365,8 +2881,13 @@ void msTiledSHPClose(layerObj *layer)
 
   tSHP = layer->layerinfo;
   if(tSHP) {
+    int i;
+
     msShapefileClose(tSHP->shpfile);
     free(tSHP->shpfile);
+    for(i=0; i<tSHP->numtiles; i++)
+      if(tSHP->tiles[i].tileindex != -1) msShapefileClose(&tSHP->tiles[i].shpfile);
+    free(tSHP->tiles);
 
     if(tSHP->tilelayerindex != -1) {
       layerObj *tlp;
@@ -2598,8 +3119,8 @@ int msSHPLayerOpen(layerObj *layer)
 
   layer->layerinfo = shpfile;
 
-  if(msShapefileOpen(shpfile, "rb", msBuildPath3(szPath, layer->map->mappath, layer->map->shapepath, layer->data), MS_TRUE) == -1) {
-    if(msShapefileOpen(shpfile, "rb", msBuildPath(szPath, layer->map->mappath, layer->data), MS_TRUE) == -1) {
+  if(msShapefileOpenLayer(layer, shpfile, msBuildPath3(szPath, layer->map->mappath, layer->map->shapepath, layer->data), MS_TRUE) == -1) {
+    if(msShapefileOpenLayer(layer, shpfile, msBuildPath(szPath, layer->map->mappath, layer->data), MS_TRUE) == -1) {
       layer->layerinfo = NULL;
       free(shpfile);
       return MS_FAILURE;
@@ -102,6 +102,13 @@ extern "C" {
     int   nPartMax;
     int   *panParts;
 
+    uchar *pabySHPMap; /* read-only mappings of the .shp/.shx, NULL unless opened with msSHPOpenMapped() */
+    size_t nSHPMapSize;
+    uchar *pabySHXMap;
+    size_t nSHXMapSize;
+
+    shapePoolObj *pool; /* buffers for the shapes read, owned by the layer, may be NULL */
+
   } SHPInfo;
   typedef SHPInfo * SHPHandle;
 #endif
@@ -138,6 +145,14 @@ extern "C" {
 #ifdef SWIG
     %mutable;
 #endif
+
+#ifndef SWIG
+    uchar *pabyMap; /* read-only mapping of the .dbf, NULL unless opened with msDBFOpenMapped() */
+    size_t nMapSize;
+    uchar *pabyColumns; /* mapped column cache, NULL unless opened with msDBFOpenCached() */
+    size_t nColumnsSize;
+    shapePoolObj *pool; /* buffers for the values read, owned by the layer, may be NULL */
+#endif
   } DBFInfo;
   typedef DBFInfo * DBFHandle;
 
@@ -168,17 +183,35 @@ extern "C" {
     rectObj statusbounds; /* holds extent associated with the status vector */
 
     int isopen;
+#ifndef SWIG
+    int packedindex; /* look for a packed index (.pqx), cleared once one was not found */
+    struct SHPPackedTreeInfo *packedtree; /* the packed index, opened by the first search that needs it */
+#endif
 #ifdef SWIG
     %mutable;
 #endif
   } shapefileObj;
 
 #ifndef SWIG
+  /* tile of a tiled shapefile layer kept open between uses */
+  typedef struct {
+    int tileindex; /* record of the tile in the tileindex, -1 for a free slot */
+    int searched; /* result of a search of shpfile.statusbounds done ahead of use, -1 if none, MS_FAILURE (shpfile closed) if that failed */
+    int lastused;
+    shapefileObj shpfile;
+  } msTiledSHPTileObj;
+
   /* layerInfo structure for tiled shapefiles */
   typedef struct {
     shapefileObj *shpfile;
     shapefileObj *tileshpfile;
     int tilelayerindex;
+    int shpfiletile; /* record of the tile open in shpfile, -1 if none */
+    msTiledSHPTileObj *tiles; /* TILE_HANDLE_CACHE + TILE_PREFETCH slots */
+    int numtiles;
+    int handlecache;
+    int prefetch;
+    int tileclock;
   } msTiledSHPLayerInfo;
 
   /* shapefileObj function prototypes  */
@@ -189,6 +222,7 @@ extern "C" {
 
   /* SHP/SHX function prototypes */
   MS_DLL_EXPORT SHPHandle msSHPOpen( const char * pszShapeFile, const char * pszAccess );
+  MS_DLL_EXPORT SHPHandle msSHPOpenMapped( const char * pszShapeFile );
   MS_DLL_EXPORT SHPHandle msSHPCreate( const char * pszShapeFile, int nShapeType );
   MS_DLL_EXPORT void msSHPClose( SHPHandle hSHP );
   MS_DLL_EXPORT void msSHPGetInfo( SHPHandle hSHP, int * pnEntities, int * pnShapeType );
@@ -203,11 +237,19 @@ extern "C" {
   MS_DLL_EXPORT int msSHXReadOffset( SHPHandle psSHP, int hEntity );
   MS_DLL_EXPORT int msSHXReadSize( SHPHandle psSHP, int hEntity );
 
+  /* Process-wide read-only file mappings shared by the SHP/SHX/DBF readers */
+  MS_DLL_EXPORT uchar *msSHPMapFile( FILE *fp, size_t *pnSize );
+  MS_DLL_EXPORT void msSHPUnmapFile( uchar *pabyMap );
+  MS_DLL_EXPORT void msSHPMapCleanup( void );
+
 
   /* tiledShapefileObj function prototypes are in mapserver.h */
 
   /* XBase function prototypes */
   MS_DLL_EXPORT DBFHandle msDBFOpen( const char * pszDBFFile, const char * pszAccess );
+  MS_DLL_EXPORT DBFHandle msDBFOpenMapped( const char * pszDBFFile );
+  MS_DLL_EXPORT DBFHandle msDBFOpenCached( const char * pszDBFFile, int bMapped, int bBuild );
+  MS_DLL_EXPORT int msDBFBuildColumnCache( const char * pszDBFFile );
   MS_DLL_EXPORT void msDBFClose( DBFHandle hDBF );
   MS_DLL_EXPORT DBFHandle msDBFCreate( const char * pszDBFFile );
 
@@ -59,6 +59,17 @@ possible to implement for other thread libraries if needed.
         Releases the indicated mutex.  If the lock id is invalid, or if the
         mutex is not currently held by this thread then results are undefined.
 
+  int msThreadRunJobs(int nThreads, int nJobs, pfnJob, pData):
+        Calls pfnJob(pData, iJob) once for each iJob in 0..nJobs-1, using up
+        to nThreads threads (the calling thread being one of them), and
+        returns once all jobs have completed.  Jobs are handed out in
+        increasing order but may complete in any order, so pfnJob must only
+        touch state belonging to its own job.  Errors raised inside a job
+        are recorded in the error context of whichever thread ran it, and
+        are lost for worker threads: pfnJob has to save anything it needs.
+        Without USE_THREAD, or if no thread can be started, the jobs are
+        run sequentially in the calling thread.
+
 It is incredibly important to ensure that any mutex that is acquired is
 released as soon as possible.  Any flow of control that could result in a
 mutex not being release is going to be a disaster.
@@ -144,8 +155,23 @@ static int thread_debug = 0;
 
 static char *lock_names[] = {
   NULL, "PARSER", "GDAL", "ERROROBJ", "PROJ", "TTF", "POOL", "SDE",
-  "ORACLE", "OWS", "LAYER_VTABLE", "IOCONTEXT", "TMPFILE", "DEBUGOBJ", "OGR", "TIME", "FRIBIDI", "WXS", "GEOS", NULL
+  "ORACLE", "OWS", "LAYER_VTABLE", "IOCONTEXT", "TMPFILE", "DEBUGOBJ", "OGR", "TIME", "FRIBIDI", "WXS", "GEOS", "SHPMAP", "MAPFILECACHE", "MARKERCACHE", "GLYPHCACHE", NULL
 };
+
+/*
+** Releases what a job worker thread may have created for itself before it
+** exits: its font cache is handed back to the thread that started it, its
+** projection cache and error context are freed.
+*/
+static void msThreadReleaseState( void *pParentThreadId )
+
+{
+  msFontCacheThreadEnd( pParentThreadId );
+#ifdef USE_PROJ
+  msProjectionCacheThreadCleanup();
+#endif
+  msResetErrorList();
+}
 #endif
 
 /************************************************************************/
@@ -227,6 +253,85 @@ void msReleaseLock( int nLockId )
   pthread_mutex_unlock( mutex_locks + nLockId );
 }
 
+/************************************************************************/
+/*                         msThreadRunJobs()                            */
+/************************************************************************/
+
+typedef struct {
+  void (*pfnJob)(void *pData, int iJob);
+  void *pData;
+  void *pParentThreadId;
+  int nJobs;
+  int iNextJob;
+  pthread_mutex_t hMutex;
+} msThreadJobQueue;
+
+static void msThreadRunQueue( msThreadJobQueue *psQueue )
+
+{
+  for( ;; ) {
+    int iJob;
+
+    pthread_mutex_lock( &psQueue->hMutex );
+    iJob = psQueue->iNextJob++;
+    pthread_mutex_unlock( &psQueue->hMutex );
+
+    if( iJob >= psQueue->nJobs )
+      break;
+    psQueue->pfnJob( psQueue->pData, iJob );
+  }
+}
+
+static void *msThreadJobWorker( void *pArg )
+
+{
+  msThreadJobQueue *psQueue = (msThreadJobQueue *) pArg;
+
+  msFontCacheThreadStart( psQueue->pParentThreadId );
+  msThreadRunQueue( psQueue );
+  msThreadReleaseState( psQueue->pParentThreadId );
+  return NULL;
+}
+
+int msThreadRunJobs( int nThreads, int nJobs,
+                     void (*pfnJob)(void *pData, int iJob), void *pData )
+
+{
+  msThreadJobQueue sQueue;
+  pthread_t *pahThreads;
+  int i, nStarted = 0;
+
+  if( nThreads > nJobs )
+    nThreads = nJobs;
+
+  sQueue.pfnJob = pfnJob;
+  sQueue.pData = pData;
+  sQueue.pParentThreadId = msGetThreadId();
+  sQueue.nJobs = nJobs;
+  sQueue.iNextJob = 0;
+  pthread_mutex_init( &sQueue.hMutex, NULL );
+
+  pahThreads = (nThreads > 1) ? (pthread_t *) malloc(sizeof(pthread_t) * (nThreads - 1)) : NULL;
+  for( i = 0; pahThreads && i < nThreads - 1; i++ ) {
+    if( pthread_create( pahThreads + nStarted, NULL, msThreadJobWorker, &sQueue ) == 0 )
+      nStarted++;
+  }
+
+  if( thread_debug )
+    fprintf( stderr, "msThreadRunJobs(%d jobs, %d threads) (posix)\n",
+             nJobs, nStarted + 1 );
+
+  msThreadRunQueue( &sQueue );
+
+  for( i = 0; i < nStarted; i++ )
+    pthread_join( pahThreads[i], NULL );
+
+  free( pahThreads );
+  pthread_mutex_destroy( &sQueue.hMutex );
+
+  return MS_SUCCESS;
+}
+
 #endif /* defined(USE_THREAD) && !defined(_WIN32) */
 
 /************************************************************************/
@@ -315,4 +420,105 @@ void msReleaseLock( int nLockId )
   ReleaseMutex( mutex_locks[nLockId] );
 }
 
+/************************************************************************/
+/*                         msThreadRunJobs()                            */
+/************************************************************************/
+
+typedef struct {
+  void (*pfnJob)(void *pData, int iJob);
+  void *pData;
+  void *pParentThreadId;
+  LONG nJobs;
+  volatile LONG iNextJob;
+} msThreadJobQueue;
+
+static void msThreadRunQueue( msThreadJobQueue *psQueue )
+
+{
+  for( ;; ) {
+    LONG iJob = InterlockedIncrement( &psQueue->iNextJob ) - 1;
+
+    if( iJob >= psQueue->nJobs )
+      break;
+    psQueue->pfnJob( psQueue->pData, (int) iJob );
+  }
+}
+
+static DWORD WINAPI msThreadJobWorker( LPVOID pArg )
+
+{
+  msThreadJobQueue *psQueue = (msThreadJobQueue *) pArg;
+
+  msFontCacheThreadStart( psQueue->pParentThreadId );
+  msThreadRunQueue( psQueue );
+  msThreadReleaseState( psQueue->pParentThreadId );
+  return 0;
+}
+
+int msThreadRunJobs( int nThreads, int nJobs,
+                     void (*pfnJob)(void *pData, int iJob), void *pData )
+
+{
+  msThreadJobQueue sQueue;
+  HANDLE *pahThreads;
+  int i, nStarted = 0;
+
+  if( nThreads > nJobs )
+    nThreads = nJobs;
+
+  sQueue.pfnJob = pfnJob;
+  sQueue.pData = pData;
+  sQueue.pParentThreadId = msGetThreadId();
+  sQueue.nJobs = nJobs;
+  sQueue.iNextJob = 0;
+
+  pahThreads = (nThreads > 1) ? (HANDLE *) malloc(sizeof(HANDLE) * (nThreads - 1)) : NULL;
+  for( i = 0; pahThreads && i < nThreads - 1; i++ ) {
+    pahThreads[nStarted] = CreateThread( NULL, 0, msThreadJobWorker, &sQueue, 0, NULL );
+    if( pahThreads[nStarted] != NULL )
+      nStarted++;
+  }
+
+  if( thread_debug )
+    fprintf( stderr, "msThreadRunJobs(%d jobs, %d threads) (win32)\n",
+             nJobs, nStarted + 1 );
+
+  msThreadRunQueue( &sQueue );
+
+  for( i = 0; i < nStarted; i++ ) {
+    WaitForSingleObject( pahThreads[i], INFINITE );
+    CloseHandle( pahThreads[i] );
+  }
+
+  free( pahThreads );
+
+  return MS_SUCCESS;
+}
+
 #endif /* defined(USE_THREAD) && defined(_WIN32) */
+
+/************************************************************************/
+/* ==================================================================== */
+/*                           NO THREADS                                 */
+/* ==================================================================== */
+/************************************************************************/
+
+#if !defined(USE_THREAD)
+
+/************************************************************************/
+/*                         msThreadRunJobs()                            */
+/************************************************************************/
+
+int msThreadRunJobs( int nThreads, int nJobs,
+                     void (*pfnJob)(void *pData, int iJob), void *pData )
+
+{
+  int iJob;
+
+  for( iJob = 0; iJob < nJobs; iJob++ )
+    pfnJob( pData, iJob );
+
+  return MS_SUCCESS;
+}
+
+#endif /* !defined(USE_THREAD) */
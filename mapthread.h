@@ -46,6 +46,9 @@ extern "C" {
 #define msReleaseLock(x)
 #endif
 
+  int msThreadRunJobs(int nThreads, int nJobs,
+                      void (*pfnJob)(void *pData, int iJob), void *pData);
+
   /*
   ** lock ids - note there is a corresponding lock_names[] array in
   ** mapthread.c that needs to be extended when new ids are added.
@@ -69,8 +72,12 @@ extern "C" {
 #define TLOCK_FRIBIDI   16
 #define TLOCK_WxS       17
 #define TLOCK_GEOS       18
+#define TLOCK_SHPMAP     19
+#define TLOCK_MAPFILECACHE 20
+#define TLOCK_MARKERCACHE 21
+#define TLOCK_GLYPHCACHE 22
 
-#define TLOCK_STATIC_MAX 20
+#define TLOCK_STATIC_MAX 23
 #define TLOCK_MAX       100
 
 #ifdef __cplusplus
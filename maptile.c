@@ -29,6 +29,12 @@
 
 #include "maptile.h"
 #include "mapproject.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 #ifdef USE_TILE_API
 static void msTileResetMetatileLevel(mapObj *map)
@@ -117,16 +123,15 @@ static void msTileGetParams(mapObj *map, tileParams *params)
 }
 
 /************************************************************************
- *                            msTileExtractSubTile                      *
+ *                            msTileCropImage                           *
  *                                                                      *
+ *  Copy the tile_size x tile_size square at (mini, minj) out of the    *
+ *  metatile image.                                                     *
  ************************************************************************/
-static imageObj* msTileExtractSubTile(const mapservObj *msObj, const imageObj *img)
+static imageObj* msTileCropImage(const mapservObj *msObj, const imageObj *img,
+                                 const tileParams *params, int mini, int minj)
 {
-
-  int width, mini, minj;
-  int zoom = 2;
   imageObj* imgOut = NULL;
-  tileParams params;
   rendererVTableObj *renderer;
   rasterBufferObj imgBuffer;
 
@@ -142,6 +147,35 @@ static imageObj* msTileExtractSubTile(const mapservObj *msObj, const imageObj *i
     return NULL;
   }
 
+  imgOut = msImageCreate(params->tile_size, params->tile_size, msObj->map->outputformat, NULL, NULL, msObj->map->resolution, msObj->map->defresolution, NULL);
+
+  if( imgOut == NULL ) {
+    return NULL;
+  }
+
+  if(msObj->map->debug)
+    msDebug("msTileExtractSubTile(): extracting (%d x %d) tile, top corner (%d, %d)\n",params->tile_size,params->tile_size,mini,minj);
+
+
+
+  if(UNLIKELY(MS_FAILURE == renderer->mergeRasterBuffer(imgOut,&imgBuffer,1.0,mini, minj,0, 0,params->tile_size, params->tile_size))) {
+    msFreeImage(imgOut);
+    return NULL;
+  }
+
+  return imgOut;
+}
+
+/************************************************************************
+ *                            msTileExtractSubTile                      *
+ *                                                                      *
+ ************************************************************************/
+static imageObj* msTileExtractSubTile(const mapservObj *msObj, const imageObj *img)
+{
+
+  int width, mini, minj;
+  int zoom = 2;
+  tileParams params;
 
   /*
   ** Load the metatiling information from the map file.
@@ -208,23 +242,7 @@ static imageObj* msTileExtractSubTile(const mapservObj *msObj, const imageObj *i
     return(NULL); /* Huh? Should have a mode. */
   }
 
-  imgOut = msImageCreate(params.tile_size, params.tile_size, msObj->map->outputformat, NULL, NULL, msObj->map->resolution, msObj->map->defresolution, NULL);
-
-  if( imgOut == NULL ) {
-    return NULL;
-  }
-
-  if(msObj->map->debug)
-    msDebug("msTileExtractSubTile(): extracting (%d x %d) tile, top corner (%d, %d)\n",params.tile_size,params.tile_size,mini,minj);
-
-
-
-  if(UNLIKELY(MS_FAILURE == renderer->mergeRasterBuffer(imgOut,&imgBuffer,1.0,mini, minj,0, 0,params.tile_size, params.tile_size))) {
-    msFreeImage(imgOut);
-    return NULL;
-  }
-
-  return imgOut;
+  return msTileCropImage(msObj, img, &params, mini, minj);
 }
 
 
@@ -504,6 +522,334 @@ int msTileSetExtent(mapservObj* msObj)
 
 
 
+/************************************************************************
+ *                          Metatile cache                              *
+ *                                                                      *
+ *  Rendering a metatile produces 4 (level 1) or 16 (level 2) tiles.    *
+ *  When the "tile_metatile_cache" web metadata names a directory, all  *
+ *  of them are encoded and written there, so that the requests for the *
+ *  neighbouring tiles are served without drawing anything. Files are   *
+ *  named <key>_<tile>.<ext>, key being a hash of the mapfile (path,    *
+ *  modification time and size), the output format and the request     *
+ *  parameters that change what is drawn. "tile_metatile_cache_ttl"     *
+ *  sets the maximum age in seconds (default: 3600), expired files are  *
+ *  removed when they are next looked up. The directory can be shared   *
+ *  by several processes, files are written under a temporary name and  *
+ *  renamed into place.                                                 *
+ ************************************************************************/
+#define MS_TILE_CACHE_DEFAULT_TTL 3600
+
+static const char *msTileCacheDir(mapObj *map, const tileParams *params)
+{
+  if( params->metatile_level <= 0 ||
+      !MS_RENDERER_PLUGIN(map->outputformat) ||
+      !MS_MAP_RENDERER(map)->supports_pixel_buffer )
+    return NULL;
+  return msLookupHashTable(&(map->web.metadata), "tile_metatile_cache");
+}
+
+typedef struct {
+  unsigned long long h1, h2;
+} tileCacheHash;
+
+/* two independent 64 bit hashes: FNV-1a and a multiply-rotate one */
+static void msTileCacheHash(tileCacheHash *hash, const char *str)
+{
+  if( str ) {
+    for( ; *str; str++ ) {
+      hash->h1 = (hash->h1 ^ (unsigned char) *str) * 0x100000001b3ULL;
+      hash->h2 = hash->h2 + (unsigned char) *str;
+      hash->h2 = ((hash->h2 << 27) | (hash->h2 >> 37)) * 0x9e3779b97f4a7c15ULL;
+    }
+  }
+  /* terminate each string so that ("ab","c") and ("a","bc") differ */
+  hash->h1 = (hash->h1 ^ 0xff) * 0x100000001b3ULL;
+  hash->h2 = ((hash->h2 + 0xff) ^ (hash->h2 >> 31)) * 0xbf58476d1ce4e5b9ULL;
+}
+
+/* Mapfile of the request, resolved the way msCGILoadMap() does */
+static const char *msTileCacheMapfile(const mapservObj *msObj)
+{
+  int i;
+
+  for( i = 0; i < msObj->request->NumParams; i++ ) {
+    if( strcasecmp(msObj->request->ParamNames[i], "map") == 0 ) {
+      if( getenv(msObj->request->ParamValues[i]) )
+        return getenv(msObj->request->ParamValues[i]);
+      return msObj->request->ParamValues[i];
+    }
+  }
+  return getenv("MS_MAPFILE");
+}
+
+static int msTileCacheHasValidation(mapObj *map, const char *name)
+{
+  int i, j;
+
+  if( msLookupHashTable(&(map->web.validation), name) )
+    return MS_TRUE;
+  for( i = 0; i < map->numlayers; i++ ) {
+    layerObj *lp = GET_LAYER(map, i);
+    if( msLookupHashTable(&(lp->validation), name) )
+      return MS_TRUE;
+    for( j = 0; j < lp->numclasses; j++ ) {
+      if( msLookupHashTable(&(lp->class[j]->validation), name) )
+        return MS_TRUE;
+    }
+  }
+  return MS_FALSE;
+}
+
+/*
+** Request parameters that change the rendered tile: the layer selection,
+** the mapfile and its overrides, and the runtime substitutions msCGILoadMap()
+** applied. Anything else (cache busters, client tokens...) is left out of
+** the key.
+*/
+static int msTileCacheUseParam(mapObj *map, const char *name)
+{
+  if( strcasecmp(name, "map") == 0 || strcasecmp(name, "layer") == 0 ||
+      strcasecmp(name, "layers") == 0 || strcasecmp(name, "tilemode") == 0 )
+    return MS_TRUE;
+
+  if( msLookupHashTable(&(map->web.validation), "immutable") )
+    return MS_FALSE;
+
+  if( strncasecmp(name, "map_", 4) == 0 || strncasecmp(name, "map.", 4) == 0 ||
+      strncasecmp(name, "classgroup", 10) == 0 || strcasecmp(name, "context") == 0 )
+    return MS_TRUE;
+
+  return msTileCacheHasValidation(map, name);
+}
+
+static int msTileCacheCompareParams(const void *a, const void *b)
+{
+  const char * const *pa = (const char * const *) a;
+  const char * const *pb = (const char * const *) b;
+  int cmp = strcasecmp(pa[0], pb[0]);
+
+  return cmp ? cmp : strcmp(pa[1], pb[1]);
+}
+
+static void msTileCacheKey(const mapservObj *msObj, const tileParams *params, char *key, size_t keysize)
+{
+  tileCacheHash hash;
+  const char *mapfile = msTileCacheMapfile(msObj);
+  const char **pairs;
+  char buffer[128];
+  struct stat sStat;
+  int i, n = 0;
+
+  hash.h1 = 0xcbf29ce484222325ULL;
+  hash.h2 = 0x2545f4914f6cdd1dULL;
+
+  snprintf(buffer, sizeof(buffer), "%d,%d,%d", msObj->TileMode, params->metatile_level, params->map_edge_buffer);
+  msTileCacheHash(&hash, buffer);
+
+  /* a new version of the mapfile starts a new set of files */
+  msTileCacheHash(&hash, mapfile);
+  if( mapfile && stat(mapfile, &sStat) == 0 ) {
+    snprintf(buffer, sizeof(buffer), "%ld:%ld", (long) sStat.st_mtime, (long) sStat.st_size);
+    msTileCacheHash(&hash, buffer);
+  }
+  msTileCacheHash(&hash, msObj->map->mappath);
+  msTileCacheHash(&hash, msObj->map->name);
+  msTileCacheHash(&hash, msObj->map->outputformat->name);
+
+  /* the same parameters given in another order make the same tiles */
+  pairs = (const char **) msSmallMalloc(2 * sizeof(char *) * (msObj->request->NumParams + 1));
+  for( i = 0; i < msObj->request->NumParams; i++ ) {
+    if( !msObj->request->ParamNames[i] || !msObj->request->ParamValues[i] ||
+        !msTileCacheUseParam(msObj->map, msObj->request->ParamNames[i]) )
+      continue;
+    pairs[2 * n] = msObj->request->ParamNames[i];
+    pairs[2 * n + 1] = msObj->request->ParamValues[i];
+    n++;
+  }
+  qsort(pairs, n, 2 * sizeof(char *), msTileCacheCompareParams);
+  for( i = 0; i < n; i++ ) {
+    char name[256];
+    strlcpy(name, pairs[2 * i], sizeof(name));
+    msStringToLower(name);
+    msTileCacheHash(&hash, name);
+    msTileCacheHash(&hash, pairs[2 * i + 1]);
+  }
+  free(pairs);
+
+  snprintf(key, keysize, "%016llx%016llx", hash.h1, hash.h2);
+}
+
+static char *msTileCacheFilename(const mapservObj *msObj, const char *dir, const char *key, const char *tile, char *path)
+{
+  char filename[MS_MAXPATHLEN];
+  const char *ext = msObj->map->outputformat->extension;
+
+  snprintf(filename, sizeof(filename), "%s_%s.%s", key, tile, ext ? ext : "img");
+  return msBuildPath(path, dir, filename);
+}
+
+/* Tile name of the cache file of the requested tile */
+static int msTileCacheName(const mapservObj *msObj, char *tile, size_t tilesize)
+{
+  if( msObj->TileMode == TILE_GMAP ) {
+    int x, y, zoom;
+    if( msTileGetGMapCoords(msObj->TileCoords, &x, &y, &zoom) == MS_FAILURE )
+      return MS_FAILURE;
+    snprintf(tile, tilesize, "%d_%d_%d", zoom, x, y);
+  } else if( msObj->TileMode == TILE_VE ) {
+    const char *c;
+    if( !msObj->TileCoords || !*msObj->TileCoords )
+      return MS_FAILURE;
+    for( c = msObj->TileCoords; *c; c++ ) {
+      if( *c < '0' || *c > '3' )
+        return MS_FAILURE;
+    }
+    snprintf(tile, tilesize, "q%s", msObj->TileCoords);
+  } else {
+    return MS_FAILURE;
+  }
+  return MS_SUCCESS;
+}
+
+/************************************************************************
+ *                            msTileGetCached                           *
+ *                                                                      *
+ *  Returns the encoded tile if a previous metatile render stored it,   *
+ *  NULL otherwise. The buffer must be freed by the caller.             *
+ ************************************************************************/
+unsigned char* msTileGetCached(mapservObj *msObj, int *size)
+{
+  tileParams params;
+  const char *dir, *value;
+  char key[40], tile[128], path[MS_MAXPATHLEN];
+  struct stat sStat;
+  int ttl = MS_TILE_CACHE_DEFAULT_TTL;
+  unsigned char *buffer;
+  FILE *fp;
+
+  msTileGetParams(msObj->map, &params);
+  if( (dir = msTileCacheDir(msObj->map, &params)) == NULL )
+    return NULL;
+  if( msTileCacheName(msObj, tile, sizeof(tile)) != MS_SUCCESS )
+    return NULL;
+  msTileCacheKey(msObj, &params, key, sizeof(key));
+  msTileCacheFilename(msObj, dir, key, tile, path);
+
+  if( stat(path, &sStat) != 0 || sStat.st_size <= 0 )
+    return NULL;
+  if( (value = msLookupHashTable(&(msObj->map->web.metadata), "tile_metatile_cache_ttl")) != NULL && atoi(value) > 0 )
+    ttl = atoi(value);
+  if( time(NULL) - sStat.st_mtime > ttl ) {
+    unlink(path);
+    return NULL;
+  }
+
+  if( (fp = fopen(path, "rb")) == NULL )
+    return NULL;
+  buffer = (unsigned char *) msSmallMalloc(sStat.st_size);
+  if( fread(buffer, 1, sStat.st_size, fp) != (size_t) sStat.st_size ) {
+    fclose(fp);
+    free(buffer);
+    return NULL;
+  }
+  fclose(fp);
+
+  if(msObj->map->debug)
+    msDebug("msTileGetCached(): serving %s from the metatile cache\n", path);
+
+  *size = (int) sStat.st_size;
+  return buffer;
+}
+
+/************************************************************************
+ *                            msTileCacheMetatile                       *
+ *                                                                      *
+ *  Slice the rendered metatile in tiles and store them all.            *
+ ************************************************************************/
+static void msTileCacheMetatile(mapservObj *msObj, const imageObj *img, const tileParams *params)
+{
+  const char *dir;
+  char key[40], tile[128], path[MS_MAXPATHLEN];
+  int n = 1 << params->metatile_level;
+  int i, j, x0 = 0, y0 = 0, zoom = 0;
+  size_t prefix = 0;
+
+  if( (dir = msTileCacheDir(msObj->map, params)) == NULL )
+    return;
+  if( msTileCacheName(msObj, tile, sizeof(tile)) != MS_SUCCESS )
+    return;
+
+  if( msObj->TileMode == TILE_GMAP ) {
+    int x, y;
+    msTileGetGMapCoords(msObj->TileCoords, &x, &y, &zoom);
+    x0 = x & ~(n - 1);
+    y0 = y & ~(n - 1);
+  } else {
+    prefix = strlen(tile) - params->metatile_level;
+  }
+
+  msTileCacheKey(msObj, params, key, sizeof(key));
+
+  for( j = 0; j < n; j++ ) {
+    for( i = 0; i < n; i++ ) {
+      imageObj *sub;
+      unsigned char *buffer;
+      int size = 0, status = MS_FAILURE;
+      char *tmpname;
+      char tmppath[MS_MAXPATHLEN];
+      FILE *fp;
+
+      if( msObj->TileMode == TILE_GMAP ) {
+        snprintf(tile, sizeof(tile), "%d_%d_%d", zoom, x0 + i, y0 + j);
+      } else {
+        int l;
+        /* one quadkey digit per level, most significant first */
+        for( l = 0; l < params->metatile_level; l++ ) {
+          int bit = params->metatile_level - 1 - l;
+          tile[prefix + l] = '0' + ((i >> bit) & 1) + 2 * ((j >> bit) & 1);
+        }
+      }
+
+      sub = msTileCropImage(msObj, img, params,
+                            params->map_edge_buffer + i * params->tile_size,
+                            params->map_edge_buffer + j * params->tile_size);
+      if( sub == NULL )
+        return;
+      buffer = msSaveImageBuffer(sub, &size, msObj->map->outputformat);
+      msFreeImage(sub);
+      if( buffer == NULL )
+        return;
+
+      msTileCacheFilename(msObj, dir, key, tile, path);
+      tmpname = msTmpFilename("tmp");
+      msBuildPath(tmppath, dir, tmpname);
+      free(tmpname);
+
+      if( (fp = fopen(tmppath, "wb")) != NULL ) {
+        if( fwrite(buffer, 1, size, fp) == (size_t) size )
+          status = MS_SUCCESS;
+        if( fclose(fp) != 0 )
+          status = MS_FAILURE;
+        if( status == MS_SUCCESS && rename(tmppath, path) != 0 )
+          status = MS_FAILURE;
+        if( status != MS_SUCCESS )
+          unlink(tmppath);
+      }
+      msFree(buffer);
+
+      if( status != MS_SUCCESS ) {
+        if(msObj->map->debug)
+          msDebug("msTileCacheMetatile(): unable to write %s\n", path);
+        return;
+      }
+    }
+  }
+
+  if(msObj->map->debug)
+    msDebug("msTileCacheMetatile(): stored %d tiles in %s\n", n * n, dir);
+}
+
+
 /************************************************************************
  *                            msDrawTile                                *
  *                                                                      *
@@ -521,6 +867,8 @@ imageObj* msTileDraw(mapservObj *msObj)
   img = msDrawMap(msObj->map, MS_FALSE);
   if( img == NULL )
     return NULL;
+  if( params.metatile_level > 0 )
+    msTileCacheMetatile(msObj, img, &params);
   if( params.metatile_level > 0 || params.map_edge_buffer > 0 ) {
     imageObj *tmp = msTileExtractSubTile(msObj, img);
     msFreeImage(img);
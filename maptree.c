@@ -764,6 +764,329 @@ int msWriteTree(treeObj *tree, char *filename, int B_order)
   return(MS_TRUE);
 }
 
+/* -------------------------------------------------------------------- */
+/*      Packed (.pqx) index. The same quadtree as the .qix, stored as a */
+/*      flat array of nodes in breadth-first order (so the children of  */
+/*      a node are contiguous) followed by the shape ids of all nodes.  */
+/*      The file is mapped (when bMapped is set), or read in one go,    */
+/*      and searched in memory without any per-node I/O. Shapefiles     */
+/*      keep it open across searches (shapefileObj.packedtree).         */
+/*                                                                      */
+/*      Header (32 bytes): "PQT", byte order, version, 3 reserved       */
+/*      bytes, then nShapes, nDepth, nNodes and nIds as 32 bit ints     */
+/*      and 8 reserved bytes.                                           */
+/* -------------------------------------------------------------------- */
+
+static char *treeIndexFilename(const char *pszTree, const char *pszExtension)
+{
+  char *pszFullname;
+  int i;
+
+  pszFullname = (char *) msSmallMalloc(strlen(pszTree)+strlen(pszExtension)+1);
+  strcpy( pszFullname, pszTree );
+  for( i = strlen(pszFullname)-1;
+       i > 0 && pszFullname[i] != '.' && pszFullname[i] != '/'
+       && pszFullname[i] != '\\';
+       i-- ) {}
+
+  if( pszFullname[i] == '.' )
+    pszFullname[i] = '\0';
+
+  strcat( pszFullname, pszExtension );
+  return pszFullname;
+}
+
+static void swapPackedTreeNode(packedTreeNodeObj *node)
+{
+  SwapWord( 8, &node->rect.minx );
+  SwapWord( 8, &node->rect.miny );
+  SwapWord( 8, &node->rect.maxx );
+  SwapWord( 8, &node->rect.maxy );
+  SwapWord( 4, &node->firstchild );
+  SwapWord( 4, &node->numchildren );
+  SwapWord( 4, &node->firstid );
+  SwapWord( 4, &node->numids );
+}
+
+SHPPackedTreeHandle msSHPPackedTreeOpen(const char * pszTree, int debug, int bMapped)
+{
+  char *pszFullname;
+  FILE *fp;
+  uchar abyHeader[MS_PACKED_TREE_HEADER_SIZE];
+  SHPPackedTreeHandle psTree;
+  size_t nSize, nMapSize = 0;
+  char bBigEndian, needswap;
+  uchar *pabyBase;
+  int i;
+
+  i = 1;
+  if( *((uchar *) &i) == 1 )
+    bBigEndian = MS_FALSE;
+  else
+    bBigEndian = MS_TRUE;
+
+  pszFullname = treeIndexFilename(pszTree, MS_PACKED_INDEX_EXTENSION);
+  fp = fopen(pszFullname, "rb");
+  if( fp == NULL ) {
+    msFree(pszFullname);
+    pszFullname = treeIndexFilename(pszTree, ".PQX");
+    fp = fopen(pszFullname, "rb");
+  }
+  msFree(pszFullname);
+
+  if( fp == NULL )
+    return( NULL );
+
+  if( fread( abyHeader, MS_PACKED_TREE_HEADER_SIZE, 1, fp ) != 1 ||
+      strncmp((char *) abyHeader, "PQT", 3) != 0 || abyHeader[4] != 1 ) {
+    if(debug) msDebug("msSHPPackedTreeOpen(): %s is not a packed index.\n", pszTree);
+    fclose(fp);
+    return( NULL );
+  }
+  needswap = (( abyHeader[3] == MS_NEW_MSB_ORDER ) ^ ( bBigEndian ));
+
+  psTree = (SHPPackedTreeHandle) msSmallCalloc(1, sizeof(SHPPackedTreeInfo));
+
+  memcpy( &psTree->nShapes, abyHeader+8, 4 );
+  memcpy( &psTree->nDepth, abyHeader+12, 4 );
+  memcpy( &psTree->nNodes, abyHeader+16, 4 );
+  memcpy( &psTree->nIds, abyHeader+20, 4 );
+  if( needswap ) {
+    SwapWord( 4, &psTree->nShapes );
+    SwapWord( 4, &psTree->nDepth );
+    SwapWord( 4, &psTree->nNodes );
+    SwapWord( 4, &psTree->nIds );
+  }
+
+  if( psTree->nShapes < 0 || psTree->nNodes <= 0 || psTree->nIds < 0 ||
+      psTree->nNodes > INT_MAX / (int) sizeof(packedTreeNodeObj) || psTree->nIds > INT_MAX / 4 ) {
+    if(debug) msDebug("msSHPPackedTreeOpen(): %s has an invalid header.\n", pszTree);
+    free(psTree);
+    fclose(fp);
+    return( NULL );
+  }
+
+  nSize = MS_PACKED_TREE_HEADER_SIZE + (size_t) psTree->nNodes * sizeof(packedTreeNodeObj) + (size_t) psTree->nIds * 4;
+
+  /* -------------------------------------------------------------------- */
+  /*      Map the file when asked to and it is in our byte order,         */
+  /*      otherwise read it into memory (and swap it there).              */
+  /* -------------------------------------------------------------------- */
+  if( bMapped && !needswap ) {
+    psTree->pabyMap = msSHPMapFile( fp, &nMapSize );
+    if( psTree->pabyMap && nMapSize < nSize ) {
+      msSHPUnmapFile( psTree->pabyMap );
+      psTree->pabyMap = NULL;
+    }
+  }
+
+  if( psTree->pabyMap ) {
+    pabyBase = psTree->pabyMap;
+  } else {
+    psTree->pabyData = (uchar *) malloc(nSize);
+    if( psTree->pabyData == NULL || fseek( fp, 0, SEEK_SET ) != 0 ||
+        fread( psTree->pabyData, nSize, 1, fp ) != 1 ) {
+      msSetError(MS_IOERR, "Unable to read packed index %s.", "msSHPPackedTreeOpen()", pszTree);
+      free(psTree->pabyData);
+      free(psTree);
+      fclose(fp);
+      return( NULL );
+    }
+    pabyBase = psTree->pabyData;
+  }
+  fclose(fp);
+
+  psTree->nodes = (packedTreeNodeObj *) (pabyBase + MS_PACKED_TREE_HEADER_SIZE);
+  psTree->ids = (ms_int32 *) (psTree->nodes + psTree->nNodes);
+
+  if( needswap ) {
+    for( i = 0; i < psTree->nNodes; i++ )
+      swapPackedTreeNode( psTree->nodes + i );
+    for( i = 0; i < psTree->nIds; i++ )
+      SwapWord( 4, psTree->ids + i );
+  }
+
+  return( psTree );
+}
+
+void msSHPPackedTreeClose(SHPPackedTreeHandle packedtree)
+{
+  msSHPUnmapFile( packedtree->pabyMap );
+  free( packedtree->pabyData );
+  free( packedtree );
+}
+
+static void searchPackedTree(SHPPackedTreeHandle packedtree, rectObj aoi, ms_bitarray status)
+{
+  ms_int32 *stack;
+  int nStack = 0, nStackMax = 64;
+  int i;
+
+  stack = (ms_int32 *) msSmallMalloc(nStackMax * sizeof(ms_int32));
+  stack[nStack++] = 0;
+
+  while( nStack > 0 ) {
+    ms_int32 iNode = stack[--nStack];
+    packedTreeNodeObj *node = packedtree->nodes + iNode;
+
+    if(!msRectOverlap(&node->rect, &aoi))
+      continue;
+
+    if( node->firstid >= 0 && node->numids > 0 && node->firstid <= packedtree->nIds - node->numids ) {
+      const ms_int32 *ids = packedtree->ids + node->firstid;
+      for( i = 0; i < node->numids; i++ ) {
+        if( ids[i] >= 0 && ids[i] < packedtree->nShapes )
+          msSetBit(status, ids[i], 1);
+      }
+    }
+
+    /* children always follow their parent, which also guards against loops */
+    if( node->numchildren > 0 && node->firstchild > iNode &&
+        node->firstchild <= packedtree->nNodes - node->numchildren ) {
+      if( nStack + node->numchildren > nStackMax ) {
+        nStackMax = nStackMax * 2 + node->numchildren;
+        stack = (ms_int32 *) msSmallRealloc(stack, nStackMax * sizeof(ms_int32));
+      }
+      for( i = node->numchildren - 1; i >= 0; i-- )
+        stack[nStack++] = node->firstchild + i;
+    }
+  }
+
+  free(stack);
+}
+
+ms_bitarray msSearchPackedTree(SHPPackedTreeHandle packedtree, rectObj aoi)
+{
+  ms_bitarray status=NULL;
+
+  status = msAllocBitArray(packedtree->nShapes);
+  if(!status) {
+    msSetError(MS_MEMERR, NULL, "msSearchPackedTree()");
+    return(NULL);
+  }
+
+  searchPackedTree(packedtree, aoi, status);
+
+  return(status);
+}
+
+static void countTreeNodes(treeNodeObj *node, ms_int32 *nNodes, ms_int32 *nIds)
+{
+  int i;
+
+  (*nNodes)++;
+  (*nIds) += node->numshapes;
+  for(i=0; i<node->numsubnodes; i++) {
+    if(node->subnode[i])
+      countTreeNodes(node->subnode[i], nNodes, nIds);
+  }
+}
+
+int msWritePackedTree(treeObj *tree, char *filename, int B_order)
+{
+  uchar abyHeader[MS_PACKED_TREE_HEADER_SIZE];
+  treeNodeObj **queue;
+  packedTreeNodeObj *nodes;
+  ms_int32 *ids;
+  ms_int32 nNodes = 0, nIds = 0, iNext = 1, iId = 0;
+  char mtBigEndian, needswap;
+  char *pszFullname;
+  FILE *fp;
+  int i, j, bOK;
+
+  /* for efficiency, trim the tree */
+  msTreeTrim(tree);
+
+  i = 1;
+  if( *((uchar *) &i) == 1 )
+    mtBigEndian = MS_FALSE;
+  else
+    mtBigEndian = MS_TRUE;
+
+  if( B_order != MS_NEW_LSB_ORDER && B_order != MS_NEW_MSB_ORDER )
+    B_order = mtBigEndian ? MS_NEW_MSB_ORDER : MS_NEW_LSB_ORDER;
+  needswap = ( mtBigEndian != (B_order == MS_NEW_MSB_ORDER) );
+
+  /* -------------------------------------------------------------------- */
+  /*      Flatten the tree breadth-first.                                 */
+  /* -------------------------------------------------------------------- */
+  countTreeNodes(tree->root, &nNodes, &nIds);
+
+  queue = (treeNodeObj **) msSmallMalloc(nNodes * sizeof(treeNodeObj *));
+  nodes = (packedTreeNodeObj *) msSmallMalloc(nNodes * sizeof(packedTreeNodeObj));
+  ids = (ms_int32 *) msSmallMalloc((nIds > 0 ? nIds : 1) * sizeof(ms_int32));
+
+  queue[0] = tree->root;
+  for(i=0; i<nNodes; i++) {
+    treeNodeObj *node = queue[i];
+
+    nodes[i].rect = node->rect;
+    nodes[i].firstid = iId;
+    nodes[i].numids = node->numshapes;
+    memcpy(ids + iId, node->ids, node->numshapes * sizeof(ms_int32));
+    iId += node->numshapes;
+
+    nodes[i].firstchild = iNext;
+    nodes[i].numchildren = 0;
+    for(j=0; j<node->numsubnodes; j++) {
+      if(node->subnode[j]) {
+        queue[iNext++] = node->subnode[j];
+        nodes[i].numchildren++;
+      }
+    }
+    if( nodes[i].numchildren == 0 )
+      nodes[i].firstchild = -1;
+  }
+  free(queue);
+
+  memset(abyHeader, 0, sizeof(abyHeader));
+  memcpy(abyHeader, "PQT", 3);
+  abyHeader[3] = B_order;
+  abyHeader[4] = 1; /* version */
+  memcpy(abyHeader+8, &tree->numshapes, 4);
+  memcpy(abyHeader+12, &tree->maxdepth, 4);
+  memcpy(abyHeader+16, &nNodes, 4);
+  memcpy(abyHeader+20, &nIds, 4);
+
+  if( needswap ) {
+    for(i=0; i<4; i++)
+      SwapWord( 4, abyHeader+8+4*i );
+    for(i=0; i<nNodes; i++)
+      swapPackedTreeNode( nodes + i );
+    for(i=0; i<nIds; i++)
+      SwapWord( 4, ids + i );
+  }
+
+  /* -------------------------------------------------------------------- */
+  /*      Write the file.                                                 */
+  /* -------------------------------------------------------------------- */
+  pszFullname = treeIndexFilename(filename, MS_PACKED_INDEX_EXTENSION);
+  fp = fopen(pszFullname, "wb");
+  msFree(pszFullname);
+
+  if(!fp) {
+    free(nodes);
+    free(ids);
+    msSetError(MS_IOERR, NULL, "msWritePackedTree()");
+    return(MS_FALSE);
+  }
+
+  bOK = fwrite(abyHeader, sizeof(abyHeader), 1, fp) == 1 &&
+        fwrite(nodes, sizeof(packedTreeNodeObj), nNodes, fp) == (size_t) nNodes &&
+        (nIds == 0 || fwrite(ids, sizeof(ms_int32), nIds, fp) == (size_t) nIds);
+  fclose(fp);
+
+  free(nodes);
+  free(ids);
+
+  if(!bOK) {
+    msSetError(MS_IOERR, "Unable to write packed index.", "msWritePackedTree()");
+    return(MS_FALSE);
+  }
+
+  return(MS_TRUE);
+}
+
 /* Function to filter search results further against feature bboxes */
 void msFilterTreeSearch(shapefileObj *shp, ms_bitarray status, rectObj search_rect)
 {
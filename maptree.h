@@ -69,6 +69,32 @@ extern "C" {
   } SHPTreeInfo;
   typedef SHPTreeInfo * SHPTreeHandle;
 
+  /* packed index (.pqx): nodes in breadth-first order, so the children */
+  /* of a node are contiguous, followed by the shape ids of all nodes    */
+  typedef struct {
+    rectObj rect;
+    ms_int32 firstchild;
+    ms_int32 numchildren;
+    ms_int32 firstid;
+    ms_int32 numids;
+  } packedTreeNodeObj;
+
+  typedef struct SHPPackedTreeInfo {
+    ms_int32        nShapes;
+    ms_int32        nDepth;
+    ms_int32        nNodes;
+    ms_int32        nIds;
+
+    packedTreeNodeObj *nodes;
+    ms_int32        *ids;
+
+    uchar           *pabyMap; /* mapping of the file, or NULL */
+    uchar           *pabyData; /* file contents read into memory, or NULL */
+  } SHPPackedTreeInfo;
+  typedef SHPPackedTreeInfo * SHPPackedTreeHandle;
+
+#define MS_PACKED_TREE_HEADER_SIZE 32
+
 #define MS_LSB_ORDER -1
 #define MS_MSB_ORDER -2
 #define MS_NATIVE_ORDER 0
@@ -90,6 +116,11 @@ extern "C" {
   MS_DLL_EXPORT treeObj *msReadTree(char *filename, int debug);
   MS_DLL_EXPORT int msWriteTree(treeObj *tree, char *filename, int LSB_order);
 
+  MS_DLL_EXPORT SHPPackedTreeHandle msSHPPackedTreeOpen(const char * pszTree, int debug, int bMapped);
+  MS_DLL_EXPORT void msSHPPackedTreeClose(SHPPackedTreeHandle packedtree);
+  MS_DLL_EXPORT ms_bitarray msSearchPackedTree(SHPPackedTreeHandle packedtree, rectObj aoi);
+  MS_DLL_EXPORT int msWritePackedTree(treeObj *tree, char *filename, int B_order);
+
   MS_DLL_EXPORT void msFilterTreeSearch(shapefileObj *shp, ms_bitarray status, rectObj search_rect);
 
 #ifdef __cplusplus
@@ -498,6 +498,20 @@ int msEvalExpression(layerObj *layer, shapeObj *shape, expressionObj *expression
       int status;
       parseObj p;
 
+      /* try the compiled form first, it is built once per set of tokens */
+      if(!expression->program && !expression->program_failed && expression->tokens) {
+        const char *compile = layer?msLayerGetProcessingKey(layer, "COMPILE_EXPRESSIONS"):NULL;
+        if((compile && strcasecmp(compile, "NO") == 0) || msCompileExpression(expression) != MS_SUCCESS)
+          expression->program_failed = MS_TRUE;
+      }
+      if(expression->program) {
+        if(msEvalCompiledExpression(expression, shape, &status) != MS_SUCCESS) {
+          msSetError(MS_PARSEERR, "Failed to parse expression: %s", "msEvalExpression", expression->string);
+          return MS_FALSE;
+        }
+        return status;
+      }
+
       p.shape = shape;
       p.expr = expression;
       p.expr->curtoken = p.expr->tokens; /* reset */
@@ -1917,6 +1931,7 @@ int msSetup()
 
   msFontCacheSetup();
 
+  msMarkerCacheSetup();
 
   return MS_SUCCESS;
 }
@@ -1946,6 +1961,7 @@ void msCleanup()
   msGDALCleanup();
 #endif
 #ifdef USE_PROJ
+  msProjectionCacheCleanup();
 #  if PJ_VERSION >= 480
   pj_clear_initcache();
 #  endif
@@ -1970,8 +1986,14 @@ void msCleanup()
 #endif
 #endif
 
+  msMapFileCacheCleanup();
+
+  msMarkerCacheCleanup();
+
   msFontCacheCleanup();
 
+  msSHPMapCleanup();
+
   msTimeCleanup();
 
   msIO_Cleanup();
@@ -1957,10 +1957,12 @@ static int msWFSGetFeature_GMLPostfix( mapObj *map,
                                        int maxfeatures,
                                        int iResultTypeHits,
                                        int iNumberOfFeatures,
+                                       int bBoundsWritten,
                                        int nWFSVersion )
 
 {
-  if (((iNumberOfFeatures==0) || (maxfeatures == 0)) && iResultTypeHits == 0) {
+  if (((iNumberOfFeatures==0) || (maxfeatures == 0)) && iResultTypeHits == 0 &&
+      !bBoundsWritten) {
 
     if( nWFSVersion < OWS_2_0_0 )
     {
@@ -3290,6 +3292,159 @@ static int msWFSApplySortBy(mapObj* map, wfsParamsObj *paramsObj, layerObj* lp,
     return MS_SUCCESS;
 }
 
+/*
+** msWFSGetFeatureUseURN()
+**
+** Whether srsName values in GetFeature output are URNs.
+*/
+static int msWFSGetFeatureUseURN(mapObj *map, int nWFSVersion)
+{
+  /* Would make sense for WFS 1.1.0 too ! See #3576 */
+  int bUseURN = (nWFSVersion == OWS_2_0_0);
+  const char* useurn = msOWSLookupMetadata(&(map->web.metadata), "F", "return_srs_as_urn");
+  if (useurn && strcasecmp(useurn, "true") == 0)
+    bUseURN = 1;
+  else if (useurn && strcasecmp(useurn, "false") == 0)
+    bUseURN = 0;
+
+  return bUseURN;
+}
+
+/*
+** msWFSGetFeature_SetGMLLayerMetadata()
+**
+** Push the per layer PROPERTYNAME selection to the GML writer.
+*/
+static void msWFSGetFeature_SetGMLLayerMetadata(mapObj *map,
+                                                char **papszGMLGroups,
+                                                char **papszGMLIncludeItems,
+                                                char **papszGMLGeometries)
+{
+  int i;
+
+  for(i=0;i<map->numlayers;i++)
+  {
+    layerObj *lp = GET_LAYER(map, i);
+    if( papszGMLGroups[i] )
+        msInsertHashTable(&(lp->metadata), "GML_GROUPS", papszGMLGroups[i]);
+    if( papszGMLIncludeItems[i] )
+        msInsertHashTable(&(lp->metadata), "GML_INCLUDE_ITEMS", papszGMLIncludeItems[i]);
+    if( papszGMLGeometries[i] )
+        msInsertHashTable(&(lp->metadata), "GML_GEOMETRIES", papszGMLGeometries[i]);
+  }
+}
+
+/*
+** msWFSCanStreamFeatures()
+**
+** Features can be written straight from the query, without going through
+** the result cache, when wfs_stream_features is set and the response
+** needs neither a feature count nor the result bounds before the first
+** feature: WFS 1.0/1.1 builtin GML output of a single vector typename
+** selected by BBOX only.
+*/
+static int msWFSCanStreamFeatures(mapObj *map, const wfsParamsObj *paramsObj,
+                                  outputFormatObj *psFormat, int iResultTypeHits,
+                                  int maxfeatures, int numlayers, int nWFSVersion)
+{
+  const char *value;
+  int i;
+
+  value = msOWSLookupMetadata(&(map->web.metadata), "FO", "stream_features");
+  if( value == NULL || strcasecmp(value, "true") != 0 )
+    return MS_FALSE;
+
+  if( psFormat != NULL || nWFSVersion >= OWS_2_0_0 ||
+      iResultTypeHits || maxfeatures == 0 || numlayers != 1 ||
+      paramsObj->pszFilter != NULL || paramsObj->pszFeatureId != NULL ||
+      paramsObj->pszSortBy != NULL )
+    return MS_FALSE;
+
+  for(i=0; i<map->numlayers; i++) {
+    layerObj *lp = GET_LAYER(map, i);
+    if( lp->status == MS_ON && lp->type == MS_LAYER_RASTER )
+      return MS_FALSE;
+  }
+
+  return MS_TRUE;
+}
+
+/*
+** msWFSGetFeature_Stream()
+**
+** Single pass GetFeature: the GML preamble is written first, then every
+** feature as the query reads it. An error past this point can only be
+** appended to the partially written response.
+*/
+static int msWFSGetFeature_Stream(mapObj *map, cgiRequestObj *req,
+                                  owsRequestObj *ows_request,
+                                  wfsParamsObj *paramsObj,
+                                  WFSGMLInfo *gmlinfo,
+                                  OWSGMLVersion outputformat,
+                                  rectObj bbox, const char *sBBoxSrs,
+                                  char **layers, int numlayers,
+                                  int maxfeatures, int nWFSVersion,
+                                  char **papszGMLGroups,
+                                  char **papszGMLIncludeItems,
+                                  char **papszGMLGeometries)
+{
+  msGMLWFSStream *psStream;
+  int iNumberOfFeatures = 0;
+  int bHasNextFeatures = MS_FALSE;
+  int status;
+
+  msIO_setHeader("Content-Type","%s; charset=UTF-8", gmlinfo->output_mime_type);
+  msIO_sendHeaders();
+
+  status = msWFSGetFeature_GMLPreamble( map, req, gmlinfo, paramsObj,
+                                        outputformat, 0, 0, -1,
+                                        maxfeatures, MS_FALSE, nWFSVersion );
+  if( status != MS_SUCCESS )
+    return MS_FAILURE;
+
+  msWFSGetFeature_SetGMLLayerMetadata(map, papszGMLGroups,
+                                      papszGMLIncludeItems,
+                                      papszGMLGeometries);
+
+  psStream = msGMLStartWFSStream(map, stdout, gmlinfo->user_namespace_prefix,
+                                 outputformat, nWFSVersion,
+                                 msWFSGetFeatureUseURN(map, nWFSVersion),
+                                 maxfeatures);
+
+  map->query.result_callback = msGMLWriteWFSStreamFeature;
+  map->query.result_callback_data = psStream;
+
+  status = msWFSRetrieveFeatures(map,
+                                 ows_request,
+                                 paramsObj,
+                                 gmlinfo,
+                                 NULL,
+                                 paramsObj->pszBbox != NULL,
+                                 sBBoxSrs,
+                                 bbox,
+                                 NULL,
+                                 layers,
+                                 numlayers,
+                                 maxfeatures,
+                                 nWFSVersion,
+                                 &iNumberOfFeatures,
+                                 &bHasNextFeatures);
+
+  map->query.result_callback = NULL;
+  map->query.result_callback_data = NULL;
+
+  iNumberOfFeatures = msGMLEndWFSStream(psStream);
+  if( status != MS_SUCCESS )
+    return status;
+  if( iNumberOfFeatures < 0 )
+    return msWFSException(map, "mapserv", MS_OWS_ERROR_NO_APPLICABLE_CODE,
+                          paramsObj->pszVersion);
+
+  return msWFSGetFeature_GMLPostfix( map, req, gmlinfo, paramsObj,
+                                     outputformat, maxfeatures, 0,
+                                     iNumberOfFeatures, MS_TRUE, nWFSVersion );
+}
+
 /*
 ** msWFSGetFeature()
 */
@@ -3738,6 +3893,23 @@ int msWFSGetFeature(mapObj *map, wfsParamsObj *paramsObj, cgiRequestObj *req,
       map->query.only_cache_result_count = MS_TRUE;
   }
 
+  if( msWFSCanStreamFeatures(map, paramsObj, psFormat, iResultTypeHits,
+                             maxfeatures, numlayers, nWFSVersion) )
+  {
+      status = msWFSGetFeature_Stream(map, req, ows_request, paramsObj,
+                                      &gmlinfo, outputformat,
+                                      bbox, sBBoxSrs, layers, numlayers,
+                                      maxfeatures, nWFSVersion,
+                                      papszGMLGroups, papszGMLIncludeItems,
+                                      papszGMLGeometries);
+      msFreeCharArray(layers, numlayers);
+      msFree(sBBoxSrs);
+      msFreeCharArray(papszGMLGroups, map->numlayers);
+      msFreeCharArray(papszGMLIncludeItems, map->numlayers);
+      msFreeCharArray(papszGMLGeometries, map->numlayers);
+      msWFSCleanupGMLInfo(&gmlinfo);
+      return status;
+  }
 
   status = msWFSRetrieveFeatures(map,
                                  ows_request,
@@ -3834,24 +4006,11 @@ int msWFSGetFeature(mapObj *map, wfsParamsObj *paramsObj, cgiRequestObj *req,
       int i;
       int bWFS2MultipleFeatureCollection = MS_FALSE;
 
-      /* Would make sense for WFS 1.1.0 too ! See #3576 */
-      int bUseURN = (nWFSVersion == OWS_2_0_0);
-      const char* useurn = msOWSLookupMetadata(&(map->web.metadata), "F", "return_srs_as_urn");
-      if (useurn && strcasecmp(useurn, "true") == 0)
-        bUseURN = 1;
-      else if (useurn && strcasecmp(useurn, "false") == 0)
-        bUseURN = 0;
+      int bUseURN = msWFSGetFeatureUseURN(map, nWFSVersion);
 
-      for(i=0;i<map->numlayers;i++)
-      {
-        lp = GET_LAYER(map, i);
-        if( papszGMLGroups[i] )
-            msInsertHashTable(&(lp->metadata), "GML_GROUPS", papszGMLGroups[i]);
-        if( papszGMLIncludeItems[i] )
-            msInsertHashTable(&(lp->metadata), "GML_INCLUDE_ITEMS", papszGMLIncludeItems[i]);
-        if( papszGMLGeometries[i] )
-            msInsertHashTable(&(lp->metadata), "GML_GEOMETRIES", papszGMLGeometries[i]);
-      }
+      msWFSGetFeature_SetGMLLayerMetadata(map, papszGMLGroups,
+                                          papszGMLIncludeItems,
+                                          papszGMLGeometries);
 
       /* For WFS 2.0, when we request several types, we must present each type */
       /* in its own FeatureCollection (§ 11.3.3.5 ) */
@@ -3968,7 +4127,7 @@ int msWFSGetFeature(mapObj *map, wfsParamsObj *paramsObj, cgiRequestObj *req,
     msWFSGetFeature_GMLPostfix( map, req, &gmlinfo, paramsObj,
                                 outputformat,
                                 maxfeatures, iResultTypeHits, iNumberOfFeatures,
-                                nWFSVersion );
+                                MS_FALSE, nWFSVersion );
   }
 
 #ifdef USE_OGR
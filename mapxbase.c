@@ -31,9 +31,15 @@
 #define _FILE_OFFSET_BITS 64
 
 #include "mapserver.h"
+#include "mapthread.h"
 #include <stdlib.h> /* for atof() and atoi() */
 #include <math.h>
 
+#ifdef HAVE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 
 /* try to use a large file version of fseek for files up to 4GB (#3514) */
@@ -132,12 +138,318 @@ static void flushRecord( DBFHandle psDBF )
   }
 }
 
+/************************************************************************/
+/*                            Column cache                              */
+/*                                                                      */
+/*      A sidecar file (<name>.dbf.col) holding the table field by      */
+/*      field: the values of a field as returned by                     */
+/*      msDBFReadStringAttribute(), that is trimmed and with numeric    */
+/*      nulls set to "0", and for numeric fields the same values        */
+/*      already converted to doubles. It is built by a single scan of   */
+/*      the table with msDBFBuildColumnCache() (the dbfcolumns utility) */
+/*      or, when asked to, on open, and is shared through               */
+/*      msSHPMapFile(). It is ignored when the .dbf size or             */
+/*      modification time no longer matches.                            */
+/************************************************************************/
+#define DBF_COLUMNS_MAGIC "MSDBFCL1"
+#define DBF_COLUMNS_BYTEORDER 0x01020304
+#define DBF_COLUMNS_ALIGN(n) (((n) + 7) & ~((size_t) 7))
+
+typedef struct {
+  char szMagic[8];
+  unsigned int nByteOrder;
+  int nRecords;
+  int nFields;
+  int nRecordLength;
+  double dfDBFSize;
+  double dfDBFMtime;
+} dbfColumnsHeader;
+
+typedef struct {
+  unsigned int nOffsets; /* file offset of the nRecords string offsets */
+  unsigned int nStrings; /* file offset of the NUL terminated values */
+  unsigned int nStringsSize;
+  unsigned int nValues; /* file offset of the nRecords doubles, 0 for non numeric fields */
+} dbfColumnEntry;
+
+#define DBF_COLUMN_ENTRY(psDBF, iField) \
+  (((const dbfColumnEntry *) ((psDBF)->pabyColumns + sizeof(dbfColumnsHeader))) + (iField))
+
+static const char *msDBFReadAttribute(DBFHandle psDBF, int hEntity, int iField );
+
+#ifdef HAVE_MMAP
+static int msDBFWriteColumns( DBFHandle psDBF, const char *pszPath, const struct stat *psStat )
+{
+  int nFields = psDBF->nFields, nRecords = psDBF->nRecords;
+  int iField, iRecord, nStatus = MS_FAILURE;
+  unsigned int **papanOffsets;
+  char **papszStrings;
+  size_t *panStringsSize, *panStringsAlloc;
+  double **papadfValues;
+  dbfColumnsHeader sHeader;
+  dbfColumnEntry *pasEntries;
+  size_t nOffset;
+  char *pszTmpName = NULL, *pszTmpPath = NULL;
+  FILE *fp = NULL;
+  static const char achPadding[8] = {0};
+
+  /* written aside and renamed, readers never see a partial file. The file
+     is created before the table is scanned, so that read-only directories
+     fail early */
+  pszTmpName = msTmpFilename( "tmp" );
+  pszTmpPath = (char *) msSmallMalloc( strlen(pszPath) + strlen(pszTmpName) + 2 );
+  sprintf( pszTmpPath, "%s.%s", pszPath, pszTmpName );
+  fp = fopen( pszTmpPath, "wb" );
+  if( fp == NULL ) {
+    msFree( pszTmpPath );
+    msFree( pszTmpName );
+    return MS_FAILURE;
+  }
+
+  papanOffsets = (unsigned int **) msSmallCalloc( nFields, sizeof(unsigned int *) );
+  papszStrings = (char **) msSmallCalloc( nFields, sizeof(char *) );
+  panStringsSize = (size_t *) msSmallCalloc( nFields, sizeof(size_t) );
+  panStringsAlloc = (size_t *) msSmallCalloc( nFields, sizeof(size_t) );
+  papadfValues = (double **) msSmallCalloc( nFields, sizeof(double *) );
+  pasEntries = (dbfColumnEntry *) msSmallCalloc( nFields, sizeof(dbfColumnEntry) );
+
+  for( iField = 0; iField < nFields; iField++ ) {
+    papanOffsets[iField] = (unsigned int *) msSmallMalloc( sizeof(unsigned int) * nRecords );
+    if( psDBF->pachFieldType[iField] == 'N' || psDBF->pachFieldType[iField] == 'F' )
+      papadfValues[iField] = (double *) msSmallMalloc( sizeof(double) * nRecords );
+  }
+
+  /* record by record, so that each record is read once */
+  for( iRecord = 0; iRecord < nRecords; iRecord++ ) {
+    for( iField = 0; iField < nFields; iField++ ) {
+      const char *pszValue = msDBFReadAttribute( psDBF, iRecord, iField );
+      size_t nLength;
+
+      if( pszValue == NULL )
+        goto done;
+      nLength = strlen( pszValue ) + 1;
+      if( panStringsSize[iField] + nLength > UINT_MAX )
+        goto done;
+      if( panStringsSize[iField] + nLength > panStringsAlloc[iField] ) {
+        panStringsAlloc[iField] = MS_MAX( panStringsAlloc[iField] * 2, panStringsSize[iField] + nLength + 1024 );
+        papszStrings[iField] = (char *) msSmallRealloc( papszStrings[iField], panStringsAlloc[iField] );
+      }
+      memcpy( papszStrings[iField] + panStringsSize[iField], pszValue, nLength );
+      papanOffsets[iField][iRecord] = (unsigned int) panStringsSize[iField];
+      panStringsSize[iField] += nLength;
+      if( papadfValues[iField] )
+        papadfValues[iField][iRecord] = atof( pszValue );
+    }
+  }
+
+  /* lay out the file, offsets are stored on 32 bits */
+  nOffset = sizeof(dbfColumnsHeader) + sizeof(dbfColumnEntry) * nFields;
+  for( iField = 0; iField < nFields; iField++ ) {
+    nOffset = DBF_COLUMNS_ALIGN( nOffset );
+    pasEntries[iField].nOffsets = (unsigned int) nOffset;
+    nOffset += sizeof(unsigned int) * nRecords;
+    pasEntries[iField].nStrings = (unsigned int) nOffset;
+    pasEntries[iField].nStringsSize = (unsigned int) panStringsSize[iField];
+    nOffset += panStringsSize[iField];
+    if( papadfValues[iField] ) {
+      nOffset = DBF_COLUMNS_ALIGN( nOffset );
+      pasEntries[iField].nValues = (unsigned int) nOffset;
+      nOffset += sizeof(double) * nRecords;
+    }
+    if( nOffset > UINT_MAX )
+      goto done;
+  }
+
+  memset( &sHeader, 0, sizeof(sHeader) );
+  memcpy( sHeader.szMagic, DBF_COLUMNS_MAGIC, 8 );
+  sHeader.nByteOrder = DBF_COLUMNS_BYTEORDER;
+  sHeader.nRecords = nRecords;
+  sHeader.nFields = nFields;
+  sHeader.nRecordLength = psDBF->nRecordLength;
+  sHeader.dfDBFSize = (double) psStat->st_size;
+  sHeader.dfDBFMtime = (double) psStat->st_mtime;
+
+  nOffset = sizeof(dbfColumnsHeader) + sizeof(dbfColumnEntry) * nFields;
+  if( fwrite( &sHeader, sizeof(sHeader), 1, fp ) != 1
+      || (nFields > 0 && fwrite( pasEntries, sizeof(dbfColumnEntry), nFields, fp ) != (size_t) nFields) )
+    goto done;
+  for( iField = 0; iField < nFields; iField++ ) {
+    if( fwrite( achPadding, 1, DBF_COLUMNS_ALIGN(nOffset) - nOffset, fp ) != DBF_COLUMNS_ALIGN(nOffset) - nOffset )
+      goto done;
+    nOffset = DBF_COLUMNS_ALIGN( nOffset );
+    if( nRecords > 0 && fwrite( papanOffsets[iField], sizeof(unsigned int), nRecords, fp ) != (size_t) nRecords )
+      goto done;
+    nOffset += sizeof(unsigned int) * nRecords;
+    if( panStringsSize[iField] > 0 && fwrite( papszStrings[iField], panStringsSize[iField], 1, fp ) != 1 )
+      goto done;
+    nOffset += panStringsSize[iField];
+    if( papadfValues[iField] ) {
+      if( fwrite( achPadding, 1, DBF_COLUMNS_ALIGN(nOffset) - nOffset, fp ) != DBF_COLUMNS_ALIGN(nOffset) - nOffset )
+        goto done;
+      nOffset = DBF_COLUMNS_ALIGN( nOffset );
+      if( nRecords > 0 && fwrite( papadfValues[iField], sizeof(double), nRecords, fp ) != (size_t) nRecords )
+        goto done;
+      nOffset += sizeof(double) * nRecords;
+    }
+  }
+
+  if( fclose( fp ) == 0 && rename( pszTmpPath, pszPath ) == 0 )
+    nStatus = MS_SUCCESS;
+  fp = NULL;
+
+done:
+  if( fp )
+    fclose( fp );
+  if( pszTmpPath && nStatus != MS_SUCCESS )
+    unlink( pszTmpPath );
+  msFree( pszTmpPath );
+  msFree( pszTmpName );
+  for( iField = 0; iField < nFields; iField++ ) {
+    msFree( papanOffsets[iField] );
+    msFree( papszStrings[iField] );
+    msFree( papadfValues[iField] );
+  }
+  msFree( papanOffsets );
+  msFree( papszStrings );
+  msFree( panStringsSize );
+  msFree( panStringsAlloc );
+  msFree( papadfValues );
+  msFree( pasEntries );
+
+  return nStatus;
+}
+
+static int msDBFColumnsValid( DBFHandle psDBF, const struct stat *psStat, const uchar *pabyColumns, size_t nSize )
+{
+  const dbfColumnsHeader *psHeader = (const dbfColumnsHeader *) pabyColumns;
+  const dbfColumnEntry *pasEntries = (const dbfColumnEntry *) (pabyColumns + sizeof(dbfColumnsHeader));
+  size_t nRecords = (size_t) psDBF->nRecords;
+  int iField;
+
+  if( nSize < sizeof(dbfColumnsHeader)
+      || memcmp( psHeader->szMagic, DBF_COLUMNS_MAGIC, 8 ) != 0
+      || psHeader->nByteOrder != DBF_COLUMNS_BYTEORDER
+      || psHeader->nRecords != psDBF->nRecords
+      || psHeader->nFields != psDBF->nFields
+      || psHeader->nRecordLength != psDBF->nRecordLength
+      || psHeader->dfDBFSize != (double) psStat->st_size
+      || psHeader->dfDBFMtime != (double) psStat->st_mtime
+      || nSize < sizeof(dbfColumnsHeader) + sizeof(dbfColumnEntry) * psDBF->nFields )
+    return MS_FALSE;
+
+  for( iField = 0; iField < psDBF->nFields; iField++ ) {
+    const dbfColumnEntry *psEntry = pasEntries + iField;
+    int bNumeric = (psDBF->pachFieldType[iField] == 'N' || psDBF->pachFieldType[iField] == 'F');
+
+    if( psEntry->nOffsets % 8 != 0 || (size_t) psEntry->nOffsets + sizeof(unsigned int) * nRecords > nSize
+        || (size_t) psEntry->nStrings + psEntry->nStringsSize > nSize
+        || (psEntry->nStringsSize > 0 && pabyColumns[psEntry->nStrings + psEntry->nStringsSize - 1] != '\0')
+        || bNumeric != (psEntry->nValues != 0) )
+      return MS_FALSE;
+    /* only numeric fields have a values array */
+    if( bNumeric && (psEntry->nValues % 8 != 0
+                     || (size_t) psEntry->nValues + sizeof(double) * nRecords > nSize) )
+      return MS_FALSE;
+  }
+
+  return MS_TRUE;
+}
+#endif
+
+#ifdef HAVE_MMAP
+/*
+** Sidecars that could not be written (read-only data directory, table too
+** large), by .dbf identity, so that opening such a table again does not
+** scan it again for nothing.
+*/
+#define DBF_COLUMNS_MAX_FAILURES 64
+
+typedef struct {
+  dev_t nDev;
+  ino_t nIno;
+  time_t nMtime;
+} dbfColumnsFailure;
+
+static dbfColumnsFailure asColumnsFailures[DBF_COLUMNS_MAX_FAILURES];
+static int nColumnsFailures = 0, iNextColumnsFailure = 0;
+
+static int msDBFColumnsFailed( const struct stat *psStat )
+{
+  int i, bFailed = MS_FALSE;
+
+  msAcquireLock( TLOCK_SHPMAP );
+  for( i = 0; i < nColumnsFailures && !bFailed; i++ )
+    bFailed = (asColumnsFailures[i].nDev == psStat->st_dev && asColumnsFailures[i].nIno == psStat->st_ino
+               && asColumnsFailures[i].nMtime == psStat->st_mtime);
+  msReleaseLock( TLOCK_SHPMAP );
+  return bFailed;
+}
+
+static void msDBFColumnsSetFailed( const struct stat *psStat )
+{
+  msAcquireLock( TLOCK_SHPMAP );
+  asColumnsFailures[iNextColumnsFailure].nDev = psStat->st_dev;
+  asColumnsFailures[iNextColumnsFailure].nIno = psStat->st_ino;
+  asColumnsFailures[iNextColumnsFailure].nMtime = psStat->st_mtime;
+  iNextColumnsFailure = (iNextColumnsFailure + 1) % DBF_COLUMNS_MAX_FAILURES;
+  if( nColumnsFailures < DBF_COLUMNS_MAX_FAILURES )
+    nColumnsFailures++;
+  msReleaseLock( TLOCK_SHPMAP );
+}
+#endif
+
+/*
+** Maps the column cache of an open table, (re)building it first when it is
+** missing or stale and bBuild is set.
+*/
+static void msDBFAttachColumns( DBFHandle psDBF, const char *pszDBFFilename, int bBuild )
+{
+#ifdef HAVE_MMAP
+  struct stat sStat;
+  char *pszPath;
+  int nPass;
+
+  if( fstat( fileno(psDBF->fp), &sStat ) != 0 )
+    return;
+
+  pszPath = (char *) msSmallMalloc( strlen(pszDBFFilename) + 5 );
+  sprintf( pszPath, "%s.col", pszDBFFilename );
+
+  for( nPass = 0; nPass < 2; nPass++ ) {
+    FILE *fp = fopen( pszPath, "rb" );
+
+    if( fp ) {
+      size_t nSize = 0;
+      uchar *pabyColumns = msSHPMapFile( fp, &nSize );
+
+      fclose( fp );
+      if( pabyColumns && msDBFColumnsValid( psDBF, &sStat, pabyColumns, nSize ) ) {
+        psDBF->pabyColumns = pabyColumns;
+        psDBF->nColumnsSize = nSize;
+        break;
+      }
+      msSHPUnmapFile( pabyColumns );
+    }
+
+    /* missing or stale, (re)build it if asked to and try once more */
+    if( nPass > 0 || !bBuild || msDBFColumnsFailed( &sStat ) )
+      break;
+    if( msDBFWriteColumns( psDBF, pszPath, &sStat ) != MS_SUCCESS ) {
+      msDBFColumnsSetFailed( &sStat );
+      break;
+    }
+  }
+
+  free( pszPath );
+#endif
+}
+
 /************************************************************************/
 /*                              msDBFOpen()                             */
 /*                                                                      */
 /*      Open a .dbf file.                                               */
 /************************************************************************/
-DBFHandle msDBFOpen( const char * pszFilename, const char * pszAccess )
+static DBFHandle msDBFOpenInternal( const char * pszFilename, const char * pszAccess, int bMapped, int bColumns, int bBuildColumns )
 
 {
   DBFHandle   psDBF;
@@ -193,8 +505,6 @@ DBFHandle msDBFOpen( const char * pszFilename, const char * pszAccess )
   psDBF->pszStringField = NULL;
   psDBF->nStringFieldLen = 0;
 
-  free( pszDBFFilename );
-
   /* -------------------------------------------------------------------- */
   /*  Read Table Header info                                              */
   /* -------------------------------------------------------------------- */
@@ -246,9 +556,75 @@ DBFHandle msDBFOpen( const char * pszFilename, const char * pszAccess )
         psDBF->panFieldOffset[iField-1] + psDBF->panFieldSize[iField-1];
   }
 
+  if( bMapped )
+    psDBF->pabyMap = msSHPMapFile( psDBF->fp, &(psDBF->nMapSize) );
+
+  if( bColumns )
+    msDBFAttachColumns( psDBF, pszDBFFilename, bBuildColumns );
+
+  free( pszDBFFilename );
+
   return( psDBF );
 }
 
+DBFHandle msDBFOpen( const char * pszFilename, const char * pszAccess )
+{
+  return msDBFOpenInternal( pszFilename, pszAccess, MS_FALSE, MS_FALSE, MS_FALSE );
+}
+
+/************************************************************************/
+/*                           msDBFOpenMapped()                          */
+/*                                                                      */
+/*      Open a .dbf file read-only, reading records straight from a     */
+/*      memory mapping of the file where the platform allows it.        */
+/************************************************************************/
+DBFHandle msDBFOpenMapped( const char * pszFilename )
+{
+  return msDBFOpenInternal( pszFilename, "rb", MS_TRUE, MS_FALSE, MS_FALSE );
+}
+
+/************************************************************************/
+/*                           msDBFOpenCached()                          */
+/*                                                                      */
+/*      Open a .dbf file read-only, reading attributes from its column  */
+/*      cache where the platform allows it. A missing or stale cache    */
+/*      is only (re)built when bBuild is set.                           */
+/************************************************************************/
+DBFHandle msDBFOpenCached( const char * pszFilename, int bMapped, int bBuild )
+{
+  return msDBFOpenInternal( pszFilename, "rb", bMapped, MS_TRUE, bBuild );
+}
+
+/************************************************************************/
+/*                        msDBFBuildColumnCache()                       */
+/*                                                                      */
+/*      (Re)build the column cache of a .dbf file unless it is up to    */
+/*      date.                                                           */
+/************************************************************************/
+int msDBFBuildColumnCache( const char * pszFilename )
+{
+#ifdef HAVE_MMAP
+  DBFHandle psDBF;
+  int nStatus;
+
+  psDBF = msDBFOpenInternal( pszFilename, "rb", MS_FALSE, MS_TRUE, MS_TRUE );
+  if( !psDBF ) {
+    msSetError(MS_IOERR, "(%s)", "msDBFBuildColumnCache()", pszFilename);
+    return MS_FAILURE;
+  }
+
+  nStatus = psDBF->pabyColumns ? MS_SUCCESS : MS_FAILURE;
+  if( nStatus != MS_SUCCESS )
+    msSetError(MS_IOERR, "Unable to write the column cache of %s.", "msDBFBuildColumnCache()", pszFilename);
+
+  msDBFClose( psDBF );
+  return nStatus;
+#else
+  msSetError(MS_MISCERR, "Column caches are not supported on this platform.", "msDBFBuildColumnCache()");
+  return MS_FAILURE;
+#endif
+}
+
 /************************************************************************/
 /*                              msDBFClose()                            */
 /************************************************************************/
@@ -289,6 +665,8 @@ void  msDBFClose(DBFHandle psDBF)
   /* -------------------------------------------------------------------- */
   /*      Close, and free resources.                                      */
   /* -------------------------------------------------------------------- */
+  msSHPUnmapFile( psDBF->pabyMap );
+  msSHPUnmapFile( psDBF->pabyColumns );
   fclose( psDBF->fp );
 
   if( psDBF->panFieldOffset != NULL ) {
@@ -361,6 +739,12 @@ DBFHandle msDBFCreate( const char * pszFilename )
   psDBF->pszStringField = NULL;
   psDBF->nStringFieldLen = 0;
 
+  psDBF->pabyMap = NULL;
+  psDBF->nMapSize = 0;
+  psDBF->pabyColumns = NULL;
+  psDBF->nColumnsSize = 0;
+  psDBF->pool = NULL;
+
   psDBF->bNoHeader = MS_TRUE;
   psDBF->bUpdated = MS_FALSE;
 
@@ -515,21 +899,34 @@ static const char *msDBFReadAttribute(DBFHandle psDBF, int hEntity, int iField )
     return( NULL );
   }
 
+  if( psDBF->pabyColumns ) {
+    const dbfColumnEntry *psEntry = DBF_COLUMN_ENTRY( psDBF, iField );
+    const unsigned int *panOffsets = (const unsigned int *) (psDBF->pabyColumns + psEntry->nOffsets);
+
+    /* the strings block ends with a NUL, so an offset inside it is a valid string */
+    if( panOffsets[hEntity] < psEntry->nStringsSize )
+      return (const char *) psDBF->pabyColumns + psEntry->nStrings + panOffsets[hEntity];
+  }
+
   /* -------------------------------------------------------------------- */
   /*  Have we read the record?              */
   /* -------------------------------------------------------------------- */
-  if( psDBF->nCurrentRecord != hEntity ) {
-    flushRecord( psDBF );
+  nRecordOffset = psDBF->nRecordLength * hEntity + psDBF->nHeaderLength;
 
-    nRecordOffset = psDBF->nRecordLength * hEntity + psDBF->nHeaderLength;
+  if( psDBF->pabyMap && (size_t) nRecordOffset + psDBF->nRecordLength <= psDBF->nMapSize ) {
+    pabyRec = psDBF->pabyMap + nRecordOffset;
+  } else {
+    if( psDBF->nCurrentRecord != hEntity ) {
+      flushRecord( psDBF );
 
-    safe_fseek( psDBF->fp, nRecordOffset, 0 );
-    fread( psDBF->pszCurrentRecord, psDBF->nRecordLength, 1, psDBF->fp );
+      safe_fseek( psDBF->fp, nRecordOffset, 0 );
+      fread( psDBF->pszCurrentRecord, psDBF->nRecordLength, 1, psDBF->fp );
 
-    psDBF->nCurrentRecord = hEntity;
-  }
+      psDBF->nCurrentRecord = hEntity;
+    }
 
-  pabyRec = (const uchar *) psDBF->pszCurrentRecord;
+    pabyRec = (const uchar *) psDBF->pszCurrentRecord;
+  }
   /* DEBUG */
   /* printf("CurrentRecord(%c):%s\n", psDBF->pachFieldType[iField], pabyRec); */
 
@@ -597,6 +994,13 @@ int msDBFReadIntegerAttribute( DBFHandle psDBF, int iRecord, int iField )
 /************************************************************************/
 double  msDBFReadDoubleAttribute( DBFHandle psDBF, int iRecord, int iField )
 {
+  if( psDBF->pabyColumns && iField >= 0 && iField < psDBF->nFields
+      && iRecord >= 0 && iRecord < psDBF->nRecords ) {
+    const dbfColumnEntry *psEntry = DBF_COLUMN_ENTRY( psDBF, iField );
+    if( psEntry->nValues )
+      return ((const double *) (psDBF->pabyColumns + psEntry->nValues))[iRecord];
+  }
+
   return(atof(msDBFReadAttribute( psDBF, iRecord, iField )));
 }
 
@@ -889,16 +1293,16 @@ char **msDBFGetValueList(DBFHandle dbffile, int record, int *itemindexes, int nu
 
   if(numitems == 0) return(NULL);
 
-  values = (char **)malloc(sizeof(char *)*numitems);
+  values = (char **)msShapePoolAlloc(dbffile->pool, sizeof(char *)*numitems);
   MS_CHECK_ALLOC(values, sizeof(char *)*numitems, NULL);
 
   for(i=0; i<numitems; i++) {
     value = msDBFReadStringAttribute(dbffile, record, itemindexes[i]);
     if (value == NULL) {
-      free(values);
+      msFreeCharArray(values, i);
       return NULL; /* Error already reported by msDBFReadStringAttribute() */
     }
-    values[i] = msStrdup(value);
+    values[i] = dbffile->pool ? msShapePoolStrdup(dbffile->pool, value) : msStrdup(value);
   }
 
   return(values);
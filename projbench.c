@@ -0,0 +1,143 @@
+/******************************************************************************
+ * $Id$
+ *
+ * Project:  MapServer
+ * Purpose:  Utility program to benchmark coordinate reprojection
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2016 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+
+#include "mapserver.h"
+#include "maptime.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+** Projects the same set of random lines with msProjectPoint() one vertex at
+** a time (how msProjectShape() used to work) and with msProjectShape(), and
+** reports the throughput of both in points per second.
+*/
+
+static double elapsed(struct mstimeval *start)
+{
+  struct mstimeval now;
+  msGettimeofday(&now, NULL);
+  return (now.tv_sec + now.tv_usec/1.0e6) - (start->tv_sec + start->tv_usec/1.0e6);
+}
+
+static void usage(void)
+{
+  fprintf(stdout,"Usage: projbench [-n numshapes] [-v vertices] [-i iterations] [-s srcproj] [-d dstproj]\n");
+  fprintf(stdout,"Defaults: -n 1000 -v 1000 -i 5 -s init=epsg:4326 -d init=epsg:3857\n");
+}
+
+int main(int argc, char **argv)
+{
+  const char *src = "init=epsg:4326", *dst = "init=epsg:3857";
+  int numshapes = 1000, numvertices = 1000, iterations = 5;
+  int i, j, k;
+  projectionObj in, out;
+  shapeObj *shapes, *work;
+  struct mstimeval start;
+  double t_point = 0, t_shape = 0, npoints;
+
+  for(i=1; i<argc; i++) {
+    if(i < argc-1 && strcmp(argv[i],"-n") == 0) numshapes = atoi(argv[++i]);
+    else if(i < argc-1 && strcmp(argv[i],"-v") == 0) numvertices = atoi(argv[++i]);
+    else if(i < argc-1 && strcmp(argv[i],"-i") == 0) iterations = atoi(argv[++i]);
+    else if(i < argc-1 && strcmp(argv[i],"-s") == 0) src = argv[++i];
+    else if(i < argc-1 && strcmp(argv[i],"-d") == 0) dst = argv[++i];
+    else {
+      usage();
+      exit(1);
+    }
+  }
+  if(numshapes < 1 || numvertices < 2 || iterations < 1) {
+    usage();
+    exit(1);
+  }
+
+  if(msSetup() != MS_SUCCESS) {
+    msWriteError(stderr);
+    exit(1);
+  }
+
+  msInitProjection(&in);
+  msInitProjection(&out);
+  if(msLoadProjectionString(&in, src) != 0 || msLoadProjectionString(&out, dst) != 0) {
+    msWriteError(stderr);
+    exit(1);
+  }
+
+  /* random lines within the bounds web mercator can represent */
+  srand(1);
+  shapes = (shapeObj *) msSmallMalloc(sizeof(shapeObj) * numshapes);
+  work = (shapeObj *) msSmallMalloc(sizeof(shapeObj) * numshapes);
+  for(i=0; i<numshapes; i++) {
+    lineObj line;
+    msInitShape(shapes + i);
+    msInitShape(work + i);
+    shapes[i].type = MS_SHAPE_LINE;
+    line.numpoints = numvertices;
+    line.point = (pointObj *) msSmallMalloc(sizeof(pointObj) * numvertices);
+    for(j=0; j<numvertices; j++) {
+      line.point[j].x = -179.0 + 358.0 * rand() / (double) RAND_MAX;
+      line.point[j].y = -85.0 + 170.0 * rand() / (double) RAND_MAX;
+#ifdef USE_POINT_Z_M
+      line.point[j].z = line.point[j].m = 0.0;
+#endif
+    }
+    msAddLineDirectly(shapes + i, &line);
+  }
+
+  for(k=0; k<iterations; k++) {
+    for(i=0; i<numshapes; i++) msCopyShape(shapes + i, work + i);
+    msGettimeofday(&start, NULL);
+    for(i=0; i<numshapes; i++)
+      for(j=0; j<work[i].line[0].numpoints; j++)
+        msProjectPoint(&in, &out, work[i].line[0].point + j);
+    t_point += elapsed(&start);
+    for(i=0; i<numshapes; i++) msFreeShape(work + i);
+
+    for(i=0; i<numshapes; i++) msCopyShape(shapes + i, work + i);
+    msGettimeofday(&start, NULL);
+    for(i=0; i<numshapes; i++)
+      msProjectShape(&in, &out, work + i);
+    t_shape += elapsed(&start);
+    for(i=0; i<numshapes; i++) msFreeShape(work + i);
+  }
+
+  npoints = (double) numshapes * numvertices * iterations;
+  fprintf(stdout, "%s -> %s, %d shapes of %d vertices, %d iterations\n",
+          src, dst, numshapes, numvertices, iterations);
+  fprintf(stdout, "msProjectPoint(): %12.0f points/s\n", npoints / t_point);
+  fprintf(stdout, "msProjectShape(): %12.0f points/s\n", npoints / t_shape);
+
+  for(i=0; i<numshapes; i++) msFreeShape(shapes + i);
+  free(shapes);
+  free(work);
+  msFreeProjection(&in);
+  msFreeProjection(&out);
+  msCleanup();
+  return 0;
+}
@@ -69,8 +69,8 @@ int main(int argc, char *argv[])
   shapefileObj shapefile;
 
   treeObj *tree;
-  int byte_order = MS_NEW_LSB_ORDER, i;
-  int depth=0;
+  int byte_order, native_order, i;
+  int depth=0, packed=MS_FALSE;
 
   if(argc > 1 && strcmp(argv[1], "-v") == 0) {
     printf("%s\n", msGetVersion());
@@ -83,9 +83,10 @@ int main(int argc, char *argv[])
   /* -------------------------------------------------------------------- */
   i = 1;
   if( *((uchar *) &i) == 1 )
-    byte_order = MS_NEW_LSB_ORDER;
+    native_order = MS_NEW_LSB_ORDER;
   else
-    byte_order = MS_NEW_MSB_ORDER;
+    native_order = MS_NEW_MSB_ORDER;
+  byte_order = native_order;
 
 
   if(argc<2) {
@@ -99,12 +100,19 @@ int main(int argc, char *argv[])
     fprintf(stdout," <index_format> (optional) is one of:\n");
     fprintf(stdout,"           NL: LSB byte order, using new index format\n");
     fprintf(stdout,"           NM: MSB byte order, using new index format\n");
+    fprintf(stdout,"           PL: LSB byte order, using packed index format (.pqx)\n");
+    fprintf(stdout,"           PM: MSB byte order, using packed index format (.pqx)\n");
+    fprintf(stdout,"           P:  native byte order (%s on this system), using packed\n",
+            (native_order == MS_NEW_LSB_ORDER) ? "LSB" : "MSB" );
+    fprintf(stdout,"               index format (.pqx), which needs no byte swapping\n");
+    fprintf(stdout,"       Packed indexes are only used by layers with PROCESSING\n");
+    fprintf(stdout,"       \"SHAPEFILE_PACKED_INDEX=ON\".\n");
     fprintf(stdout,"       The following old format options are deprecated:\n");
     fprintf(stdout,"           N:  Native byte order\n");
     fprintf(stdout,"           L:  LSB (intel) byte order\n");
     fprintf(stdout,"           M:  MSB byte order\n");
     fprintf(stdout,"       The default index_format on this system is: %s\n\n",
-            (byte_order == MS_NEW_LSB_ORDER) ? "NL" : "NM" );
+            (native_order == MS_NEW_LSB_ORDER) ? "NL" : "NM" );
     exit(0);
   }
 
@@ -122,6 +130,18 @@ int main(int argc, char *argv[])
       byte_order = MS_NEW_LSB_ORDER;
     if( !strcasecmp(argv[3],"NM" ))
       byte_order = MS_NEW_MSB_ORDER;
+    if( !strcasecmp(argv[3],"P" )) {
+      byte_order = native_order;
+      packed = MS_TRUE;
+    }
+    if( !strcasecmp(argv[3],"PL" )) {
+      byte_order = MS_NEW_LSB_ORDER;
+      packed = MS_TRUE;
+    }
+    if( !strcasecmp(argv[3],"PM" )) {
+      byte_order = MS_NEW_MSB_ORDER;
+      packed = MS_TRUE;
+    }
   }
 
   if(msShapefileOpen(&shapefile, "rb", argv[1], MS_TRUE) == -1) {
@@ -129,7 +149,7 @@ int main(int argc, char *argv[])
     exit(0);
   }
 
-  printf( "creating index of %s %s format\n",(byte_order < 1 ? "old (deprecated)" :"new"),
+  printf( "creating index of %s %s format\n",(packed ? "packed" : (byte_order < 1 ? "old (deprecated)" :"new")),
           ((byte_order == MS_NATIVE_ORDER) ? "native" :
            ((byte_order == MS_LSB_ORDER) || (byte_order == MS_NEW_LSB_ORDER)? " LSB":"MSB")));
 
@@ -143,7 +163,10 @@ int main(int argc, char *argv[])
     exit(0);
   }
 
-  msWriteTree(tree, AddFileSuffix(argv[1], MS_INDEX_EXTENSION), byte_order);
+  if(packed)
+    msWritePackedTree(tree, AddFileSuffix(argv[1], MS_PACKED_INDEX_EXTENSION), byte_order);
+  else
+    msWriteTree(tree, AddFileSuffix(argv[1], MS_INDEX_EXTENSION), byte_order);
   msDestroyTree(tree);
 
   /*
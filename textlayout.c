@@ -416,6 +416,25 @@ struct line_desc{
   int rtl;
 } ;
 
+/*
+** Builds the key under which the layout of a text symbol is cached: the
+** text and everything its glyphs and their placement depend on. Returns
+** NULL when the layout is not cacheable.
+*/
+static char *msTextLayoutCacheKey(textSymbolObj *ts, textPathObj *tgret) {
+  char *key;
+  size_t len;
+  /* iconv rewrites annotext, only cache text that is already utf8 */
+  if(ts->label->encoding && strcasecmp(ts->label->encoding,"UTF-8"))
+    return NULL;
+  len = strlen(ts->annotext) + (ts->label->font ? strlen(ts->label->font) : 0) + 64;
+  key = msSmallMalloc(len);
+  snprintf(key, len, "%d|%d|%d|%d|%d|%s|%s", tgret->glyph_size, tgret->line_height,
+           ts->label->wrap, ts->label->maxlength, ts->label->align,
+           ts->label->font ? ts->label->font : "", ts->annotext);
+  return key;
+}
+
 int msLayoutTextSymbol(mapObj *map, textSymbolObj *ts, textPathObj *tgret) {
 #define STATIC_GLYPHS 100
 #define STATIC_LINES 10
@@ -442,9 +461,18 @@ int msLayoutTextSymbol(mapObj *map, textSymbolObj *ts, textPathObj *tgret) {
 
   TextInfo glyphs;
   int num_glyphs = 0;
+  char *cachekey = NULL;
 
   assert(ts->annotext && *ts->annotext); /* ensure we have at least one character/glyph to treat */
 
+  /* labels repeat the same strings over and over, skip the shaping if we've seen this one */
+  if(msTextLayoutCacheGetSize() > 0 && (cachekey = msTextLayoutCacheKey(ts, tgret)) != NULL) {
+    if(msGetCachedTextLayout(cachekey, tgret)) {
+      free(cachekey);
+      return MS_SUCCESS;
+    }
+  }
+
   if(map) fontset = &map->fontset;
   /* go through iconv beforehand, so we know we're handling utf8 */
 #ifdef USE_ICONV
@@ -855,6 +883,11 @@ cleanup:
     free(glyphs.unicodes);
     free(runs);
   }
+  if(cachekey) {
+    if(ret == MS_SUCCESS)
+      msCacheTextLayout(cachekey, tgret);
+    free(cachekey);
+  }
   return ret;
 
 